@@ -0,0 +1,71 @@
+#include "adaptive.h"
+
+adaptive_config adaptive_default_config(double cpuBudgetPerc, double targetDropPerc, uint32_t levels, uint32_t fpsSteps)
+{
+    adaptive_config config{};
+    config.cpuBudgetPerc = cpuBudgetPerc;
+    config.targetDropPerc = targetDropPerc;
+    config.levels = levels > 0 ? levels : 1;
+    config.fpsSteps = fpsSteps;
+    config.overIntervals = 3;
+    config.underIntervals = 10;
+    config.cooldownIntervals = 3;
+    config.recoverMargin = 0.2;
+    return config;
+}
+
+adaptive_action adaptive_step(const adaptive_config& config, adaptive_state& state, const adaptive_sample& sample)
+{
+    // the two conditions are separated by a dead band, a load between them resets both counters
+    bool over = sample.cpuPerc > config.cpuBudgetPerc || sample.dropPerc > config.targetDropPerc;
+    bool under = sample.cpuPerc < config.cpuBudgetPerc * (1.0 - config.recoverMargin) && sample.dropPerc <= config.targetDropPerc / 2;
+
+    state.overCount = over ? state.overCount + 1 : 0;
+    state.underCount = under ? state.underCount + 1 : 0;
+
+    if (state.cooldown > 0) {
+        // a change takes an interval or two to show in the cpu figures, and its first interval is usually noisy
+        state.cooldown--;
+        return ADAPTIVE_HOLD;
+    }
+
+    adaptive_action action = ADAPTIVE_HOLD;
+    if (state.overCount >= config.overIntervals) {
+        if (state.level + 1 < config.levels) {
+            state.level++;
+            action = ADAPTIVE_FASTER;
+        }
+        else if (state.fpsStep < config.fpsSteps) {
+            state.fpsStep++;
+            action = ADAPTIVE_REDUCE_FPS;
+        }
+    }
+    else if (state.underCount >= config.underIntervals) {
+        if (state.fpsStep > 0) {
+            state.fpsStep--;
+            action = ADAPTIVE_RESTORE_FPS;
+        }
+        else if (state.level > 0) {
+            state.level--;
+            action = ADAPTIVE_SLOWER;
+        }
+    }
+
+    if (action != ADAPTIVE_HOLD) {
+        state.overCount = 0;
+        state.underCount = 0;
+        state.cooldown = config.cooldownIntervals;
+    }
+    return action;
+}
+
+const char* adaptive_action_name(adaptive_action action)
+{
+    switch (action) {
+    case ADAPTIVE_FASTER: return "faster";
+    case ADAPTIVE_SLOWER: return "slower";
+    case ADAPTIVE_REDUCE_FPS: return "reduce_fps";
+    case ADAPTIVE_RESTORE_FPS: return "restore_fps";
+    default: return "hold";
+    }
+}
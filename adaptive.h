@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+
+// the control law behind --cpuBudget. it only sees one sample per status interval and returns what to change,
+// applying the change is up to the caller, so it can be driven by recorded or simulated load traces.
+//
+// level 0 is the encoder profile the recording started with, each level above it is cheaper to encode. once the
+// cheapest level is reached and the load is still too high, the fps is stepped down as a last resort. recovering
+// undoes the fps steps first and then walks the levels back down, but never below level 0.
+
+// how many times the fps may be stepped down when the cheapest level is not enough
+#define ADAPTIVE_FPS_STEPS 2
+
+struct adaptive_config
+{
+    double cpuBudgetPerc;          // share of the whole machine the process may use
+    double targetDropPerc;         // share of frames per interval which may be skipped or lagged
+    uint32_t levels;               // encoder levels available, at least 1
+    uint32_t fpsSteps;             // how many times the fps may be stepped down
+    uint32_t overIntervals;        // consecutive intervals over budget before stepping up
+    uint32_t underIntervals;       // consecutive intervals comfortably under budget before stepping back
+    uint32_t cooldownIntervals;    // intervals after any change during which its effect is only observed
+    double recoverMargin;          // cpu must be below budget * (1 - margin), and drops below half the target
+};
+
+// sensible defaults for a budget and target. recovering takes several times longer than stepping up, so a
+// level which only just keeps up is not given up at the first quiet interval.
+adaptive_config adaptive_default_config(double cpuBudgetPerc, double targetDropPerc, uint32_t levels, uint32_t fpsSteps);
+
+struct adaptive_sample
+{
+    double cpuPerc;
+    double dropPerc;
+};
+
+enum adaptive_action
+{
+    ADAPTIVE_HOLD,
+    ADAPTIVE_FASTER,        // level + 1
+    ADAPTIVE_SLOWER,        // level - 1
+    ADAPTIVE_REDUCE_FPS,    // fpsStep + 1
+    ADAPTIVE_RESTORE_FPS,   // fpsStep - 1
+};
+
+struct adaptive_state
+{
+    uint32_t level;
+    uint32_t fpsStep;
+    uint32_t overCount;
+    uint32_t underCount;
+    uint32_t cooldown;
+};
+
+// feeds one interval to the controller, updates state and returns the change it made, if any
+adaptive_action adaptive_step(const adaptive_config& config, adaptive_state& state, const adaptive_sample& sample);
+
+const char* adaptive_action_name(adaptive_action action);
@@ -0,0 +1,281 @@
+#include "armed.h"
+#include "mux.h"
+#include "outputwriter.h"
+
+#include <string>
+#include <deque>
+#include <mutex>
+
+using namespace std;
+
+// everything but the writer is guarded by its lock
+struct armed_output
+{
+    output_writer writer;           // once started, timed from the trigger
+    deque<encoder_packet> ring;     // until triggered, every packet since the newest keyframe
+    bool triggered;
+    bool started;                   // the keyframe the file begins with has been sent to the writer
+
+    int64_t prerollUsec;
+    int64_t firstFrameUsec;         // earliest video pts at or after the origin seen so far, -1 if none
+    bool firstFrameReported;
+    uint32_t trimmedFrames;
+};
+
+struct armed_report
+{
+    bool ready;
+    int64_t latencyUsec;
+    int64_t prerollUsec;
+    uint32_t trimmedFrames;
+};
+
+static int64_t packet_pts_usec(const encoder_packet* packet)
+{
+    return packet->sys_dts_usec + (packet->pts - packet->dts) * 1000000 * packet->timebase_num / packet->timebase_den;
+}
+
+static void release_packets(deque<encoder_packet>& packets)
+{
+    for (auto& packet : packets) {
+        obs_encoder_packet_release(&packet);
+    }
+    packets.clear();
+}
+
+// caller holds ctx->writer.lock, takes ownership of the packet reference
+static void armed_output_send(armed_output* ctx, encoder_packet& packet, armed_report& report)
+{
+    int64_t pts = packet_pts_usec(&packet);
+    if (packet.type == OBS_ENCODER_AUDIO && pts < ctx->writer.originUsec) {
+        // audio frames are all keyframes, so audio can begin exactly at the origin
+        obs_encoder_packet_release(&packet);
+        return;
+    }
+
+    if (packet.type == OBS_ENCODER_VIDEO && !ctx->firstFrameReported) {
+        if (pts < ctx->writer.originUsec) {
+            ctx->trimmedFrames++;
+        }
+        else if (ctx->firstFrameUsec < 0 || pts < ctx->firstFrameUsec) {
+            ctx->firstFrameUsec = pts;
+        }
+
+        // b-frames can still arrive with an earlier pts until the decode time has passed the candidate
+        if (ctx->firstFrameUsec >= 0 && packet.sys_dts_usec >= ctx->firstFrameUsec) {
+            ctx->firstFrameReported = true;
+            report = { true, ctx->firstFrameUsec - ctx->writer.originUsec, ctx->prerollUsec, ctx->trimmedFrames };
+        }
+    }
+
+    output_writer_push(&ctx->writer, packet);
+}
+
+// caller holds ctx->writer.lock, takes ownership of the packet reference
+static void armed_output_begin(armed_output* ctx, encoder_packet& packet, armed_report& report)
+{
+    // an output which was never triggered has nothing worth keeping
+    ctx->started = ctx->writer.keep = true;
+    ctx->prerollUsec = ctx->writer.originUsec - packet_pts_usec(&packet);
+    armed_output_send(ctx, packet, report);
+}
+
+static void armed_output_signal_recording(armed_output* ctx, const armed_report& report)
+{
+    calldata_t cd{};
+    calldata_set_ptr(&cd, "output", ctx->writer.output);
+    calldata_set_int(&cd, "latency_us", report.latencyUsec);
+    calldata_set_int(&cd, "preroll_us", report.prerollUsec);
+    calldata_set_int(&cd, "trimmed_frames", report.trimmedFrames);
+    signal_handler_signal(obs_output_get_signal_handler(ctx->writer.output), "recording", &cd);
+    calldata_free(&cd);
+}
+
+static void armed_output_trigger(armed_output* ctx, uint64_t timestampNs)
+{
+    armed_report report{};
+    {
+        lock_guard<mutex> guard(ctx->writer.lock);
+        if (!ctx->writer.mux || ctx->triggered || ctx->writer.finishing || ctx->writer.stopping) {
+            return;
+        }
+        ctx->triggered = true;
+        ctx->writer.originUsec = (int64_t)(timestampNs / 1000);
+
+        // the ring always begins with the newest keyframe, which was captured before the trigger unless the
+        // encoder has not produced one yet. a keyframe still inside the encoder only means more frames trimmed.
+        if (!ctx->ring.empty() && ctx->ring.front().type == OBS_ENCODER_VIDEO) {
+            armed_output_begin(ctx, ctx->ring.front(), report);
+            for (size_t i = 1; i < ctx->ring.size(); i++) {
+                armed_output_send(ctx, ctx->ring[i], report);
+            }
+            ctx->ring.clear();
+        }
+        else {
+            release_packets(ctx->ring);
+        }
+    }
+
+    if (report.ready) {
+        armed_output_signal_recording(ctx, report);
+    }
+}
+
+static void armed_output_trigger_proc(void* data, calldata_t* cd)
+{
+    armed_output_trigger((armed_output*)data, (uint64_t)calldata_int(cd, "timestamp_ns"));
+}
+
+static void armed_output_get_stats_proc(void* data, calldata_t* cd)
+{
+    output_writer_get_stats(&((armed_output*)data)->writer, cd);
+}
+
+static const char* armed_output_get_name(void* unused)
+{
+    return "Armed Pre-roll Output";
+}
+
+static void* armed_output_create(obs_data_t* settings, obs_output_t* output)
+{
+    auto ctx = new armed_output{};
+    ctx->writer.output = output;
+    ctx->writer.closed = [ctx] {
+        lock_guard<mutex> guard(ctx->writer.lock);
+        release_packets(ctx->ring);
+    };
+    signal_handler_add(obs_output_get_signal_handler(output), "void recording(ptr output, int latency_us, int preroll_us, int trimmed_frames)");
+    proc_handler_add(obs_output_get_proc_handler(output), "void trigger(int timestamp_ns)", armed_output_trigger_proc, ctx);
+    proc_handler_add(obs_output_get_proc_handler(output), "void get_stats(" OUTPUT_WRITER_STATS ")", armed_output_get_stats_proc, ctx);
+    return ctx;
+}
+
+static void armed_output_destroy(void* data)
+{
+    auto ctx = (armed_output*)data;
+    output_writer_join(&ctx->writer);
+    release_packets(ctx->ring);
+    delete ctx;
+}
+
+static bool armed_output_start(void* data)
+{
+    auto ctx = (armed_output*)data;
+    obs_output_t* output = ctx->writer.output;
+    if (!obs_output_can_begin_data_capture(output, 0)) {
+        return false;
+    }
+    if (!obs_output_initialize_encoders(output, 0)) {
+        return false;
+    }
+    output_writer_join(&ctx->writer);
+
+    // the file and its headers are written now, so nothing but packets is left to do once triggered
+    obs_data_t* settings = obs_output_get_settings(output);
+    string path = obs_data_get_string(settings, "path");
+    string muxerSettings = obs_data_get_string(settings, "muxer_settings");
+    disk_writer_options fileOptions = mux_disk_options(settings);
+    obs_data_release(settings);
+
+    string error;
+    mux_writer* mux = mux_writer_open(path, "", obs_output_get_video_encoder(output), obs_output_get_audio_encoder(output, 0), muxerSettings, error, fileOptions);
+    if (!mux) {
+        obs_output_set_last_error(output, error.c_str());
+        return false;
+    }
+
+    {
+        lock_guard<mutex> guard(ctx->writer.lock);
+        ctx->triggered = ctx->started = false;
+        ctx->prerollUsec = 0;
+        ctx->firstFrameUsec = -1;
+        ctx->firstFrameReported = false;
+        ctx->trimmedFrames = 0;
+    }
+    output_writer_start(&ctx->writer, mux, 0, false);
+
+    if (!obs_output_begin_data_capture(output, 0)) {
+        lock_guard<mutex> guard(ctx->writer.lock);
+        output_writer_finish(&ctx->writer, false);
+        return false;
+    }
+    return true;
+}
+
+static void armed_output_stop(void* data, uint64_t ts)
+{
+    auto ctx = (armed_output*)data;
+    lock_guard<mutex> guard(ctx->writer.lock);
+
+    // like ffmpeg_muxer, keep everything captured before the stop was requested
+    output_writer_stop(&ctx->writer, ctx->started ? ts : 0);
+}
+
+static void armed_output_packet(void* data, encoder_packet* packet)
+{
+    auto ctx = (armed_output*)data;
+    if (!packet) {
+        // the encoder failed
+        lock_guard<mutex> guard(ctx->writer.lock);
+        if (ctx->writer.mux) {
+            output_writer_fail(&ctx->writer, OBS_OUTPUT_ENCODE_ERROR);
+        }
+        return;
+    }
+
+    armed_report report{};
+    {
+        lock_guard<mutex> guard(ctx->writer.lock);
+        if (!ctx->writer.mux || ctx->writer.finishing || output_writer_reached_stop(&ctx->writer, packet)) {
+            return;
+        }
+
+        encoder_packet copy{};
+        obs_encoder_packet_ref(&copy, packet);
+        bool keyframe = copy.type == OBS_ENCODER_VIDEO && copy.keyframe;
+
+        if (!ctx->triggered) {
+            if (keyframe) {
+                release_packets(ctx->ring);
+            }
+            ctx->ring.push_back(copy);
+        }
+        else if (ctx->started) {
+            armed_output_send(ctx, copy, report);
+        }
+        else if (keyframe) {
+            // triggered before the encoder produced its first keyframe
+            armed_output_begin(ctx, copy, report);
+        }
+        else if (copy.type == OBS_ENCODER_AUDIO) {
+            armed_output_send(ctx, copy, report);
+        }
+        else {
+            obs_encoder_packet_release(&copy);
+        }
+    }
+
+    if (report.ready) {
+        armed_output_signal_recording(ctx, report);
+    }
+}
+
+static uint64_t armed_output_get_total_bytes(void* data)
+{
+    return ((armed_output*)data)->writer.bytes.load(memory_order_relaxed);
+}
+
+void armed_register()
+{
+    obs_output_info output{};
+    output.id = ARMED_OUTPUT_ID;
+    output.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED;
+    output.get_name = armed_output_get_name;
+    output.create = armed_output_create;
+    output.destroy = armed_output_destroy;
+    output.start = armed_output_start;
+    output.stop = armed_output_stop;
+    output.encoded_packet = armed_output_packet;
+    output.get_total_bytes = armed_output_get_total_bytes;
+    obs_register_output(&output);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "obs-studio/libobs/obs.h"
+
+#define ARMED_OUTPUT_ID "express_armed_output"
+
+// the video encoder is given a short keyframe interval while armed, this bounds both the memory held by the
+// ring and the number of frames which have to be trimmed from the start of the file
+#define ARMED_KEYFRAME_INTERVAL_SEC 1
+
+// an output which starts its encoders straight away but writes nothing until it is triggered. until then,
+// every packet since the newest keyframe is kept in a ring, so the file can begin at the keyframe before the
+// trigger time instead of waiting for the encoders to start and produce their first keyframe. frames between
+// that keyframe and the trigger time are trimmed from playback with an edit list, and audio before it is dropped.
+//
+// settings: "path", "muxer_settings", and the disk_writer_options read by mux_disk_options
+// procs:    "void trigger(int timestamp_ns)", begins recording from an os_gettime_ns time
+//           "void get_stats(...)", the blocked_ns, disk_wait_ns, disk_queued and latency_p50_ms, latency_p95_ms,
+//           latency_p99_ms and latency_max_ms of output_writer_get_stats
+// signals:  "void recording(ptr output, int latency_us, int preroll_us, int trimmed_frames)", once the first
+//           frame at or after the trigger time is known. latency_us is how long after the trigger that frame
+//           was captured, preroll_us how far before the trigger the file starts.
+void armed_register();
@@ -0,0 +1,368 @@
+#include "calibrate.h"
+#include "encoder.h"
+#include "events.h"
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "windows.h"
+
+#include "obs-studio/libobs/util/platform.h"
+
+using namespace std;
+
+#define CALIBRATION_SOURCE_ID "express_calibration_frames"
+#define CALIBRATION_OUTPUT_ID "express_calibration_output"
+
+// rows scrolled per frame, roughly a mouse wheel scroll through a document
+#define CALIBRATION_SCROLL_ROWS 6
+
+// renders a page of text-like content which scrolls every frame, so the encoder sees the sharp edges
+// and large flat areas typical of a screen rather than camera noise or a static image
+struct calibration_source
+{
+    obs_source_t* source;
+    gs_texture_t* texture;
+    uint32_t width;
+    uint32_t height;
+    uint32_t offset;
+
+    // twice the canvas height, the second half repeats the first so any offset is a contiguous window
+    vector<uint32_t> pattern;
+};
+
+static void calibration_fill_pattern(calibration_source* ctx)
+{
+    const uint32_t background = 0xFFFFFFFF;
+    const uint32_t text = 0xFF202020;
+    const uint32_t accents[] = { 0xFF2B579A, 0xFFD83B01, 0xFF107C10 };
+
+    uint32_t w = ctx->width;
+    uint32_t h = ctx->height;
+    ctx->pattern.assign((size_t)w * h * 2, background);
+
+    uint32_t seed = 0x12345678;
+    auto next = [&seed]() { seed = seed * 1664525 + 1013904223; return seed >> 8; };
+
+    for (uint32_t lineTop = 0; lineTop + 16 <= h; lineTop += 16) {
+        uint32_t lineIndex = lineTop / 16;
+
+        if (lineIndex % 24 == 0) {
+            // a toolbar or heading block every so often
+            uint32_t color = accents[next() % 3];
+            for (uint32_t y = lineTop; y < lineTop + 14; y++) {
+                for (uint32_t x = 0; x < w; x++) {
+                    ctx->pattern[(size_t)y * w + x] = color;
+                }
+            }
+            continue;
+        }
+
+        // words of 8px wide glyphs with random strokes, ragged right margin
+        uint32_t lineWidth = w / 2 + next() % (w / 2);
+        uint32_t x = 16;
+        while (x + 8 < lineWidth) {
+            uint32_t wordLength = 2 + next() % 8;
+            for (uint32_t g = 0; g < wordLength && x + 8 < lineWidth; g++, x += 8) {
+                uint32_t strokes = next();
+                for (uint32_t gy = 0; gy < 10; gy++) {
+                    for (uint32_t gx = 0; gx < 6; gx++) {
+                        if ((strokes >> ((gy * 6 + gx) % 24)) & 1) {
+                            ctx->pattern[(size_t)(lineTop + 3 + gy) * w + x + gx] = text;
+                        }
+                    }
+                }
+            }
+            x += 8;
+        }
+    }
+
+    std::copy(ctx->pattern.begin(), ctx->pattern.begin() + (size_t)w * h, ctx->pattern.begin() + (size_t)w * h);
+}
+
+static const char* calibration_source_get_name(void* unused)
+{
+    return "Encoder Calibration Frames";
+}
+
+static void* calibration_source_create(obs_data_t* settings, obs_source_t* source)
+{
+    obs_video_info ovi;
+    if (!obs_get_video_info(&ovi)) {
+        return nullptr;
+    }
+
+    auto ctx = new calibration_source{};
+    ctx->source = source;
+    ctx->width = ovi.base_width;
+    ctx->height = ovi.base_height;
+    calibration_fill_pattern(ctx);
+
+    obs_enter_graphics();
+    ctx->texture = gs_texture_create(ctx->width, ctx->height, GS_BGRA, 1, nullptr, GS_DYNAMIC);
+    obs_leave_graphics();
+
+    if (!ctx->texture) {
+        delete ctx;
+        return nullptr;
+    }
+    return ctx;
+}
+
+static void calibration_source_destroy(void* data)
+{
+    auto ctx = (calibration_source*)data;
+    obs_enter_graphics();
+    gs_texture_destroy(ctx->texture);
+    obs_leave_graphics();
+    delete ctx;
+}
+
+static uint32_t calibration_source_get_width(void* data)
+{
+    return ((calibration_source*)data)->width;
+}
+
+static uint32_t calibration_source_get_height(void* data)
+{
+    return ((calibration_source*)data)->height;
+}
+
+static void calibration_source_tick(void* data, float seconds)
+{
+    auto ctx = (calibration_source*)data;
+    ctx->offset = (ctx->offset + CALIBRATION_SCROLL_ROWS) % ctx->height;
+}
+
+static void calibration_source_render(void* data, gs_effect_t* effect)
+{
+    auto ctx = (calibration_source*)data;
+    const uint32_t* window = ctx->pattern.data() + (size_t)ctx->offset * ctx->width;
+    gs_texture_set_image(ctx->texture, (const uint8_t*)window, ctx->width * 4, false);
+    obs_source_draw(ctx->texture, 0, 0, 0, 0, false);
+}
+
+// accepts encoded packets and throws them away, only counting how many video packets arrived
+struct calibration_output
+{
+    obs_output_t* output;
+    atomic<uint32_t> packets{ 0 };
+};
+
+static const char* calibration_output_get_name(void* unused)
+{
+    return "Encoder Calibration Output";
+}
+
+static void* calibration_output_create(obs_data_t* settings, obs_output_t* output)
+{
+    auto ctx = new calibration_output{};
+    ctx->output = output;
+    return ctx;
+}
+
+static void calibration_output_destroy(void* data)
+{
+    delete (calibration_output*)data;
+}
+
+static bool calibration_output_start(void* data)
+{
+    auto ctx = (calibration_output*)data;
+    if (!obs_output_can_begin_data_capture(ctx->output, 0)) {
+        return false;
+    }
+    if (!obs_output_initialize_encoders(ctx->output, 0)) {
+        return false;
+    }
+    return obs_output_begin_data_capture(ctx->output, 0);
+}
+
+static void calibration_output_stop(void* data, uint64_t ts)
+{
+    auto ctx = (calibration_output*)data;
+    obs_output_end_data_capture(ctx->output);
+}
+
+static void calibration_output_packet(void* data, encoder_packet* packet)
+{
+    auto ctx = (calibration_output*)data;
+    if (packet && packet->type == OBS_ENCODER_VIDEO) {
+        ctx->packets.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void calibration_register()
+{
+    obs_source_info source{};
+    source.id = CALIBRATION_SOURCE_ID;
+    source.type = OBS_SOURCE_TYPE_INPUT;
+    source.output_flags = OBS_SOURCE_VIDEO;
+    source.get_name = calibration_source_get_name;
+    source.create = calibration_source_create;
+    source.destroy = calibration_source_destroy;
+    source.get_width = calibration_source_get_width;
+    source.get_height = calibration_source_get_height;
+    source.video_tick = calibration_source_tick;
+    source.video_render = calibration_source_render;
+    obs_register_source(&source);
+
+    obs_output_info output{};
+    output.id = CALIBRATION_OUTPUT_ID;
+    output.flags = OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED;
+    output.get_name = calibration_output_get_name;
+    output.create = calibration_output_create;
+    output.destroy = calibration_output_destroy;
+    output.start = calibration_output_start;
+    output.stop = calibration_output_stop;
+    output.encoded_packet = calibration_output_packet;
+    obs_register_output(&output);
+}
+
+vector<calibration_candidate> calibration_candidates(const encoder_capabilities& caps, video_codec codec, encoder_intent intent)
+{
+    vector<calibration_candidate> candidates{};
+    for (auto& id : video_codec_encoders(codec, true)) {
+        if (caps.has_encoder(id)) {
+            candidates.push_back({ id, intent });
+        }
+    }
+
+    // x264 is always available, so h264 always has something to fall back on without a gpu
+    for (auto& id : video_codec_encoders(codec, false)) {
+        if (caps.has_encoder(id)) {
+            candidates.push_back({ id, intent });
+            if (intent != INTENT_LATENCY)
+                candidates.push_back({ id, INTENT_LATENCY });
+        }
+    }
+    return candidates;
+}
+
+static uint64_t process_cpu_time_ns()
+{
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) * 100;
+}
+
+struct calibration_counters
+{
+    uint64_t cpuNs;
+    uint32_t videoFrames;
+    uint32_t skippedFrames;
+    uint32_t laggedFrames;
+};
+
+static calibration_counters read_counters()
+{
+    video_t* video = obs_get_video();
+    return calibration_counters{
+        process_cpu_time_ns(),
+        video_output_get_total_frames(video),
+        video_output_get_skipped_frames(video),
+        obs_get_lagged_frames(),
+    };
+}
+
+vector<calibration_result> calibration_run(const encoder_capabilities& caps, const nlohmann::json& profiles, const vector<calibration_candidate>& candidates, uint16_t crf)
+{
+    vector<calibration_result> results{};
+
+    obs_video_info ovi;
+    if (!obs_get_video_info(&ovi)) {
+        return results;
+    }
+    double fps = (double)ovi.fps_num / (double)ovi.fps_den;
+    int cores = max(1, os_get_logical_cores());
+
+    obs_source_t* frames = obs_source_create(CALIBRATION_SOURCE_ID, "calibration_frames", nullptr, nullptr);
+    if (!frames) {
+        return results;
+    }
+    obs_set_output_source(0, frames);
+
+    // rendering and scaling the synthetic frames costs something on its own, only what the encoder adds is counted
+    Sleep(CALIBRATION_WARMUP_MS);
+    auto baseStart = read_counters();
+    Sleep(CALIBRATION_WINDOW_MS);
+    auto baseEnd = read_counters();
+    uint32_t baseFrames = baseEnd.videoFrames - baseStart.videoFrames;
+    double baseCostNs = baseFrames > 0 ? (double)(baseEnd.cpuNs - baseStart.cpuNs) / baseFrames : 0;
+
+    for (auto& candidate : candidates) {
+        calibration_result result{};
+        result.candidate = candidate;
+        events_write("Calibrating " + candidate.encoderId + " (" + encoder_intent_name(candidate.intent) + ")");
+
+        auto profile = profiles_resolve(profiles, caps, candidate.encoderId, candidate.intent, crf, ovi.output_width, ovi.output_height);
+        obs_encoder_t* encoder = create_and_configure_video_encoder(profile);
+        obs_output_t* output = obs_output_create(CALIBRATION_OUTPUT_ID, "calibration_output", nullptr, nullptr);
+        obs_encoder_set_video(encoder, obs_get_video());
+        obs_output_set_video_encoder(output, encoder);
+
+        result.started = obs_output_start(output);
+        if (result.started) {
+            auto ctx = (calibration_output*)obs_obj_get_data(output);
+
+            // the first frames include encoder session setup, which is not a per-frame cost
+            Sleep(CALIBRATION_WARMUP_MS);
+            auto start = read_counters();
+            uint32_t packetsStart = ctx->packets.load(memory_order_relaxed);
+            Sleep(CALIBRATION_WINDOW_MS);
+            auto end = read_counters();
+            uint32_t packetsEnd = ctx->packets.load(memory_order_relaxed);
+
+            result.framesIn = end.videoFrames - start.videoFrames;
+            result.framesEncoded = packetsEnd - packetsStart;
+            result.skippedFrames = end.skippedFrames - start.skippedFrames;
+            result.laggedFrames = end.laggedFrames - start.laggedFrames;
+
+            if (result.framesIn > 0) {
+                double costNs = (double)(end.cpuNs - start.cpuNs) / result.framesIn - baseCostNs;
+                result.costMs = max(0.0, costNs) / 1000000.0;
+            }
+            result.utilisation = result.costMs * fps / (1000.0 * cores);
+
+            // encoders with a fixed delay still emit one packet per frame once they are running, so falling
+            // short of the frames rendered means a backlog is building up
+            result.sustained = result.skippedFrames == 0 && result.laggedFrames == 0
+                && result.framesEncoded + 2 >= result.framesIn
+                && result.utilisation <= CALIBRATION_MAX_UTILISATION;
+
+            obs_output_stop(output);
+        }
+
+        obs_output_release(output);
+        obs_encoder_release(encoder);
+        results.push_back(result);
+    }
+
+    obs_set_output_source(0, nullptr);
+    obs_source_release(frames);
+    return results;
+}
+
+int calibration_choose(const vector<calibration_result>& results)
+{
+    // if nothing keeps up with headroom, the cheapest encoder still gives the best chance of not dropping frames
+    int chosen = -1;
+    for (int i = 0; i < (int)results.size(); i++) {
+        if (!results[i].started) {
+            continue;
+        }
+        if (chosen < 0 || (results[i].sustained && !results[chosen].sustained)
+            || (results[i].sustained == results[chosen].sustained && results[i].costMs < results[chosen].costMs)) {
+            chosen = i;
+        }
+    }
+    return chosen;
+}
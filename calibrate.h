@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "obs-studio/libobs/obs.h"
+#include "encoder.h"
+#include "profiles.h"
+
+// an encoder is only chosen if encoding at the target fps costs at most this share of all logical cores,
+// the rest is left for capture, rendering and whatever the user is recording
+#define CALIBRATION_MAX_UTILISATION 0.5
+#define CALIBRATION_WARMUP_MS 500
+#define CALIBRATION_WINDOW_MS 1500
+
+struct calibration_candidate
+{
+    std::string encoderId;
+    encoder_intent intent;
+};
+
+struct calibration_result
+{
+    calibration_candidate candidate;
+    bool started;            // false if the encoder could not be initialized on this machine
+    uint32_t framesIn;       // frames rendered during the measured window
+    uint32_t framesEncoded;  // packets received from the encoder during the measured window
+    uint32_t skippedFrames;  // frames the encoder was too busy to accept
+    uint32_t laggedFrames;   // frames the renderer missed
+    double costMs;           // process cpu time spent per frame, above the cost of rendering alone
+    double utilisation;      // costMs at the target fps as a share of all logical cores
+    bool sustained;          // kept up with the target fps with headroom to spare
+};
+
+// registers the synthetic frame source and the packet counting output, must be called after obs_startup
+void calibration_register();
+
+// every available hardware encoder for the codec with the given intent, followed by each software encoder
+// with both the given intent and the latency intent
+std::vector<calibration_candidate> calibration_candidates(const encoder_capabilities& caps, video_codec codec, encoder_intent intent);
+
+// encodes synthetic screen-like frames through each candidate in turn, at the current canvas size and fps.
+// takes roughly (CALIBRATION_WARMUP_MS + CALIBRATION_WINDOW_MS) per candidate. nothing else may be using
+// output channel 0 while this runs.
+std::vector<calibration_result> calibration_run(const encoder_capabilities& caps, const nlohmann::json& profiles, const std::vector<calibration_candidate>& candidates, uint16_t crf);
+
+// index of the cheapest result which sustained the target fps. if none did, the cheapest which started,
+// or -1 if no candidate could be started at all.
+int calibration_choose(const std::vector<calibration_result>& results);
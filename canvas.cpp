@@ -0,0 +1,108 @@
+#include "canvas.h"
+
+#include <cmath>
+
+static uint32_t align_up(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t align_down(uint32_t value, uint32_t alignment)
+{
+    uint32_t aligned = value / alignment * alignment;
+    return aligned < alignment ? alignment : aligned;
+}
+
+// texture samples needed for each output pixel
+static double scaler_taps(canvas_scaler scaler, double factorX, double factorY)
+{
+    switch (scaler) {
+    case CANVAS_SCALE_POINT:
+    case CANVAS_SCALE_BILINEAR:
+        return 1;
+    case CANVAS_SCALE_AREA:
+        return ceil(factorX + 1) * ceil(factorY + 1);
+    case CANVAS_SCALE_BICUBIC:
+        return 16;
+    case CANVAS_SCALE_LANCZOS:
+        return 36;
+    }
+    return 1;
+}
+
+canvas_plan canvas_plan_create(uint32_t regionWidth, uint32_t regionHeight, uint32_t maxWidth, uint32_t maxHeight, uint32_t alignment)
+{
+    if (alignment == 0)
+        alignment = 2;
+
+    double width = regionWidth;
+    double height = regionHeight;
+
+    if (maxWidth > 0 && width > maxWidth) {
+        double waspect = width / height;
+        width = maxWidth;
+        height = round(maxWidth / waspect);
+    }
+
+    if (maxHeight > 0 && height > maxHeight) {
+        double haspect = height / width;
+        width = round(maxHeight / haspect);
+        height = maxHeight;
+    }
+
+    canvas_plan plan{};
+    plan.alignment = alignment;
+
+    bool downscale = (uint32_t)width != regionWidth || (uint32_t)height != regionHeight;
+    uint32_t evenWidth = align_up(regionWidth, 2);
+    uint32_t evenHeight = align_up(regionHeight, 2);
+    if (!downscale && evenWidth % alignment == 0 && evenHeight % alignment == 0) {
+        // no downscale, pad the canvas by a pixel instead of paying for a scale pass
+        plan.baseWidth = plan.outputWidth = evenWidth;
+        plan.baseHeight = plan.outputHeight = evenHeight;
+        plan.scaler = CANVAS_SCALE_POINT;
+        plan.pixelCost = (double)plan.baseWidth * plan.baseHeight;
+        return plan;
+    }
+    plan.alignScaled = !downscale;
+
+    // align down so we never exceed the requested maximums
+    plan.baseWidth = regionWidth;
+    plan.baseHeight = regionHeight;
+    plan.outputWidth = align_down((uint32_t)width, alignment);
+    plan.outputHeight = align_down((uint32_t)height, alignment);
+
+    double factorX = (double)plan.baseWidth / plan.outputWidth;
+    double factorY = (double)plan.baseHeight / plan.outputHeight;
+
+    if (plan.outputWidth * 2 == plan.baseWidth && plan.outputHeight * 2 == plan.baseHeight) {
+        plan.scaler = CANVAS_SCALE_BILINEAR;
+    }
+    else if (factorX >= 2 || factorY >= 2) {
+        plan.scaler = CANVAS_SCALE_AREA;
+    }
+    else {
+        plan.scaler = CANVAS_SCALE_BICUBIC;
+    }
+
+    plan.pixelCost = (double)plan.baseWidth * plan.baseHeight
+        + (double)plan.outputWidth * plan.outputHeight * scaler_taps(plan.scaler, factorX, factorY);
+    return plan;
+}
+
+const char* canvas_scaler_name(canvas_scaler scaler)
+{
+    switch (scaler) {
+    case CANVAS_SCALE_POINT:
+        return "point";
+    case CANVAS_SCALE_BILINEAR:
+        return "bilinear";
+    case CANVAS_SCALE_AREA:
+        return "area";
+    case CANVAS_SCALE_BICUBIC:
+        return "bicubic";
+    case CANVAS_SCALE_LANCZOS:
+        return "lanczos";
+    }
+    return "unknown";
+}
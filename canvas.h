@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+enum canvas_scaler
+{
+    CANVAS_SCALE_POINT,    // no resize, or only used when the output is the same size as the base
+    CANVAS_SCALE_BILINEAR, // exact 2x downscale, each output pixel is the average of a 2x2 block
+    CANVAS_SCALE_AREA,     // large downscales, every source pixel contributes
+    CANVAS_SCALE_BICUBIC,  // small non-integer downscales
+    CANVAS_SCALE_LANCZOS,
+};
+
+struct canvas_plan
+{
+    uint32_t baseWidth;   // the obs canvas which sources are composited into
+    uint32_t baseHeight;
+    uint32_t outputWidth; // the size handed to the encoder
+    uint32_t outputHeight;
+    canvas_scaler scaler;
+    double pixelCost;     // estimated texture samples per frame for compositing and scaling
+    uint32_t alignment;
+    bool alignScaled;     // the output was scaled down to the alignment, it would otherwise have been the region's size
+};
+
+// the dimension alignment every encoder is given frames at. NV12 needs even dimensions because chroma is subsampled
+// 2x2, anything coarser the encoders pad internally and crop again in the bitstream, quick sync included.
+#define CANVAS_ENCODER_ALIGNMENT 2
+
+// plans the canvas and output size for a capture region. maxWidth/maxHeight of 0 means unconstrained.
+// if no downscale is needed the base is padded to even dimensions so no scale pass is required at all,
+// otherwise the output is aligned and the cheapest scaler that gives acceptable quality is chosen. an
+// alignment coarser than even is never padded, padding would record black rows, the output is scaled to it.
+canvas_plan canvas_plan_create(uint32_t regionWidth, uint32_t regionHeight, uint32_t maxWidth, uint32_t maxHeight, uint32_t alignment);
+
+const char* canvas_scaler_name(canvas_scaler scaler);
@@ -0,0 +1,216 @@
+#include "capcache.h"
+#include "modules.h"
+#include "json.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <functional>
+#include <sys/stat.h>
+
+#include "obs-studio/libobs/util/platform.h"
+#include "obs-studio/libobs/util/bmem.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+// bump when the file layout changes so older files are treated as a miss
+#define CAPCACHE_FORMAT 4
+#define CAPCACHE_DIRECTORY "obs-express"
+#define CAPCACHE_FILE "obs-express/capabilities.json"
+
+// a module updated in place keeps its name, so the size and write time stand in for its version
+static string module_key(const module_loaded& module)
+{
+    struct stat st;
+    if (os_stat(module.binaryPath.c_str(), &st) != 0) {
+        return "";
+    }
+    return to_string((uint64_t)st.st_size) + ":" + to_string((uint64_t)st.st_mtime);
+}
+
+string capcache_key(uint32_t adapter)
+{
+    ostringstream key;
+    key << "format=" << CAPCACHE_FORMAT << "|obs=" << obs_get_version_string() << "|adapter=" << adapter << ":";
+
+    obs_enter_graphics();
+    const char* device = gs_get_device_name();
+    key << (device ? device : "unknown");
+    obs_leave_graphics();
+    return key.str();
+}
+
+size_t capcache_update(capability_cache& cache)
+{
+    size_t probed = 0;
+    cache.encoders = {};
+    for (auto& module : modules_loaded()) {
+        auto key = module_key(module);
+        auto& entry = cache.modules[module.name];
+        if (key.empty() || entry.key != key) {
+            entry.key = key;
+            entry.encoders = probe_encoder_capabilities(module.encoders);
+            probed++;
+        }
+        merge_encoder_capabilities(cache.encoders, entry.encoders);
+    }
+    return probed;
+}
+
+string capcache_calibration_key(video_codec codec, encoder_intent intent, const json& profiles, const vector<calibration_candidate>& candidates, uint32_t outputWidth, uint32_t outputHeight, uint32_t fps, uint16_t crf)
+{
+    string key = string(video_codec_name(codec)) + "," + encoder_intent_name(intent) + ",profiles" + to_string(std::hash<string>{}(profiles.dump())) + ",";
+    for (auto& candidate : candidates) {
+        key += candidate.encoderId + ";";
+    }
+    return key + to_string(outputWidth) + "x" + to_string(outputHeight) + "@" + to_string(fps) + ",crf" + to_string(crf);
+}
+
+static json property_to_json(const encoder_property& property)
+{
+    json j = json::object();
+    if (!property.values.empty()) {
+        j["values"] = property.values;
+    }
+    if (property.ranged) {
+        j["min"] = property.min;
+        j["max"] = property.max;
+    }
+    return j;
+}
+
+static encoder_property property_from_json(const json& j)
+{
+    encoder_property property{};
+    property.values = j.value("values", vector<string>{});
+    property.ranged = j.contains("min") && j.contains("max");
+    if (property.ranged) {
+        property.min = j.at("min").get<long long>();
+        property.max = j.at("max").get<long long>();
+    }
+    return property;
+}
+
+static encoder_capabilities capabilities_from_json(const json& j)
+{
+    encoder_capabilities caps{};
+    caps.encoders = j.at("encoders").get<vector<string>>();
+    for (auto& [encoderId, properties] : j.at("properties").items()) {
+        auto& list = caps.properties[encoderId];
+        for (auto& [name, property] : properties.items()) {
+            list[name] = property_from_json(property);
+        }
+    }
+    return caps;
+}
+
+static json capabilities_to_json(const encoder_capabilities& caps)
+{
+    json j;
+    j["encoders"] = caps.encoders;
+    j["properties"] = json::object();
+    for (auto& [encoderId, properties] : caps.properties) {
+        auto& list = j["properties"][encoderId] = json::object();
+        for (auto& [name, property] : properties) {
+            list[name] = property_to_json(property);
+        }
+    }
+    return j;
+}
+
+static json calibration_to_json(const calibration_result& result)
+{
+    return {
+        { "encoder", result.candidate.encoderId },
+        { "intent", encoder_intent_name(result.candidate.intent) },
+        { "started", result.started },
+        { "framesIn", result.framesIn },
+        { "framesEncoded", result.framesEncoded },
+        { "skipped", result.skippedFrames },
+        { "lagged", result.laggedFrames },
+        { "costMs", result.costMs },
+        { "utilisation", result.utilisation },
+        { "sustained", result.sustained },
+    };
+}
+
+static calibration_result calibration_from_json(const json& j)
+{
+    calibration_result result{};
+    result.candidate.encoderId = j.at("encoder").get<string>();
+    result.candidate.intent = parse_encoder_intent(j.at("intent").get<string>());
+    result.started = j.at("started").get<bool>();
+    result.framesIn = j.at("framesIn").get<uint32_t>();
+    result.framesEncoded = j.at("framesEncoded").get<uint32_t>();
+    result.skippedFrames = j.at("skipped").get<uint32_t>();
+    result.laggedFrames = j.at("lagged").get<uint32_t>();
+    result.costMs = j.at("costMs").get<double>();
+    result.utilisation = j.at("utilisation").get<double>();
+    result.sustained = j.at("sustained").get<bool>();
+    return result;
+}
+
+bool capcache_load(const string& key, capability_cache& cache)
+{
+    char* path = os_get_config_path_ptr(CAPCACHE_FILE);
+    char* contents = path ? os_quick_read_utf8_file(path) : nullptr;
+    bfree(path);
+    if (!contents) {
+        return false;
+    }
+
+    auto doc = json::parse(contents, nullptr, false);
+    bfree(contents);
+    if (doc.is_discarded() || !doc.is_object() || doc.value("key", "") != key) {
+        return false;
+    }
+
+    try {
+        capability_cache loaded{};
+        loaded.key = key;
+        for (auto& [name, module] : doc.at("modules").items()) {
+            loaded.modules[name] = { module.at("key").get<string>(), capabilities_from_json(module) };
+        }
+        for (auto& [calibrationKey, results] : doc.at("calibrations").items()) {
+            auto& list = loaded.calibrations[calibrationKey];
+            for (auto& result : results) {
+                list.push_back(calibration_from_json(result));
+            }
+        }
+        cache = std::move(loaded);
+        return true;
+    }
+    catch (const json::exception&) {
+        return false;
+    }
+    catch (const std::invalid_argument&) {
+        return false;
+    }
+}
+
+void capcache_save(const capability_cache& cache)
+{
+    json doc;
+    doc["key"] = cache.key;
+    doc["modules"] = json::object();
+    for (auto& [name, module] : cache.modules) {
+        auto& entry = doc["modules"][name] = capabilities_to_json(module.encoders);
+        entry["key"] = module.key;
+    }
+    doc["calibrations"] = json::object();
+    for (auto& [calibrationKey, results] : cache.calibrations) {
+        auto& list = doc["calibrations"][calibrationKey] = json::array();
+        for (auto& result : results) {
+            list.push_back(calibration_to_json(result));
+        }
+    }
+
+    char* directory = os_get_config_path_ptr(CAPCACHE_DIRECTORY);
+    char* path = os_get_config_path_ptr(CAPCACHE_FILE);
+    if (directory && path && os_mkdirs(directory) != MKDIR_ERROR) {
+        auto contents = doc.dump();
+        os_quick_write_utf8_file_safe(path, contents.c_str(), contents.size(), false, "tmp", nullptr);
+    }
+    bfree(directory);
+    bfree(path);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "encoder.h"
+#include "calibrate.h"
+
+// what one module's encoders reported, and the size and write time of the module binary when they did
+struct capability_module
+{
+    std::string key;
+    encoder_capabilities encoders;
+};
+
+// probing encoders and calibrating them is the slowest part of startup, and gives the same answer on every
+// launch until the machine changes. the file is keyed by libobs and the adapter, a mismatched key simply means
+// a miss and the file is rewritten. encoders are kept per module, so launches which load different modules add
+// to the same file instead of replacing each other's entries.
+struct capability_cache
+{
+    std::string key;
+
+    // by module name, including modules this launch has not loaded
+    std::map<std::string, capability_module> modules;
+
+    // merged from the entries of the loaded modules, see capcache_update
+    encoder_capabilities encoders;
+
+    // calibration results for one codec, profile, canvas size, fps and crf, see capcache_calibration_key
+    std::map<std::string, std::vector<calibration_result>> calibrations;
+};
+
+// libobs version and graphics adapter. must be called after video is initialized.
+std::string capcache_key(uint32_t adapter);
+
+// probes every loaded module without an entry, or whose binary changed since its entry was written, then
+// rebuilds the merged encoders. call again after more modules are loaded. returns the number of modules probed,
+// the cache needs saving if it isn't zero.
+size_t capcache_update(capability_cache& cache);
+
+// profiles is the table the candidates were configured from, so editing a --profileFile is a miss. the candidate
+// encoders are part of the key, since they depend on which modules were loaded.
+std::string capcache_calibration_key(video_codec codec, encoder_intent intent, const nlohmann::json& profiles, const std::vector<calibration_candidate>& candidates, uint32_t outputWidth, uint32_t outputHeight, uint32_t fps, uint16_t crf);
+
+// returns false if there is no cache file, it could not be read, or it was written for a different key. the
+// merged encoders are empty until capcache_update.
+bool capcache_load(const std::string& key, capability_cache& cache);
+
+// written to a temporary file and renamed, so a crash or a concurrent launch never leaves a partial file
+void capcache_save(const capability_cache& cache);
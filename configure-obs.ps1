@@ -93,5 +93,7 @@ Move-Item -Path "$BinDir/bin/*" -Destination $BinDir -ErrorAction Ignore
 Remove-Item -Path "$BinDir/bin" -Recurse -ErrorAction Ignore
 Remove-Item -Path "$BinDir/*.lib" -ErrorAction Ignore
 
-# OBS-express dependencies
-Copy-Item ./tracker.png -Destination $BinDir
\ No newline at end of file
+# FFmpeg headers and import libraries, for muxing in process
+$DepsDir = Join-Path $PSScriptRoot "obs-deps"
+Remove-Item -Path $DepsDir -Recurse -ErrorAction Ignore
+Invoke-Expression "7z x `"$DependenciesZip`" -y -o`"$DepsDir`" include/* lib/*"
\ No newline at end of file
@@ -0,0 +1,240 @@
+#include "control.h"
+#include "json.hpp"
+
+#include <mutex>
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+using json = nlohmann::json;
+
+static mutex controlLock;
+
+static string to_lower(string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return std::tolower(c); });
+    return str;
+}
+
+static bool parse_command(const string& name, control_command& command)
+{
+    if (name == "q" || name == "quit" || name == "exit") command = CONTROL_QUIT;
+    else if (name == "stop") command = CONTROL_STOP;
+    else if (name == "start") command = CONTROL_START;
+    else if (name == "pause") command = CONTROL_PAUSE;
+    else if (name == "mute") command = CONTROL_MUTE;
+    else if (name == "unmute") command = CONTROL_UNMUTE;
+    else if (name == "save") command = CONTROL_SAVE;
+    else if (name == "record") command = CONTROL_RECORD;
+    else return false;
+    return true;
+}
+
+static bool parse_device_type(const string& name, char& deviceType)
+{
+    if (name == "s" || name == "speaker") deviceType = 's';
+    else if (name == "m" || name == "microphone") deviceType = 'm';
+    else return false;
+    return true;
+}
+
+static const char* command_name(control_command command)
+{
+    switch (command) {
+    case CONTROL_START: return "start";
+    case CONTROL_PAUSE: return "pause";
+    case CONTROL_STOP: return "stop";
+    case CONTROL_MUTE: return "mute";
+    case CONTROL_UNMUTE: return "unmute";
+    case CONTROL_SAVE: return "save";
+    case CONTROL_RECORD: return "record";
+    case CONTROL_QUIT: return "quit";
+    }
+    return "unknown";
+}
+
+static bool parse_json_request(const string& line, control_request& request, string& error)
+{
+    auto doc = json::parse(line, nullptr, false);
+    if (doc.is_discarded() || !doc.is_object()) {
+        error = "Request is not a valid json object.";
+        return false;
+    }
+
+    if (doc.contains("id")) {
+        request.id = doc["id"].is_string() ? doc["id"].get<string>() : doc["id"].dump();
+    }
+
+    if (!doc.contains("command") || !doc["command"].is_string() || !parse_command(to_lower(doc["command"].get<string>()), request.command)) {
+        error = "Missing or unknown command.";
+        return false;
+    }
+
+    if (request.command == CONTROL_MUTE || request.command == CONTROL_UNMUTE) {
+        if (!doc.contains("device") || !doc["device"].is_string() || !parse_device_type(to_lower(doc["device"].get<string>()), request.deviceType)) {
+            error = "Missing or unknown audio device type, must be 'speaker' or 'microphone'.";
+            return false;
+        }
+        if (!doc.contains("index") || !doc["index"].is_number_integer()) {
+            error = "Missing audio device index.";
+            return false;
+        }
+        request.deviceIndex = doc["index"].get<int>();
+    }
+
+    if (request.command == CONTROL_RECORD) {
+        if (!doc.contains("args") || !doc["args"].is_array()) {
+            error = "Missing recording options, 'args' must be an array of command line arguments.";
+            return false;
+        }
+        for (auto& arg : doc["args"]) {
+            if (!arg.is_string()) {
+                error = "Recording options must be strings.";
+                return false;
+            }
+            request.args.push_back(arg.get<string>());
+        }
+    }
+
+    return true;
+}
+
+static bool parse_text_request(const string& line, control_request& request, string& error)
+{
+    vector<string> words{};
+    stringstream ss(to_lower(line));
+    string word;
+    while (ss >> word) {
+        words.push_back(word);
+    }
+
+    if (words.empty() || !parse_command(words[0], request.command)) {
+        error = "Unknown command or invalid arguments: " + line;
+        return false;
+    }
+
+    if (request.command == CONTROL_MUTE || request.command == CONTROL_UNMUTE) {
+        if (words.size() != 3) {
+            error = "Unknown command or invalid arguments: " + line;
+            return false;
+        }
+        if (!parse_device_type(words[1], request.deviceType)) {
+            error = "Unknown audio device type: " + words[1];
+            return false;
+        }
+        try {
+            request.deviceIndex = stoi(words[2]);
+        }
+        catch (const std::exception&) {
+            error = "Invalid audio device index: " + words[2];
+            return false;
+        }
+    }
+    else if (request.command == CONTROL_RECORD) {
+        // options are case sensitive (file paths), so split the original line rather than the lowered words
+        stringstream original(line);
+        original >> word;
+        while (original >> word) {
+            request.args.push_back(word);
+        }
+    }
+    else if (words.size() != 1) {
+        error = "Unknown command or invalid arguments: " + line;
+        return false;
+    }
+
+    return true;
+}
+
+bool control_parse_request(const string& line, control_request& request, string& error)
+{
+    request = control_request{};
+    auto first = line.find_first_not_of(" \t\r");
+    request.json = first != string::npos && line[first] == '{';
+    return request.json ? parse_json_request(line, request, error) : parse_text_request(line, request, error);
+}
+
+uint64_t control_now_ns()
+{
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+string control_handle_line(control_target& target, const string& line, uint64_t receivedNs, const control_reply& reply)
+{
+    if (line.find_first_not_of(" \t\r") == string::npos) {
+        return "";
+    }
+
+    control_request request;
+    control_result result{};
+    string error;
+    bool parsed = control_parse_request(line, request, error);
+    control_ticket ticket{ request.id, request.command, receivedNs, request.json, reply };
+
+    if (!parsed) {
+        result = control_result{ false, error };
+    }
+    else {
+        lock_guard<mutex> guard(controlLock);
+        switch (request.command) {
+        case CONTROL_START:
+            result = target.start(ticket);
+            break;
+        case CONTROL_PAUSE:
+            result = target.pause(ticket);
+            break;
+        case CONTROL_STOP:
+            result = target.stop(ticket);
+            break;
+        case CONTROL_MUTE:
+        case CONTROL_UNMUTE:
+            result = target.set_muted(request.deviceType, request.deviceIndex, request.command == CONTROL_MUTE);
+            break;
+        case CONTROL_SAVE:
+            result = target.save();
+            break;
+        case CONTROL_RECORD:
+            result = target.record(request.args);
+            break;
+        case CONTROL_QUIT:
+            result = target.quit();
+            break;
+        }
+    }
+
+    if (!request.json) {
+        return result.message;
+    }
+
+    json response;
+    response["type"] = "response";
+    response["id"] = request.id;
+    if (parsed) {
+        response["command"] = command_name(request.command);
+    }
+    response["ok"] = result.ok;
+    response["message"] = result.message;
+    // a start, pause or stop which was accepted reports its latency once the recorder has signalled it
+    bool signalled = request.command == CONTROL_START || request.command == CONTROL_PAUSE || request.command == CONTROL_STOP;
+    if (!parsed || !signalled || !result.ok) {
+        response["latencyUs"] = (control_now_ns() - receivedNs) / 1000;
+    }
+    return response.dump();
+}
+
+string control_applied_line(const control_ticket& ticket, uint64_t nowNs, const string& error)
+{
+    json applied;
+    applied["type"] = "applied";
+    applied["id"] = ticket.id;
+    applied["command"] = command_name(ticket.command);
+    applied["ok"] = error.empty();
+    if (!error.empty()) {
+        applied["message"] = error;
+    }
+    applied["latencyUs"] = (nowNs - ticket.receivedNs) / 1000;
+    return applied.dump();
+}
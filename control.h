@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+enum control_command
+{
+    CONTROL_START,
+    CONTROL_PAUSE,
+    CONTROL_STOP,
+    CONTROL_MUTE,
+    CONTROL_UNMUTE,
+    CONTROL_SAVE,
+    CONTROL_RECORD,
+    CONTROL_QUIT,
+};
+
+struct control_request
+{
+    std::string id;     // echoed back in the response, empty for legacy text commands
+    control_command command;
+    char deviceType;    // 's' speaker or 'm' microphone, for mute/unmute
+    int deviceIndex;
+    std::vector<std::string> args; // command line style recording options, for record
+    bool json;          // reply with a json response rather than the legacy text message
+};
+
+struct control_result
+{
+    bool ok;
+    std::string message;
+};
+
+// sends a line to the controller a request came from. it may be called from any thread and after the response,
+// and does nothing once the controller has disconnected.
+using control_reply = std::function<void(const std::string& line)>;
+
+// a start, pause or stop which only takes effect once the recorder signals it. the target keeps the ticket of a
+// json request until then and passes it to control_applied_line.
+struct control_ticket
+{
+    std::string id;
+    control_command command;
+    uint64_t receivedNs;    // control_now_ns when the line was read
+    bool json;              // legacy text requests get no applied message
+    control_reply reply;
+};
+
+// the recorder operations a controller can perform. implemented by main.cpp on top of libobs,
+// and can be implemented by anything else to exercise the protocol without obs.
+struct control_target
+{
+    virtual ~control_target() = default;
+    virtual control_result start(const control_ticket& ticket) = 0;
+    virtual control_result pause(const control_ticket& ticket) = 0;
+    virtual control_result stop(const control_ticket& ticket) = 0;
+    virtual control_result set_muted(char deviceType, int deviceIndex, bool muted) = 0;
+    virtual control_result save() = 0;
+    virtual control_result record(const std::vector<std::string>& args) = 0;
+    virtual control_result quit() = 0;
+};
+
+// parses a request, either newline-delimited json: {"id":"1","command":"mute","device":"s","index":0}
+// or the legacy stdin text format: "mute s 0". returns false and sets error if the request is invalid.
+bool control_parse_request(const std::string& line, control_request& request, std::string& error);
+
+// a steady clock, for the time a request was received and the time it took effect
+uint64_t control_now_ns();
+
+// parses and executes one request line and returns the response line to send back (without a newline).
+// json requests get a json response with the id. the latency from receivedNs is part of the response for the
+// commands which take effect while they are handled, start, pause and stop report it in an applied message
+// sent through reply later. requests are executed one at a time, so this can be called from any number of
+// controller threads.
+std::string control_handle_line(control_target& target, const std::string& line, uint64_t receivedNs, const control_reply& reply);
+
+// the json message for a ticket whose command has taken effect at nowNs, or failed to with the error
+std::string control_applied_line(const control_ticket& ticket, uint64_t nowNs, const std::string& error = "");
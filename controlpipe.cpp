@@ -0,0 +1,205 @@
+#include "controlpipe.h"
+#include "events.h"
+
+#include <string>
+#include <mutex>
+#include <memory>
+#include <deque>
+#include <condition_variable>
+
+#include "windows.h"
+#include "process.h"
+
+using namespace std;
+
+// replies a controller may leave unread before it is disconnected
+#define CONTROL_PIPE_MAX_QUEUED 4096
+
+struct control_pipe_client
+{
+    HANDLE pipe;
+    control_target* target;
+
+    // replies are queued by any thread, applied messages by the obs signal handlers, and only the client's writer
+    // thread writes them, so a controller which stops reading never blocks the thread that replied
+    mutex queueLock;
+    condition_variable queued;
+    deque<string> replies;
+    bool open;
+};
+
+// the pipe is overlapped, so the reader and the writer thread each wait on their own operation instead of the
+// system serializing a write behind the pending read
+static bool control_pipe_io(HANDLE pipe, bool write, void* data, DWORD size, DWORD* done, HANDLE event)
+{
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = event;
+    BOOL ok = write ? WriteFile(pipe, data, size, NULL, &overlapped) : ReadFile(pipe, data, size, NULL, &overlapped);
+    if (!ok && GetLastError() != ERROR_IO_PENDING) {
+        return false;
+    }
+    return GetOverlappedResult(pipe, &overlapped, done, TRUE);
+}
+
+// must be called with queueLock held, ends the client's pending read so its thread closes the pipe
+static void control_pipe_disconnect(control_pipe_client* client)
+{
+    if (client->open) {
+        client->open = false;
+        CancelIoEx(client->pipe, NULL);
+        client->queued.notify_all();
+    }
+}
+
+static bool control_pipe_write(control_pipe_client* client, const string& line)
+{
+    lock_guard<mutex> guard(client->queueLock);
+    if (!client->open) {
+        return false;
+    }
+    if (client->replies.size() >= CONTROL_PIPE_MAX_QUEUED) {
+        control_pipe_disconnect(client);
+        return false;
+    }
+    client->replies.push_back(line);
+    client->queued.notify_one();
+    return true;
+}
+
+static unsigned int __stdcall thread_control_pipe_writer(void* lpParam)
+{
+    auto client = (control_pipe_client*)lpParam;
+    HANDLE event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    string batch;
+
+    while (true) {
+        {
+            unique_lock<mutex> guard(client->queueLock);
+            client->queued.wait(guard, [client] { return !client->open || !client->replies.empty(); });
+            if (!client->open) {
+                break;
+            }
+
+            // everything queued while the previous write was waiting on the controller goes out in one write
+            batch.clear();
+            for (auto& line : client->replies) {
+                batch += line;
+                batch += '\n';
+            }
+            client->replies.clear();
+        }
+
+        DWORD written;
+        if (!control_pipe_io(client->pipe, true, batch.data(), (DWORD)batch.size(), &written, event)) {
+            lock_guard<mutex> guard(client->queueLock);
+            control_pipe_disconnect(client);
+            break;
+        }
+    }
+
+    CloseHandle(event);
+    return 0;
+}
+
+struct control_pipe_server
+{
+    string path;
+    control_target* target;
+};
+
+static unsigned int __stdcall thread_control_pipe_client(void* lpParam)
+{
+    // an applied message may still be on its way after the controller disconnects, it holds the client too
+    shared_ptr<control_pipe_client> client((control_pipe_client*)lpParam);
+    control_reply reply = [client](const string& line) { control_pipe_write(client.get(), line); };
+    HANDLE writer = (HANDLE)_beginthreadex(NULL, 0, thread_control_pipe_writer, client.get(), 0, nullptr);
+    HANDLE event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    string pending;
+    char buffer[4096];
+    DWORD read;
+
+    while (writer && control_pipe_io(client->pipe, false, buffer, sizeof(buffer), &read, event) && read > 0) {
+        pending.append(buffer, read);
+
+        size_t start = 0;
+        size_t newline;
+        uint64_t receivedNs = control_now_ns();
+        while ((newline = pending.find('\n', start)) != string::npos) {
+            auto response = control_handle_line(*client->target, pending.substr(start, newline - start), receivedNs, reply);
+            start = newline + 1;
+
+            if (!response.empty() && !control_pipe_write(client.get(), response)) {
+                break;
+            }
+        }
+        pending.erase(0, start);
+    }
+
+    {
+        lock_guard<mutex> guard(client->queueLock);
+        control_pipe_disconnect(client.get());
+    }
+    if (writer) {
+        WaitForSingleObject(writer, INFINITE);
+        CloseHandle(writer);
+    }
+    CloseHandle(event);
+    DisconnectNamedPipe(client->pipe);
+    CloseHandle(client->pipe);
+    return 0;
+}
+
+static unsigned int __stdcall thread_control_pipe_listen(void* lpParam)
+{
+    auto server = (control_pipe_server*)lpParam;
+    HANDLE connectEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    while (true) {
+        // a new instance is created for each controller, so several can be connected at once
+        HANDLE pipe = CreateNamedPipeA(server->path.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+            PIPE_UNLIMITED_INSTANCES, 4096, 4096, 0, NULL);
+
+        if (pipe == INVALID_HANDLE_VALUE) {
+            events_write("ERROR: Unable to create control pipe " + server->path + ", error code: " + to_string(GetLastError()));
+            return 1;
+        }
+
+        OVERLAPPED overlapped{};
+        overlapped.hEvent = connectEvent;
+        bool connected = ConnectNamedPipe(pipe, &overlapped) ? true : GetLastError() == ERROR_PIPE_CONNECTED;
+        DWORD unused;
+        if (!connected && GetLastError() == ERROR_IO_PENDING) {
+            connected = GetOverlappedResult(pipe, &overlapped, &unused, TRUE);
+        }
+        if (!connected) {
+            CloseHandle(pipe);
+            continue;
+        }
+
+        auto client = new control_pipe_client{};
+        client->pipe = pipe;
+        client->target = server->target;
+        client->open = true;
+        HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, thread_control_pipe_client, client, 0, nullptr);
+        if (thread) {
+            CloseHandle(thread);
+        }
+        else {
+            CloseHandle(pipe);
+            delete client;
+        }
+    }
+
+    return 0;
+}
+
+void control_pipe_start(const string& name, control_target* target)
+{
+    auto server = new control_pipe_server{ "\\\\.\\pipe\\" + name, target };
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, thread_control_pipe_listen, server, 0, nullptr);
+    if (!thread) {
+        delete server;
+        throw std::runtime_error("Unable to start control pipe thread");
+    }
+    CloseHandle(thread);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+#include "control.h"
+
+// serves newline-delimited control requests on the named pipe \\.\pipe\{name}. any number of controllers
+// can be connected at once, each gets the responses to its own requests. the target must outlive the process.
+void control_pipe_start(const std::string& name, control_target* target);
@@ -0,0 +1,354 @@
+#include "diskwriter.h"
+
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+
+#include "windows.h"
+#include "obs-studio/libobs/util/platform.h"
+
+using namespace std;
+
+struct disk_block
+{
+    uint8_t* data;
+    uint32_t size;
+    int64_t offset;
+};
+
+struct disk_writer
+{
+    string path;
+    HANDLE file;
+    disk_writer_options options;
+    bool direct;                // the handle bypasses the cache, so only whole sectors at sector offsets
+    int64_t position;           // where the next write goes
+    int64_t size;               // the end of everything written
+    int64_t allocated;          // only used by whichever thread is writing to the file
+
+    // with direct io, the partial sector which ends at position, written at the front of the next block
+    alignas(16) uint8_t carry[DISK_WRITER_ALIGNMENT];
+    uint32_t carrySize;
+
+    mutex lock;
+    condition_variable wake;    // for the disk thread, a block was queued or it should stop
+    condition_variable done;    // for the caller, a block was written
+    vector<uint8_t*> freeBlocks;
+    deque<disk_block> queued;   // a block stays queued until it has been written
+    bool stopping;
+    thread diskThread;
+
+    atomic<bool> failed{ false };
+    atomic<DWORD> lastError{ 0 };
+
+    mutex statsLock;
+    uint32_t latencyUsec[DISK_WRITER_LATENCY_WINDOW];
+    uint64_t writes;
+    uint64_t bytes;
+    uint64_t waitNs;
+};
+
+static HANDLE open_file(const string& path, DWORD disposition, bool direct)
+{
+    int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+    wstring wide(length > 0 ? length - 1 : 0, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wide.data(), length);
+
+    // readers may open the file while it is written, the muxer itself does to move an index
+    DWORD flags = direct ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH : FILE_FLAG_SEQUENTIAL_SCAN;
+    return CreateFileW(wide.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, disposition, FILE_ATTRIBUTE_NORMAL | flags, nullptr);
+}
+
+static bool write_at(disk_writer* writer, const uint8_t* data, uint32_t size, int64_t offset)
+{
+    // the allocation grows an extent ahead of the data, one metadata update and one run of clusters per extent.
+    // a disk too full for a whole extent is not an error yet, the write itself finds out whether there is room.
+    int64_t end = offset + size;
+    if (writer->options.preallocateBytes > 0 && end > writer->allocated) {
+        int64_t extent = (int64_t)writer->options.preallocateBytes;
+        FILE_ALLOCATION_INFO allocation{};
+        allocation.AllocationSize.QuadPart = (end + extent - 1) / extent * extent;
+        SetFileInformationByHandle(writer->file, FileAllocationInfo, &allocation, sizeof(allocation));
+        writer->allocated = allocation.AllocationSize.QuadPart;
+    }
+
+    OVERLAPPED position{};
+    position.Offset = (DWORD)offset;
+    position.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD written = 0;
+    uint64_t startNs = os_gettime_ns();
+    bool success = WriteFile(writer->file, data, size, &written, &position) && written == size;
+    uint64_t elapsedNs = os_gettime_ns() - startNs;
+
+    if (!success) {
+        writer->lastError = GetLastError();
+        writer->failed = true;
+        return false;
+    }
+
+    lock_guard<mutex> guard(writer->statsLock);
+    writer->latencyUsec[writer->writes % DISK_WRITER_LATENCY_WINDOW] = (uint32_t)min<uint64_t>(elapsedNs / 1000, UINT32_MAX);
+    writer->writes++;
+    writer->bytes += size;
+    return true;
+}
+
+static void disk_writer_loop(disk_writer* writer)
+{
+    unique_lock<mutex> guard(writer->lock);
+    while (true) {
+        writer->wake.wait(guard, [writer] { return !writer->queued.empty() || writer->stopping; });
+        if (writer->queued.empty()) {
+            break;
+        }
+
+        disk_block block = writer->queued.front();
+        guard.unlock();
+
+        // after a failure the blocks are only cycled, so the caller never waits on a disk which is gone
+        if (!writer->failed) {
+            write_at(writer, block.data, block.size, block.offset);
+        }
+
+        guard.lock();
+        writer->queued.pop_front();
+        writer->freeBlocks.push_back(block.data);
+        writer->done.notify_all();
+    }
+}
+
+static uint8_t* take_block(disk_writer* writer)
+{
+    unique_lock<mutex> guard(writer->lock);
+    if (writer->freeBlocks.empty()) {
+        uint64_t startNs = os_gettime_ns();
+        writer->done.wait(guard, [writer] { return !writer->freeBlocks.empty(); });
+        lock_guard<mutex> stats(writer->statsLock);
+        writer->waitNs += os_gettime_ns() - startNs;
+    }
+    uint8_t* block = writer->freeBlocks.back();
+    writer->freeBlocks.pop_back();
+    return block;
+}
+
+static void submit_block(disk_writer* writer, uint8_t* block, uint32_t size, int64_t offset)
+{
+    lock_guard<mutex> guard(writer->lock);
+    if (size == 0) {
+        writer->freeBlocks.push_back(block);
+        return;
+    }
+    writer->queued.push_back({ block, size, offset });
+    writer->wake.notify_one();
+}
+
+static void advance_position(disk_writer* writer, size_t bytes)
+{
+    writer->position += (int64_t)bytes;
+    writer->size = max(writer->size, writer->position);
+}
+
+disk_writer* disk_writer_open(const string& path, const disk_writer_options& options, string& error)
+{
+    auto writer = new disk_writer{};
+    writer->path = path;
+    writer->options = options;
+    writer->options.blocks = min<uint32_t>(options.blocks, DISK_WRITER_MAX_BLOCKS);
+
+    // direct writes come from the blocks, which are page aligned, and are whole multiples of a sector
+    writer->direct = options.directIo && writer->options.blocks > 0 && options.blockBytes % DISK_WRITER_ALIGNMENT == 0;
+    writer->file = open_file(path, CREATE_ALWAYS, writer->direct);
+    if (writer->file == INVALID_HANDLE_VALUE && writer->direct) {
+        // not every file system takes unbuffered writes
+        writer->direct = false;
+        writer->file = open_file(path, CREATE_ALWAYS, false);
+    }
+    if (writer->file == INVALID_HANDLE_VALUE) {
+        error = "Unable to open '" + path + "', error " + to_string(GetLastError());
+        delete writer;
+        return nullptr;
+    }
+
+    for (uint32_t i = 0; i < writer->options.blocks; i++) {
+        auto block = (uint8_t*)VirtualAlloc(nullptr, writer->options.blockBytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!block) {
+            error = "Unable to allocate " + to_string(writer->options.blocks) + " write blocks of " + to_string(writer->options.blockBytes) + " bytes";
+            disk_writer_close(writer);
+            return nullptr;
+        }
+        writer->freeBlocks.push_back(block);
+    }
+
+    if (writer->options.blocks > 0) {
+        writer->diskThread = thread(disk_writer_loop, writer);
+    }
+    return writer;
+}
+
+bool disk_writer_write(disk_writer* writer, const void* data, size_t size)
+{
+    if (writer->failed) {
+        return false;
+    }
+
+    auto bytes = (const uint8_t*)data;
+    if (writer->options.blocks == 0) {
+        if (!write_at(writer, bytes, (uint32_t)size, writer->position)) {
+            return false;
+        }
+        advance_position(writer, size);
+        return true;
+    }
+
+    while (size > 0) {
+        uint8_t* block = take_block(writer);
+        int64_t offset = writer->position - writer->carrySize;
+        uint32_t used = writer->carrySize;
+        memcpy(block, writer->carry, writer->carrySize);
+        writer->carrySize = 0;
+
+        uint32_t chunk = (uint32_t)min<size_t>(size, writer->options.blockBytes - used);
+        memcpy(block + used, bytes, chunk);
+        used += chunk;
+        bytes += chunk;
+        size -= chunk;
+        advance_position(writer, chunk);
+
+        if (writer->direct) {
+            uint32_t whole = used / DISK_WRITER_ALIGNMENT * DISK_WRITER_ALIGNMENT;
+            writer->carrySize = used - whole;
+            memcpy(writer->carry, block + whole, writer->carrySize);
+            used = whole;
+        }
+        submit_block(writer, block, used, offset);
+    }
+    return !writer->failed;
+}
+
+bool disk_writer_flush(disk_writer* writer)
+{
+    {
+        unique_lock<mutex> guard(writer->lock);
+        writer->done.wait(guard, [writer] { return writer->queued.empty(); });
+    }
+
+    if (writer->direct) {
+        // the disk thread is idle with nothing queued, so the handle can be swapped for one through the cache.
+        // closing gives back the preallocated extent, the next write allocates it again.
+        CloseHandle(writer->file);
+        writer->direct = false;
+        writer->allocated = 0;
+        writer->file = open_file(writer->path, OPEN_EXISTING, false);
+        if (writer->file == INVALID_HANDLE_VALUE) {
+            writer->lastError = GetLastError();
+            writer->failed = true;
+            return false;
+        }
+        if (writer->carrySize > 0) {
+            uint32_t carrySize = writer->carrySize;
+            writer->carrySize = 0;
+            if (!write_at(writer, writer->carry, carrySize, writer->position - carrySize)) {
+                return false;
+            }
+        }
+    }
+    return !writer->failed;
+}
+
+int64_t disk_writer_seek(disk_writer* writer, int64_t offset, int whence)
+{
+    int64_t target = offset;
+    if (whence == SEEK_CUR) {
+        target += writer->position;
+    }
+    else if (whence == SEEK_END) {
+        target += writer->size;
+    }
+    if (target < 0) {
+        return -1;
+    }
+
+    if (target != writer->position && !disk_writer_flush(writer)) {
+        return -1;
+    }
+    writer->position = target;
+    return target;
+}
+
+int64_t disk_writer_size(disk_writer* writer)
+{
+    return writer->size;
+}
+
+bool disk_writer_out_of_space(disk_writer* writer)
+{
+    DWORD error = writer->lastError;
+    return error == ERROR_DISK_FULL || error == ERROR_HANDLE_DISK_FULL;
+}
+
+disk_writer_stats disk_writer_get_stats(disk_writer* writer)
+{
+    disk_writer_stats stats{};
+    uint32_t latencies[DISK_WRITER_LATENCY_WINDOW];
+    uint32_t count = 0;
+    {
+        lock_guard<mutex> guard(writer->statsLock);
+        stats.writes = writer->writes;
+        stats.bytes = writer->bytes;
+        stats.waitNs = writer->waitNs;
+        count = (uint32_t)min<uint64_t>(writer->writes, DISK_WRITER_LATENCY_WINDOW);
+        memcpy(latencies, writer->latencyUsec, count * sizeof(uint32_t));
+    }
+    {
+        lock_guard<mutex> guard(writer->lock);
+        stats.queued = (uint32_t)writer->queued.size();
+    }
+
+    if (count > 0) {
+        sort(latencies, latencies + count);
+        auto percentile = [&](double p) { return latencies[min(count - 1, (uint32_t)(p * count))] / 1000.0; };
+        stats.latencyP50Ms = percentile(0.50);
+        stats.latencyP95Ms = percentile(0.95);
+        stats.latencyP99Ms = percentile(0.99);
+        stats.latencyMaxMs = latencies[count - 1] / 1000.0;
+    }
+    return stats;
+}
+
+bool disk_writer_close(disk_writer* writer)
+{
+    bool success = writer->file != INVALID_HANDLE_VALUE && disk_writer_flush(writer);
+
+    {
+        lock_guard<mutex> guard(writer->lock);
+        writer->stopping = true;
+        writer->wake.notify_one();
+    }
+    if (writer->diskThread.joinable()) {
+        writer->diskThread.join();
+    }
+
+    if (writer->file != INVALID_HANDLE_VALUE) {
+        // whatever was preallocated past the end is given back
+        FILE_END_OF_FILE_INFO end{};
+        end.EndOfFile.QuadPart = writer->size;
+        FILE_ALLOCATION_INFO allocation{};
+        allocation.AllocationSize.QuadPart = writer->size;
+        if (!SetFileInformationByHandle(writer->file, FileEndOfFileInfo, &end, sizeof(end))) {
+            success = false;
+        }
+        SetFileInformationByHandle(writer->file, FileAllocationInfo, &allocation, sizeof(allocation));
+        CloseHandle(writer->file);
+    }
+
+    for (uint8_t* block : writer->freeBlocks) {
+        VirtualFree(block, 0, MEM_RELEASE);
+    }
+    delete writer;
+    return success;
+}
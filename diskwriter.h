@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// writes a file front to back in large blocks, from a thread of its own so the caller only waits on the disk
+// once every block is in flight. the file is preallocated an extent at a time so it does not fragment as it
+// grows, and each block write is timed. with directIo the blocks bypass the file cache, which then holds
+// neither the recording nor anything it would have pushed out, but only whole sectors can be written that way:
+// what is left of a partial one waits for the next block, and reaches the file through the cache at the end.
+struct disk_writer;
+
+#define DISK_WRITER_BLOCK_BYTES (4 * 1024 * 1024)
+#define DISK_WRITER_MAX_BLOCKS 8
+
+// block memory and direct writes are aligned to this, a multiple of every sector size in use
+#define DISK_WRITER_ALIGNMENT 4096
+
+struct disk_writer_options
+{
+    uint32_t blockBytes = DISK_WRITER_BLOCK_BYTES;
+    uint32_t blocks = 2;                                    // blocks in flight, 0 writes on the caller's thread
+    bool directIo = false;                                  // needs blocks, and a blockBytes which is aligned
+    uint64_t preallocateBytes = 256ull * 1024 * 1024;       // the extent the file grows by, 0 to not preallocate
+};
+
+struct disk_writer_stats
+{
+    uint64_t writes;        // blocks which have reached the file
+    uint64_t bytes;
+    uint32_t queued;        // blocks waiting for the disk
+    uint64_t waitNs;        // how long the caller has waited for a free block, the time the disk held it up
+    double latencyP50Ms;    // block write latency over the most recent DISK_WRITER_LATENCY_WINDOW writes
+    double latencyP95Ms;
+    double latencyP99Ms;
+    double latencyMaxMs;
+};
+
+#define DISK_WRITER_LATENCY_WINDOW 256
+
+// creates or truncates path. options the file system can not honor are left out rather than failing.
+disk_writer* disk_writer_open(const std::string& path, const disk_writer_options& options, std::string& error);
+
+// writes at the current position and moves it on. returns false once any write has failed.
+bool disk_writer_write(disk_writer* writer, const void* data, size_t size);
+
+// waits for everything written so far to reach the file, so it can be read back. ends direct io for the rest of
+// the file, as what is left of a partial sector can only be written through the cache.
+bool disk_writer_flush(disk_writer* writer);
+
+// the same as fseek, returns the new position or -1. moving anywhere but the current position flushes.
+int64_t disk_writer_seek(disk_writer* writer, int64_t offset, int whence);
+
+// the end of everything written, as opposed to what is allocated
+int64_t disk_writer_size(disk_writer* writer);
+
+// the last write failed because the disk is full
+bool disk_writer_out_of_space(disk_writer* writer);
+
+// may be called from another thread while the writer is in use
+disk_writer_stats disk_writer_get_stats(disk_writer* writer);
+
+// flushes, trims the file to its size and closes it. the writer is freed either way.
+bool disk_writer_close(disk_writer* writer);
@@ -1,112 +1,141 @@
 #include "encoder.h"
+#include "events.h"
+#include "profiles.h"
 
 #include <vector>
-#include <unordered_set>
 #include <string>
 #include <sstream>
-#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
 
 using namespace std;
 
-static bool icq_available(obs_encoder_t* encoder)
+bool encoder_capabilities::has_encoder(const string& id) const
 {
-    obs_properties_t* props = obs_encoder_properties(encoder);
-    obs_property_t* p = obs_properties_get(props, "rate_control");
-    bool              icq_found = false;
-
-    size_t num = obs_property_list_item_count(p);
-    for (size_t i = 0; i < num; i++) {
-        const char* val = obs_property_list_item_string(p, i);
-        if (strcmp(val, "ICQ") == 0) {
-            icq_found = true;
-            break;
-        }
-    }
-
-    obs_properties_destroy(props);
-    return icq_found;
+    return std::find(encoders.begin(), encoders.end(), id) != encoders.end();
 }
 
-void UpdateRecordingSettings_qsv11(obs_encoder_t* videoRecordingEncoder, int crf)
+bool encoder_capabilities::has_rate_control(const string& id, const string& rateControl) const
 {
-    bool icq = icq_available(videoRecordingEncoder);
+    auto property = find_property(id, "rate_control");
+    return property && std::find(property->values.begin(), property->values.end(), rateControl) != property->values.end();
+}
 
-    obs_data_t* settings = obs_data_create();
-    obs_data_set_string(settings, "profile", "high");
+const encoder_property* encoder_capabilities::find_property(const string& id, const string& name) const
+{
+    auto encoder = properties.find(id);
+    if (encoder == properties.end()) {
+        return nullptr;
+    }
+    auto property = encoder->second.find(name);
+    return property == encoder->second.end() ? nullptr : &property->second;
+}
 
-    if (icq) {
-        obs_data_set_string(settings, "rate_control", "ICQ");
-        obs_data_set_int(settings, "icq_quality", crf);
+static void collect_properties(obs_properties_t* props, map<string, encoder_property>& found)
+{
+    for (obs_property_t* p = obs_properties_first(props); p != nullptr; obs_property_next(&p)) {
+        encoder_property property{};
+        switch (obs_property_get_type(p)) {
+        case OBS_PROPERTY_GROUP:
+            collect_properties(obs_property_group_content(p), found);
+            continue;
+        case OBS_PROPERTY_INT:
+            property.ranged = true;
+            property.min = obs_property_int_min(p);
+            property.max = obs_property_int_max(p);
+            break;
+        case OBS_PROPERTY_LIST:
+            if (obs_property_list_format(p) == OBS_COMBO_FORMAT_STRING) {
+                size_t num = obs_property_list_item_count(p);
+                for (size_t i = 0; i < num; i++) {
+                    const char* val = obs_property_list_item_string(p, i);
+                    if (val) {
+                        property.values.emplace_back(val);
+                    }
+                }
+            }
+            break;
+        default:
+            break;
+        }
+        found[obs_property_name(p)] = property;
     }
-    else {
-        obs_data_set_string(settings, "rate_control", "CQP");
-        obs_data_set_int(settings, "qpi", crf);
-        obs_data_set_int(settings, "qpp", crf);
-        obs_data_set_int(settings, "qpb", crf);
+}
+
+struct codec_encoders
+{
+    video_codec codec;
+    const char* name;
+    vector<string> hardware;
+    vector<string> software;
+};
+
+// obs 29 has no software hevc encoder, so hevc always needs a gpu
+static const codec_encoders CODEC_ENCODERS[] = {
+    { VIDEO_CODEC_H264, "h264", { "jim_nvenc", "amd_amf_h264", "obs_qsv11" }, { "obs_x264" } },
+    { VIDEO_CODEC_HEVC, "hevc", { "jim_hevc_nvenc", "h265_texture_amf", "obs_qsv11_hevc" }, {} },
+    { VIDEO_CODEC_AV1, "av1", { "jim_av1_nvenc", "av1_texture_amf", "obs_qsv11_av1" }, { "ffmpeg_svt_av1", "ffmpeg_aom_av1" } },
+};
+
+video_codec parse_video_codec(const string& name)
+{
+    for (auto& entry : CODEC_ENCODERS) {
+        if (name == entry.name) {
+            return entry.codec;
+        }
     }
+    throw std::invalid_argument("Invalid codec '" + name + "', must be one of: h264, hevc, av1.");
+}
 
-    obs_encoder_update(videoRecordingEncoder, settings);
-    obs_data_release(settings);
+const char* video_codec_name(video_codec codec)
+{
+    return CODEC_ENCODERS[codec].name;
 }
 
-void UpdateRecordingSettings_nvenc(obs_encoder_t* videoRecordingEncoder, int cqp)
+vector<string> video_codec_encoders(video_codec codec, bool hardware)
 {
-    obs_data_t* settings = obs_data_create();
-    obs_data_set_string(settings, "rate_control", "CQP");
-    obs_data_set_string(settings, "profile", "high");
-    obs_data_set_string(settings, "preset", "hq");
-    obs_data_set_int(settings, "cqp", cqp);
-    obs_data_set_int(settings, "bitrate", 0);
-    obs_encoder_update(videoRecordingEncoder, settings);
-    obs_data_release(settings);
+    return hardware ? CODEC_ENCODERS[codec].hardware : CODEC_ENCODERS[codec].software;
 }
 
-void UpdateRecordingSettings_amd_cqp(obs_encoder_t* videoRecordingEncoder, int cqp)
+encoder_capabilities probe_encoder_capabilities(const vector<string>& ids)
 {
-    obs_data_t* settings = obs_data_create();
-
-    // Static Properties
-    obs_data_set_int(settings, "Usage", 0);
-    obs_data_set_int(settings, "Profile", 100); // High
-
-    // Rate Control Properties
-    obs_data_set_int(settings, "RateControlMethod", 0);
-    obs_data_set_int(settings, "QP.IFrame", cqp);
-    obs_data_set_int(settings, "QP.PFrame", cqp);
-    obs_data_set_int(settings, "QP.BFrame", cqp);
-    obs_data_set_int(settings, "VBVBuffer", 1);
-    obs_data_set_int(settings, "VBVBuffer.Size", 100000);
-
-    // Picture Control Properties
-    obs_data_set_double(settings, "KeyframeInterval", 2.0);
-    obs_data_set_int(settings, "BFrame.Pattern", 0);
-
-    // Update and release
-    obs_encoder_update(videoRecordingEncoder, settings);
-    obs_data_release(settings);
+    encoder_capabilities caps{};
+    for (auto& id : ids) {
+        caps.encoders.push_back(id);
+        if (obs_get_encoder_type(id.c_str()) != OBS_ENCODER_VIDEO) {
+            continue;
+        }
+
+        obs_properties_t* props = obs_get_encoder_properties(id.c_str());
+        if (props) {
+            collect_properties(props, caps.properties[id]);
+            obs_properties_destroy(props);
+        }
+    }
+    return caps;
 }
 
-void UpdateRecordingSettings_x264_crf(obs_encoder_t* videoRecordingEncoder, int crf, bool lowCPUx264)
+void merge_encoder_capabilities(encoder_capabilities& into, const encoder_capabilities& from)
 {
-    obs_data_t* settings = obs_data_create();
-    obs_data_set_int(settings, "crf", crf);
-    obs_data_set_bool(settings, "use_bufsize", true);
-    obs_data_set_string(settings, "rate_control", "CRF");
-    obs_data_set_string(settings, "profile", "high");
-    obs_data_set_string(settings, "preset", lowCPUx264 ? "ultrafast" : "veryfast");
-    obs_encoder_update(videoRecordingEncoder, settings);
-    obs_data_release(settings);
+    for (auto& id : from.encoders) {
+        if (!into.has_encoder(id)) {
+            into.encoders.push_back(id);
+        }
+    }
+    for (auto& [id, properties] : from.properties) {
+        into.properties.emplace(id, properties);
+    }
 }
 
 #define CROSS_DIST_CUTOFF 2000.0
-int CalcCRF(int outputX, int outputY, int crf, bool lowCPUx264)
+int CalcCRF(int outputX, int outputY, int crf)
 {
     double fCX = double(outputX);
     double fCY = double(outputY);
 
-    if (lowCPUx264)
-        crf -= 2;
-
     double crossDist = sqrt(fCX * fCX + fCY * fCY);
     double crfResReduction = fmin(CROSS_DIST_CUTOFF, crossDist) / CROSS_DIST_CUTOFF;
     crfResReduction = (1.0 - crfResReduction) * 10.0;
@@ -114,46 +143,34 @@ int CalcCRF(int outputX, int outputY, int crf, bool lowCPUx264)
     return crf - int(crfResReduction);
 }
 
-obs_encoder_t* create_and_configure_video_encoder(bool hwAccel, bool lowCpuMode, uint16_t crf, Gdiplus::SizeF& outputSize)
+static string first_available(const encoder_capabilities& caps, const vector<string>& ids)
 {
-    unordered_set<string> encoders{};
-    for (int i = 0; i < 100; i++) {
-        const char* name;
-        if (!obs_enum_encoder_types(i, &name))
-            break;
-        encoders.insert(name);
-    }
-    
-    std::ostringstream imploded;
-    std::copy(encoders.begin(), encoders.end(), std::ostream_iterator<std::string>(imploded, ", "));
-    std::cout << "Available OBS encoders: " << imploded.str() << std::endl;
-
-    obs_encoder_t* encVideo = nullptr;
-    if (hwAccel) {
-        auto adjustedCrf = CalcCRF((int)outputSize.Width, (int)outputSize.Height, crf, false);
-        cout << "Actual CRF: " << adjustedCrf << std::endl;
-
-        if (encoders.find("jim_nvenc") != encoders.end()) {
-            encVideo = obs_video_encoder_create("jim_nvenc", "enc_jim_nvenc", nullptr, nullptr);
-            UpdateRecordingSettings_nvenc(encVideo, adjustedCrf);
-        }
-        else if (encoders.find("amd_amf_h264") != encoders.end()) {
-            encVideo = obs_video_encoder_create("amd_amf_h264", "enc_amd_amf_h264", nullptr, nullptr);
-            UpdateRecordingSettings_amd_cqp(encVideo, adjustedCrf);
-        }
-        else if (encoders.find("obs_qsv11") != encoders.end()) {
-            encVideo = obs_video_encoder_create("obs_qsv11", "enc_obs_qsv11", nullptr, nullptr);
-            UpdateRecordingSettings_qsv11(encVideo, adjustedCrf);
+    for (auto& id : ids) {
+        if (caps.has_encoder(id)) {
+            return id;
         }
     }
+    return "";
+}
 
-    if (encVideo == nullptr) {
-        auto adjustedCrfForCpu = CalcCRF((int)outputSize.Width, (int)outputSize.Height, crf, lowCpuMode);
-        cout << "Actual CRF: " << adjustedCrfForCpu << std::endl;
-
-        encVideo = obs_video_encoder_create("obs_x264", "enc_obs_x264", nullptr, nullptr);
-        UpdateRecordingSettings_x264_crf(encVideo, adjustedCrfForCpu, lowCpuMode);
-    }
+string select_video_encoder(const encoder_capabilities& caps, video_codec codec, bool hwAccel)
+{
+    std::ostringstream imploded;
+    std::copy(caps.encoders.begin(), caps.encoders.end(), std::ostream_iterator<std::string>(imploded, ", "));
+    events_write("Available OBS encoders: " + imploded.str());
+
+    auto& entry = CODEC_ENCODERS[codec];
+    string id = first_available(caps, hwAccel ? entry.hardware : entry.software);
+    if (id.empty())
+        id = first_available(caps, hwAccel ? entry.software : entry.hardware);
+    return id;
+}
 
+obs_encoder_t* create_and_configure_video_encoder(const resolved_profile& profile)
+{
+    string name = "enc_" + profile.encoderId;
+    obs_data_t* settings = obs_data_create_from_json(profile.settings.dump().c_str());
+    obs_encoder_t* encVideo = obs_video_encoder_create(profile.encoderId.c_str(), name.c_str(), settings, nullptr);
+    obs_data_release(settings);
     return encVideo;
-}
\ No newline at end of file
+}
@@ -1,6 +1,59 @@
 #pragma once
-#include "windows.h"
-#include "gdiplus.h"
+#include <string>
+#include <vector>
+#include <map>
 #include "obs-studio/libobs/obs.h"
 
-obs_encoder_t* create_and_configure_video_encoder(bool hwAccel, bool lowCpuMode, uint16_t crf, Gdiplus::SizeF& outputSize);
\ No newline at end of file
+struct resolved_profile;
+
+// what an encoder reports it accepts for one of its settings
+struct encoder_property
+{
+    std::vector<std::string> values;  // the choices of a string list, empty for any other kind of property
+    bool ranged;                      // an integer with a minimum and maximum
+    long long min, max;
+};
+
+// what the loaded obs modules can do on this machine. probing builds a property tree for every video encoder,
+// so the result is worth caching between runs (see capcache.h)
+struct encoder_capabilities
+{
+    std::vector<std::string> encoders;  // every registered encoder id
+    std::map<std::string, std::map<std::string, encoder_property>> properties;  // video encoder id -> setting -> property
+
+    bool has_encoder(const std::string& id) const;
+    bool has_rate_control(const std::string& id, const std::string& rateControl) const;
+
+    // null if the encoder does not report a property by this name
+    const encoder_property* find_property(const std::string& id, const std::string& name) const;
+};
+
+enum video_codec
+{
+    VIDEO_CODEC_H264,
+    VIDEO_CODEC_HEVC,
+    VIDEO_CODEC_AV1,
+};
+
+// accepts the names used by --codec, throws std::invalid_argument for anything else
+video_codec parse_video_codec(const std::string& name);
+const char* video_codec_name(video_codec codec);
+
+// encoder ids which produce the codec, in order of preference
+std::vector<std::string> video_codec_encoders(video_codec codec, bool hardware);
+
+// probes the registered encoders among ids
+encoder_capabilities probe_encoder_capabilities(const std::vector<std::string>& ids);
+
+// adds what another probe found, an encoder already known keeps its properties
+void merge_encoder_capabilities(encoder_capabilities& into, const encoder_capabilities& from);
+
+// picks the best available encoder id for the codec, hardware encoders are only preferred if hwAccel is set.
+// a codec without a software encoder falls back to hardware. returns an empty string if nothing is available.
+std::string select_video_encoder(const encoder_capabilities& caps, video_codec codec, bool hwAccel);
+
+// lowers crf for small outputs, where each pixel covers more of the screen and artifacts are more visible
+int CalcCRF(int outputX, int outputY, int crf);
+
+// creates the encoder named by the profile and applies its settings, see profiles.h
+obs_encoder_t* create_and_configure_video_encoder(const resolved_profile& profile);
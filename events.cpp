@@ -0,0 +1,154 @@
+#include "events.h"
+#include "mpsc_queue.h"
+#include "util.h"
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+
+#include "windows.h"
+#include "process.h"
+#include "io.h"
+#include "fcntl.h"
+
+using namespace std;
+
+// large enough to absorb a burst of signals while the reader is stalled, lines beyond this are dropped
+static mpsc_queue<string, 4096> queue;
+static atomic<string*> pendingStatus{ nullptr };
+static atomic<uint64_t> enqueued{ 0 };
+static atomic<uint64_t> written{ 0 };
+static atomic<uint64_t> dropped{ 0 };
+static atomic<bool> started{ false };
+static HANDLE wakeHandle = nullptr;
+
+static void write_stdout(const string& data)
+{
+    fwrite(data.data(), 1, data.size(), stdout);
+    fflush(stdout);
+}
+
+static unsigned int __stdcall thread_event_writer(void* lpParam)
+{
+    string batch;
+    batch.reserve(64 * 1024);
+    string line;
+
+    while (true) {
+        WaitForSingleObject(wakeHandle, INFINITE);
+
+        // everything that arrived while the previous write was blocked goes out in a single write
+        uint64_t count = 0;
+        batch.clear();
+        while (queue.pop(line)) {
+            batch += line;
+            batch += '\n';
+            count++;
+        }
+
+        string* status = pendingStatus.exchange(nullptr, memory_order_acquire);
+        if (status) {
+            batch += *status;
+            batch += '\n';
+            delete status;
+        }
+
+        if (!batch.empty()) {
+            write_stdout(batch);
+        }
+        written.fetch_add(count, memory_order_release);
+    }
+
+    return 0;
+}
+
+void events_start()
+{
+    fflush(stdout);
+    wakeHandle = CreateEvent(NULL, FALSE, FALSE, NULL);
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, thread_event_writer, nullptr, 0, nullptr);
+    if (!thread) {
+        throw std::runtime_error("Unable to start event writer thread");
+    }
+    CloseHandle(thread);
+    started = true;
+}
+
+void events_redirect(const string& target)
+{
+    int fd = -1;
+    if (target == "stderr") {
+        fd = _dup(_fileno(stderr));
+    }
+    else if (target.rfind("pipe:", 0) == 0) {
+        HANDLE pipe = util_connect_pipe(target.substr(5), 5000);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            throw std::invalid_argument("Unable to connect to the events pipe \\\\.\\pipe\\" + target.substr(5));
+        }
+        // the reader gets the lines byte for byte, without the crt turning each newline into crlf
+        fd = _open_osfhandle((intptr_t)pipe, _O_WRONLY | _O_BINARY);
+    }
+    else {
+        throw std::invalid_argument("Option '--events " + target + "' invalid. Must be stderr or pipe:{name}.");
+    }
+
+    // the crt stdout and the std handle both move, so child processes and anything printing with cout follow
+    fflush(stdout);
+    _dup2(fd, _fileno(stdout));
+    _close(fd);
+    SetStdHandle(STD_OUTPUT_HANDLE, (HANDLE)_get_osfhandle(_fileno(stdout)));
+}
+
+void events_write(string line)
+{
+    if (!started) {
+        line += '\n';
+        write_stdout(line);
+        return;
+    }
+
+    if (queue.push(std::move(line))) {
+        enqueued.fetch_add(1, memory_order_relaxed);
+        SetEvent(wakeHandle);
+    }
+    else {
+        dropped.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void events_write_status(string line)
+{
+    if (!started) {
+        events_write(std::move(line));
+        return;
+    }
+
+    string* previous = pendingStatus.exchange(new string(std::move(line)), memory_order_acq_rel);
+    if (previous) {
+        delete previous;
+        dropped.fetch_add(1, memory_order_relaxed);
+    }
+    SetEvent(wakeHandle);
+}
+
+uint64_t events_dropped()
+{
+    return dropped.load(memory_order_relaxed);
+}
+
+void events_flush(uint32_t timeoutMs)
+{
+    if (!started) {
+        fflush(stdout);
+        return;
+    }
+
+    uint64_t target = enqueued.load(memory_order_relaxed);
+    SetEvent(wakeHandle);
+    for (uint32_t waited = 0; waited < timeoutMs; waited++) {
+        if (written.load(memory_order_acquire) >= target && pendingStatus.load(memory_order_acquire) == nullptr) {
+            return;
+        }
+        Sleep(1);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// all stdout output goes through a single writer thread so a slow reader on the other end of the pipe
+// only ever stalls that thread, never the obs signal, input or status threads.
+void events_start();
+
+// sends everything written to stdout from here on, events and anything else the process prints, to "stderr" or
+// to "pipe:{name}", a named pipe \\.\pipe\{name} the reader has created. for when stdout carries something else,
+// call it before anything is written. throws if the pipe could not be opened.
+void events_redirect(const std::string& target);
+
+// queues one line for stdout, never blocks. before events_start this writes synchronously.
+// if the queue is full the line is dropped and counted.
+void events_write(std::string line);
+
+// status lines are superseded by the next one, so only the latest pending status is kept.
+// any status replaced before the writer got to it is counted as dropped.
+void events_write_status(std::string line);
+
+// number of lines dropped or coalesced away since start
+uint64_t events_dropped();
+
+// waits for everything queued so far to be written, for use right before the process exits
+void events_flush(uint32_t timeoutMs);
@@ -0,0 +1,671 @@
+#include "fmp4.h"
+
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <io.h>
+
+#include "obs-studio/libobs/util/platform.h"
+
+using namespace std;
+
+// tfhd and trun flags from iso 14496-12
+#define TFHD_BASE_DATA_OFFSET 0x1
+#define TFHD_SAMPLE_DESCRIPTION 0x2
+#define TFHD_DEFAULT_DURATION 0x8
+#define TFHD_DEFAULT_SIZE 0x10
+#define TFHD_DEFAULT_FLAGS 0x20
+#define TFHD_BASE_IS_MOOF 0x20000
+#define TRUN_DATA_OFFSET 0x1
+#define TRUN_FIRST_FLAGS 0x4
+#define TRUN_DURATION 0x100
+#define TRUN_SIZE 0x200
+#define TRUN_FLAGS 0x400
+#define TRUN_CTO 0x800
+#define SAMPLE_NON_SYNC 0x10000
+
+struct top_box
+{
+    string type;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t headerSize;
+};
+
+// a box inside one which has been read into memory
+struct child_box
+{
+    string type;
+    const uint8_t* start;   // the header
+    size_t total;
+    const uint8_t* data;    // the payload
+    size_t size;
+};
+
+struct fmp4_sample
+{
+    uint64_t offset;
+    uint32_t size;
+    uint32_t duration;
+    int32_t cto;
+    bool sync;
+};
+
+struct fmp4_track
+{
+    uint32_t timescale;
+    uint32_t defaultDuration, defaultSize, defaultFlags;  // from its trex
+    vector<fmp4_sample> samples;
+};
+
+struct box_reader
+{
+    const uint8_t* p;
+    size_t left;
+    bool ok;
+
+    uint32_t u32()
+    {
+        if (left < 4) {
+            ok = false;
+            return 0;
+        }
+        uint32_t value = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        p += 4;
+        left -= 4;
+        return value;
+    }
+
+    uint64_t u64()
+    {
+        uint64_t high = u32();
+        return (high << 32) | u32();
+    }
+};
+
+static uint32_t read_u32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void set_u32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static void put_u32(vector<uint8_t>& out, uint32_t value)
+{
+    out.resize(out.size() + 4);
+    set_u32(&out[out.size() - 4], value);
+}
+
+static void put_u64(vector<uint8_t>& out, uint64_t value)
+{
+    put_u32(out, (uint32_t)(value >> 32));
+    put_u32(out, (uint32_t)value);
+}
+
+static void put_box(vector<uint8_t>& out, const char* type, const vector<uint8_t>& payload)
+{
+    put_u32(out, (uint32_t)(payload.size() + 8));
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+static void put_full_box(vector<uint8_t>& out, const char* type, uint8_t version, const vector<uint8_t>& payload)
+{
+    vector<uint8_t> full{};
+    put_u32(full, (uint32_t)version << 24);
+    full.insert(full.end(), payload.begin(), payload.end());
+    put_box(out, type, full);
+}
+
+static void put_copy(vector<uint8_t>& out, const child_box& box)
+{
+    out.insert(out.end(), box.start, box.start + box.total);
+}
+
+// copies a mvhd, tkhd or mdhd with a new duration, which sits at a different offset in version 0 and 1 boxes
+static void put_with_duration(vector<uint8_t>& out, const child_box& box, size_t v0Offset, size_t v1Offset, uint64_t duration)
+{
+    size_t payload = out.size() + (box.total - box.size);
+    put_copy(out, box);
+    if (box.size > 0 && box.data[0] == 1 && box.size >= v1Offset + 8) {
+        set_u32(&out[payload + v1Offset], (uint32_t)(duration >> 32));
+        set_u32(&out[payload + v1Offset + 4], (uint32_t)duration);
+    }
+    else if (box.size >= v0Offset + 4) {
+        set_u32(&out[payload + v0Offset], (uint32_t)min<uint64_t>(duration, UINT32_MAX));
+    }
+}
+
+static vector<child_box> read_children(const uint8_t* data, size_t size)
+{
+    vector<child_box> boxes{};
+    size_t offset = 0;
+    while (offset + 8 <= size) {
+        uint64_t boxSize = read_u32(data + offset);
+        size_t header = 8;
+        if (boxSize == 1) {
+            if (offset + 16 > size) {
+                break;
+            }
+            boxSize = ((uint64_t)read_u32(data + offset + 8) << 32) | read_u32(data + offset + 12);
+            header = 16;
+        }
+        else if (boxSize == 0) {
+            boxSize = size - offset;
+        }
+        if (boxSize < header || boxSize > size - offset) {
+            break;
+        }
+        boxes.push_back({ string((const char*)data + offset + 4, 4), data + offset, (size_t)boxSize, data + offset + header, (size_t)boxSize - header });
+        offset += (size_t)boxSize;
+    }
+    return boxes;
+}
+
+static const child_box* find_child(const vector<child_box>& boxes, const char* type)
+{
+    for (auto& box : boxes) {
+        if (box.type == type) {
+            return &box;
+        }
+    }
+    return nullptr;
+}
+
+static bool read_at(FILE* file, uint64_t offset, void* data, size_t size)
+{
+    return os_fseeki64(file, (int64_t)offset, SEEK_SET) == 0 && fread(data, 1, size, file) == size;
+}
+
+static bool write_at(FILE* file, uint64_t offset, const void* data, size_t size)
+{
+    return os_fseeki64(file, (int64_t)offset, SEEK_SET) == 0 && fwrite(data, 1, size, file) == size;
+}
+
+// stops at the first box which does not fit in the file, everything from there on was cut short by a crash
+static vector<top_box> read_top_level(FILE* file, uint64_t fileSize)
+{
+    vector<top_box> boxes{};
+    uint64_t offset = 0;
+    while (offset + 8 <= fileSize) {
+        uint8_t header[16];
+        if (!read_at(file, offset, header, 8)) {
+            break;
+        }
+        uint64_t size = read_u32(header);
+        uint32_t headerSize = 8;
+        if (size == 1) {
+            if (offset + 16 > fileSize || !read_at(file, offset + 8, header + 8, 8)) {
+                break;
+            }
+            size = ((uint64_t)read_u32(header + 8) << 32) | read_u32(header + 12);
+            headerSize = 16;
+        }
+        else if (size == 0) {
+            size = fileSize - offset;
+        }
+        if (size < headerSize || size > fileSize - offset) {
+            break;
+        }
+        boxes.push_back({ string((const char*)header + 4, 4), offset, size, headerSize });
+        offset += size;
+    }
+    return boxes;
+}
+
+static bool read_payload(FILE* file, const top_box& box, vector<uint8_t>& payload)
+{
+    payload.resize((size_t)(box.size - box.headerSize));
+    return read_at(file, box.offset + box.headerSize, payload.data(), payload.size());
+}
+
+static bool parse_moof(const vector<uint8_t>& moof, uint64_t moofOffset, map<uint32_t, fmp4_track>& tracks, string& error)
+{
+    auto boxes = read_children(moof.data(), moof.size());
+    uint64_t previousEnd = moofOffset;
+    bool first = true;
+    for (auto& traf : boxes) {
+        if (traf.type != "traf") {
+            continue;
+        }
+        auto trafBoxes = read_children(traf.data, traf.size);
+        auto tfhd = find_child(trafBoxes, "tfhd");
+        if (!tfhd) {
+            error = "A fragment has no track header";
+            return false;
+        }
+
+        box_reader header{ tfhd->data, tfhd->size, true };
+        uint32_t flags = header.u32() & 0xFFFFFF;
+        auto found = tracks.find(header.u32());
+        if (found == tracks.end()) {
+            error = "A fragment refers to a track which is not in the index";
+            return false;
+        }
+        auto& track = found->second;
+
+        // without an explicit base, data is relative to the moof, or for later trafs to the end of the previous one
+        uint64_t base = (flags & TFHD_BASE_DATA_OFFSET) ? header.u64() : (flags & TFHD_BASE_IS_MOOF) || first ? moofOffset : previousEnd;
+        if (flags & TFHD_SAMPLE_DESCRIPTION) {
+            header.u32();
+        }
+        uint32_t defaultDuration = (flags & TFHD_DEFAULT_DURATION) ? header.u32() : track.defaultDuration;
+        uint32_t defaultSize = (flags & TFHD_DEFAULT_SIZE) ? header.u32() : track.defaultSize;
+        uint32_t defaultFlags = (flags & TFHD_DEFAULT_FLAGS) ? header.u32() : track.defaultFlags;
+        if (!header.ok) {
+            error = "A track fragment header is truncated";
+            return false;
+        }
+
+        uint64_t next = base;
+        for (auto& trun : trafBoxes) {
+            if (trun.type != "trun") {
+                continue;
+            }
+            box_reader run{ trun.data, trun.size, true };
+            uint32_t runFlags = run.u32() & 0xFFFFFF;
+            uint32_t count = run.u32();
+            if (runFlags & TRUN_DATA_OFFSET) {
+                next = base + (int64_t)(int32_t)run.u32();
+            }
+            bool hasFirstFlags = (runFlags & TRUN_FIRST_FLAGS) != 0;
+            uint32_t firstFlags = hasFirstFlags ? run.u32() : 0;
+
+            for (uint32_t i = 0; i < count && run.ok; i++) {
+                fmp4_sample sample{};
+                sample.duration = (runFlags & TRUN_DURATION) ? run.u32() : defaultDuration;
+                sample.size = (runFlags & TRUN_SIZE) ? run.u32() : defaultSize;
+                uint32_t sampleFlags = (runFlags & TRUN_FLAGS) ? run.u32() : i == 0 && hasFirstFlags ? firstFlags : defaultFlags;
+                // version 0 offsets are unsigned, but never large enough for that to matter
+                sample.cto = (runFlags & TRUN_CTO) ? (int32_t)run.u32() : 0;
+                sample.sync = (sampleFlags & SAMPLE_NON_SYNC) == 0;
+                sample.offset = next;
+                next += sample.size;
+                if (run.ok) {
+                    track.samples.push_back(sample);
+                }
+            }
+            if (!run.ok) {
+                error = "A track run is truncated";
+                return false;
+            }
+        }
+        previousEnd = next;
+        first = false;
+    }
+    return true;
+}
+
+static vector<uint8_t> build_stbl(const child_box& stsd, const fmp4_track& track)
+{
+    vector<uint8_t> stbl{};
+    put_copy(stbl, stsd);
+    auto& samples = track.samples;
+
+    vector<uint8_t> stts{};
+    vector<pair<uint32_t, uint32_t>> durations{};
+    for (auto& sample : samples) {
+        if (!durations.empty() && durations.back().second == sample.duration) {
+            durations.back().first++;
+        }
+        else {
+            durations.push_back({ 1, sample.duration });
+        }
+    }
+    put_u32(stts, (uint32_t)durations.size());
+    for (auto& run : durations) {
+        put_u32(stts, run.first);
+        put_u32(stts, run.second);
+    }
+    put_full_box(stbl, "stts", 0, stts);
+
+    bool hasCto = false, negativeCto = false;
+    for (auto& sample : samples) {
+        hasCto |= sample.cto != 0;
+        negativeCto |= sample.cto < 0;
+    }
+    if (hasCto) {
+        vector<uint8_t> ctts{};
+        vector<pair<uint32_t, int32_t>> offsets{};
+        for (auto& sample : samples) {
+            if (!offsets.empty() && offsets.back().second == sample.cto) {
+                offsets.back().first++;
+            }
+            else {
+                offsets.push_back({ 1, sample.cto });
+            }
+        }
+        put_u32(ctts, (uint32_t)offsets.size());
+        for (auto& run : offsets) {
+            put_u32(ctts, run.first);
+            put_u32(ctts, (uint32_t)run.second);
+        }
+        put_full_box(stbl, "ctts", negativeCto ? 1 : 0, ctts);
+    }
+
+    // without an stss every sample is a sync sample
+    if (any_of(samples.begin(), samples.end(), [](const fmp4_sample& sample) { return !sample.sync; })) {
+        vector<uint32_t> syncSamples{};
+        for (size_t i = 0; i < samples.size(); i++) {
+            if (samples[i].sync) {
+                syncSamples.push_back((uint32_t)i + 1);
+            }
+        }
+        vector<uint8_t> stss{};
+        put_u32(stss, (uint32_t)syncSamples.size());
+        for (auto index : syncSamples) {
+            put_u32(stss, index);
+        }
+        put_full_box(stbl, "stss", 0, stss);
+    }
+
+    // a chunk is a run of samples which follow each other in the file, usually one per fragment
+    vector<pair<uint64_t, uint32_t>> chunks{};
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (i > 0 && samples[i].offset == samples[i - 1].offset + samples[i - 1].size) {
+            chunks.back().second++;
+        }
+        else {
+            chunks.push_back({ samples[i].offset, 1 });
+        }
+    }
+
+    vector<uint8_t> stsc{};
+    vector<pair<uint32_t, uint32_t>> chunkRuns{};
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunkRuns.empty() || chunkRuns.back().second != chunks[i].second) {
+            chunkRuns.push_back({ (uint32_t)i + 1, chunks[i].second });
+        }
+    }
+    put_u32(stsc, (uint32_t)chunkRuns.size());
+    for (auto& run : chunkRuns) {
+        put_u32(stsc, run.first);
+        put_u32(stsc, run.second);
+        put_u32(stsc, 1);
+    }
+    put_full_box(stbl, "stsc", 0, stsc);
+
+    vector<uint8_t> stsz{};
+    bool constantSize = !samples.empty() && all_of(samples.begin(), samples.end(), [&](const fmp4_sample& sample) { return sample.size == samples[0].size; });
+    put_u32(stsz, constantSize ? samples[0].size : 0);
+    put_u32(stsz, (uint32_t)samples.size());
+    if (!constantSize) {
+        for (auto& sample : samples) {
+            put_u32(stsz, sample.size);
+        }
+    }
+    put_full_box(stbl, "stsz", 0, stsz);
+
+    bool largeOffsets = !chunks.empty() && chunks.back().first > UINT32_MAX;
+    vector<uint8_t> stco{};
+    put_u32(stco, (uint32_t)chunks.size());
+    for (auto& chunk : chunks) {
+        if (largeOffsets) {
+            put_u64(stco, chunk.first);
+        }
+        else {
+            put_u32(stco, (uint32_t)chunk.first);
+        }
+    }
+    put_full_box(stbl, largeOffsets ? "co64" : "stco", 0, stco);
+    return stbl;
+}
+
+static vector<uint8_t> build_container(const child_box& box, const fmp4_track& track, uint64_t duration);
+
+static bool build_trak(vector<uint8_t>& out, const child_box& trak, const fmp4_track& track, uint32_t movieTimescale, uint64_t& movieDuration)
+{
+    uint64_t duration = 0;
+    int64_t firstPresented = INT64_MAX;
+    for (auto& sample : track.samples) {
+        firstPresented = min(firstPresented, (int64_t)duration + sample.cto);
+        duration += sample.duration;
+    }
+
+    // the frames before the first one presented, the b-frame delay, are skipped with an edit list as ffmpeg does
+    int64_t mediaStart = firstPresented > 0 && firstPresented != INT64_MAX ? firstPresented : 0;
+    uint64_t presented = (duration - mediaStart) * movieTimescale / max<uint32_t>(track.timescale, 1);
+    movieDuration = max(movieDuration, presented);
+
+    vector<uint8_t> payload{};
+    for (auto& child : read_children(trak.data, trak.size)) {
+        if (child.type == "tkhd") {
+            put_with_duration(payload, child, 20, 28, presented);
+            if (mediaStart > 0) {
+                vector<uint8_t> elst{};
+                put_u32(elst, 1);
+                put_u32(elst, (uint32_t)min<uint64_t>(presented, UINT32_MAX));
+                put_u32(elst, (uint32_t)mediaStart);
+                put_u32(elst, 0x00010000);
+                vector<uint8_t> edts{};
+                put_full_box(edts, "elst", 0, elst);
+                put_box(payload, "edts", edts);
+            }
+        }
+        else if (child.type == "edts") {
+            // replaced above
+        }
+        else if (child.type == "mdia") {
+            auto mdia = build_container(child, track, duration);
+            if (mdia.empty()) {
+                return false;
+            }
+            put_box(payload, "mdia", mdia);
+        }
+        else {
+            put_copy(payload, child);
+        }
+    }
+    put_box(out, "trak", payload);
+    return true;
+}
+
+// the payload of an mdia or minf with its sample tables rebuilt, empty if there is no sample description
+static vector<uint8_t> build_container(const child_box& box, const fmp4_track& track, uint64_t duration)
+{
+    vector<uint8_t> payload{};
+    for (auto& child : read_children(box.data, box.size)) {
+        if (child.type == "mdhd") {
+            put_with_duration(payload, child, 16, 24, duration);
+        }
+        else if (child.type == "minf") {
+            auto minf = build_container(child, track, duration);
+            if (minf.empty()) {
+                return {};
+            }
+            put_box(payload, "minf", minf);
+        }
+        else if (child.type == "stbl") {
+            auto stblBoxes = read_children(child.data, child.size);
+            auto stsd = find_child(stblBoxes, "stsd");
+            if (!stsd) {
+                return {};
+            }
+            // stsd points into the original moov, which outlives this
+            put_box(payload, "stbl", build_stbl(*stsd, track));
+        }
+        else {
+            put_copy(payload, child);
+        }
+    }
+    return payload;
+}
+
+static uint32_t read_timescale(const child_box& box, size_t v0Offset, size_t v1Offset)
+{
+    size_t offset = box.size > 0 && box.data[0] == 1 ? v1Offset : v0Offset;
+    return box.size >= offset + 4 ? read_u32(box.data + offset) : 0;
+}
+
+static uint32_t read_track_id(const child_box& trak)
+{
+    auto trakBoxes = read_children(trak.data, trak.size);
+    auto tkhd = find_child(trakBoxes, "tkhd");
+    if (!tkhd) {
+        return 0;
+    }
+    size_t offset = tkhd->size > 0 && tkhd->data[0] == 1 ? 20 : 12;
+    return tkhd->size >= offset + 4 ? read_u32(tkhd->data + offset) : 0;
+}
+
+static uint32_t read_media_timescale(const child_box& trak)
+{
+    auto trakBoxes = read_children(trak.data, trak.size);
+    auto mdia = find_child(trakBoxes, "mdia");
+    if (!mdia) {
+        return 0;
+    }
+    auto mdiaBoxes = read_children(mdia->data, mdia->size);
+    auto mdhd = find_child(mdiaBoxes, "mdhd");
+    return mdhd ? read_timescale(*mdhd, 12, 20) : 0;
+}
+
+fmp4_finalize_result fmp4_finalize(const string& path)
+{
+    fmp4_finalize_result result{};
+    FILE* file = os_fopen(path.c_str(), "r+b");
+    if (!file) {
+        result.error = "Unable to open '" + path + "'";
+        return result;
+    }
+    auto fail = [&](const string& error) {
+        fclose(file);
+        result.error = error;
+        return result;
+    };
+
+    os_fseeki64(file, 0, SEEK_END);
+    uint64_t fileSize = (uint64_t)os_ftelli64(file);
+    auto boxes = read_top_level(file, fileSize);
+    uint64_t dataEnd = boxes.empty() ? 0 : boxes.back().offset + boxes.back().size;
+
+    size_t moovIndex = 0;
+    while (moovIndex < boxes.size() && boxes[moovIndex].type != "moov") {
+        moovIndex++;
+    }
+    if (moovIndex == boxes.size()) {
+        return fail("'" + path + "' has no index");
+    }
+    vector<uint8_t> moov{};
+    if (!read_payload(file, boxes[moovIndex], moov)) {
+        return fail("Unable to read the index of '" + path + "'");
+    }
+    auto moovBoxes = read_children(moov.data(), moov.size());
+    auto mvhd = find_child(moovBoxes, "mvhd");
+    auto mvex = find_child(moovBoxes, "mvex");
+    if (!mvhd || !mvex) {
+        return fail("'" + path + "' is not a fragmented mp4");
+    }
+
+    map<uint32_t, fmp4_track> tracks{};
+    for (auto& trak : moovBoxes) {
+        if (trak.type == "trak") {
+            tracks[read_track_id(trak)].timescale = read_media_timescale(trak);
+        }
+    }
+    for (auto& trex : read_children(mvex->data, mvex->size)) {
+        box_reader reader{ trex.data, trex.size, true };
+        reader.u32();
+        uint32_t id = reader.u32();
+        reader.u32();
+        uint32_t defaultDuration = reader.u32();
+        uint32_t defaultSize = reader.u32();
+        uint32_t defaultFlags = reader.u32();
+        if (trex.type == "trex" && reader.ok && tracks.count(id)) {
+            tracks[id].defaultDuration = defaultDuration;
+            tracks[id].defaultSize = defaultSize;
+            tracks[id].defaultFlags = defaultFlags;
+        }
+    }
+
+    vector<uint8_t> moof{};
+    for (auto& box : boxes) {
+        if (box.type != "moof") {
+            continue;
+        }
+        string error;
+        if (!read_payload(file, box, moof) || !parse_moof(moof, box.offset, tracks, error)) {
+            return fail(error.empty() ? "Unable to read a fragment of '" + path + "'" : error);
+        }
+        result.fragments++;
+    }
+
+    // samples of a fragment whose data never fully reached the disk
+    for (auto& track : tracks) {
+        auto& samples = track.second.samples;
+        samples.erase(remove_if(samples.begin(), samples.end(), [&](const fmp4_sample& sample) { return sample.offset + sample.size > dataEnd; }), samples.end());
+        result.samples += samples.size();
+    }
+
+    uint32_t movieTimescale = read_timescale(*mvhd, 12, 20);
+    uint64_t movieDuration = 0;
+    vector<uint8_t> payload{};
+    for (auto& child : moovBoxes) {
+        if (child.type == "trak") {
+            if (!build_trak(payload, child, tracks[read_track_id(child)], movieTimescale, movieDuration)) {
+                return fail("A track of '" + path + "' has no sample description");
+            }
+        }
+        else if (child.type != "mvhd" && child.type != "mvex") {
+            put_copy(payload, child);
+        }
+    }
+    vector<uint8_t> mvhdBox{};
+    put_with_duration(mvhdBox, *mvhd, 16, 24, movieDuration);
+    payload.insert(payload.begin(), mvhdBox.begin(), mvhdBox.end());
+    vector<uint8_t> index{};
+    put_box(index, "moov", payload);
+    result.indexBytes = index.size();
+
+    // the empty index and the space the muxer reserved after it
+    auto& oldMoov = boxes[moovIndex];
+    uint64_t available = oldMoov.size;
+    if (moovIndex + 1 < boxes.size() && boxes[moovIndex + 1].type == "free") {
+        available += boxes[moovIndex + 1].size;
+    }
+
+    bool written;
+    if (index.size() == available || index.size() + 8 <= available) {
+        result.faststart = true;
+        written = write_at(file, oldMoov.offset, index.data(), index.size());
+        if (written && index.size() < available) {
+            uint8_t free[8];
+            set_u32(free, (uint32_t)(available - index.size()));
+            memcpy(free + 4, "free", 4);
+            written = write_at(file, oldMoov.offset + index.size(), free, sizeof(free));
+        }
+        if (written && fileSize > dataEnd) {
+            fflush(file);
+            written = _chsize_s(_fileno(file), (long long)dataEnd) == 0;
+        }
+    }
+    else {
+        // anything after the last complete box is dropped, a crash can leave half a fragment there
+        written = write_at(file, dataEnd, index.data(), index.size()) && write_at(file, oldMoov.offset + 4, "free", 4);
+        fflush(file);
+        written = written && _chsize_s(_fileno(file), (long long)(dataEnd + index.size())) == 0;
+    }
+
+    // fragment headers left in place would add their samples a second time
+    for (size_t i = moovIndex + 1; i < boxes.size() && written; i++) {
+        auto& type = boxes[i].type;
+        if (type == "moof" || type == "mfra" || type == "sidx" || type == "styp") {
+            written = write_at(file, boxes[i].offset + 4, "free", 4);
+        }
+    }
+
+    if (fclose(file) != 0 || !written) {
+        result.error = "Unable to write the index of '" + path + "'";
+        return result;
+    }
+    result.success = true;
+    return result;
+}
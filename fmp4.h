@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+// a fragmented mp4 is written as an empty index followed by self contained fragments, so whatever reached the
+// disk before a crash plays up to its last complete fragment. fmp4_finalize turns such a file into a regular,
+// seekable mp4 in place: the sample tables are rebuilt from the fragment headers and only the index is written.
+// the media data is not read or moved.
+//
+// the new index goes where the empty one was if the space reserved after it is large enough, which makes the file
+// faststart, otherwise it is appended to the end. the old index and the fragment headers are turned into free
+// boxes, so players see one index and the mdat boxes it points into.
+
+// reserved after the empty index by the in-process muxer, about twenty minutes of 60fps video with audio
+#define FMP4_INDEX_RESERVE_BYTES (1024 * 1024)
+
+struct fmp4_finalize_result
+{
+    bool success;
+    bool faststart;         // the index fitted in front of the media
+    uint64_t indexBytes;
+    uint64_t samples;
+    uint32_t fragments;
+    std::string error;
+};
+
+fmp4_finalize_result fmp4_finalize(const std::string& path);
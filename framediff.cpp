@@ -0,0 +1,165 @@
+#include "framediff.h"
+
+#include <cstring>
+#include <intrin.h>
+
+#include "obs-studio/libobs/util/platform.h"
+
+using namespace std;
+
+typedef bool (*row_equal_fn)(const uint8_t* a, const uint8_t* b, size_t bytes);
+
+static bool row_equal_scalar(const uint8_t* a, const uint8_t* b, size_t bytes)
+{
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y) {
+            return false;
+        }
+    }
+    for (; i < bytes; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// rows are a few kilobytes, so the differences are accumulated over the row and tested once at its end
+static bool row_equal_sse2(const uint8_t* a, const uint8_t* b, size_t bytes)
+{
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(a + i + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(b + i + 16));
+        acc0 = _mm_or_si128(acc0, _mm_xor_si128(a0, b0));
+        acc1 = _mm_or_si128(acc1, _mm_xor_si128(a1, b1));
+    }
+    __m128i acc = _mm_or_si128(acc0, acc1);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) {
+        return false;
+    }
+    return row_equal_scalar(a + i, b + i, bytes - i);
+}
+
+static bool row_equal_avx2(const uint8_t* a, const uint8_t* b, size_t bytes)
+{
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 64 <= bytes; i += 64) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(a + i + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(b + i + 32));
+        acc0 = _mm256_or_si256(acc0, _mm256_xor_si256(a0, b0));
+        acc1 = _mm256_or_si256(acc1, _mm256_xor_si256(a1, b1));
+    }
+    __m256i acc = _mm256_or_si256(acc0, acc1);
+    if (!_mm256_testz_si256(acc, acc)) {
+        return false;
+    }
+    return row_equal_sse2(a + i, b + i, bytes - i);
+}
+
+static row_equal_fn get_row_equal(framediff_kernel kernel)
+{
+    switch (kernel) {
+    case FRAMEDIFF_AVX2: return row_equal_avx2;
+    case FRAMEDIFF_SSE2: return row_equal_sse2;
+    default: return row_equal_scalar;
+    }
+}
+
+framediff_kernel framediff_best_kernel()
+{
+    int info[4]{};
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    // avx2 also needs the os to save the upper halves of the ymm registers
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) {
+            return FRAMEDIFF_AVX2;
+        }
+    }
+    return sse2 ? FRAMEDIFF_SSE2 : FRAMEDIFF_SCALAR;
+}
+
+const char* framediff_kernel_name(framediff_kernel kernel)
+{
+    switch (kernel) {
+    case FRAMEDIFF_AVX2: return "avx2";
+    case FRAMEDIFF_SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+bool framediff_update(framediff_kernel kernel, uint8_t* reference, size_t referenceStride, const uint8_t* current, size_t currentStride, size_t rowBytes, size_t rows)
+{
+    row_equal_fn rowEqual = get_row_equal(kernel);
+    for (size_t row = 0; row < rows; row++) {
+        if (rowEqual(reference + row * referenceStride, current + row * currentStride, rowBytes)) {
+            continue;
+        }
+
+        // the rows before this one already match
+        for (; row < rows; row++) {
+            memcpy(reference + row * referenceStride, current + row * currentStride, rowBytes);
+        }
+        return true;
+    }
+    return false;
+}
+
+vector<framediff_benchmark_result> framediff_benchmark(uint32_t width, uint32_t height, uint32_t iterations)
+{
+    // readback rows are aligned to 256 bytes
+    size_t stride = ((size_t)width + 255) & ~(size_t)255;
+    size_t bytes = stride * height;
+    vector<uint8_t> reference(bytes);
+    vector<uint8_t> current(bytes);
+    for (size_t i = 0; i < bytes; i++) {
+        current[i] = (uint8_t)((i * 2654435761u) >> 24);
+    }
+
+    framediff_kernel best = framediff_best_kernel();
+    vector<framediff_benchmark_result> results{};
+    for (int k = FRAMEDIFF_SCALAR; k <= best; k++) {
+        auto kernel = (framediff_kernel)k;
+        framediff_benchmark_result result{};
+        result.kernel = kernel;
+        double frameGB = (double)width * height / 1e9;
+
+        memcpy(reference.data(), current.data(), bytes);
+        uint64_t startNs = os_gettime_ns();
+        for (uint32_t i = 0; i < iterations; i++) {
+            framediff_update(kernel, reference.data(), stride, current.data(), stride, width, height);
+        }
+        result.unchangedGBps = frameGB * iterations / ((os_gettime_ns() - startNs) / 1e9);
+
+        uint8_t* lastRow = current.data() + stride * (height - 1);
+        startNs = os_gettime_ns();
+        for (uint32_t i = 0; i < iterations; i++) {
+            lastRow[i % width] ^= 0xFF;
+            framediff_update(kernel, reference.data(), stride, current.data(), stride, width, height);
+        }
+        result.changedGBps = frameGB * iterations / ((os_gettime_ns() - startNs) / 1e9);
+
+        results.push_back(result);
+    }
+    return results;
+}
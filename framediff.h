@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// change detection for --vfr. a plane is compared row by row against a reference copy of the previous frame,
+// stopping at the first row which differs, and from there the rest of the plane is copied into the reference.
+// a static screen costs one read of each plane, a changed one at most a read and a copy.
+
+enum framediff_kernel
+{
+    FRAMEDIFF_SCALAR,
+    FRAMEDIFF_SSE2,
+    FRAMEDIFF_AVX2,
+};
+
+// the widest kernel this cpu and os support
+framediff_kernel framediff_best_kernel();
+const char* framediff_kernel_name(framediff_kernel kernel);
+
+// returns true if any of the rows differ from the reference, which then holds the current plane. rowBytes
+// may be less than either stride.
+bool framediff_update(framediff_kernel kernel, uint8_t* reference, size_t referenceStride, const uint8_t* current, size_t currentStride, size_t rowBytes, size_t rows);
+
+struct framediff_benchmark_result
+{
+    framediff_kernel kernel;
+    double unchangedGBps;   // a frame identical to the reference, the common case on a static screen
+    double changedGBps;     // a frame which differs in its last row, so every row is compared
+};
+
+// times each supported kernel on synthetic frames of this size, with a stride padded the way gpu readback pads it
+std::vector<framediff_benchmark_result> framediff_benchmark(uint32_t width, uint32_t height, uint32_t iterations);
@@ -1,17 +1,29 @@
 #include "getscreens.h"
+#include "topology.h"
 #include "windows.h"
 #include "shellscalingapi.h"
+#include "process.h"
+
+#include <string>
+#include <mutex>
 
 using namespace std;
 
-static bool GetMonitorTarget(LPCWSTR device, DISPLAYCONFIG_TARGET_DEVICE_NAME* target)
+struct monitor_target_name
+{
+    wstring gdiDeviceName;
+    wstring friendlyName;
+};
+
+// queries the display configuration once and resolves every active path, rather than re-querying per monitor
+static vector<monitor_target_name> GetMonitorTargets()
 {
-    bool found = false;
+    vector<monitor_target_name> targets{};
     UINT32 numPath, numMode;
     if (GetDisplayConfigBufferSizes(QDC_ONLY_ACTIVE_PATHS, &numPath, &numMode) == ERROR_SUCCESS) {
-        DISPLAYCONFIG_PATH_INFO* paths = (DISPLAYCONFIG_PATH_INFO*)malloc(numPath * sizeof(DISPLAYCONFIG_PATH_INFO));
-        DISPLAYCONFIG_MODE_INFO* modes = (DISPLAYCONFIG_MODE_INFO*)malloc(numMode * sizeof(DISPLAYCONFIG_MODE_INFO));
-        if (QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &numPath, paths, &numMode, modes, NULL) == ERROR_SUCCESS) {
+        vector<DISPLAYCONFIG_PATH_INFO> paths(numPath);
+        vector<DISPLAYCONFIG_MODE_INFO> modes(numMode);
+        if (QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &numPath, paths.data(), &numMode, modes.data(), NULL) == ERROR_SUCCESS) {
             for (size_t i = 0; i < numPath; ++i) {
                 const DISPLAYCONFIG_PATH_INFO* const path = &paths[i];
                 DISPLAYCONFIG_SOURCE_DEVICE_NAME source;
@@ -19,41 +31,51 @@ static bool GetMonitorTarget(LPCWSTR device, DISPLAYCONFIG_TARGET_DEVICE_NAME* t
                 source.header.size = sizeof(source);
                 source.header.adapterId = path->sourceInfo.adapterId;
                 source.header.id = path->sourceInfo.id;
-                if (DisplayConfigGetDeviceInfo(&source.header) == ERROR_SUCCESS && wcscmp(device, source.viewGdiDeviceName) == 0) {
-                    target->header.type = DISPLAYCONFIG_DEVICE_INFO_GET_TARGET_NAME;
-                    target->header.size = sizeof(*target);
-                    target->header.adapterId = path->sourceInfo.adapterId;
-                    target->header.id = path->targetInfo.id;
-                    found = DisplayConfigGetDeviceInfo(&target->header) == ERROR_SUCCESS;
-                    break;
+                if (DisplayConfigGetDeviceInfo(&source.header) != ERROR_SUCCESS) {
+                    continue;
+                }
+
+                DISPLAYCONFIG_TARGET_DEVICE_NAME target;
+                target.header.type = DISPLAYCONFIG_DEVICE_INFO_GET_TARGET_NAME;
+                target.header.size = sizeof(target);
+                target.header.adapterId = path->sourceInfo.adapterId;
+                target.header.id = path->targetInfo.id;
+                if (DisplayConfigGetDeviceInfo(&target.header) == ERROR_SUCCESS) {
+                    targets.push_back(monitor_target_name{ source.viewGdiDeviceName, target.monitorFriendlyDeviceName });
                 }
             }
         }
-
-        free(modes);
-        free(paths);
     }
 
-    return found;
+    return targets;
 }
 
-static void GetMonitorName(HMONITOR handle, char* name, size_t count)
+static void GetMonitorName(HMONITOR handle, const vector<monitor_target_name>& targets, char* name, size_t count)
 {
     MONITORINFOEXW mi;
-    DISPLAYCONFIG_TARGET_DEVICE_NAME target;
-
     mi.cbSize = sizeof(mi);
-    if (GetMonitorInfoW(handle, (LPMONITORINFO)&mi) && GetMonitorTarget(mi.szDevice, &target)) {
-        snprintf(name, count, "%ls", target.monitorFriendlyDeviceName);
-    }
-    else {
-        strcpy_s(name, count, "[OBS: Unknown]");
+    if (GetMonitorInfoW(handle, (LPMONITORINFO)&mi)) {
+        for (auto& target : targets) {
+            if (target.gdiDeviceName == mi.szDevice) {
+                snprintf(name, count, "%ls", target.friendlyName.c_str());
+                return;
+            }
+        }
     }
+
+    strcpy_s(name, count, "[OBS: Unknown]");
 }
 
+struct enum_monitor_context
+{
+    vector<screen_info>& infos;
+    const vector<monitor_target_name>& targets;
+};
+
 BOOL __cdecl EnumMonitorCallback(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData)
 {
-    std::vector<screen_info>& infos = *((std::vector<screen_info>*)dwData);
+    auto& ctx = *((enum_monitor_context*)dwData);
+    std::vector<screen_info>& infos = ctx.infos;
 
     MONITORINFOEXA mon_info{};
     mon_info.cbSize = sizeof(MONITORINFOEXA);
@@ -69,7 +91,7 @@ BOOL __cdecl EnumMonitorCallback(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcM
     EnumDisplayDevicesA(mon_info.szDevice, 0, &device, EDD_GET_DEVICE_INTERFACE_NAME);
 
     char monitor_name[64];
-    GetMonitorName(hMonitor, monitor_name, sizeof(monitor_name));
+    GetMonitorName(hMonitor, ctx.targets, monitor_name, sizeof(monitor_name));
 
     infos.emplace_back(
         mon_info.rcMonitor.left,
@@ -84,12 +106,69 @@ BOOL __cdecl EnumMonitorCallback(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcM
     return TRUE;
 }
 
+struct win32_display_topology_provider : display_topology_provider
+{
+    vector<screen_info> enumerate() override
+    {
+        std::vector<screen_info> screens{};
+        auto targets = GetMonitorTargets();
+        enum_monitor_context ctx{ screens, targets };
+        EnumDisplayMonitors(NULL, NULL, EnumMonitorCallback, (LPARAM)&ctx);
+        return screens;
+    }
+};
+
+static display_topology* topology = nullptr;
+static once_flag topologyOnce;
+
+static LRESULT CALLBACK topology_window_proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    switch (msg) {
+    case WM_DISPLAYCHANGE:
+    case WM_DPICHANGED:
+    case WM_SETTINGCHANGE:
+        topology->invalidate();
+        break;
+    }
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
+}
+
+static unsigned int __stdcall thread_topology_watch(void* lpParam)
+{
+    // display change notifications are only broadcast to top-level windows, so this can't be a message-only window
+    WNDCLASSW wc{};
+    wc.lpfnWndProc = topology_window_proc;
+    wc.hInstance = GetModuleHandleW(NULL);
+    wc.lpszClassName = L"obs_express_topology_watcher";
+    RegisterClassW(&wc);
+
+    HWND hwnd = CreateWindowExW(0, wc.lpszClassName, L"", WS_POPUP, 0, 0, 0, 0, NULL, NULL, wc.hInstance, NULL);
+    if (!hwnd) {
+        return 1;
+    }
+
+    MSG msg;
+    while (GetMessageW(&msg, NULL, 0, 0) > 0) {
+        TranslateMessage(&msg);
+        DispatchMessageW(&msg);
+    }
+
+    DestroyWindow(hwnd);
+    return 0;
+}
+
+display_topology& get_display_topology()
+{
+    call_once(topologyOnce, []() {
+        topology = new display_topology(make_unique<win32_display_topology_provider>());
+        CloseHandle((HANDLE)_beginthreadex(NULL, 0, thread_topology_watch, nullptr, 0, nullptr));
+    });
+    return *topology;
+}
+
 vector<screen_info> get_screen_info()
 {
-    std::vector<screen_info> screens{};
-    HDC hdc = GetDC(NULL);
-    EnumDisplayMonitors(hdc, NULL, EnumMonitorCallback, (LPARAM)&screens);
-    return screens;
+    return get_display_topology().screens();
 }
 
 mouse_info get_mouse_info()
@@ -104,10 +183,11 @@ mouse_info get_mouse_info()
     bool pressed = leftkeydown || rightkeydown;
 
     // get dpi of monitor mouse is located on
-    HMONITOR hMon = MonitorFromPoint(p, MONITOR_DEFAULTTONEAREST);
-    UINT dpiX, dpiY;
-    GetDpiForMonitor(hMon, MDT_DEFAULT, &dpiX, &dpiY);
-
-    mouse_info info{ x, y, pressed, dpiX };
+    mouse_info info{ x, y, pressed, get_dpi_for_point(x, y) };
     return info;
+}
+
+uint32_t get_dpi_for_point(int32_t x, int32_t y)
+{
+    return get_display_topology().dpi_for_point(x, y);
 }
\ No newline at end of file
@@ -1,15 +1,18 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <cstdio>
 
 struct screen_info
 {
-    screen_info(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t dpi, char id[128], char name[64], char friendly_name[64])
+    screen_info(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t dpi, const char* id, const char* name, const char* friendly_name)
         : x(x), y(y), width(width), height(height), dpi(dpi), monitor_id(""), monitor_device_name(""), monitor_friendly_name("")
     {
-        strcpy_s(monitor_id, _countof(monitor_id), id);
-        strcpy_s(monitor_device_name, _countof(monitor_device_name), name);
-        strcpy_s(monitor_friendly_name, _countof(monitor_friendly_name), friendly_name);
+        // snprintf instead of strcpy_s so this header has no windows dependency and can be used by fake topologies
+        snprintf(monitor_id, sizeof(monitor_id), "%s", id);
+        snprintf(monitor_device_name, sizeof(monitor_device_name), "%s", name);
+        snprintf(monitor_friendly_name, sizeof(monitor_friendly_name), "%s", friendly_name);
     }
     int32_t x;
     int32_t y;
@@ -29,6 +32,13 @@ struct mouse_info
     uint32_t dpi;
 };
 
+class display_topology;
+
+// cached monitor layout, re-enumerated only when windows reports a display change
+display_topology& get_display_topology();
+
 std::vector<screen_info> get_screen_info();
 
-mouse_info get_mouse_info();
\ No newline at end of file
+mouse_info get_mouse_info();
+
+uint32_t get_dpi_for_point(int32_t x, int32_t y);
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "input.h"
+#include "util.h"
+
+#include <atomic>
+#include <vector>
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+
+#include "windows.h"
+#include "process.h"
+
+#include "obs-studio/libobs/util/platform.h"
+
+using namespace std;
+
+struct input_collector
+{
+    input_event_queue queue;
+    atomic<uint64_t> dropped{ 0 };
+    HANDLE thread = nullptr;
+    HANDLE stopEvent = nullptr;
+    unsigned int threadId = 0;
+    bool hookInstalled = false;
+    vector<input_event> replay;
+};
+
+static void input_collector_push(input_collector* collector, const input_event& ev)
+{
+    if (!collector->queue.push(ev)) {
+        collector->dropped.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+// low-level hooks have no user data pointer, only one hook collector can be running
+static input_collector* hookCollector = nullptr;
+
+static LRESULT CALLBACK input_hook_proc(int nCode, WPARAM wParam, LPARAM lParam)
+{
+    if (nCode == HC_ACTION && hookCollector) {
+        auto info = (MSLLHOOKSTRUCT*)lParam;
+        input_event ev{ os_gettime_ns(), info->pt.x, info->pt.y, INPUT_EVENT_MOVE };
+        bool known = true;
+
+        switch (wParam) {
+        case WM_MOUSEMOVE:
+            ev.type = INPUT_EVENT_MOVE;
+            break;
+        case WM_LBUTTONDOWN:
+        case WM_RBUTTONDOWN:
+            ev.type = INPUT_EVENT_DOWN;
+            break;
+        case WM_LBUTTONUP:
+        case WM_RBUTTONUP:
+            ev.type = INPUT_EVENT_UP;
+            break;
+        default:
+            known = false;
+            break;
+        }
+
+        if (known) {
+            input_collector_push(hookCollector, ev);
+        }
+    }
+
+    return CallNextHookEx(NULL, nCode, wParam, lParam);
+}
+
+static unsigned int __stdcall thread_input_hook(void* lpParam)
+{
+    auto collector = (input_collector*)lpParam;
+
+    // make sure this thread has a message queue before anyone can post WM_QUIT to it
+    MSG msg;
+    PeekMessageW(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+
+    // hook callbacks are dispatched on this thread while it is pumping messages
+    HHOOK hook = SetWindowsHookExW(WH_MOUSE_LL, input_hook_proc, GetModuleHandleW(NULL), 0);
+    collector->hookInstalled = hook != NULL;
+    SetEvent(collector->stopEvent);
+    if (!hook) {
+        return 1;
+    }
+
+    while (GetMessageW(&msg, NULL, 0, 0) > 0) {
+        TranslateMessage(&msg);
+        DispatchMessageW(&msg);
+    }
+
+    UnhookWindowsHookEx(hook);
+    return 0;
+}
+
+static unsigned int __stdcall thread_input_replay(void* lpParam)
+{
+    auto collector = (input_collector*)lpParam;
+    uint64_t baseNs = os_gettime_ns();
+
+    for (auto ev : collector->replay) {
+        ev.timeNs += baseNs;
+        uint64_t now = os_gettime_ns();
+        if (ev.timeNs > now) {
+            DWORD waitMs = (DWORD)((ev.timeNs - now) / 1000000);
+            if (WaitForSingleObject(collector->stopEvent, waitMs) == WAIT_OBJECT_0) {
+                break;
+            }
+        }
+        input_collector_push(collector, ev);
+    }
+
+    return 0;
+}
+
+input_collector* input_collector_create_hook()
+{
+    if (hookCollector) {
+        throw std::runtime_error("Only one mouse hook input collector can be active");
+    }
+
+    auto collector = new input_collector();
+    hookCollector = collector;
+
+    // stopEvent doubles as the 'hook installed' signal for the hook thread, which is stopped with WM_QUIT
+    collector->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    collector->thread = (HANDLE)_beginthreadex(NULL, 0, thread_input_hook, collector, 0, &collector->threadId);
+    WaitForSingleObject(collector->stopEvent, INFINITE);
+
+    if (!collector->hookInstalled) {
+        input_collector_destroy(collector);
+        throw std::runtime_error("Unable to install low-level mouse hook");
+    }
+
+    return collector;
+}
+
+input_collector* input_collector_create_replay(const string& filePath)
+{
+    ifstream file(filePath);
+    if (!file.is_open()) {
+        throw std::invalid_argument("Unable to open input replay file: " + filePath);
+    }
+
+    auto collector = new input_collector();
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        stringstream ss(line);
+        uint64_t timeMs;
+        string type;
+        input_event ev{};
+        if (!(ss >> timeMs >> type >> ev.x >> ev.y)) {
+            delete collector;
+            throw std::invalid_argument("Invalid input replay event on line " + to_string(lineNumber) + ": " + line);
+        }
+
+        if (type == "move") ev.type = INPUT_EVENT_MOVE;
+        else if (type == "down") ev.type = INPUT_EVENT_DOWN;
+        else if (type == "up") ev.type = INPUT_EVENT_UP;
+        else {
+            delete collector;
+            throw std::invalid_argument("Unknown input replay event type on line " + to_string(lineNumber) + ": " + type);
+        }
+
+        ev.timeNs = timeMs * 1000000;
+        collector->replay.push_back(ev);
+    }
+
+    collector->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    collector->thread = (HANDLE)_beginthreadex(NULL, 0, thread_input_replay, collector, 0, &collector->threadId);
+    return collector;
+}
+
+void input_collector_destroy(input_collector* collector)
+{
+    if (collector == nullptr) {
+        return;
+    }
+
+    if (collector->thread) {
+        if (collector == hookCollector) {
+            PostThreadMessageW(collector->threadId, WM_QUIT, 0, 0);
+        }
+        else {
+            SetEvent(collector->stopEvent);
+        }
+        WaitForSingleObject(collector->thread, INFINITE);
+        CloseHandle(collector->thread);
+    }
+
+    if (collector->stopEvent) {
+        CloseHandle(collector->stopEvent);
+    }
+
+    if (collector == hookCollector) {
+        hookCollector = nullptr;
+    }
+
+    delete collector;
+}
+
+bool input_collector_pop(input_collector* collector, input_event& ev)
+{
+    return collector->queue.pop(ev);
+}
+
+uint64_t input_collector_dropped(input_collector* collector)
+{
+    return collector->dropped.load(memory_order_relaxed);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "spsc_queue.h"
+
+enum input_event_type : uint8_t
+{
+    INPUT_EVENT_MOVE,
+    INPUT_EVENT_DOWN,
+    INPUT_EVENT_UP,
+};
+
+struct input_event
+{
+    uint64_t timeNs; // os_gettime_ns() clock
+    int32_t x;       // physical screen coordinates
+    int32_t y;
+    input_event_type type;
+};
+
+typedef spsc_queue<input_event, 1024> input_event_queue;
+
+// collects mouse events on a dedicated thread and pushes them into a queue for a single consumer
+struct input_collector;
+
+// low-level mouse hook backend, sees every click no matter how short
+input_collector* input_collector_create_hook();
+
+// replays a recorded event file, one event per line: "{timeMs} {move|down|up} {x} {y}".
+// timeMs is relative to the first event, the file is replayed in real time from when this is called.
+input_collector* input_collector_create_replay(const std::string& filePath);
+
+void input_collector_destroy(input_collector* collector);
+
+// consumer side, returns false once the queue is drained
+bool input_collector_pop(input_collector* collector, input_event& ev);
+
+// number of events lost because the consumer was not draining the queue fast enough
+uint64_t input_collector_dropped(input_collector* collector);
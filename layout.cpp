@@ -0,0 +1,38 @@
+#include "layout.h"
+
+#include <algorithm>
+
+using namespace std;
+
+vector<capture_placement> layout_capture_region(const vector<screen_info>& screens, const capture_region& region)
+{
+    vector<capture_placement> placements{};
+    int32_t regionRight = region.x + region.width;
+    int32_t regionBottom = region.y + region.height;
+
+    for (size_t i = 0; i < screens.size(); i++) {
+        auto& screen = screens[i];
+        int32_t screenRight = screen.x + screen.width;
+        int32_t screenBottom = screen.y + screen.height;
+
+        int32_t left = max(screen.x, region.x);
+        int32_t top = max(screen.y, region.y);
+        int32_t right = min(screenRight, regionRight);
+        int32_t bottom = min(screenBottom, regionBottom);
+        if (right <= left || bottom <= top) {
+            continue;
+        }
+
+        capture_placement p{};
+        p.screen = i;
+        p.x = left - region.x;
+        p.y = top - region.y;
+        p.cropLeft = left - screen.x;
+        p.cropTop = top - screen.y;
+        p.cropRight = screenRight - right;
+        p.cropBottom = screenBottom - bottom;
+        placements.push_back(p);
+    }
+
+    return placements;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "getscreens.h"
+
+// where a monitor capture source goes in the canvas, and how much of it is cropped away so that
+// only the pixels inside the capture region are drawn
+struct capture_placement
+{
+    size_t screen;  // index into the screens passed to layout_capture_region
+    int32_t x;      // position of the cropped source in the canvas
+    int32_t y;
+    int32_t cropLeft;
+    int32_t cropTop;
+    int32_t cropRight;
+    int32_t cropBottom;
+};
+
+struct capture_region
+{
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+// computes a placement for every screen that intersects the region. screen and region coordinates are
+// physical desktop pixels (we are per-monitor dpi aware), which is also the size of each monitor_capture
+// texture, so mixed-dpi layouts need no scaling.
+std::vector<capture_placement> layout_capture_region(const std::vector<screen_info>& screens, const capture_region& region);
@@ -4,6 +4,11 @@
 #include <iterator>
 #include <unordered_set>
 #include <regex>
+#include <algorithm>
+#include <mutex>
+#include <deque>
+#include <map>
+#include <atomic>
 
 #include "windows.h"
 #include "gdiplus.h"
@@ -15,8 +20,31 @@
 #include "getscreens.h"
 #include "util.h"
 #include "encoder.h"
+#include "tracker.h"
+#include "input.h"
+#include "layout.h"
+#include "canvas.h"
+#include "control.h"
+#include "controlpipe.h"
+#include "telemetry.h"
+#include "events.h"
+#include "calibrate.h"
+#include "capcache.h"
+#include "modules.h"
+#include "armed.h"
+#include "profiles.h"
+#include "adaptive.h"
+#include "vfr.h"
+#include "mux.h"
+#include "muxoutput.h"
+#include "replaymeter.h"
+#include "fmp4.h"
+#include "framediff.h"
+#include "topology.h"
 #include "json.hpp"
 #include "obs-studio/libobs/obs.h"
+#include "obs-studio/libobs/util/platform.h"
+#include "obs-studio/libobs/util/base.h"
 
 #pragma comment(lib, "user32.lib") 
 #pragma comment(lib, "dwmapi.lib")
@@ -31,73 +59,153 @@ using json = nlohmann::json;
 // general state
 HANDLE startHandle;
 HANDLE cancelHandle;
+HANDLE stoppedHandle;
+HANDLE jobHandle;
 bool cancelRequested = false;
+bool quitRequested = false;
+bool daemonMode = false;
 obs_output_t* muxer;
+// held while the muxer and audio devices are swapped between daemon jobs, and by other threads using them
+std::mutex outputLock;
 uint64_t startTimeMs = 0;
+uint64_t startCommandNs = 0;
 Rect captureRegion;
 
-// for audio device muting/unmuting
-vector<obs_source_t*> spkDevices{};
-vector<obs_source_t*> micDevices{};
-
-// for mouse animation
-obs_source_t* mouseFilter = 0;
-obs_sceneitem_t* mouseSceneItem = 0;
-uint64_t lastMouseClick;
-mouse_info lastMouseClickPosition;
-bool mouseVisible;
-
-void update_mouse_tracker_state(float x, float y, float opacity, float scale)
+// for replay buffer mode
+uint32_t replayBufferSeconds = 0;
+uint32_t replayBufferMaxMb = 0;
+string replayBufferStem;
+uint32_t replayBufferSaveCount = 0;
+obs_output_t* replayMeter = nullptr;    // follows what the replay buffer holds, under outputLock
+
+// for segmented recording
+uint32_t segmentSeconds = 0;
+uint64_t segmentBytes = 0;
+uint32_t segmentIndex = 0;
+string segmentDirectory, segmentStem, segmentExtension, segmentPath;
+// obs-ffmpeg-mux may still be finishing a segment when file_changed names the next one, so the segments it has
+// switched away from wait here until the segment thread sees they are closed
+struct closing_segment
 {
-    if (mouseFilter == nullptr || mouseSceneItem == nullptr) {
-        return;
-    }
-
-    vec2 pos{ x - captureRegion.X , y - captureRegion.Y };
-    obs_sceneitem_set_pos(mouseSceneItem, &pos);
-    vec2 vscale{ scale, scale };
-    obs_sceneitem_set_scale(mouseSceneItem, &vscale);
+    uint32_t index;
+    string path;
+};
+std::mutex segmentLock;
+deque<closing_segment> segmentsClosing;
+HANDLE segmentsHandle;
+uint16_t videoFps = 30;
+
+// for variable frame rate recording
+bool vfrMode = false;
+
+// for --fragmentMs with --faststart, the fragments are given a regular index once each file is finished
+bool finalizeFragments = false;
+
+// for --output - and pipe:{name}, how long writes waited on the reader at the previous status sample
+bool streamOutput = false;
+uint64_t lastStreamBlockedNs = 0;
+
+// for the free space watch, the directory being recorded to and the disk_warning level already written
+string outputDirectory;
+uint32_t diskWarningSeconds = 600;
+uint32_t diskWarningLevel = 0;
+bool diskWriterStats = false;   // the main output is a file written through a disk_writer, which has write latency
+
+// for the packets the in process muxer holds while its writes stall, what was reported at the previous status sample
+bool bufferStats = false;
+uint64_t bufferBudgetBytes = 0;
+string bufferPolicy;
+uint64_t lastBufferDrainedBytes = 0;
+uint32_t lastBufferFullCount = 0;
+
+// for --cpuBudget, stepped by the status thread while recording
+struct adaptive_runtime
+{
+    bool enabled = false;
+    adaptive_config config{};
+    adaptive_state state{};
+    obs_encoder_t* encoder = nullptr;  // owned by the pipeline
+    vector<json> levels{};             // encoder settings for each speed level, the job's own profile first
+    uint32_t lastDroppedFrames = 0;    // skipped and lagged frames at the previous status sample
+};
+adaptive_runtime adaptive{};
 
-    auto opt_opacity = obs_data_create();
-    obs_data_set_int(opt_opacity, "opacity", (int32_t)opacity);
-    obs_source_update(mouseFilter, opt_opacity);
-    obs_data_release(opt_opacity);
+// for --rendition, extra encodes of the same render which are written to their own files
+struct rendition_output
+{
+    string path;
+    uint32_t width, height;
+    obs_encoder_t* encoder;
+    obs_output_t* output;
+    uint64_t lastFrames;    // totals at the previous status sample
+    uint64_t lastBytes;
 };
+vector<rendition_output> renditions{};
 
-void tick_obs_frame_processing(void* priv, float seconds)
+// renditions created for a job which has not handed them over to renditions yet. if the job fails before it
+// does, they are released with it.
+struct pending_renditions
 {
-    auto time = util_obs_get_time_ms();
-    auto mouseData = get_mouse_info();
-    const float duration = 400;
+    vector<rendition_output> list{};
 
-    if (mouseData.pressed) {
-        lastMouseClickPosition = mouseData;
-        lastMouseClick = time;
+    ~pending_renditions()
+    {
+        for (auto& rendition : list) {
+            if (rendition.output)
+                obs_output_release(rendition.output);
+            obs_encoder_release(rendition.encoder);
+        }
     }
+};
+std::atomic<uint32_t> renditionsRunning{ 0 };
+HANDLE renditionsStoppedHandle;
 
-    uint64_t lastClickAgo = time - lastMouseClick;
-    if (lastClickAgo < duration) {
-        mouseVisible = true;
-        // max 85% opacity
-        float opacity = (float)((1 - (lastClickAgo / duration)) * 85);
-        float mouseZoom = (float)lastMouseClickPosition.dpi / 96;
-
-        // radius: min 15, will grow +35 to max of 50 (*dpi)
-        float radius = (10 + ((lastClickAgo / duration) * 30)) * mouseZoom;
-
-        // scale: intendedRenderedSize/actualImageSize - the tracker.png is 100x100
-        float scale = radius / 50;
+// for status events
+uint32_t statusIntervalMs = 1000;
 
-        auto x = lastMouseClickPosition.x - radius;
-        auto y = lastMouseClickPosition.y - radius;
+// for audio device muting/unmuting
+vector<obs_source_t*> spkDevices{};
+vector<obs_source_t*> micDevices{};
 
-        update_mouse_tracker_state(x, y, opacity, scale);
-        //cout << "mouse visible: " << opacity << std::endl;
+void print_canvas_plan(const canvas_plan& canvas)
+{
+    double dnsclperc = round((1 - (((double)canvas.outputWidth * canvas.outputHeight) / ((double)captureRegion.Width * captureRegion.Height))) * 100);
+    if (canvas.alignScaled) {
+        events_write("Scaling from " + to_string(captureRegion.Width) + "x" + to_string(captureRegion.Height) + " to " + to_string(canvas.outputWidth) + "x" + to_string(canvas.outputHeight)
+            + " for the encoder's " + to_string(canvas.alignment) + " pixel alignment (" + canvas_scaler_name(canvas.scaler) + ")");
+    }
+    else if (dnsclperc > 0) {
+        events_write("Downscaling from " + to_string(captureRegion.Width) + "x" + to_string(captureRegion.Height) + " to " + to_string(canvas.outputWidth) + "x" + to_string(canvas.outputHeight)
+            + " (-" + to_string((int)dnsclperc) + "%, " + canvas_scaler_name(canvas.scaler) + ")");
     }
-    else if (mouseVisible) {
-        mouseVisible = false;
-        update_mouse_tracker_state(0, 0, 0, 1);
-        //cout << "mouse removed..." << std::endl;
+    else if (canvas.baseWidth != (uint32_t)captureRegion.Width || canvas.baseHeight != (uint32_t)captureRegion.Height) {
+        events_write("Padding canvas from " + to_string(captureRegion.Width) + "x" + to_string(captureRegion.Height) + " to " + to_string(canvas.baseWidth) + "x" + to_string(canvas.baseHeight) + " for even dimensions");
+    }
+}
+
+void apply_canvas_plan(obs_video_info& vvi, const canvas_plan& canvas)
+{
+    vvi.base_width = canvas.baseWidth;
+    vvi.base_height = canvas.baseHeight;
+    vvi.output_width = canvas.outputWidth;
+    vvi.output_height = canvas.outputHeight;
+
+    switch (canvas.scaler) {
+    case CANVAS_SCALE_POINT:
+        vvi.scale_type = obs_scale_type::OBS_SCALE_POINT;
+        break;
+    case CANVAS_SCALE_BILINEAR:
+        vvi.scale_type = obs_scale_type::OBS_SCALE_BILINEAR;
+        break;
+    case CANVAS_SCALE_AREA:
+        vvi.scale_type = obs_scale_type::OBS_SCALE_AREA;
+        break;
+    case CANVAS_SCALE_LANCZOS:
+        vvi.scale_type = obs_scale_type::OBS_SCALE_LANCZOS;
+        break;
+    default:
+        vvi.scale_type = obs_scale_type::OBS_SCALE_BICUBIC;
+        break;
     }
 }
 
@@ -108,320 +216,1038 @@ void tick_draw_preview_callback(void* displayPtr, uint32_t cx, uint32_t cy)
 
 BOOL WINAPI handle_console_ctrl_event(DWORD fdwCtrlType)
 {
-    cout << "Received exit signal." << std::endl;
+    events_write("Received exit signal.");
     cancelRequested = true;
+    quitRequested = true;
+    SetEvent(jobHandle);
     SetEvent(cancelHandle);
     SetEvent(startHandle);
     return TRUE; // indicate we have handled the signal and no further processing should happen
 }
 
+// json start, pause and stop requests waiting for the output to signal that they took effect
+std::mutex ticketLock;
+vector<control_ticket> pendingTickets{};
+
+void control_ticket_add(const control_ticket& ticket)
+{
+    if (ticket.json) {
+        lock_guard<mutex> guard(ticketLock);
+        pendingTickets.push_back(ticket);
+    }
+}
+
+// called from the output signals, sends each waiting request for this command its latency
+void control_tickets_applied(control_command command)
+{
+    uint64_t nowNs = control_now_ns();
+    vector<control_ticket> applied;
+    {
+        lock_guard<mutex> guard(ticketLock);
+        auto it = std::stable_partition(pendingTickets.begin(), pendingTickets.end(), [command](const control_ticket& ticket) { return ticket.command != command; });
+        applied.assign(it, pendingTickets.end());
+        pendingTickets.erase(it, pendingTickets.end());
+    }
+    for (auto& ticket : applied) {
+        ticket.reply(control_applied_line(ticket, nowNs));
+    }
+}
+
+// the job has ended, nothing which is still waiting will take effect
+void control_tickets_abandon()
+{
+    uint64_t nowNs = control_now_ns();
+    vector<control_ticket> abandoned;
+    {
+        lock_guard<mutex> guard(ticketLock);
+        abandoned.swap(pendingTickets);
+    }
+    for (auto& ticket : abandoned) {
+        ticket.reply(control_applied_line(ticket, nowNs, "The recording ended before the command took effect."));
+    }
+}
+
 void handle_signal_all(void* data, calldata_t* cd)
 {
     auto signal_name = std::string((char*)data);
     json rec_start;
     rec_start["signal"] = signal_name;
     rec_start["type"] = "signal";
-    cout << rec_start << std::endl;
+    events_write(rec_start.dump());
+
+    if (signal_name == "pause") {
+        control_tickets_applied(CONTROL_PAUSE);
+    }
+    else if (signal_name == "unpause") {
+        control_tickets_applied(CONTROL_START);
+    }
 }
 
 void handle_signal_started_recording(void* data, calldata_t* cd)
 {
+    telemetry_output_started(muxer);
     startTimeMs = util_obs_get_time_ms();
     json rec_start;
     rec_start["type"] = "started_recording";
-    cout << rec_start << std::endl;
+    events_write(rec_start.dump());
+    control_tickets_applied(CONTROL_START);
 }
 
-void handle_signal_stopped_recording(void* data, calldata_t* cd)
+void handle_signal_armed(void* data, calldata_t* cd)
 {
-    obs_output_t* output = (obs_output_t*)calldata_ptr(cd, "output");
-    uint32_t code = (uint32_t)calldata_int(cd, "code");
-    const char* output_error = obs_output_get_last_error(output);
-
-    json rec_stop;
-    rec_stop["type"] = "stopped_recording";
-    rec_stop["code"] = code;
-    rec_stop["message"] = get_obs_output_errorcode_string(code);
-    if (output_error != nullptr) {
-        rec_stop["error"] = output_error;
-    }
-
-    cout << rec_stop << std::endl;
+    json armed;
+    armed["type"] = "armed";
+    events_write(armed.dump());
+}
 
-    cout << "Exiting process" << std::endl;
+void handle_signal_armed_recording(void* data, calldata_t* cd)
+{
+    telemetry_output_started(muxer);
+    startTimeMs = util_obs_get_time_ms();
+    json rec_start;
+    rec_start["type"] = "started_recording";
+    rec_start["commandToFirstFrameMs"] = calldata_int(cd, "latency_us") / 1000.0;
+    rec_start["prerollMs"] = calldata_int(cd, "preroll_us") / 1000.0;
+    rec_start["trimmedFrames"] = calldata_int(cd, "trimmed_frames");
+    events_write(rec_start.dump());
+    control_tickets_applied(CONTROL_START);
+}
 
-    // obs_shutdown() actually crashes, probably because we're not cleaning up all the resources beforehand.
-    // I don't really care to do this properly as this is a one-off recorder and the OS will clean up
-    ExitProcess(code);
+void handle_signal_replay_saved(void* data, calldata_t* cd)
+{
+    calldata_t out{};
+    proc_handler_call(obs_output_get_proc_handler(muxer), "get_last_replay", &out);
+    const char* path = calldata_string(&out, "path");
+
+    json saved;
+    saved["type"] = "replay_saved";
+    saved["path"] = path ? path : "";
+    calldata_free(&out);
+    events_write(saved.dump());
 }
 
-unsigned int __stdcall thread_read_input(void* lpParam)
+string get_segment_path(uint32_t index)
 {
-    while (!cancelRequested) {
-        std::string str;
-        std::getline(std::cin, str);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%03u", index);
+    return segmentDirectory + "/" + segmentStem + suffix + "." + segmentExtension;
+}
 
-        // tolower the command
-        std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return std::tolower(c); });
+void set_next_segment_format(uint32_t index)
+{
+    // ffmpeg_muxer reads the file name format from its settings each time it splits
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%03u", index);
+    obs_data_t* settings = obs_output_get_settings(muxer);
+    obs_data_set_string(settings, "format", (segmentStem + suffix).c_str());
+    obs_data_release(settings);
+}
 
-        auto words = util_string_split(str, ' ');
+void write_segment_complete(uint32_t index, const string& path)
+{
+    // the duration is read back from the finished file, so it is what a player sees rather than a frame count
+    json segment;
+    segment["type"] = "segment_complete";
+    segment["index"] = index;
+    segment["path"] = path;
+    segment["durationMs"] = mux_file_duration_ms(path);
+    segment["bytes"] = os_get_file_size(path.c_str());
+    events_write(segment.dump());
+}
 
-        if (str == "q" || str == "quit" || str == "exit" || str == "stop") {
-            cout << "Quit/stop command received." << std::endl;
-            cancelRequested = true;
-            SetEvent(cancelHandle);
-            SetEvent(startHandle);
-        }
+void segment_closing(uint32_t index, const string& path)
+{
+    lock_guard<mutex> guard(segmentLock);
+    segmentsClosing.push_back({ index, path });
+    SetEvent(segmentsHandle);
+}
 
-        else if (str == "start") {
-            cout << "Start command received." << std::endl;
-            if (obs_output_paused(muxer)) {
-                obs_output_pause(muxer, false);
-            }
-            else {
-                // first start
-                SetEvent(startHandle);
+// waits until the segment thread has reported every segment handed to it, or the timeout
+void segments_flush(uint32_t timeoutMs)
+{
+    for (uint32_t waited = 0; waited < timeoutMs; waited += 10) {
+        {
+            lock_guard<mutex> guard(segmentLock);
+            if (segmentsClosing.empty()) {
+                return;
             }
         }
+        Sleep(10);
+    }
+}
 
-        else if (str == "pause") {
-            cout << "Pause command received." << std::endl;
-            obs_output_pause(muxer, true);
+unsigned int __stdcall thread_segments_closing(void* lpParam)
+{
+    // probing the finished file takes a while, so it is done here rather than on the output's signal thread
+    while (true) {
+        bool waiting;
+        {
+            lock_guard<mutex> guard(segmentLock);
+            waiting = !segmentsClosing.empty();
         }
-
-        else if (words.size() == 3 && (words[0] == "mute" || words[0] == "unmute")) {
-            bool isMuted = words[0] == "mute";
-            if (words[1] == "s") {
-                auto idx = stoi(words[2]);
-                if (idx < spkDevices.size()) {
-                    obs_source_set_muted(spkDevices[idx], isMuted);
-                    cout << "Audio speaker device " << idx << ": " << words[0] << "d." << std::endl;
-                }
-                else {
-                    cout << "Audio speaker device " << idx << " out of range." << std::endl;
+        WaitForSingleObject(segmentsHandle, waiting ? 50 : INFINITE);
+
+        while (true) {
+            closing_segment segment;
+            {
+                lock_guard<mutex> guard(segmentLock);
+                if (segmentsClosing.empty()) {
+                    break;
                 }
+                segment = segmentsClosing.front();
             }
-            else if (words[1] == "m") {
-                auto idx = stoi(words[2]);
-                if (idx < micDevices.size()) {
-                    obs_source_set_muted(micDevices[idx], isMuted);
-                    cout << "Audio microphone device " << idx << ": " << words[0] << "d." << std::endl;
-                }
-                else {
-                    cout << "Audio microphone device " << idx << " out of range." << std::endl;
-                }
-            }
-            else {
-                cout << "Unknown audio device type: " << words[1] << std::endl;
-                continue;
+            // segments close in the order they were written
+            if (!util_file_closed(segment.path)) {
+                break;
             }
-        }
+            write_segment_complete(segment.index, segment.path);
 
-        else if (!str.empty()) {
-            cout << "Unknown command or invalid arguments: " << str << std::endl;
+            lock_guard<mutex> guard(segmentLock);
+            segmentsClosing.pop_front();
         }
     }
-
-    cout << "stdin read thread has exited." << std::endl;
     return 0;
 }
 
-unsigned int __stdcall thread_output_realtime_status(void* lpParam)
+void handle_signal_file_changed(void* data, calldata_t* cd)
 {
-    while (!cancelRequested) {
-        Sleep(1000);
+    segment_closing(segmentIndex, segmentPath);
+    segmentIndex++;
+    segmentPath = calldata_string(cd, "next_file");
+    set_next_segment_format(segmentIndex + 1);
+}
 
-        if (startTimeMs == 0 || obs_output_paused(muxer)) {
-            continue;
+void finalize_fragments(obs_output_t* output, json& event)
+{
+    obs_data_t* settings = obs_output_get_settings(output);
+    string path = obs_data_get_string(settings, "path");
+    obs_data_release(settings);
+
+    uint64_t startNs = os_gettime_ns();
+    auto result = fmp4_finalize(path);
+    json finalize = {
+        { "success", result.success },
+        { "faststart", result.faststart },
+        { "indexBytes", result.indexBytes },
+        { "samples", result.samples },
+        { "fragments", result.fragments },
+        { "ms", (os_gettime_ns() - startNs) / 1000000.0 },
+    };
+    if (!result.success) {
+        finalize["error"] = result.error;
+    }
+    event["finalize"] = finalize;
+}
+
+void handle_signal_rendition_stopped(void* data, calldata_t* cd)
+{
+    obs_output_t* output = (obs_output_t*)calldata_ptr(cd, "output");
+    uint32_t code = (uint32_t)calldata_int(cd, "code");
+    const char* output_error = obs_output_get_last_error(output);
+    obs_data_t* settings = obs_output_get_settings(output);
+
+    json rendition_stop;
+    rendition_stop["type"] = "rendition_stopped";
+    rendition_stop["index"] = (uint32_t)(uintptr_t)data;
+    rendition_stop["path"] = obs_data_get_string(settings, "path");
+    rendition_stop["code"] = code;
+    rendition_stop["message"] = get_obs_output_errorcode_string(code);
+    if (output_error != nullptr) {
+        rendition_stop["error"] = output_error;
+    }
+    obs_data_release(settings);
+    if (finalizeFragments) {
+        finalize_fragments(output, rendition_stop);
+    }
+    events_write(rendition_stop.dump());
+
+    if (--renditionsRunning == 0) {
+        SetEvent(renditionsStoppedHandle);
+    }
+}
+
+void handle_signal_stopped_recording(void* data, calldata_t* cd)
+{
+    obs_output_t* output = (obs_output_t*)calldata_ptr(cd, "output");
+    uint32_t code = (uint32_t)calldata_int(cd, "code");
+    const char* output_error = obs_output_get_last_error(output);
+
+    if (segmentSeconds > 0 || segmentBytes > 0) {
+        // obs-ffmpeg-mux has exited, so the last segments are reported as soon as the segment thread gets to them
+        segment_closing(segmentIndex, segmentPath);
+        segments_flush(5000);
+    }
+
+    json rec_stop;
+    rec_stop["type"] = "stopped_recording";
+    rec_stop["code"] = code;
+    rec_stop["message"] = get_obs_output_errorcode_string(code);
+    if (output_error != nullptr) {
+        rec_stop["error"] = output_error;
+    }
+    if (finalizeFragments) {
+        finalize_fragments(output, rec_stop);
+    }
+
+    events_write(rec_stop.dump());
+    control_tickets_applied(CONTROL_STOP);
+
+    // the renditions end with the main output, whichever way it stopped
+    {
+        lock_guard<mutex> guard(outputLock);
+        for (auto& rendition : renditions) {
+            obs_output_stop(rendition.output);
         }
+        if (replayMeter) {
+            obs_output_stop(replayMeter);
+        }
+    }
 
-        auto currentTimeMs = util_obs_get_time_ms();
+    if (daemonMode) {
+        // the job loop tears the output down and keeps the rest of the pipeline for the next job
+        SetEvent(stoppedHandle);
+        return;
+    }
 
-        double percent = 0;
-        int totalDropped = obs_output_get_frames_dropped(muxer);
-        int totalFrames = obs_output_get_total_frames(muxer);
-        if (totalFrames == 0) { percent = 0.0; }
-        else { percent = (double)totalDropped / (double)totalFrames * 100.0; }
+    if (renditionsRunning > 0) {
+        WaitForSingleObject(renditionsStoppedHandle, 30000);
+    }
 
-        auto frameTime = (double)obs_get_average_frame_time_ns() / 1000000.0;
+    events_write("Exiting process");
+    events_flush(5000);
 
-        json status;
-        status["timeMs"] = currentTimeMs - startTimeMs;
-        status["dropped"] = totalDropped;
-        status["droppedPerc"] = percent;
-        status["fps"] = obs_get_active_fps();
-        status["frameTime"] = frameTime;
-        status["cpu"] = util_obs_get_cpu_utilisation();
-        status["type"] = "status";
-        cout << status << std::endl;
+    // obs_shutdown() actually crashes, probably because we're not cleaning up all the resources beforehand.
+    // I don't really care to do this properly as this is a one-off recorder and the OS will clean up
+    ExitProcess(code);
+}
+
+// --rendition {maxW}x{maxH}:{crf}
+struct rendition_spec
+{
+    uint32_t maxWidth, maxHeight;
+    uint16_t crf;
+};
+
+// everything a single recording needs. a one-shot run records exactly one job from the command line,
+// in daemon mode each record request is parsed into a job from the same options.
+struct recording_job
+{
+    string outputFile;
+    string captureMonitor;
+    Rect region;
+    vector<string> speakers;
+    vector<string> microphones;
+    vector<pair<string, string>> muxerOptions;
+    vector<rendition_spec> renditions;
+    uint16_t fps, crf, maxOutputWidth, maxOutputHeight;
+    double cpuBudget, dropTarget;
+    bool pause, armed, vfr, inProcessMux, faststart, trackerEnabled, hwAccel, noCursor, directIo;
+    uint32_t vfrMaxGapMs, fragmentMs, writeBuffers, preallocateMb, diskWarningMinutes, stallBufferMb;
+    string streamFormat;    // the container for a stream --output, empty for a file
+    string stallPolicy;
+    string encoderMode;
+    video_codec codec;
+    encoder_intent intent;
+    json profiles;
+    Color trackerColor;
+    string trackerReplay;
+    uint32_t replayBufferSeconds, replayBufferMaxMb, segmentSeconds;
+    uint64_t segmentBytes;
+};
+
+// adds to the muxer_settings given with --omux. flags are combined with any given for the same key, other
+// settings given with --omux are left as they are.
+void add_muxer_setting(vector<pair<string, string>>& muxerOptions, const string& key, const string& value)
+{
+    auto existing = std::find_if(muxerOptions.begin(), muxerOptions.end(), [](const pair<string, string>& kvp) { return kvp.first == "muxer_settings"; });
+    if (existing == muxerOptions.end()) {
+        muxerOptions.emplace_back("muxer_settings", "");
+        existing = muxerOptions.end() - 1;
     }
-    return 0;
+    mux_add_setting(existing->second, key, value);
 }
 
-void run(vector<string> arguments)
+argh::parser parse_arguments(const vector<string>& arguments)
 {
-    // handle command line arguments
     argh::parser cmdl;
     cmdl.add_params({ "adapter", "region", "speaker", "microphone", "fps", "crf", "maxWidth", "maxHeight",
-        "output", "trackerColor", "preview", "monitor", "omux" });
+        "output", "trackerColor", "trackerReplay", "preview", "monitor", "omux", "replayBuffer", "replayBufferMb",
+        "segmentSeconds", "segmentBytes", "control", "statusInterval", "encoder", "codec", "profile", "profileFile",
+        "cpuBudget", "dropTarget", "vfrMaxGap", "rendition", "muxer", "fragmentMs", "events", "writeBuffers", "preallocateMb",
+        "diskWarning", "stallBufferMb", "stallPolicy" });
     cmdl.parse(arguments);
+    return cmdl;
+}
 
-    cout << std::endl;
-    cout << "obs-express v" << OBS_EXPRESS_VERSION << ", a command line screen recording utility" << std::endl;
-    cout << "  bundled with obs-studio v" << obs_get_version_string() << std::endl;
-    cout << "  created for Clowd (https://github.com/clowd/Clowd)" << std::endl;
-    cout << std::endl;
+recording_job parse_recording_job(argh::parser& cmdl)
+{
+    recording_job job{};
+    job.pause = cmdl["pause"];
+    job.armed = cmdl["armed"];
+    job.vfr = cmdl["vfr"];
+    job.faststart = cmdl["faststart"];
+    job.trackerEnabled = cmdl["tracker"];
+    job.hwAccel = cmdl["hwAccel"];
+    job.noCursor = cmdl["noCursor"];
+    job.directIo = cmdl["directIo"];
+    job.encoderMode = cmdl("encoder").str();
+    job.codec = parse_video_codec(cmdl("codec", "h264").str());
+
+    // only the in process muxer can write a stream, so it is the default for one
+    job.outputFile = cmdl("output").str();
+    bool stream = mux_is_stream(job.outputFile);
+    string muxer = cmdl("muxer", stream ? "inprocess" : "subprocess").str();
+    if (muxer != "subprocess" && muxer != "inprocess")
+        throw std::invalid_argument("Option '--muxer " + muxer + "' invalid. Must be subprocess or inprocess.");
+    job.inProcessMux = muxer == "inprocess";
+
+    // --lowCpuMode predates profiles and is the same as asking for the latency profile
+    job.intent = parse_encoder_intent(cmdl("profile", cmdl["lowCpuMode"] ? "latency" : "balanced").str());
+    job.profiles = profiles_load(cmdl("profileFile").str());
+    if (!job.encoderMode.empty() && job.encoderMode != "auto" && !job.profiles.contains(job.encoderMode))
+        throw std::invalid_argument("No encoder profile for '" + job.encoderMode + "', add one with --profileFile");
+
+    cmdl("fps", 30) >> job.fps;
+    cmdl("crf", 24) >> job.crf;
+    cmdl("maxWidth", 0) >> job.maxOutputWidth;
+    cmdl("maxHeight", 0) >> job.maxOutputHeight;
+    cmdl("replayBuffer", 0) >> job.replayBufferSeconds;
+    cmdl("replayBufferMb", 512) >> job.replayBufferMaxMb;
+    cmdl("segmentSeconds", 0) >> job.segmentSeconds;
+    cmdl("segmentBytes", 0) >> job.segmentBytes;
+    cmdl("cpuBudget", 0.0) >> job.cpuBudget;
+    cmdl("dropTarget", 1.0) >> job.dropTarget;
+    cmdl("vfrMaxGap", 1000) >> job.vfrMaxGapMs;
+    cmdl("fragmentMs", 0) >> job.fragmentMs;
+    cmdl("writeBuffers", 2) >> job.writeBuffers;
+    cmdl("preallocateMb", 256) >> job.preallocateMb;
+    cmdl("diskWarning", 10) >> job.diskWarningMinutes;
+    cmdl("stallBufferMb", 256) >> job.stallBufferMb;
+    job.stallPolicy = cmdl("stallPolicy", "drop").str();
+
+    for (auto& kvp : cmdl.params("speaker"))
+        job.speakers.push_back(kvp.second);
+    for (auto& kvp : cmdl.params("microphone"))
+        job.microphones.push_back(kvp.second);
+
+    std::regex re_rendition("^(\\d+)x(\\d+):(\\d+)$");
+    for (auto& kvp : cmdl.params("rendition")) {
+        std::smatch match;
+        if (!std::regex_match(kvp.second, match, re_rendition) || std::stoul(match[3]) > 51)
+            throw invalid_argument("Option '--" + kvp.first + " " + kvp.second + "' invalid. Must be in the format {maxWidth}x{maxHeight}:{crf} with a crf from 0-51.");
+        job.renditions.push_back({ (uint32_t)std::stoul(match[1]), (uint32_t)std::stoul(match[2]), (uint16_t)std::stoul(match[3]) });
+    }
 
-    bool help = cmdl[{ "h", "help" }];
-    if (help) {
-        cout << "Global: " << std::endl;
-        cout << "  --help                  Show this help text" << std::endl;
-        cout << std::endl << "Required: " << std::endl;
-        cout << "  --output {filePath}     The file for the generated recording" << std::endl;
-        cout << std::endl << "One of: " << std::endl;
-        cout << "  --region {x,y,w,h}      A capture region to spanning multiple monitors" << std::endl;
-        cout << "  --monitor {szDevice}    Only capture the specified monitor" << std::endl;
-        cout << std::endl << "Optional: " << std::endl;
-        cout << "  --adapter {int}         The index of the graphics device to use" << std::endl;
-        cout << "  --speaker {dev_id}      Output device ID to record (can be multiple)" << std::endl;
-        cout << "  --microphone {dev_id}   Input device ID to record (can be multiple)" << std::endl;
-        cout << "  --fps {int}             The target video framerate (default: 30)" << std::endl;
-        cout << "  --crf {int}             Quality from 0-51, lower is better. (default: 24) " << std::endl;
-        cout << "  --maxWidth {int}        Downscale output to a maximum width" << std::endl;
-        cout << "  --maxHeight {int}       Downscale output to a maximum height" << std::endl;
-        cout << "  --tracker               If the mouse click tracker should be rendered" << std::endl;
-        cout << "  --trackerColor {r,g,b}  The color of the tracker (default: 255,0,0)" << std::endl;
-        cout << "  --lowCpuMode            Maximize performance if using CPU encoding" << std::endl;
-        cout << "  --hwAccel               Use hardware encoding if available" << std::endl;
-        cout << "  --noCursor              Do not render mouse cursor in recording" << std::endl;
-        cout << "  --pause                 Pause before recording until start command" << std::endl;
-        cout << "  --preview {hWnd}        Render a recording preview to window handle" << std::endl;
-        cout << "  --omux {name:value}     Add custom muxer/ffmpeg output options" << std::endl;
-        return;
+    for (auto& kvp : cmdl.params("omux")) {
+        auto idx = kvp.second.find_first_of(':', 0);
+        if (idx == string::npos || idx == kvp.second.length() - 1)
+            throw invalid_argument("Option '--" + kvp.first + " " + kvp.second + "' invalid. Must be in the format of a key-value pair separated by the ':' character.");
+        job.muxerOptions.emplace_back(kvp.second.substr(0, idx), kvp.second.substr(idx + 1));
     }
 
-    bool pause = cmdl["pause"];
-    bool trackerEnabled = cmdl["tracker"];
-    bool lowCpuMode = cmdl["lowCpuMode"];
-    bool hwAccel = cmdl["hwAccel"];
-    bool noCursor = cmdl["noCursor"];
+    string tmpCaptureRegion = cmdl("region").str();
+    job.captureMonitor = cmdl("monitor").str();
+    job.trackerColor = util_parse_color(cmdl("trackerColor", "255,0,0").str());
+    job.trackerReplay = cmdl("trackerReplay").str();
 
-    uint16_t adapter, fps, crf, maxOutputWidth, maxOutputHeight;
-    cmdl("adapter", 0) >> adapter;
-    cmdl("fps", 30) >> fps;
-    cmdl("crf", 24) >> crf;
-    cmdl("maxWidth", 0) >> maxOutputWidth;
-    cmdl("maxHeight", 0) >> maxOutputHeight;
+    if (tmpCaptureRegion.empty() == job.captureMonitor.empty())
+        throw std::invalid_argument("Must specify one of parameters: [--region, --monitor] but not both.");
 
-    uint32_t previewWidth, previewHeight;
-    void* previewHwnd = 0;
-    std::string previewStr = cmdl("preview").str();
-    if (!previewStr.empty()) {
-        std::regex re_all_digits("^\\d+$");
-        std::regex re_hexidecimal("^0x[0-9a-zA-Z]+$");
-        if (std::regex_match(previewStr, re_hexidecimal)) {
-            previewHwnd = (void*)std::stoul(previewStr, nullptr, 16);
-        }
-        else if (std::regex_match(previewStr, re_all_digits)) {
-            previewHwnd = (void*)std::stoul(previewStr, nullptr, 10);
-        }
-        else {
-            throw std::invalid_argument("Unknown window handle format, must be decimal or hexidecimal: " + previewStr);
-        }
+    if (job.outputFile.empty())
+        throw std::invalid_argument("Missing required parameter: --output");
 
-        RECT r;
-        if (!GetWindowRect((HWND)previewHwnd, &r))
-            throw std::invalid_argument("Unable to retrieve details for window handle '" + previewStr + "'. Is it a real window? Does this process have permission to access it?");
+    if (job.replayBufferSeconds > 0 && (job.segmentSeconds > 0 || job.segmentBytes > 0))
+        throw std::invalid_argument("--replayBuffer can not be combined with --segmentSeconds or --segmentBytes.");
+
+    if (job.armed && (job.replayBufferSeconds > 0 || job.segmentSeconds > 0 || job.segmentBytes > 0))
+        throw std::invalid_argument("--armed can not be combined with --replayBuffer, --segmentSeconds or --segmentBytes.");
+
+    if (job.vfr && (job.armed || job.replayBufferSeconds > 0 || job.segmentSeconds > 0 || job.segmentBytes > 0))
+        throw std::invalid_argument("--vfr can not be combined with --armed, --replayBuffer, --segmentSeconds or --segmentBytes.");
+
+    if (!job.renditions.empty() && (job.armed || job.vfr || job.replayBufferSeconds > 0 || job.segmentSeconds > 0 || job.segmentBytes > 0))
+        throw std::invalid_argument("--rendition can not be combined with --armed, --vfr, --replayBuffer, --segmentSeconds or --segmentBytes.");
 
-        previewWidth = r.right - r.left;
-        previewHeight = r.bottom - r.top;
+    if (job.inProcessMux && (job.replayBufferSeconds > 0 || job.segmentSeconds > 0 || job.segmentBytes > 0))
+        throw std::invalid_argument("--muxer inprocess can not be combined with --replayBuffer, --segmentSeconds or --segmentBytes.");
+
+    if (stream) {
+        if (!job.inProcessMux)
+            throw std::invalid_argument("--output " + job.outputFile + " needs --muxer inprocess.");
+        if (job.armed || job.vfr || job.faststart || !job.renditions.empty() || job.replayBufferSeconds > 0 || job.segmentSeconds > 0 || job.segmentBytes > 0)
+            throw std::invalid_argument("--output " + job.outputFile + " can not be combined with --armed, --vfr, --faststart, --rendition, --replayBuffer, --segmentSeconds or --segmentBytes.");
+        if (job.outputFile == "-" && daemonMode)
+            throw std::invalid_argument("--output - is only for a single recording, a --daemon job can use pipe:{name}.");
+
+        // a stream is mpegts, or a fragmented mp4 when --fragmentMs says how long each fragment is
+        job.streamFormat = job.fragmentMs > 0 ? "mp4" : "mpegts";
+    }
+    else if (job.fragmentMs > 0 || job.faststart) {
+        string directory, stem, extension;
+        util_split_path(job.outputFile, directory, stem, extension);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension != "mp4" && extension != "mov" && extension != "m4v")
+            throw std::invalid_argument("--fragmentMs and --faststart need an mp4, mov or m4v --output.");
     }
 
-    auto speakers = cmdl.params("speaker");
-    auto microphones = cmdl.params("microphone");
-    auto opt_muxer = cmdl.params("omux");
+    if (job.fragmentMs > 0 && (job.armed || job.vfr || job.replayBufferSeconds > 0 || job.segmentSeconds > 0 || job.segmentBytes > 0))
+        throw std::invalid_argument("--fragmentMs can not be combined with --armed, --vfr, --replayBuffer, --segmentSeconds or --segmentBytes.");
 
-    string tmpCaptureRegion, tmpTrackerColor, outputFile, captureMonitor;
-    tmpCaptureRegion = cmdl("region").str();
-    captureMonitor = cmdl("monitor").str();
-    tmpTrackerColor = cmdl("trackerColor", "255,0,0").str();
-    outputFile = cmdl("output").str();
+    // the block writer is part of the in process muxer, which --armed and --vfr always use
+    bool writerOptions = job.directIo || !cmdl("writeBuffers").str().empty() || !cmdl("preallocateMb").str().empty();
+    if (writerOptions && (stream || !(job.inProcessMux || job.armed || job.vfr)))
+        throw std::invalid_argument("--writeBuffers, --directIo and --preallocateMb need a file written with --muxer inprocess, --armed or --vfr.");
 
-    if (tmpCaptureRegion.empty() == captureMonitor.empty())
-        throw std::invalid_argument("Must specify one of parameters: [--region, --monitor] but not both.");
+    if (job.writeBuffers > DISK_WRITER_MAX_BLOCKS)
+        throw std::invalid_argument("--writeBuffers must be from 0 to " + to_string(DISK_WRITER_MAX_BLOCKS) + ".");
 
-    if (outputFile.empty())
-        throw std::invalid_argument("Missing required parameter: --output");
+    // --armed and --vfr hold packets of their own, only MUX_OUTPUT_ID puts a budget on them
+    bool stallOptions = !cmdl("stallBufferMb").str().empty() || !cmdl("stallPolicy").str().empty();
+    if (stallOptions && (!job.inProcessMux || job.armed || job.vfr))
+        throw std::invalid_argument("--stallBufferMb and --stallPolicy need --muxer inprocess, without --armed or --vfr.");
 
-    auto displays = get_screen_info();
-    Color trackerColor = util_parse_color(tmpTrackerColor);
+    if (job.stallPolicy != "drop" && job.stallPolicy != "block")
+        throw std::invalid_argument("Option '--stallPolicy " + job.stallPolicy + "' invalid. Must be drop or block.");
+
+    // fragments are flushed as soon as they are complete, so the file on disk always ends with a whole one
+    if (job.fragmentMs > 0) {
+        add_muxer_setting(job.muxerOptions, "movflags", "+empty_moov+default_base_moof");
+        add_muxer_setting(job.muxerOptions, "frag_duration", to_string((uint64_t)job.fragmentMs * 1000));
+        add_muxer_setting(job.muxerOptions, "flush_packets", "1");
+    }
+    else if (job.faststart) {
+        add_muxer_setting(job.muxerOptions, "movflags", "+faststart");
+    }
+
+    if (job.vfr && job.vfrMaxGapMs == 0)
+        throw std::invalid_argument("--vfrMaxGap must be greater than zero.");
 
-    if (!captureMonitor.empty()) {
+    if (job.cpuBudget < 0 || job.cpuBudget > 100 || job.dropTarget < 0)
+        throw std::invalid_argument("--cpuBudget must be between 0 and 100, --dropTarget must not be negative.");
+
+    if (!job.captureMonitor.empty()) {
         // capturing only a single display
         vector<string> availableDisplays{};
-        for (auto& display : displays) {
+        for (auto& display : get_screen_info()) {
             availableDisplays.emplace_back(display.monitor_device_name);
-            if (string(display.monitor_device_name) == captureMonitor) {
-                captureRegion = Rect(display.x, display.y, display.width, display.height);
-                cout << "Capturing single display: " << display.monitor_device_name << " (" << display.monitor_friendly_name << ")" << std::endl;
+            if (string(display.monitor_device_name) == job.captureMonitor) {
+                job.region = Rect(display.x, display.y, display.width, display.height);
+                events_write("Capturing single display: " + string(display.monitor_device_name) + " (" + display.monitor_friendly_name + ")");
                 break;
             }
         }
-        if (captureRegion.IsEmptyArea()) {
+        if (job.region.IsEmptyArea()) {
             std::ostringstream imploded;
             std::copy(availableDisplays.begin(), availableDisplays.end(), std::ostream_iterator<std::string>(imploded, ", "));
-            throw std::invalid_argument("Invalid monitor '" + captureMonitor + "'. Available displays: " + imploded.str());
+            throw std::invalid_argument("Invalid monitor '" + job.captureMonitor + "'. Available displays: " + imploded.str());
         }
     }
     else {
         // capturing a virtual region
-        captureRegion = util_parse_rect(tmpCaptureRegion);
+        job.region = util_parse_rect(tmpCaptureRegion);
     }
 
-    cout << "Capture region: X=" << captureRegion.X << ", Y=" << captureRegion.Y << ", W=" << captureRegion.Width << ", H=" << captureRegion.Height << std::endl;
-    cout << std::endl;
+    return job;
+}
 
-    // calculate ideal obs canvas size
-    SizeF outputSize{ (float)captureRegion.Width, (float)captureRegion.Height };
+// daemon mode record requests waiting for the current job to finish, jobHandle is set when one is queued
+std::mutex jobLock;
+std::deque<recording_job> pendingJobs{};
 
-    if (maxOutputWidth > 0 && outputSize.Width > maxOutputWidth) {
-        float waspect = outputSize.Width / outputSize.Height;
-        outputSize.Width = maxOutputWidth;
-        outputSize.Height = round(maxOutputWidth / waspect);
+struct recorder_control_target : control_target
+{
+    control_result start(const control_ticket& ticket) override
+    {
+        lock_guard<mutex> guard(outputLock);
+        if (muxer && obs_output_paused(muxer)) {
+            control_ticket_add(ticket);
+            obs_output_pause(muxer, false);
+            for (auto& rendition : renditions) {
+                obs_output_pause(rendition.output, false);
+            }
+        }
+        else {
+            // first start. an armed output begins its file from the frame captured at this moment, however
+            // long the recording thread takes to wake up
+            if (startCommandNs == 0)
+                startCommandNs = os_gettime_ns();
+            if (startTimeMs == 0)
+                control_ticket_add(ticket);
+            SetEvent(startHandle);
+        }
+        return { true, "Start command received." };
     }
 
-    if (maxOutputHeight > 0 && outputSize.Height > maxOutputHeight) {
-        float haspect = outputSize.Height / outputSize.Width;
-        outputSize.Width = round(maxOutputHeight / haspect);
-        outputSize.Height = maxOutputHeight;
+    control_result pause(const control_ticket& ticket) override
+    {
+        lock_guard<mutex> guard(outputLock);
+        // added first, the pause signal may arrive before obs_output_pause returns
+        control_ticket_add(ticket);
+        if (!muxer || !obs_output_pause(muxer, true)) {
+            if (ticket.json) {
+                lock_guard<mutex> ticketGuard(ticketLock);
+                pendingTickets.pop_back();
+            }
+            return { false, "Unable to pause, the output is not active or does not support pausing." };
+        }
+        for (auto& rendition : renditions) {
+            obs_output_pause(rendition.output, true);
+        }
+        return { true, "Pause command received." };
     }
 
-    float dnsclperc = round((1 - ((outputSize.Width * outputSize.Height) / (captureRegion.Width * captureRegion.Height))) * 100);
-
-    if (dnsclperc > 0) {
-        cout << "Downscaling from " << captureRegion.Width << "x" << captureRegion.Height << " to " << outputSize.Width << "x" << outputSize.Height << " (-" << dnsclperc << "%)" << std::endl;
+    control_result stop(const control_ticket& ticket) override
+    {
+        // in daemon mode this only ends the current job, a one-shot recorder exits once its only job ends
+        if (daemonMode && !muxer) {
+            return { false, "No recording in progress." };
+        }
+        control_ticket_add(ticket);
+        cancelRequested = true;
+        SetEvent(cancelHandle);
+        SetEvent(startHandle);
+        return { true, "Quit/stop command received." };
     }
 
-    // do obs setup.
-    if (!obs_startup("en-US", nullptr, nullptr))
-        throw std::exception("Unable to start OBS");
+    control_result quit() override
+    {
+        quitRequested = true;
+        SetEvent(jobHandle);
+        return stop({});
+    }
 
-    util_obs_cpu_usage_info_start();
+    control_result record(const vector<string>& args) override
+    {
+        if (!daemonMode) {
+            return { false, "Recording jobs can only be queued in --daemon mode." };
+        }
+
+        // validated here so the controller gets the error straight away rather than when the job runs
+        recording_job job;
+        try {
+            auto cmdl = parse_arguments(args);
+            job = parse_recording_job(cmdl);
+        }
+        catch (const std::exception& exc) {
+            return { false, exc.what() };
+        }
+
+        size_t ahead;
+        {
+            lock_guard<mutex> guard(jobLock);
+            ahead = pendingJobs.size();
+            pendingJobs.push_back(job);
+        }
+        SetEvent(jobHandle);
+        return { true, "Recording job queued, " + to_string(ahead) + " ahead of it." };
+    }
+
+    control_result set_muted(char deviceType, int deviceIndex, bool muted) override
+    {
+        lock_guard<mutex> guard(outputLock);
+        auto& devices = deviceType == 's' ? spkDevices : micDevices;
+        string deviceName = deviceType == 's' ? "speaker" : "microphone";
+        string action = muted ? "muted" : "unmuted";
+
+        if (deviceIndex < 0 || deviceIndex >= (int)devices.size()) {
+            return { false, "Audio " + deviceName + " device " + to_string(deviceIndex) + " out of range." };
+        }
 
+        obs_source_set_muted(devices[deviceIndex], muted);
+        return { true, "Audio " + deviceName + " device " + to_string(deviceIndex) + ": " + action + "." };
+    }
+
+    control_result save() override
+    {
+        lock_guard<mutex> guard(outputLock);
+        if (replayBufferSeconds == 0) {
+            return { false, "Replay buffer is not enabled, use --replayBuffer to enable it." };
+        }
+        if (!muxer || startTimeMs == 0) {
+            return { false, "Replay buffer has not started yet." };
+        }
+
+        // the replay buffer reads the file name format when it saves, so give each save a sequential name
+        char format[32];
+        snprintf(format, sizeof(format), "_%03u", ++replayBufferSaveCount);
+        obs_data_t* settings = obs_output_get_settings(muxer);
+        obs_data_set_string(settings, "format", (replayBufferStem + format).c_str());
+        obs_data_release(settings);
+
+        // the buffered packets are written on the replay buffer's own mux thread, not the encoder thread
+        calldata_t cd{};
+        proc_handler_call(obs_output_get_proc_handler(muxer), "save", &cd);
+        calldata_free(&cd);
+        return { true, "Save command received." };
+    }
+};
+
+recorder_control_target controlTarget{};
+
+unsigned int __stdcall thread_read_input(void* lpParam)
+{
+    // stdin is just another controller, it accepts the legacy text commands as well as json requests
+    while (!quitRequested) {
+        std::string str;
+        if (!std::getline(std::cin, str)) {
+            break;
+        }
+
+        auto response = control_handle_line(controlTarget, str, control_now_ns(), [](const string& line) { events_write(line); });
+        if (!response.empty()) {
+            events_write(response);
+        }
+    }
+
+    events_write("stdin read thread has exited.");
+    return 0;
+}
+
+// the fps the controller would record at after stepping down this many times
+uint32_t adaptive_effective_fps(uint32_t fpsStep)
+{
+    return max<uint32_t>(1, videoFps * 2 / (2 + fpsStep));
+}
+
+// feeds one status sample to the --cpuBudget controller and applies what it decides. caller holds outputLock.
+void adaptive_update(const telemetry_sample& sample, double cpu)
+{
+    uint32_t dropped = sample.laggedFrames + sample.skippedFrames;
+    uint32_t droppedInterval = dropped - min(dropped, adaptive.lastDroppedFrames);
+    adaptive.lastDroppedFrames = dropped;
+
+    double expectedFrames = (double)sample.intervalMs * videoFps / 1000.0;
+    double dropPerc = expectedFrames > 0 ? min(100.0, droppedInterval / expectedFrames * 100.0) : 0.0;
+
+    auto action = adaptive_step(adaptive.config, adaptive.state, { cpu, dropPerc });
+    if (action == ADAPTIVE_HOLD) {
+        return;
+    }
+
+    json event;
+    event["type"] = "adaptive";
+    event["action"] = adaptive_action_name(action);
+    event["cpu"] = cpu;
+    event["dropPerc"] = dropPerc;
+    event["level"] = adaptive.state.level;
+    event["levels"] = adaptive.config.levels;
+    event["fps"] = adaptive_effective_fps(adaptive.state.fpsStep);
+
+    if (action == ADAPTIVE_FASTER || action == ADAPTIVE_SLOWER) {
+        // every level spells out the same keys, so applying one on top of another replaces it completely
+        auto& settings = adaptive.levels[adaptive.state.level];
+        obs_data_t* data = obs_data_create_from_json(settings.dump().c_str());
+        obs_encoder_update(adaptive.encoder, data);
+        obs_data_release(data);
+        event["settings"] = settings;
+        event["applied"] = true;
+    }
+    else {
+        // obs 29 can not change the rate of a running video output, the fps steps are only offered with --vfr,
+        // whose own video output holds frames back before the encoder sees them
+        calldata_t cd{};
+        calldata_set_int(&cd, "num", 2);
+        calldata_set_int(&cd, "den", 2 + adaptive.state.fpsStep);
+        event["applied"] = proc_handler_call(obs_output_get_proc_handler(muxer), "set_frame_share", &cd);
+        calldata_free(&cd);
+    }
+    events_write(event.dump());
+}
+
+unsigned int __stdcall thread_output_realtime_status(void* lpParam)
+{
+    // samples are taken on a fixed schedule so the interval doesn't drift by however long sampling takes
+    uint64_t intervalNs = (uint64_t)statusIntervalMs * 1000000;
+    uint64_t nextSampleNs = os_gettime_ns() + intervalNs;
+    telemetry_sample sample{};
+
+    while (!quitRequested) {
+        os_sleepto_ns(nextSampleNs);
+        uint64_t nowNs = os_gettime_ns();
+        while (nextSampleNs <= nowNs) {
+            nextSampleNs += intervalNs;
+        }
+
+        lock_guard<mutex> guard(outputLock);
+        if (!muxer || startTimeMs == 0 || obs_output_paused(muxer)) {
+            continue;
+        }
+
+        auto currentTimeMs = util_obs_get_time_ms();
+
+        double percent = 0;
+        int totalDropped = obs_output_get_frames_dropped(muxer);
+        int totalFrames = obs_output_get_total_frames(muxer);
+        if (totalFrames == 0) { percent = 0.0; }
+        else { percent = (double)totalDropped / (double)totalFrames * 100.0; }
+
+        auto frameTime = (double)obs_get_average_frame_time_ns() / 1000000.0;
+        auto cpu = util_obs_get_cpu_utilisation();
+        telemetry_collect(muxer, sample);
+
+        // the in process outputs answer get_stats, sampled once here for every part of the status which reads it
+        calldata_t outputStats{};
+        if (vfrMode || streamOutput || diskWriterStats || bufferStats) {
+            proc_handler_call(obs_output_get_proc_handler(muxer), "get_stats", &outputStats);
+        }
+
+        // with --vfr the encoder is fed by its own video output, frames it was too busy for are skipped there
+        if (vfrMode) {
+            sample.skippedFrames += (uint32_t)calldata_int(&outputStats, "skipped");
+            auto unsent = (uint32_t)(calldata_int(&outputStats, "unchanged") + calldata_int(&outputStats, "reduced"));
+            sample.encoderInFlight = sample.encoderInFlight > unsent ? sample.encoderInFlight - unsent : 0;
+        }
+        if (adaptive.enabled) {
+            adaptive_update(sample, cpu);
+        }
+
+        json status;
+        status["timeMs"] = currentTimeMs - startTimeMs;
+        status["dropped"] = totalDropped;
+        status["droppedPerc"] = percent;
+        status["fps"] = obs_get_active_fps();
+        status["frameTime"] = frameTime;
+        status["cpu"] = cpu;
+        status["intervalMs"] = sample.intervalMs;
+        status["lagged"] = sample.laggedFrames;
+        status["skipped"] = sample.skippedFrames;
+        status["encoderQueue"] = sample.encoderInFlight;
+        status["bytes"] = sample.bytesWritten;
+        status["bitrateKbps"] = sample.bitrateKbps;
+        status["frameInterval"] = {
+            { "p50", sample.frameIntervalP50Ms },
+            { "p95", sample.frameIntervalP95Ms },
+            { "p99", sample.frameIntervalP99Ms },
+            { "max", sample.frameIntervalMaxMs },
+        };
+        status["audioBufferingMs"] = sample.audioBufferingMs;
+        status["eventsDropped"] = events_dropped();
+        double totalKbps = sample.bitrateKbps;
+        if (!renditions.empty()) {
+            // every encoder is handed the same frames, so a rendition's queue is how far it trails what was sent
+            uint64_t sentToEncoders = (uint64_t)totalFrames + sample.encoderInFlight;
+            double seconds = sample.intervalMs > 0 ? sample.intervalMs / 1000.0 : 1.0;
+            json list = json::array();
+            for (auto& rendition : renditions) {
+                uint64_t frames = (uint64_t)obs_output_get_total_frames(rendition.output);
+                uint64_t bytes = obs_output_get_total_bytes(rendition.output);
+                totalKbps += (bytes - min(bytes, rendition.lastBytes)) * 8 / 1000.0 / seconds;
+                list.push_back({
+                    { "width", rendition.width },
+                    { "height", rendition.height },
+                    { "fps", (frames - min(frames, rendition.lastFrames)) / seconds },
+                    { "encoderQueue", sentToEncoders > frames ? sentToEncoders - frames : 0 },
+                    { "dropped", obs_output_get_frames_dropped(rendition.output) },
+                    { "bytes", bytes },
+                    { "bitrateKbps", (bytes - min(bytes, rendition.lastBytes)) * 8 / 1000.0 / seconds },
+                });
+                rendition.lastFrames = frames;
+                rendition.lastBytes = bytes;
+            }
+            status["renditions"] = list;
+        }
+        if (streamOutput) {
+            // a reader which keeps up never makes a write wait, the queue grows while one is waiting
+            auto blockedNs = (uint64_t)calldata_int(&outputStats, "blocked_ns");
+            double sampleNs = sample.intervalMs > 0 ? sample.intervalMs * 1000000.0 : (double)intervalNs;
+            status["stream"] = {
+                { "blockedMs", blockedNs / 1000000 },
+                { "blockedPerc", min(100.0, (blockedNs - min(blockedNs, lastStreamBlockedNs)) / sampleNs * 100.0) },
+                { "queuedBytes", calldata_int(&outputStats, "queued_bytes") },
+                { "queuedPackets", calldata_int(&outputStats, "queued_packets") },
+            };
+            lastStreamBlockedNs = blockedNs;
+        }
+        if (!outputDirectory.empty()) {
+            // remaining time is projected from what every output wrote in the last interval
+            json disk = json::object();
+            uint64_t freeBytes = util_disk_free_bytes(outputDirectory);
+            if (freeBytes != UINT64_MAX) {
+                disk["freeBytes"] = freeBytes;
+            }
+            if (freeBytes != UINT64_MAX && totalKbps > 0) {
+                double remainingSec = freeBytes / (totalKbps * 1000 / 8);
+                disk["remainingSec"] = (uint64_t)remainingSec;
+
+                // each level is written once per recording, critical is always the last minute
+                uint32_t level = remainingSec < 60 ? 2 : remainingSec < diskWarningSeconds ? 1 : 0;
+                if (level > diskWarningLevel) {
+                    diskWarningLevel = level;
+                    json warning;
+                    warning["type"] = "disk_warning";
+                    warning["level"] = level == 2 ? "critical" : "low";
+                    warning["directory"] = outputDirectory;
+                    warning["freeBytes"] = freeBytes;
+                    warning["remainingSec"] = (uint64_t)remainingSec;
+                    events_write(warning.dump());
+                }
+            }
+            if (diskWriterStats) {
+                disk["writeLatencyMs"] = {
+                    { "p50", calldata_float(&outputStats, "latency_p50_ms") },
+                    { "p95", calldata_float(&outputStats, "latency_p95_ms") },
+                    { "p99", calldata_float(&outputStats, "latency_p99_ms") },
+                    { "max", calldata_float(&outputStats, "latency_max_ms") },
+                };
+                disk["waitMs"] = calldata_int(&outputStats, "disk_wait_ns") / 1000000;
+                disk["queuedBlocks"] = calldata_int(&outputStats, "disk_queued");
+            }
+            status["disk"] = disk;
+        }
+        if (bufferStats) {
+            // packets waiting for the writer, which grow while a write stalls and drain once it is done
+            auto drainedBytes = (uint64_t)calldata_int(&outputStats, "drained_bytes");
+            auto fullCount = (uint32_t)calldata_int(&outputStats, "full_count");
+            double seconds = sample.intervalMs > 0 ? sample.intervalMs / 1000.0 : 1.0;
+            status["buffer"] = {
+                { "bytes", calldata_int(&outputStats, "queued_bytes") },
+                { "peakBytes", calldata_int(&outputStats, "peak_bytes") },
+                { "budgetBytes", bufferBudgetBytes },
+                { "longestStallMs", calldata_int(&outputStats, "longest_stall_ns") / 1000000 },
+                { "drainKbps", (drainedBytes - min(drainedBytes, lastBufferDrainedBytes)) * 8 / 1000.0 / seconds },
+                { "droppedPackets", calldata_int(&outputStats, "dropped_packets") },
+                { "blockedMs", calldata_int(&outputStats, "full_blocked_ns") / 1000000 },
+            };
+
+            // written each time the budget runs out, the ring has drained to half of it in between
+            if (fullCount > lastBufferFullCount) {
+                json full;
+                full["type"] = "buffer_full";
+                full["policy"] = bufferPolicy;
+                full["budgetBytes"] = bufferBudgetBytes;
+                full["count"] = fullCount;
+                full["droppedPackets"] = calldata_int(&outputStats, "dropped_packets");
+                full["blockedMs"] = calldata_int(&outputStats, "full_blocked_ns") / 1000000;
+                events_write(full.dump());
+            }
+            lastBufferDrainedBytes = drainedBytes;
+            lastBufferFullCount = fullCount;
+        }
+        if (vfrMode) {
+            auto frames = calldata_int(&outputStats, "frames");
+            auto unchanged = calldata_int(&outputStats, "unchanged");
+            status["vfr"] = {
+                { "unchanged", unchanged },
+                { "unchangedPerc", frames > 0 ? (double)unchanged / (double)frames * 100.0 : 0.0 },
+                { "reduced", calldata_int(&outputStats, "reduced") },
+            };
+        }
+        calldata_free(&outputStats);
+        if (adaptive.enabled) {
+            status["adaptive"] = {
+                { "level", adaptive.state.level },
+                { "fps", adaptive_effective_fps(adaptive.state.fpsStep) },
+            };
+        }
+        if (replayBufferSeconds > 0 && replayMeter) {
+            // the replay buffer trims to whichever of the time or memory limit it hits first, the meter by the same rules
+            calldata_t meterStats{};
+            proc_handler_call(obs_output_get_proc_handler(replayMeter), "get_stats", &meterStats);
+            status["replayBuffer"] = {
+                { "maxSeconds", replayBufferSeconds },
+                { "maxMb", replayBufferMaxMb },
+                { "bufferedMs", calldata_int(&meterStats, "buffered_usec") / 1000 },
+                { "bufferedBytes", calldata_int(&meterStats, "buffered_bytes") },
+                { "saved", replayBufferSaveCount },
+            };
+            calldata_free(&meterStats);
+        }
+        status["type"] = "status";
+        events_write_status(status.dump());
+    }
+    return 0;
+}
+
+// wall clock time spent in each startup phase, reported in the initialized event
+struct startup_timer
+{
+    uint64_t startNs = os_gettime_ns();
+    uint64_t lastNs = startNs;
+    json phases = json::object();
+
+    void mark(const char* phase)
+    {
+        uint64_t now = os_gettime_ns();
+        phases[phase] = (double)(now - lastNs) / 1000000.0;
+        lastNs = now;
+    }
+
+    json report() const
+    {
+        json result = phases;
+        result["total"] = (double)(lastNs - startNs) / 1000000.0;
+        return result;
+    }
+};
+
+// obs objects which outlive a single job in daemon mode, so later recordings skip the expensive setup
+struct pipeline_state
+{
     obs_video_info vvi{};
+    capability_cache capabilities{};
+    bool capabilitiesHit = false;
+    obs_scene_t* scene = nullptr;
+    map<string, obs_source_t*> sources{}; // capture sources by id and settings
+    uint32_t channels = 0;                // output channels assigned by the previous job
+    obs_encoder_t* videoEncoder = nullptr;
+    string videoEncoderKey;
+    obs_encoder_t* audioEncoder = nullptr;
+    obs_source_t* tracker = nullptr;
+};
+
+pipeline_state pipeline{};
+
+void require_obs_type(module_object kind, const char* id)
+{
+    size_t loaded = modules_loaded().size();
+    if (!modules_require(kind, id))
+        throw std::runtime_error(string("'") + id + "' is not provided by any obs module");
+
+    // the modules loaded on demand add their encoders to the cache without dropping what it held for the others
+    if (modules_loaded().size() != loaded && capcache_update(pipeline.capabilities) > 0) {
+        capcache_save(pipeline.capabilities);
+    }
+}
+
+// libobs logs from its graphics, encoder and output threads, so its lines go through the event writer like every other
+// event instead of being printed straight to stdout, where a stalled reader would block those threads
+static void handle_obs_log(int lvl, const char* msg, va_list args, void* param)
+{
+    if (lvl > LOG_INFO) {
+        return;
+    }
+
+    char message[4096];
+    vsnprintf(message, sizeof(message), msg, args);
+
+    json log;
+    log["type"] = "log";
+    log["level"] = lvl <= LOG_ERROR ? "error" : lvl <= LOG_WARNING ? "warning" : "info";
+    log["message"] = message;
+    events_write(log.dump(-1, ' ', false, json::error_handler_t::replace));
+}
+
+void pipeline_start(uint16_t adapter, uint16_t fps, const canvas_plan& canvas, const vector<string>& requiredModules, startup_timer& startup)
+{
+    base_set_log_handler(handle_obs_log, nullptr);
+
+    // do obs setup.
+    if (!obs_startup("en-US", nullptr, nullptr))
+        throw std::exception("Unable to start OBS");
+    startup.mark("obsStartup");
+
+    util_obs_cpu_usage_info_start();
+
+    obs_video_info& vvi = pipeline.vvi;
     vvi.adapter = adapter;
-    vvi.base_width = captureRegion.Width;
-    vvi.base_height = captureRegion.Height;
     vvi.fps_num = fps;
     vvi.fps_den = 1;
     vvi.graphics_module = "libobs-d3d11";
     vvi.output_format = video_format::VIDEO_FORMAT_NV12;
-    vvi.output_width = (uint32_t)outputSize.Width;
-    vvi.output_height = (uint32_t)outputSize.Height;
-    vvi.scale_type = obs_scale_type::OBS_SCALE_BICUBIC;
     vvi.colorspace = video_colorspace::VIDEO_CS_709;
     vvi.gpu_conversion = true;
     vvi.range = video_range_type::VIDEO_RANGE_PARTIAL;
+    apply_canvas_plan(vvi, canvas);
 
     auto vr = obs_reset_video(&vvi);
     if (vr != OBS_VIDEO_SUCCESS) {
@@ -435,6 +1261,8 @@ void run(vector<string> arguments)
         }
     }
 
+    startup.mark("video");
+
     obs_audio_info avi{};
     avi.samples_per_sec = 44100;
     avi.speakers = speaker_layout::SPEAKERS_STEREO;
@@ -442,122 +1270,964 @@ void run(vector<string> arguments)
     if (!obs_reset_audio(&avi))
         throw std::exception("Unable to initialize audio");
 
-    struct obs_module_failure_info mfi;
-    obs_load_all_modules2(&mfi);
-    obs_log_loaded_modules();
-    obs_post_load_modules();
+    startup.mark("audio");
+
+    auto loadedModules = modules_load(requiredModules);
+    tracker_register_source();
+    calibration_register();
+    armed_register();
+    vfr_register();
+    mux_output_register();
+    replay_meter_register();
+    telemetry_init();
 
     if (!obs_initialized()) {
         throw std::exception("Unknown error initializing");
     }
 
-    cout << "OBS version " + string(obs_get_version_string()) + " loaded successfully." << std::endl;
+    cout << "OBS version " + string(obs_get_version_string()) + " loaded successfully, " << loadedModules << " modules." << std::endl;
+    startup.mark("modules");
+
+    // encoder probing and calibration give the same answer until obs, its modules or the adapter change. only
+    // the loaded modules which have no entry yet, or have changed, are probed.
+    auto capabilitiesKey = capcache_key(adapter);
+    if (!capcache_load(capabilitiesKey, pipeline.capabilities)) {
+        pipeline.capabilities = capability_cache{};
+        pipeline.capabilities.key = capabilitiesKey;
+    }
+    pipeline.capabilitiesHit = capcache_update(pipeline.capabilities) == 0;
+    if (!pipeline.capabilitiesHit) {
+        capcache_save(pipeline.capabilities);
+    }
+
+    require_obs_type(MODULE_ENCODER, "ffmpeg_aac");
+    pipeline.audioEncoder = obs_audio_encoder_create("ffmpeg_aac", "audio_encoder", nullptr, 0, nullptr);
+    obs_encoder_set_audio(pipeline.audioEncoder, obs_get_audio());
+
+    startup.mark("capabilities");
+}
+
+// resets video only if the canvas or fps changed. nothing can be recording when this is called.
+void pipeline_reset_video(const canvas_plan& canvas, uint16_t fps)
+{
+    obs_video_info vvi = pipeline.vvi;
+    vvi.fps_num = fps;
+    apply_canvas_plan(vvi, canvas);
+
+    if (vvi.fps_num == pipeline.vvi.fps_num && vvi.base_width == pipeline.vvi.base_width && vvi.base_height == pipeline.vvi.base_height
+        && vvi.output_width == pipeline.vvi.output_width && vvi.output_height == pipeline.vvi.output_height && vvi.scale_type == pipeline.vvi.scale_type) {
+        return;
+    }
+
+    // the video encoder is bound to the video output being replaced
+    if (pipeline.videoEncoder) {
+        obs_encoder_release(pipeline.videoEncoder);
+        pipeline.videoEncoder = nullptr;
+        pipeline.videoEncoderKey.clear();
+    }
+
+    if (obs_reset_video(&vvi) != OBS_VIDEO_SUCCESS)
+        throw std::exception("Could not re-initialize video pipeline");
+    pipeline.vvi = vvi;
+}
+
+// returns a capture source with these settings, reusing the one from the previous job if it matches
+obs_source_t* pipeline_acquire_source(const char* id, const string& key, obs_data_t* settings, unordered_set<obs_source_t*>& used)
+{
+    string fullKey = string(id) + "|" + key;
+    auto existing = pipeline.sources.find(fullKey);
+    obs_source_t* source;
+    if (existing != pipeline.sources.end()) {
+        source = existing->second;
+    }
+    else {
+        source = obs_source_create(id, "", settings, nullptr);
+        pipeline.sources[fullKey] = source;
+    }
+    used.insert(source);
+    return source;
+}
+
+void pipeline_release_unused_sources(const unordered_set<obs_source_t*>& used)
+{
+    for (auto it = pipeline.sources.begin(); it != pipeline.sources.end();) {
+        if (used.find(it->second) == used.end()) {
+            obs_source_release(it->second);
+            it = pipeline.sources.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+}
+
+bool collect_scene_item(obs_scene_t* scene, obs_sceneitem_t* item, void* param)
+{
+    obs_sceneitem_addref(item);
+    ((vector<obs_sceneitem_t*>*)param)->push_back(item);
+    return true;
+}
+
+// releases everything which belongs to one job, and keeps what the next job may reuse
+void pipeline_end_job()
+{
+    {
+        lock_guard<mutex> guard(outputLock);
+        if (muxer) {
+            obs_output_release(muxer);
+            muxer = nullptr;
+        }
+        startTimeMs = 0;
+        startCommandNs = 0;
+        control_tickets_abandon();
+        spkDevices.clear();
+        micDevices.clear();
+
+        for (auto& rendition : renditions) {
+            obs_output_release(rendition.output);
+            obs_encoder_release(rendition.encoder);
+        }
+        renditions.clear();
+        renditionsRunning = 0;
+        if (replayMeter) {
+            obs_output_release(replayMeter);
+            replayMeter = nullptr;
+        }
+
+        // an encoder the controller has stepped no longer matches its key, so the next job gets a fresh one
+        if (adaptive.enabled && adaptive.state.level > 0) {
+            obs_encoder_release(pipeline.videoEncoder);
+            pipeline.videoEncoder = nullptr;
+            pipeline.videoEncoderKey.clear();
+        }
+        adaptive = adaptive_runtime{};
+    }
+
+    // a stop for this job must not cancel the next one
+    cancelRequested = false;
+    ResetEvent(startHandle);
+    ResetEvent(cancelHandle);
+    ResetEvent(stoppedHandle);
+    ResetEvent(renditionsStoppedHandle);
+
+    if (pipeline.scene) {
+        vector<obs_sceneitem_t*> items{};
+        obs_scene_enum_items(pipeline.scene, collect_scene_item, &items);
+        for (auto item : items) {
+            obs_sceneitem_remove(item);
+            obs_sceneitem_release(item);
+        }
+    }
+
+    if (pipeline.tracker) {
+        obs_source_release(pipeline.tracker);
+        pipeline.tracker = nullptr;
+    }
+}
+
+void run_job(const recording_job& job, startup_timer& startup)
+{
+    // per-job state read by the signal handlers and controllers
+    captureRegion = job.region;
+    videoFps = job.fps;
+    replayBufferSeconds = job.replayBufferSeconds;
+    replayBufferMaxMb = job.replayBufferMaxMb;
+    replayBufferSaveCount = 0;
+    segmentSeconds = job.segmentSeconds;
+    segmentBytes = job.segmentBytes;
+    segmentIndex = 0;
+    vfrMode = job.vfr;
+    finalizeFragments = job.fragmentMs > 0 && job.faststart;
+    streamOutput = !job.streamFormat.empty();
+    lastStreamBlockedNs = 0;
+    diskWarningSeconds = job.diskWarningMinutes * 60;
+    diskWarningLevel = 0;
+    diskWriterStats = (job.inProcessMux || job.armed || job.vfr) && !streamOutput;
+    bufferStats = job.inProcessMux && !job.armed && !job.vfr;
+    bufferBudgetBytes = (uint64_t)job.stallBufferMb * 1024 * 1024;
+    bufferPolicy = job.stallPolicy;
+    lastBufferDrainedBytes = 0;
+    lastBufferFullCount = 0;
+    if (streamOutput) {
+        outputDirectory.clear();
+    }
+    else {
+        string stem, extension;
+        util_split_path(job.outputFile, outputDirectory, stem, extension);
+    }
+
+    events_write("Capture region: X=" + to_string(captureRegion.X) + ", Y=" + to_string(captureRegion.Y) + ", W=" + to_string(captureRegion.Width) + ", H=" + to_string(captureRegion.Height));
+
+    // calculate ideal obs canvas size, every encoder is given even dimensions
+    auto canvas = canvas_plan_create(captureRegion.Width, captureRegion.Height, job.maxOutputWidth, job.maxOutputHeight, CANVAS_ENCODER_ALIGNMENT);
+    print_canvas_plan(canvas);
+    pipeline_reset_video(canvas, job.fps);
+    startup.mark("jobVideo");
+
+    auto& capabilities = pipeline.capabilities;
+    encoder_intent intent = job.intent;
+    string encoderId;
+    json calibration = json::array();
+    bool calibrationHit = false;
+    if (job.encoderMode == "auto") {
+        // measured at the planned canvas size, before this job's capture sources are connected to compete with it
+        auto candidates = calibration_candidates(capabilities.encoders, job.codec, job.intent);
+        auto calibrationKey = capcache_calibration_key(job.codec, job.intent, job.profiles, candidates, canvas.outputWidth, canvas.outputHeight, job.fps, job.crf);
+        auto cached = capabilities.calibrations.find(calibrationKey);
+        calibrationHit = cached != capabilities.calibrations.end();
+        if (!calibrationHit) {
+            capabilities.calibrations[calibrationKey] = calibration_run(capabilities.encoders, job.profiles, candidates, job.crf);
+            capcache_save(capabilities);
+        }
+        auto& results = capabilities.calibrations[calibrationKey];
+        int chosen = calibration_choose(results);
+        if (chosen < 0)
+            throw std::exception("No encoder could be started during calibration");
+
+        for (auto& result : results) {
+            string line = "  " + result.candidate.encoderId + " (" + encoder_intent_name(result.candidate.intent) + "): ";
+            if (!result.started) {
+                line += "failed to start";
+            }
+            else {
+                line += to_string(result.costMs) + "ms/frame, " + to_string(result.framesEncoded) + "/" + to_string(result.framesIn) + " frames encoded"
+                    + (result.sustained ? "" : ", cannot sustain target fps");
+            }
+            events_write(line);
+            calibration.push_back({
+                { "encoder", result.candidate.encoderId },
+                { "intent", encoder_intent_name(result.candidate.intent) },
+                { "started", result.started },
+                { "costMs", result.costMs },
+                { "utilisation", result.utilisation },
+                { "framesIn", result.framesIn },
+                { "framesEncoded", result.framesEncoded },
+                { "skipped", result.skippedFrames },
+                { "lagged", result.laggedFrames },
+                { "sustained", result.sustained },
+            });
+        }
+
+        encoderId = results[chosen].candidate.encoderId;
+        intent = results[chosen].candidate.intent;
+        events_write("Calibration " + string(calibrationHit ? "(cached) " : "") + "chose " + encoderId + " (" + encoder_intent_name(intent) + ")");
+    }
+    else if (!job.encoderMode.empty()) {
+        // any encoder id with a profile, so an encoder added by --profileFile can be used without a code change
+        encoderId = job.encoderMode;
+    }
+    else {
+        encoderId = select_video_encoder(capabilities.encoders, job.codec, job.hwAccel);
+        if (encoderId.empty())
+            throw std::runtime_error("No " + string(video_codec_name(job.codec)) + " encoder is available on this machine");
+    }
+
+    require_obs_type(MODULE_ENCODER, encoderId.c_str());
+    if (job.vfr && (obs_get_encoder_caps(encoderId.c_str()) & OBS_ENCODER_CAP_PASS_TEXTURE))
+        throw std::runtime_error("--vfr needs an encoder which reads frames from memory, " + encoderId + " is given gpu textures");
+    startup.mark("encoderSelection");
+
+    // create scene. a single monitor with nothing drawn on top doesn't need one, the capture source
+    // can be the output source directly and skip the scene composite.
+    uint32_t channel = 0;
+    bool directCapture = !job.captureMonitor.empty() && !job.trackerEnabled;
+    if (!directCapture) {
+        if (!pipeline.scene)
+            pipeline.scene = obs_scene_create("main");
+        obs_set_output_source(channel, obs_scene_get_source(pipeline.scene));
+    }
+    channel++;
 
-    // create scene
-    int channel = 0;
-    auto scene = obs_scene_create("main");
-    auto sceneSource = obs_scene_get_source(scene);
-    obs_set_output_source(channel++, sceneSource);
+    // capture sources from the previous job are reused when their settings match, a monitor or audio
+    // device which is already capturing delivers its first frame immediately
+    unordered_set<obs_source_t*> usedSources{};
+    vector<obs_source_t*> speakerSources{};
+    vector<obs_source_t*> microphoneSources{};
 
     // audio capture sources
-    for (auto& id : speakers) {
+    if (!job.speakers.empty())
+        require_obs_type(MODULE_SOURCE, "wasapi_output_capture");
+    if (!job.microphones.empty())
+        require_obs_type(MODULE_SOURCE, "wasapi_input_capture");
+    for (auto& id : job.speakers) {
         auto opt = obs_data_create();
-        obs_data_set_string(opt, "device_id", id.second.c_str());
-        auto source = obs_source_create("wasapi_output_capture", "", opt, nullptr);
+        obs_data_set_string(opt, "device_id", id.c_str());
+        auto source = pipeline_acquire_source("wasapi_output_capture", id, opt, usedSources);
+        obs_source_set_muted(source, false);
         obs_set_output_source(channel++, source);
         obs_data_release(opt);
-        spkDevices.push_back(source);
+        speakerSources.push_back(source);
     }
 
-    for (auto& id : microphones) {
+    for (auto& id : job.microphones) {
         auto opt = obs_data_create();
-        obs_data_set_string(opt, "device_id", id.second.c_str());
-        auto source = obs_source_create("wasapi_input_capture", "", opt, nullptr);
+        obs_data_set_string(opt, "device_id", id.c_str());
+        auto source = pipeline_acquire_source("wasapi_input_capture", id, opt, usedSources);
+        obs_source_set_muted(source, false);
         obs_set_output_source(channel++, source);
         obs_data_release(opt);
-        micDevices.push_back(source);
+        microphoneSources.push_back(source);
     }
 
-    // display capture sources
-    for (int i = 0; i < displays.size(); i++) {
-        auto& display = displays[i];
+    for (uint32_t unused = channel; unused < pipeline.channels; unused++) {
+        obs_set_output_source(unused, nullptr);
+    }
+    pipeline.channels = channel;
 
-        Rect displayBounds{ display.x, display.y, display.width, display.height };
+    // display capture sources, cropped so each one only draws the pixels inside the capture region
+    auto displays = get_screen_info();
+    capture_region region{ captureRegion.X, captureRegion.Y, captureRegion.Width, captureRegion.Height };
+    require_obs_type(MODULE_SOURCE, "monitor_capture");
+    for (auto& placement : layout_capture_region(displays, region)) {
+        auto& display = displays[placement.screen];
 
-        if (displayBounds.IntersectsWith(captureRegion)) {
-            auto opt = obs_data_create();
-            obs_data_set_bool(opt, "capture_cursor", !noCursor);
-            obs_data_set_int(opt, "monitor", i);
-            // https://github.com/obsproject/obs-studio/pull/7049 switches the property from 'monitor' to 'monitor_id'
-            obs_data_set_string(opt, "monitor_id", display.monitor_id);
-            obs_source_t* source = obs_source_create("monitor_capture", "", opt, nullptr);
-            obs_data_release(opt);
+        auto opt = obs_data_create();
+        obs_data_set_bool(opt, "capture_cursor", !job.noCursor);
+        obs_data_set_int(opt, "monitor", placement.screen);
+        // https://github.com/obsproject/obs-studio/pull/7049 switches the property from 'monitor' to 'monitor_id'
+        obs_data_set_string(opt, "monitor_id", display.monitor_id);
+        string key = string(display.monitor_id) + (job.noCursor ? "|nocursor" : "|cursor");
+        obs_source_t* source = pipeline_acquire_source("monitor_capture", key, opt, usedSources);
+        obs_data_release(opt);
 
-            obs_sceneitem_t* sceneItem = obs_scene_add(scene, source);
-            vec2 pos{ (float)(displayBounds.X - captureRegion.X) , (float)(displayBounds.Y - captureRegion.Y) };
-            obs_sceneitem_set_pos(sceneItem, &pos);
+        if (directCapture) {
+            obs_set_output_source(0, source);
+            continue;
         }
+
+        obs_sceneitem_t* sceneItem = obs_scene_add(pipeline.scene, source);
+        vec2 pos{ (float)placement.x, (float)placement.y };
+        obs_sceneitem_set_pos(sceneItem, &pos);
+        obs_sceneitem_crop crop{ placement.cropLeft, placement.cropTop, placement.cropRight, placement.cropBottom };
+        obs_sceneitem_set_crop(sceneItem, &crop);
     }
 
-    // encoders & output muxer
-    auto encVideo = create_and_configure_video_encoder(hwAccel, lowCpuMode, crf, outputSize);
-    auto encAudio = obs_audio_encoder_create("ffmpeg_aac", "audio_encoder", nullptr, 0, nullptr);
-    auto muxerOptions = obs_data_create();
-    obs_data_set_string(muxerOptions, "path", outputFile.c_str());
+    pipeline_release_unused_sources(usedSources);
+    startup.mark("sources");
+
+    // encoders & output muxer. the video encoder is reused if nothing about it changed since the last job
+    require_obs_type(MODULE_OUTPUT, job.armed ? ARMED_OUTPUT_ID : job.vfr ? VFR_OUTPUT_ID : job.replayBufferSeconds > 0 ? "replay_buffer" : job.inProcessMux ? MUX_OUTPUT_ID : "ffmpeg_muxer");
+    auto resolve_profile = [&](uint32_t speedStep) {
+        auto resolved = profiles_resolve(job.profiles, capabilities.encoders, encoderId, intent, job.crf, canvas.outputWidth, canvas.outputHeight, speedStep);
+        if (job.armed) {
+            // x264, nvenc and qsv read keyint_sec, the amf plugin reads KeyframeInterval
+            resolved.settings["keyint_sec"] = ARMED_KEYFRAME_INTERVAL_SEC;
+            resolved.settings["KeyframeInterval"] = (double)ARMED_KEYFRAME_INTERVAL_SEC;
+        }
+        return resolved;
+    };
+    auto profile = resolve_profile(0);
+    for (auto& warning : profile.warnings) {
+        events_write("Encoder profile: " + warning);
+    }
 
-    for (auto& kvp : opt_muxer) {
-        auto idx = kvp.second.find_first_of(':', 0);
-        if (idx == string::npos || idx == kvp.second.length() - 1)
-            throw invalid_argument("Option '--" + kvp.first + " " + kvp.second + "' invalid. Must be in the format of a key-value pair separated by the ':' character.");
-        auto k = kvp.second.substr(0, idx);
-        auto v = kvp.second.substr(idx + 1);
-        obs_data_set_string(muxerOptions, k.c_str(), v.c_str());
+    // the controller starts at the job's own profile and may only step towards the cheaper end of its ladder
+    vector<json> speedLevels{};
+    if (job.cpuBudget > 0) {
+        speedLevels.push_back(profile.settings);
+        uint32_t levels = profiles_speed_levels(job.profiles, encoderId, intent);
+        if (levels < 2 && !job.vfr)
+            throw std::runtime_error("--cpuBudget has nothing to adjust, " + encoderId + " has no speed steps and the fps can only be lowered with --vfr");
+        for (uint32_t step = 1; step < levels; step++) {
+            speedLevels.push_back(resolve_profile(step).settings);
+        }
+        events_write("CPU budget " + to_string(job.cpuBudget) + "%, " + to_string(levels - 1) + " speed step(s)"
+            + (job.vfr ? " and " + to_string(ADAPTIVE_FPS_STEPS) + " fps step(s)" : "") + " for " + encoderId);
     }
 
-    muxer = obs_output_create("ffmpeg_muxer", "main_output_muxer", muxerOptions, nullptr);
+    string videoEncoderKey = encoderId + "|" + profile.settings.dump() + "|" + to_string(canvas.outputWidth) + "x" + to_string(canvas.outputHeight);
+    if (pipeline.videoEncoder && pipeline.videoEncoderKey != videoEncoderKey) {
+        obs_encoder_release(pipeline.videoEncoder);
+        pipeline.videoEncoder = nullptr;
+    }
+    if (!pipeline.videoEncoder) {
+        pipeline.videoEncoder = create_and_configure_video_encoder(profile);
+        pipeline.videoEncoderKey = videoEncoderKey;
+        obs_encoder_set_video(pipeline.videoEncoder, obs_get_video());
+    }
 
-    obs_encoder_set_video(encVideo, obs_get_video());
-    obs_encoder_set_audio(encAudio, obs_get_audio());
-    obs_output_set_video_encoder(muxer, encVideo);
-    obs_output_set_audio_encoder(muxer, encAudio, 0);
+    auto muxerOptions = obs_data_create();
+    obs_data_set_string(muxerOptions, "path", job.outputFile.c_str());
+    if (!job.streamFormat.empty()) {
+        obs_data_set_string(muxerOptions, "format_name", job.streamFormat.c_str());
+    }
 
-    if (trackerEnabled) // tracker
-    {
-        auto opt = obs_data_create();
-        obs_data_set_bool(opt, "unload", true);
-        obs_data_set_string(opt, "file", ".\\tracker.png");
-        obs_source_t* source = obs_source_create("image_source", "mouse_highlight", opt, nullptr);
-        obs_data_release(opt);
+    // read by the in process writers, ffmpeg_muxer has no use for them
+    obs_data_set_int(muxerOptions, "write_buffers", job.writeBuffers);
+    obs_data_set_bool(muxerOptions, "direct_io", job.directIo);
+    obs_data_set_int(muxerOptions, "preallocate_bytes", (long long)job.preallocateMb * 1024 * 1024);
+    obs_data_set_int(muxerOptions, "buffer_bytes", (long long)job.stallBufferMb * 1024 * 1024);
+    obs_data_set_string(muxerOptions, "buffer_policy", job.stallPolicy.c_str());
 
-        auto fopt = obs_data_create();
-        obs_data_set_int(fopt, "opacity", 0);
-        obs_data_set_int(fopt, "color", RGB(trackerColor.GetR(), trackerColor.GetG(), trackerColor.GetB()));
-        obs_source_t* filter = obs_source_create("color_filter", "mouse_color_correction", fopt, nullptr);
-        obs_data_release(fopt);
+    for (auto& kvp : job.muxerOptions) {
+        obs_data_set_string(muxerOptions, kvp.first.c_str(), kvp.second.c_str());
+    }
+    if (finalizeFragments && job.inProcessMux) {
+        obs_data_set_int(muxerOptions, "index_reserve_bytes", FMP4_INDEX_RESERVE_BYTES);
+    }
 
-        obs_source_filter_add(source, filter);
-        obs_sceneitem_t* sceneItem = obs_scene_add(scene, source);
-        obs_sceneitem_addref(sceneItem);
+    // each rendition has an encoder which scales the main render itself, written next to --output as {name}_{w}x{h}.{ext}
+    pending_renditions jobRenditions{};
+    json renditionInfo = json::array();
+    if (!job.renditions.empty()) {
+        string directory, stem, extension;
+        util_split_path(job.outputFile, directory, stem, extension);
+        if (extension.empty())
+            extension = "mp4";
+
+        for (auto& spec : job.renditions) {
+            auto size = canvas_plan_create(canvas.outputWidth, canvas.outputHeight, spec.maxWidth, spec.maxHeight, CANVAS_ENCODER_ALIGNMENT);
+            auto renditionProfile = profiles_resolve(job.profiles, capabilities.encoders, encoderId, intent, spec.crf, size.outputWidth, size.outputHeight);
+
+            string path = directory + "/" + stem + "_" + to_string(size.outputWidth) + "x" + to_string(size.outputHeight) + "." + extension;
+            obs_encoder_t* encoder = create_and_configure_video_encoder(renditionProfile);
+            if (encoder == nullptr)
+                throw std::runtime_error("Unable to create the encoder for rendition " + path);
+
+            uint32_t index = (uint32_t)jobRenditions.list.size();
+            jobRenditions.list.push_back({ path, size.outputWidth, size.outputHeight, encoder, nullptr, 0, 0 });
+            rendition_output& rendition = jobRenditions.list.back();
+            if (rendition.width != canvas.outputWidth || rendition.height != canvas.outputHeight)
+                obs_encoder_set_scaled_size(rendition.encoder, rendition.width, rendition.height);
+            obs_encoder_set_video(rendition.encoder, obs_get_video());
+
+            obs_data_t* renditionOptions = obs_data_create();
+            obs_data_apply(renditionOptions, muxerOptions);
+            obs_data_set_string(renditionOptions, "path", rendition.path.c_str());
+            rendition.output = obs_output_create(job.inProcessMux ? MUX_OUTPUT_ID : "ffmpeg_muxer", "rendition_muxer", renditionOptions, nullptr);
+            obs_data_release(renditionOptions);
+            obs_output_set_video_encoder(rendition.output, rendition.encoder);
+            obs_output_set_audio_encoder(rendition.output, pipeline.audioEncoder, 0);
+
+            signal_handler_connect(obs_output_get_signal_handler(rendition.output), "stop", handle_signal_rendition_stopped, (void*)(uintptr_t)index);
+            renditionInfo.push_back({
+                { "path", rendition.path },
+                { "width", rendition.width },
+                { "height", rendition.height },
+                { "quality", renditionProfile.quality },
+            });
+        }
+    }
 
-        mouseFilter = filter;
-        mouseSceneItem = sceneItem;
+    obs_output_t* output;
+    obs_output_t* meter = nullptr;
+    if (job.replayBufferSeconds > 0) {
+        // --output is used as the name template for saved replays
+        string directory, stem, extension;
+        util_split_path(job.outputFile, directory, stem, extension);
+        replayBufferStem = stem;
+        obs_data_set_int(muxerOptions, "max_time_sec", job.replayBufferSeconds);
+        obs_data_set_int(muxerOptions, "max_size_mb", job.replayBufferMaxMb);
+        obs_data_set_string(muxerOptions, "directory", directory.c_str());
+        obs_data_set_string(muxerOptions, "format", stem.c_str());
+        obs_data_set_string(muxerOptions, "extension", extension.empty() ? "mp4" : extension.c_str());
+        obs_data_set_bool(muxerOptions, "allow_spaces", true);
+        output = obs_output_create("replay_buffer", "main_output_replay_buffer", muxerOptions, nullptr);
+        meter = obs_output_create(REPLAY_METER_OUTPUT_ID, "main_output_replay_meter", muxerOptions, nullptr);
+        obs_output_set_video_encoder(meter, pipeline.videoEncoder);
+        obs_output_set_audio_encoder(meter, pipeline.audioEncoder, 0);
+        events_write("Replay buffer: " + to_string(job.replayBufferSeconds) + " seconds, max " + to_string(job.replayBufferMaxMb) + "mb");
+    }
+    else if (job.segmentSeconds > 0 || job.segmentBytes > 0) {
+        // segments are split on keyframes by the muxer itself, so packets are never dropped or duplicated
+        util_split_path(job.outputFile, segmentDirectory, segmentStem, segmentExtension);
+        if (segmentExtension.empty())
+            segmentExtension = "mp4";
+        segmentPath = get_segment_path(0);
+        obs_data_set_string(muxerOptions, "path", segmentPath.c_str());
+        obs_data_set_bool(muxerOptions, "split_file", true);
+        obs_data_set_int(muxerOptions, "max_time_sec", job.segmentSeconds);
+        obs_data_set_int(muxerOptions, "max_size_mb", job.segmentBytes > 0 ? max<uint64_t>(1, (job.segmentBytes + (1024 * 1024) - 1) / (1024 * 1024)) : 0);
+        obs_data_set_string(muxerOptions, "directory", segmentDirectory.c_str());
+        obs_data_set_string(muxerOptions, "extension", segmentExtension.c_str());
+        obs_data_set_bool(muxerOptions, "allow_spaces", true);
+        obs_data_set_bool(muxerOptions, "allow_overwrite", true);
+        output = obs_output_create("ffmpeg_muxer", "main_output_muxer", muxerOptions, nullptr);
+        events_write("Segmenting output, first segment: " + segmentPath);
+    }
+    else if (job.armed) {
+        // packets are muxed in process, only the muxer_settings of --omux apply
+        output = obs_output_create(ARMED_OUTPUT_ID, "main_output_armed", muxerOptions, nullptr);
+        events_write("Armed pre-roll, keyframe every " + to_string(ARMED_KEYFRAME_INTERVAL_SEC) + " second(s)");
+    }
+    else if (job.vfr) {
+        // packets are muxed in process, only the muxer_settings of --omux apply
+        obs_data_set_int(muxerOptions, "max_gap_ms", job.vfrMaxGapMs);
+        output = obs_output_create(VFR_OUTPUT_ID, "main_output_vfr", muxerOptions, nullptr);
+        events_write("Variable frame rate, at least one frame every " + to_string(job.vfrMaxGapMs) + "ms, " + framediff_kernel_name(framediff_best_kernel()) + " change detection");
+    }
+    else if (job.inProcessMux && !job.streamFormat.empty()) {
+        output = obs_output_create(MUX_OUTPUT_ID, "main_output_mux", muxerOptions, nullptr);
+        events_write("Streaming " + job.streamFormat + " to " + (job.outputFile == "-" ? string("stdout") : "\\\\.\\pipe\\" + job.outputFile.substr(5))
+            + ", " + to_string(MUX_STREAM_BUFFER_BYTES / 1024) + "kb writes");
+    }
+    else if (job.inProcessMux) {
+        output = obs_output_create(MUX_OUTPUT_ID, "main_output_mux", muxerOptions, nullptr);
+        events_write("Muxing in process, " + to_string(DISK_WRITER_BLOCK_BYTES / (1024 * 1024)) + "mb writes, " + to_string(job.writeBuffers) + " in flight"
+            + (job.directIo ? ", direct io" : ""));
+    }
+    else {
+        output = obs_output_create("ffmpeg_muxer", "main_output_muxer", muxerOptions, nullptr);
+    }
+    obs_data_release(muxerOptions);
+
+    obs_output_set_video_encoder(output, pipeline.videoEncoder);
+    obs_output_set_audio_encoder(output, pipeline.audioEncoder, 0);
+
+    {
+        lock_guard<mutex> guard(outputLock);
+        muxer = output;
+        replayMeter = meter;
+        spkDevices = speakerSources;
+        micDevices = microphoneSources;
+        renditions.swap(jobRenditions.list);
+        if (!speedLevels.empty()) {
+            adaptive.enabled = true;
+            adaptive.config = adaptive_default_config(job.cpuBudget, job.dropTarget, (uint32_t)speedLevels.size(), job.vfr ? ADAPTIVE_FPS_STEPS : 0);
+            adaptive.encoder = pipeline.videoEncoder;
+            adaptive.levels = speedLevels;
+        }
+    }
+    if (job.segmentSeconds > 0 || job.segmentBytes > 0) {
+        set_next_segment_format(1);
+    }
 
-        obs_add_tick_callback(tick_obs_frame_processing, NULL);
+    if (job.trackerEnabled) // tracker
+    {
+        // clicks are collected on their own thread so none are missed between frames
+        auto input = job.trackerReplay.empty() ? input_collector_create_hook() : input_collector_create_replay(job.trackerReplay);
+        auto color = ((uint32_t)job.trackerColor.GetR() << 16) | ((uint32_t)job.trackerColor.GetG() << 8) | job.trackerColor.GetB();
+        pipeline.tracker = tracker_create_source(captureRegion.X, captureRegion.Y, captureRegion.Width, captureRegion.Height, color, input);
+        if (pipeline.tracker == nullptr)
+            throw std::exception("Unable to create mouse click tracker");
+        obs_scene_add(pipeline.scene, pipeline.tracker);
     }
 
     // obs signals
     signal_handler_t* signals = obs_output_get_signal_handler(muxer);
-    signal_handler_connect(signals, "start", handle_signal_started_recording, nullptr);
+    if (job.armed) {
+        signal_handler_connect(signals, "start", handle_signal_armed, nullptr);
+        signal_handler_connect(signals, "recording", handle_signal_armed_recording, nullptr);
+    }
+    else {
+        signal_handler_connect(signals, "start", handle_signal_started_recording, nullptr);
+    }
     signal_handler_connect(signals, "stop", handle_signal_stopped_recording, nullptr);
     signal_handler_connect(signals, "stop", handle_signal_all, (void*)"stop");
     signal_handler_connect(signals, "start", handle_signal_all, (void*)"start");
     signal_handler_connect(signals, "pause", handle_signal_all, (void*)"pause");
     signal_handler_connect(signals, "unpause", handle_signal_all, (void*)"unpause");
     signal_handler_connect(signals, "starting", handle_signal_all, (void*)"starting");
+    if (job.replayBufferSeconds > 0) {
+        signal_handler_connect(signals, "saved", handle_signal_replay_saved, nullptr);
+    }
+    if (job.segmentSeconds > 0 || job.segmentBytes > 0) {
+        signal_handler_connect(signals, "file_changed", handle_signal_file_changed, nullptr);
+    }
     signal_handler_connect(signals, "stopping", handle_signal_all, (void*)"stopping");
 
+    json rec_init;
+    startup.mark("outputs");
+    rec_init["type"] = "initialized";
+    rec_init["startupMs"] = startup.report();
+    rec_init["encoder"] = encoderId;
+    rec_init["codec"] = obs_get_encoder_codec(encoderId.c_str());
+    rec_init["encoderProfile"] = {
+        { "intent", encoder_intent_name(profile.intent) },
+        { "rateControl", profile.rateControl },
+        { "quality", profile.quality },
+        { "settings", profile.settings },
+        { "warnings", profile.warnings },
+    };
+    if (!renditionInfo.empty()) {
+        rec_init["renditions"] = renditionInfo;
+    }
+    rec_init["capabilityCacheHit"] = pipeline.capabilitiesHit;
+    if (!calibration.empty()) {
+        rec_init["calibration"] = calibration;
+        rec_init["calibrationCacheHit"] = calibrationHit;
+    }
+    rec_init["canvas"] = {
+        { "baseWidth", canvas.baseWidth },
+        { "baseHeight", canvas.baseHeight },
+        { "outputWidth", canvas.outputWidth },
+        { "outputHeight", canvas.outputHeight },
+        { "scaler", canvas_scaler_name(canvas.scaler) },
+        { "pixelCost", canvas.pixelCost },
+        { "alignment", canvas.alignment },
+        { "alignScaled", canvas.alignScaled },
+    };
+    events_write(rec_init.dump());
+
+    if (job.armed) {
+        // the encoders start now, the start command only chooses where in their output the file begins
+        events_write("Requesting armed output start");
+        if (!obs_output_start(muxer))
+            throw std::runtime_error(obs_output_get_last_error(muxer));
+    }
+
+    if (job.pause || job.armed) {
+        events_write(">>>> Type 'start' + Enter to start recording.");
+        WaitForSingleObject(startHandle, INFINITE);
+    }
+
+    if (cancelRequested && !job.armed) {
+        control_tickets_abandon();
+        if (!daemonMode) {
+            events_write("Cancel requested. No output yet. Exiting process.");
+            events_flush(5000);
+            ExitProcess(0);
+        }
+        events_write("Cancel requested. No output yet.");
+        pipeline_end_job();
+        return;
+    }
+
+    if (job.armed) {
+        // an armed output cancelled before start is stopped below and deletes its empty file
+        if (!cancelRequested) {
+            calldata_t cd{};
+            calldata_set_int(&cd, "timestamp_ns", (long long)startCommandNs);
+            proc_handler_call(obs_output_get_proc_handler(muxer), "trigger", &cd);
+            calldata_free(&cd);
+        }
+    }
+    else {
+        events_write("Requesting output start");
+
+        // the renditions start first so none of them misses the main output's first frame
+        for (auto& rendition : renditions) {
+            renditionsRunning++;
+            if (!obs_output_start(rendition.output)) {
+                renditionsRunning--;
+                const char* error = obs_output_get_last_error(rendition.output);
+                throw std::runtime_error("Unable to start rendition " + rendition.path + (error ? string(": ") + error : ""));
+            }
+        }
+        // only a status is lost without it, the replay buffer itself does not depend on it
+        if (replayMeter && !obs_output_start(replayMeter)) {
+            events_write("Unable to start the replay buffer meter, its buffered size is not reported");
+        }
+        if (!obs_output_start(muxer))
+            throw std::runtime_error(obs_output_get_last_error(muxer));
+    }
+
+    WaitForSingleObject(cancelHandle, INFINITE);
+
+    events_write("Cancel requested. Starting Shutdown");
+
+    for (auto& rendition : renditions) {
+        obs_output_stop(rendition.output);
+    }
+    if (replayMeter) {
+        obs_output_stop(replayMeter);
+    }
+    obs_output_stop(muxer);
+
+    // the stopped signal arrives on another thread. a one-shot recorder exits from there, in daemon mode
+    // it hands back to us so the output can be released
+    if (WaitForSingleObject(stoppedHandle, 30000) != WAIT_OBJECT_0) {
+        if (!daemonMode) {
+            events_flush(5000);
+            ExitProcess(-1);
+        }
+        obs_output_force_stop(muxer);
+        WaitForSingleObject(stoppedHandle, 5000);
+    }
+    if (renditionsRunning > 0 && WaitForSingleObject(renditionsStoppedHandle, 30000) != WAIT_OBJECT_0) {
+        for (auto& rendition : renditions) {
+            obs_output_force_stop(rendition.output);
+        }
+    }
+
+    pipeline_end_job();
+}
+
+void run(vector<string> arguments)
+{
+    startup_timer startup{};
+
+    // handle command line arguments
+    auto cmdl = parse_arguments(arguments);
+
+    // with --output - the recording is written to stdout, so everything printed goes to --events instead
+    string eventsTarget = cmdl("events").str();
+    if (cmdl("output").str() == "-") {
+        mux_claim_stdout();
+        events_redirect(eventsTarget.empty() ? "stderr" : eventsTarget);
+    }
+    else if (!eventsTarget.empty()) {
+        events_redirect(eventsTarget);
+    }
+
+    cout << std::endl;
+    cout << "obs-express v" << OBS_EXPRESS_VERSION << ", a command line screen recording utility" << std::endl;
+    cout << "  bundled with obs-studio v" << obs_get_version_string() << std::endl;
+    cout << "  created for Clowd (https://github.com/clowd/Clowd)" << std::endl;
+    cout << std::endl;
+
+    bool help = cmdl[{ "h", "help" }];
+    if (help) {
+        cout << "Global: " << std::endl;
+        cout << "  --help                  Show this help text" << std::endl;
+        cout << "  --daemon                Stay running and record each job sent with the 'record' command" << std::endl;
+        cout << std::endl << "Required: " << std::endl;
+        cout << "  --output {filePath}     The file for the generated recording, - for stdout or pipe:{name} for" << std::endl;
+        cout << "                          the named pipe \\\\.\\pipe\\{name}, streamed as mpegts or mp4 with --fragmentMs" << std::endl;
+        cout << std::endl << "One of: " << std::endl;
+        cout << "  --region {x,y,w,h}      A capture region to spanning multiple monitors" << std::endl;
+        cout << "  --monitor {szDevice}    Only capture the specified monitor" << std::endl;
+        cout << std::endl << "Optional: " << std::endl;
+        cout << "  --adapter {int}         The index of the graphics device to use" << std::endl;
+        cout << "  --speaker {dev_id}      Output device ID to record (can be multiple)" << std::endl;
+        cout << "  --microphone {dev_id}   Input device ID to record (can be multiple)" << std::endl;
+        cout << "  --fps {int}             The target video framerate (default: 30)" << std::endl;
+        cout << "  --crf {int}             Quality from 0-51, lower is better. (default: 24) " << std::endl;
+        cout << "  --maxWidth {int}        Downscale output to a maximum width" << std::endl;
+        cout << "  --maxHeight {int}       Downscale output to a maximum height" << std::endl;
+        cout << "  --rendition {w}x{h}:{crf}" << std::endl;
+        cout << "                          Also record a copy scaled to fit w x h at this crf (can be multiple)" << std::endl;
+        cout << "  --tracker               If the mouse click tracker should be rendered" << std::endl;
+        cout << "  --trackerColor {r,g,b}  The color of the tracker (default: 255,0,0)" << std::endl;
+        cout << "  --trackerReplay {file}  Drive the tracker from a recorded mouse event file" << std::endl;
+        cout << "  --lowCpuMode            Maximize performance, the same as --profile latency" << std::endl;
+        cout << "  --profile {name}        Encoder profile: latency, balanced, quality or size (default: balanced)" << std::endl;
+        cout << "  --profileFile {file}    Json file with encoder profiles to add or override" << std::endl;
+        cout << "  --hwAccel               Use hardware encoding if available" << std::endl;
+        cout << "  --encoder {auto|id}     Benchmark the available encoders and use the cheapest that keeps up," << std::endl;
+        cout << "                          or use the obs encoder with this id" << std::endl;
+        cout << "  --codec {name}          Video codec: h264, hevc or av1 (default: h264)" << std::endl;
+        cout << "  --cpuBudget {percent}   Step to cheaper encoder settings while recording to stay under this cpu use" << std::endl;
+        cout << "  --dropTarget {percent}  Frames per status interval which may be dropped under --cpuBudget (default: 1)" << std::endl;
+        cout << "  --noCursor              Do not render mouse cursor in recording" << std::endl;
+        cout << "  --pause                 Pause before recording until start command" << std::endl;
+        cout << "  --armed                 Like --pause, but encode ahead so recording begins at the start command" << std::endl;
+        cout << "  --vfr                   Only encode frames which changed, for mostly static screens" << std::endl;
+        cout << "  --vfrMaxGap {ms}        Longest time --vfr goes without a frame (default: 1000)" << std::endl;
+        cout << "  --preview {hWnd}        Render a recording preview to window handle" << std::endl;
+        cout << "  --omux {name:value}     Add custom muxer/ffmpeg output options" << std::endl;
+        cout << "  --muxer {name}          Where packets are muxed: subprocess or inprocess (default: subprocess)" << std::endl;
+        cout << "  --fragmentMs {ms}       Write a fragmented mp4 which stays playable if recording is cut short" << std::endl;
+        cout << "  --faststart             Put the mp4 index at the front, without copying the media with --fragmentMs" << std::endl;
+        cout << "  --replayBuffer {sec}    Keep the last N seconds in memory, write them with 'save'" << std::endl;
+        cout << "  --replayBufferMb {int}  Memory limit of the replay buffer (default: 512)" << std::endl;
+        cout << "  --segmentSeconds {sec}  Split the recording into files of this duration" << std::endl;
+        cout << "  --segmentBytes {int}    Split the recording into files of this size (1mb granularity)" << std::endl;
+        cout << "  --statusInterval {ms}   How often status events are written (default: 1000)" << std::endl;
+        cout << "  --control {pipeName}    Also accept json commands on the named pipe \\\\.\\pipe\\{pipeName}" << std::endl;
+        cout << "  --writeBuffers {n}      Blocks the in process muxer has in flight to the disk, 0-8 (default: 2)" << std::endl;
+        cout << "  --directIo              Write around the file cache with the in process muxer" << std::endl;
+        cout << "  --preallocateMb {mb}    Grow the file by this much at a time, 0 to not preallocate (default: 256)" << std::endl;
+        cout << "  --diskWarning {min}     Warn when less than this much recording time is left on the disk (default: 10)" << std::endl;
+        cout << "  --stallBufferMb {mb}    Memory the in process muxer holds packets in while writes stall, 0 for no limit (default: 256)" << std::endl;
+        cout << "  --stallPolicy {name}    When that is full: drop frames nothing refers to, or block the encoder (default: drop)" << std::endl;
+        cout << "  --benchmarkFrameDiff    Measure the --vfr change detection on this cpu and exit" << std::endl;
+        cout << "  --benchmarkTopology     Measure the cursor's monitor and dpi lookups on this display layout and exit" << std::endl;
+        cout << "  --events {stderr|pipe:{name}}" << std::endl;
+        cout << "                          Where events are written instead of stdout (default: stderr with --output -)" << std::endl;
+        cout << "  --benchmarkMux          Measure both --muxer paths on a synthetic 200mbps recording and exit" << std::endl;
+        cout << "  --benchmarkStall        Stall a synthetic recording's writes for 2 seconds under each --stallPolicy and exit" << std::endl;
+        return;
+    }
+
+    if (cmdl["benchmarkFrameDiff"]) {
+        // a 1080p nv12 frame, luma and chroma measured as one plane
+        json results = json::array();
+        for (auto& result : framediff_benchmark(1920, 1080 * 3 / 2, 500)) {
+            results.push_back({
+                { "kernel", framediff_kernel_name(result.kernel) },
+                { "unchangedGBps", result.unchangedGBps },
+                { "changedGBps", result.changedGBps },
+            });
+        }
+        json benchmark;
+        benchmark["type"] = "benchmark";
+        benchmark["frameDiff"] = results;
+        cout << benchmark.dump() << std::endl;
+        return;
+    }
+
+    if (cmdl["benchmarkTopology"]) {
+        // the dpi under the cursor is looked up every time the mouse is sampled
+        auto result = topology_benchmark(get_display_topology(), 1000000);
+        json benchmark;
+        benchmark["type"] = "benchmark";
+        benchmark["topology"] = {
+            { "monitors", result.monitors },
+            { "sameMonitorNs", result.sameMonitorNs },
+            { "alternatingNs", result.alternatingNs },
+            { "offScreenNs", result.offScreenNs },
+        };
+        cout << benchmark.dump() << std::endl;
+        return;
+    }
+
+    if (cmdl["benchmarkMux"] && mux_is_stream(cmdl("output").str())) {
+        // a reader tried end to end, the synthetic recording is streamed the way a real one would be
+        uint32_t fragmentMs = 0;
+        cmdl("fragmentMs", 0) >> fragmentMs;
+        vector<pair<string, string>> muxerOptions{};
+        if (fragmentMs > 0) {
+            add_muxer_setting(muxerOptions, "movflags", "+empty_moov+default_base_moof");
+            add_muxer_setting(muxerOptions, "frag_duration", to_string((uint64_t)fragmentMs * 1000));
+            add_muxer_setting(muxerOptions, "flush_packets", "1");
+        }
+        auto result = mux_benchmark_stream(cmdl("output").str(), fragmentMs > 0 ? "mp4" : "mpegts", muxerOptions.empty() ? "" : muxerOptions[0].second, 8000, 10);
+        json benchmark;
+        benchmark["type"] = "benchmark";
+        benchmark["mux"] = json::array({ {
+            { "path", result.path },
+            { "MBps", result.MBps },
+            { "realtime", result.realtime },
+            { "packets", result.packets },
+            { "bytes", result.bytes },
+            { "blockedMs", result.blockedMs },
+        } });
+        cout << benchmark.dump() << std::endl;
+        return;
+    }
+
+    if (cmdl["benchmarkMux"]) {
+        // ten seconds of a near lossless 1080p60 recording, written to --output or the temp directory
+        string file = cmdl("output").str();
+        if (file.empty()) {
+            char tempPath[MAX_PATH]{};
+            GetTempPathA(MAX_PATH, tempPath);
+            file = string(tempPath) + "obs-express-mux-benchmark.mp4";
+        }
+        json results = json::array();
+        for (auto& result : mux_benchmark(file, 200000, 10)) {
+            results.push_back({
+                { "path", result.path },
+                { "MBps", result.MBps },
+                { "realtime", result.realtime },
+                { "packets", result.packets },
+                { "bytes", result.bytes },
+            });
+        }
+        json benchmark;
+        benchmark["type"] = "benchmark";
+        benchmark["mux"] = results;
+        cout << benchmark.dump() << std::endl;
+        return;
+    }
+
+    if (cmdl["benchmarkStall"]) {
+        // a 20mbps recording whose writer stalls for two seconds: within a budget of twice what arrives meanwhile
+        // nothing may be lost, within half of it drop loses frames and block holds up the encoder instead
+        const uint32_t kbps = 20000, seconds = 5, stallMs = 2000;
+        uint64_t stallBytes = (uint64_t)kbps * 1000 / 8 * stallMs / 1000;
+        string file = cmdl("output").str();
+        if (file.empty()) {
+            char tempPath[MAX_PATH]{};
+            GetTempPathA(MAX_PATH, tempPath);
+            file = string(tempPath) + "obs-express-stall-benchmark.ts";
+        }
+
+        vector<pair<packet_ring_policy, uint64_t>> scenarios = {
+            { packet_ring_policy::drop, stallBytes * 2 },
+            { packet_ring_policy::drop, stallBytes / 2 },
+            { packet_ring_policy::block, stallBytes / 2 },
+        };
+        json results = json::array();
+        for (auto& [policy, budget] : scenarios) {
+            packet_ring_options options{};
+            options.budgetBytes = budget;
+            options.policy = policy;
+            options.codec = "h264";
+            auto result = mux_benchmark_stall(file, kbps, seconds, stallMs, options);
+            results.push_back({
+                { "policy", policy == packet_ring_policy::block ? "block" : "drop" },
+                { "budgetBytes", budget },
+                { "stallMs", stallMs },
+                { "packets", result.packets },
+                { "written", result.written },
+                { "lost", result.packets - result.written },
+                { "dropped", result.dropped },
+                { "peakBytes", result.peakBytes },
+                { "longestStallMs", result.longestStallMs },
+                { "blockedMs", result.blockedMs },
+            });
+        }
+        json benchmark;
+        benchmark["type"] = "benchmark";
+        benchmark["stall"] = results;
+        cout << benchmark.dump() << std::endl;
+        return;
+    }
+
+    daemonMode = cmdl["daemon"];
+
+    uint16_t adapter;
+    cmdl("adapter", 0) >> adapter;
+    cmdl("statusInterval", 1000) >> statusIntervalMs;
+    if (statusIntervalMs == 0)
+        throw std::invalid_argument("--statusInterval must be greater than zero.");
+
+    void* previewHwnd = 0;
+    std::string previewStr = cmdl("preview").str();
+    if (!previewStr.empty()) {
+        std::regex re_all_digits("^\\d+$");
+        std::regex re_hexidecimal("^0x[0-9a-zA-Z]+$");
+        if (std::regex_match(previewStr, re_hexidecimal)) {
+            previewHwnd = (void*)std::stoul(previewStr, nullptr, 16);
+        }
+        else if (std::regex_match(previewStr, re_all_digits)) {
+            previewHwnd = (void*)std::stoul(previewStr, nullptr, 10);
+        }
+        else {
+            throw std::invalid_argument("Unknown window handle format, must be decimal or hexidecimal: " + previewStr);
+        }
+
+        RECT r;
+        if (!GetWindowRect((HWND)previewHwnd, &r))
+            throw std::invalid_argument("Unable to retrieve details for window handle '" + previewStr + "'. Is it a real window? Does this process have permission to access it?");
+    }
+
+    string controlPipe = cmdl("control").str();
+
+    // a one-shot run records the job on the command line. the daemon starts with a canvas the size of the
+    // first display and resizes it to suit each job as it arrives.
+    recording_job job{};
+    vector<string> requiredModules{ "win-capture", "obs-ffmpeg", "obs-x264" };
+    canvas_plan initialCanvas;
+    uint16_t initialFps;
+    if (!daemonMode) {
+        job = parse_recording_job(cmdl);
+        captureRegion = job.region;
+        initialFps = job.fps;
+        initialCanvas = canvas_plan_create(job.region.Width, job.region.Height, job.maxOutputWidth, job.maxOutputHeight, CANVAS_ENCODER_ALIGNMENT);
+
+        // only the modules this command line uses are loaded, anything else is loaded on demand by require_obs_type
+        if (!job.speakers.empty() || !job.microphones.empty())
+            requiredModules.push_back("win-wasapi");
+        if (job.hwAccel || job.encoderMode == "auto" || job.codec != VIDEO_CODEC_H264)
+            requiredModules.push_back("obs-qsv11");
+    }
+    else {
+        auto displays = get_screen_info();
+        if (displays.empty())
+            throw std::exception("No displays found");
+        captureRegion = Rect(displays[0].x, displays[0].y, displays[0].width, displays[0].height);
+        initialFps = 30;
+        initialCanvas = canvas_plan_create(captureRegion.Width, captureRegion.Height, 0, 0, CANVAS_ENCODER_ALIGNMENT);
+
+        // jobs can ask for anything, so load everything they may need up front
+        requiredModules.push_back("win-wasapi");
+        requiredModules.push_back("obs-qsv11");
+    }
+
+    startup.mark("arguments");
+    pipeline_start(adapter, initialFps, initialCanvas, requiredModules, startup);
+
+    // from here on stdout is written by the event writer thread, so obs threads never block on the reader
+    events_start();
+
     startHandle = CreateEvent(NULL, TRUE, FALSE, NULL);
     cancelHandle = CreateEvent(NULL, TRUE, FALSE, NULL);
+    stoppedHandle = CreateEvent(NULL, TRUE, FALSE, NULL);
+    renditionsStoppedHandle = CreateEvent(NULL, TRUE, FALSE, NULL);
+    jobHandle = CreateEvent(NULL, FALSE, FALSE, NULL);
 
     // catch ctrl events and shut down obs gracefully
     SetConsoleCtrlHandler(handle_console_ctrl_event, TRUE);
@@ -565,6 +2235,11 @@ void run(vector<string> arguments)
     // read std-input for commands
     _beginthreadex(NULL, 0, thread_read_input, nullptr, 0, nullptr);
 
+    if (!controlPipe.empty()) {
+        control_pipe_start(controlPipe, &controlTarget);
+        events_write("Listening for control requests on \\\\.\\pipe\\" + controlPipe);
+    }
+
     // start preview rendering
     if (previewHwnd) {
         gs_init_data display_init{};
@@ -579,41 +2254,55 @@ void run(vector<string> arguments)
         obs_display_add_draw_callback(hdisplay, tick_draw_preview_callback, 0);
     }
 
-    json rec_init;
-    rec_init["type"] = "initialized";
-    cout << rec_init << std::endl;
-
-    if (pause) {
-        cout << ">>>> Type 'start' + Enter to start recording." << std::endl;
-        WaitForSingleObject(startHandle, INFINITE);
-    }
-
-    if (cancelRequested) {
-        cout << "Cancel requested. No output yet. Exiting process." << std::endl;
-        ExitProcess(0);
-    }
-
-    cout << "Requesting output start" << std::endl;
-
-    if (!obs_output_start(muxer))
-        throw std::runtime_error(obs_output_get_last_error(muxer));
-
-    // begin writing status to std out
+    // status is sampled for whichever job is recording
     _beginthreadex(NULL, 0, thread_output_realtime_status, nullptr, 0, nullptr);
+    segmentsHandle = CreateEvent(NULL, FALSE, FALSE, NULL);
+    _beginthreadex(NULL, 0, thread_segments_closing, nullptr, 0, nullptr);
 
-    WaitForSingleObject(cancelHandle, INFINITE);
+    if (!daemonMode) {
+        run_job(job, startup);
+        // the stopped signal has already exited the process
+        return;
+    }
 
-    //if (trackerEnabled) obs_remove_tick_callback(frame_tick, NULL);
+    json ready;
+    ready["type"] = "daemon_ready";
+    ready["startupMs"] = startup.report();
+    events_write(ready.dump());
+
+    while (!quitRequested) {
+        WaitForSingleObject(jobHandle, INFINITE);
+
+        while (!quitRequested) {
+            recording_job next;
+            {
+                lock_guard<mutex> guard(jobLock);
+                if (pendingJobs.empty())
+                    break;
+                next = pendingJobs.front();
+                pendingJobs.pop_front();
+            }
 
-    cout << "Cancel requested. Starting Shutdown" << std::endl;
+            // each job reports how long it took from being picked up to being ready to record
+            startup_timer jobTimer{};
+            try {
+                run_job(next, jobTimer);
+            }
+            catch (const std::exception& exc) {
+                json failed;
+                failed["type"] = "job_failed";
+                failed["message"] = exc.what();
+                events_write(failed.dump());
+                pipeline_end_job();
+            }
+        }
+    }
 
-    obs_output_stop(muxer);
+    events_write("Exiting process");
+    events_flush(5000);
 
-    // cleanup is handled by signal_stopped_recording in a different thread
-    for (int i = 0; i < 30; i++) {
-        Sleep(1000);
-    }
-    ExitProcess(-1);
+    // see handle_signal_stopped_recording, the os cleans up faster and more reliably than obs_shutdown
+    ExitProcess(0);
 }
 
 int wmain(int argc, wchar_t* argv[], wchar_t* envp[])
@@ -632,16 +2321,19 @@ int wmain(int argc, wchar_t* argv[], wchar_t* envp[])
         return 0;
     }
     catch (const std::invalid_argument& exc) {
+        events_flush(1000);
         std::cerr << std::endl << exc.what();
         std::cerr << std::endl << "Invalid or missing arguments. The application will now exit." << std::endl;
         return -1;
     }
     catch (const std::exception& exc) {
+        events_flush(1000);
         std::cerr << std::endl << exc.what();
         std::cerr << std::endl << "A fatal error has occurred. The application will now exit." << std::endl;
         return -1;
     }
     catch (...) {
+        events_flush(1000);
         std::cerr << std::endl << "An unknown error has occurred. The application will now exit." << std::endl;
         return -1;
     }
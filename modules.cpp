@@ -0,0 +1,125 @@
+#include "modules.h"
+#include "events.h"
+
+#include <string>
+#include <algorithm>
+
+#include "obs-studio/libobs/obs.h"
+#include "obs-studio/libobs/util/platform.h"
+
+using namespace std;
+
+struct module_location
+{
+    string name;
+    string binaryPath;
+    string dataPath;
+};
+
+static vector<module_location> deferredModules{};
+static vector<module_loaded> loadedModules{};
+
+static void find_module(void* param, const obs_module_info2* info)
+{
+    auto found = (vector<module_location>*)param;
+    found->push_back({ info->name ? info->name : "", info->bin_path ? info->bin_path : "", info->data_path ? info->data_path : "" });
+}
+
+static vector<string> registered_encoders()
+{
+    vector<string> ids{};
+    const char* id;
+    for (size_t i = 0; obs_enum_encoder_types(i, &id); i++) {
+        ids.emplace_back(id);
+    }
+    return ids;
+}
+
+static obs_module_t* load_module(const module_location& location)
+{
+    obs_module_t* module = nullptr;
+    int code = obs_open_module(&module, location.binaryPath.c_str(), location.dataPath.c_str());
+    if (code != MODULE_SUCCESS) {
+        events_write("ERROR: Unable to open module " + location.name + ", error code: " + to_string(code));
+        return nullptr;
+    }
+
+    // obs does not record which module registered an encoder, so it is told by what appeared during its init
+    auto before = registered_encoders();
+    if (!obs_init_module(module)) {
+        events_write("ERROR: Unable to initialize module " + location.name);
+        return nullptr;
+    }
+    module_loaded loaded{ location.name, location.binaryPath, {} };
+    for (auto& id : registered_encoders()) {
+        if (std::find(before.begin(), before.end(), id) == before.end()) {
+            loaded.encoders.push_back(id);
+        }
+    }
+    loadedModules.push_back(loaded);
+    return module;
+}
+
+size_t modules_load(const vector<string>& names)
+{
+    vector<module_location> found{};
+    obs_find_modules2(find_module, &found);
+
+    size_t loaded = 0;
+    for (auto& location : found) {
+        if (std::find(names.begin(), names.end(), location.name) == names.end()) {
+            deferredModules.push_back(location);
+        }
+        else if (load_module(location)) {
+            loaded++;
+        }
+    }
+
+    obs_log_loaded_modules();
+    obs_post_load_modules();
+    return loaded;
+}
+
+static bool is_registered(module_object kind, const char* id)
+{
+    switch (kind) {
+    case MODULE_SOURCE: return obs_source_get_display_name(id) != nullptr;
+    case MODULE_ENCODER: return obs_encoder_get_display_name(id) != nullptr;
+    case MODULE_OUTPUT: return obs_output_get_display_name(id) != nullptr;
+    }
+    return false;
+}
+
+bool modules_require(module_object kind, const char* id)
+{
+    if (is_registered(kind, id)) {
+        return true;
+    }
+    if (deferredModules.empty()) {
+        return false;
+    }
+
+    // there is no registry of which module provides which id without loading it, so load them all
+    events_write("'" + string(id) + "' is not provided by the loaded modules, loading the remaining " + to_string(deferredModules.size()));
+    vector<obs_module_t*> modules{};
+    for (auto& location : deferredModules) {
+        if (auto module = load_module(location)) {
+            modules.push_back(module);
+        }
+    }
+    deferredModules.clear();
+
+    // obs_post_load_modules would run the post load of every module again, so only the new ones get theirs
+    for (auto module : modules) {
+        auto postLoad = (void (*)())os_dlsym(obs_get_module_lib(module), "obs_module_post_load");
+        if (postLoad) {
+            postLoad();
+        }
+    }
+    return is_registered(kind, id);
+}
+
+const vector<module_loaded>& modules_loaded()
+{
+    return loadedModules;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <vector>
+
+enum module_object
+{
+    MODULE_SOURCE,
+    MODULE_ENCODER,
+    MODULE_OUTPUT,
+};
+
+// a module which has been opened and initialized, with the encoder ids which were registered while it was
+struct module_loaded
+{
+    std::string name;
+    std::string binaryPath;
+    std::vector<std::string> encoders;
+};
+
+// finds every bundled module but only opens and initializes the named ones, the rest are remembered so
+// they can still be loaded later. returns the number of modules loaded.
+size_t modules_load(const std::vector<std::string>& names);
+
+// returns true if the id is registered. if it isn't, every module which has not been loaded yet is loaded
+// and post-loaded, and the id is checked again, so an id outside the expected set costs a slower start instead
+// of failing.
+bool modules_require(module_object kind, const char* id);
+
+// in the order they were loaded
+const std::vector<module_loaded>& modules_loaded();
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// bounded lock-free queue for any number of producer threads and exactly one consumer thread.
+// capacity must be a power of two. each slot carries a sequence number so producers can claim slots
+// without a lock, and push never waits on the consumer.
+template <typename T, size_t Capacity>
+struct mpsc_queue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "mpsc_queue capacity must be a power of two");
+
+    mpsc_queue()
+    {
+        for (size_t i = 0; i < Capacity; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // returns false if the queue is full, the item is not enqueued
+    bool push(T&& item)
+    {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        slot* s;
+        while (true) {
+            s = &slots[head & (Capacity - 1)];
+            size_t sequence = s->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)head;
+            if (diff == 0) {
+                if (this->head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                head = this->head.load(std::memory_order_relaxed);
+            }
+        }
+
+        s->item = std::move(item);
+        s->sequence.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // returns false if the queue is empty, or the next item is claimed but not yet written
+    bool pop(T& item)
+    {
+        slot* s = &slots[tail & (Capacity - 1)];
+        if (s->sequence.load(std::memory_order_acquire) != tail + 1) {
+            return false;
+        }
+        item = std::move(s->item);
+        s->sequence.store(tail + Capacity, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+private:
+    struct slot
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) size_t tail = 0;
+    slot slots[Capacity];
+};
@@ -0,0 +1,800 @@
+#include "mux.h"
+#include "events.h"
+#include "diskwriter.h"
+#include "packetring.h"
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "windows.h"
+#include "io.h"
+#include "fcntl.h"
+#include "util.h"
+#include "obs-studio/libobs/util/platform.h"
+
+extern "C" {
+#include "libavformat/avformat.h"
+#include "libavutil/channel_layout.h"
+}
+
+#pragma comment(lib, "avformat.lib")
+#pragma comment(lib, "avcodec.lib")
+#pragma comment(lib, "avutil.lib")
+
+using namespace std;
+
+static const AVRational USEC_TIME_BASE{ 1, 1000000 };
+
+struct mux_writer
+{
+    string path;
+    disk_writer* disk;      // a file
+    FILE* file;             // a stream
+    bool stream;
+    atomic<uint64_t> blockedNs{ 0 };
+    atomic<uint64_t> writeStartNs{ 0 };     // while a write to a stream is waiting on the reader
+    AVFormatContext* format;
+    AVStream* video;
+    AVStream* audio;
+    AVPacket* packet;
+    bool failed;
+
+    // the format's own io_open, which is wrapped so anything it reads back has reached the file
+    int (*ioOpen)(AVFormatContext* s, AVIOContext** pb, const char* url, int flags, AVDictionary** options);
+};
+
+static string av_error_string(int code)
+{
+    char message[AV_ERROR_MAX_STRING_SIZE]{};
+    av_strerror(code, message, sizeof(message));
+    return message;
+}
+
+static AVCodecID get_codec_id(const string& codec)
+{
+    if (codec == "h264") return AV_CODEC_ID_H264;
+    if (codec == "hevc") return AV_CODEC_ID_HEVC;
+    if (codec == "av1") return AV_CODEC_ID_AV1;
+    if (codec == "aac") return AV_CODEC_ID_AAC;
+    if (codec == "opus") return AV_CODEC_ID_OPUS;
+    return AV_CODEC_ID_NONE;
+}
+
+mux_stream_info mux_stream_from_encoder(obs_encoder_t* encoder)
+{
+    mux_stream_info info{};
+    const char* codec = obs_encoder_get_codec(encoder);
+    info.codec = codec ? codec : "";
+    if (obs_encoder_get_type(encoder) == OBS_ENCODER_VIDEO) {
+        const video_output_info* voi = video_output_get_info(obs_encoder_video(encoder));
+        info.width = obs_encoder_get_width(encoder);
+        info.height = obs_encoder_get_height(encoder);
+        info.fpsNum = voi->fps_num;
+        info.fpsDen = voi->fps_den;
+    }
+    else {
+        info.sampleRate = obs_encoder_get_sample_rate(encoder);
+        info.frameSize = (uint32_t)obs_encoder_get_frame_size(encoder);
+        info.channels = (uint32_t)audio_output_get_channels(obs_encoder_audio(encoder));
+    }
+
+    uint8_t* extraData = nullptr;
+    size_t extraSize = 0;
+    if (obs_encoder_get_extra_data(encoder, &extraData, &extraSize) && extraSize > 0) {
+        info.extraData.assign(extraData, extraData + extraSize);
+    }
+    return info;
+}
+
+static AVStream* add_stream(mux_writer* writer, const mux_stream_info* info, bool isVideo, string& error)
+{
+    AVCodecID codecId = get_codec_id(info->codec);
+    if (codecId == AV_CODEC_ID_NONE) {
+        error = "Unsupported codec for muxing: " + info->codec;
+        return nullptr;
+    }
+
+    AVStream* stream = avformat_new_stream(writer->format, nullptr);
+    if (!stream) {
+        error = "Unable to create output stream";
+        return nullptr;
+    }
+
+    AVCodecParameters* par = stream->codecpar;
+    par->codec_id = codecId;
+    if (isVideo) {
+        par->codec_type = AVMEDIA_TYPE_VIDEO;
+        par->width = (int)info->width;
+        par->height = (int)info->height;
+        stream->time_base = { (int)info->fpsDen, (int)info->fpsNum };
+        stream->avg_frame_rate = { (int)info->fpsNum, (int)info->fpsDen };
+    }
+    else {
+        par->codec_type = AVMEDIA_TYPE_AUDIO;
+        par->sample_rate = (int)info->sampleRate;
+        par->frame_size = (int)info->frameSize;
+        av_channel_layout_default(&par->ch_layout, (int)info->channels);
+        stream->time_base = { 1, par->sample_rate };
+    }
+
+    if (!info->extraData.empty()) {
+        par->extradata = (uint8_t*)av_mallocz(info->extraData.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+        memcpy(par->extradata, info->extraData.data(), info->extraData.size());
+        par->extradata_size = (int)info->extraData.size();
+    }
+
+    return stream;
+}
+
+// the stdout this process was started with, once mux_claim_stdout has taken it for "-"
+static int claimedStdout = -1;
+
+void mux_claim_stdout()
+{
+    fflush(stdout);
+    claimedStdout = _dup(_fileno(stdout));
+    _setmode(claimedStdout, _O_BINARY);
+}
+
+bool mux_is_stream(const string& path)
+{
+    return path == "-" || path.rfind("pipe:", 0) == 0;
+}
+
+static FILE* open_stream(const string& path, string& error)
+{
+    int fd = -1;
+    if (path == "-") {
+        // there is only one stdout, the first writer to open it closes it when it is done
+        fd = claimedStdout;
+        claimedStdout = -1;
+        if (fd < 0) {
+            error = "Unable to write to stdout, it has not been claimed or is already in use";
+            return nullptr;
+        }
+    }
+    else {
+        HANDLE pipe = util_connect_pipe(path.substr(5), 5000);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            error = "Unable to connect to \\\\.\\pipe\\" + path.substr(5) + ", the reader must create it first";
+            return nullptr;
+        }
+        fd = _open_osfhandle((intptr_t)pipe, _O_WRONLY | _O_BINARY);
+    }
+
+    FILE* file = _fdopen(fd, "wb");
+    if (!file) {
+        _close(fd);
+        error = "Unable to open '" + path + "'";
+    }
+    return file;
+}
+
+// avio hands over its buffer only once it is full, or when the muxer seeks or flushes, so almost every write is
+// a whole block. files go to a disk_writer, which writes them out while the muxer fills the next one.
+static int file_write(void* opaque, uint8_t* data, int size)
+{
+    auto writer = (mux_writer*)opaque;
+    if (writer->disk) {
+        return disk_writer_write(writer->disk, data, (size_t)size) ? size : AVERROR(EIO);
+    }
+
+    // a pipe only makes a write wait once its buffer is full, so for a stream this is how far the reader is behind
+    uint64_t startNs = writer->stream ? os_gettime_ns() : 0;
+    writer->writeStartNs.store(startNs, memory_order_relaxed);
+    size_t written = fwrite(data, 1, (size_t)size, writer->file);
+    if (writer->stream) {
+        writer->writeStartNs.store(0, memory_order_relaxed);
+        writer->blockedNs.fetch_add(os_gettime_ns() - startNs, memory_order_relaxed);
+    }
+
+    if (written != (size_t)size) {
+        return AVERROR(EIO);
+    }
+    return size;
+}
+
+static int64_t file_seek(void* opaque, int64_t offset, int whence)
+{
+    disk_writer* disk = ((mux_writer*)opaque)->disk;
+    if (whence & AVSEEK_SIZE) {
+        return disk_writer_size(disk);
+    }
+    int64_t position = disk_writer_seek(disk, offset, whence & ~AVSEEK_FORCE);
+    return position < 0 ? AVERROR(EIO) : position;
+}
+
+// mp4 faststart reads the file back through a second handle to move the index, which must see every block
+static int open_flushed(AVFormatContext* s, AVIOContext** pb, const char* url, int flags, AVDictionary** options)
+{
+    auto writer = (mux_writer*)s->opaque;
+    if (writer->disk && !disk_writer_flush(writer->disk)) {
+        return AVERROR(EIO);
+    }
+    return writer->ioOpen(s, pb, url, flags, options);
+}
+
+static bool free_writer(mux_writer* writer)
+{
+    if (writer->format) {
+        if (writer->format->pb) {
+            av_freep(&writer->format->pb->buffer);
+            avio_context_free(&writer->format->pb);
+        }
+        avformat_free_context(writer->format);
+    }
+    bool success = true;
+    if (writer->disk) {
+        success = disk_writer_close(writer->disk);
+    }
+    if (writer->file) {
+        fclose(writer->file);
+    }
+    av_packet_free(&writer->packet);
+    delete writer;
+    return success;
+}
+
+mux_writer* mux_writer_open(const string& path, const string& formatName, const mux_stream_info* video, const mux_stream_info* audio, const string& muxerSettings, string& error, const disk_writer_options& fileOptions)
+{
+    auto writer = new mux_writer{};
+    writer->path = path;
+    writer->stream = mux_is_stream(path);
+    writer->packet = av_packet_alloc();
+
+    int ret = -1;
+    if (!formatName.empty() || writer->stream) {
+        ret = avformat_alloc_output_context2(&writer->format, nullptr, formatName.empty() ? "mpegts" : formatName.c_str(), nullptr);
+    }
+    else {
+        ret = avformat_alloc_output_context2(&writer->format, nullptr, nullptr, path.c_str());
+        if (ret < 0) {
+            ret = avformat_alloc_output_context2(&writer->format, nullptr, "mp4", path.c_str());
+        }
+    }
+    if (ret < 0) {
+        error = "Unable to create muxer for '" + path + "': " + av_error_string(ret);
+        free_writer(writer);
+        return nullptr;
+    }
+
+    writer->video = add_stream(writer, video, true, error);
+    if (!writer->video || (audio && !(writer->audio = add_stream(writer, audio, false, error)))) {
+        free_writer(writer);
+        return nullptr;
+    }
+
+    AVDictionary* options = nullptr;
+    if (!muxerSettings.empty() && av_dict_parse_string(&options, muxerSettings.c_str(), "=", " ", 0) < 0) {
+        error = "Unable to parse muxer settings '" + muxerSettings + "'";
+        av_dict_free(&options);
+        free_writer(writer);
+        return nullptr;
+    }
+
+    size_t bufferBytes = fileOptions.blockBytes;
+    if (writer->stream) {
+        writer->file = open_stream(path, error);
+        if (writer->file) {
+            setvbuf(writer->file, nullptr, _IONBF, 0);
+        }
+        bufferBytes = min<size_t>(bufferBytes, MUX_STREAM_BUFFER_BYTES);
+    }
+    else {
+        writer->disk = disk_writer_open(path, fileOptions, error);
+    }
+    if (!writer->file && !writer->disk) {
+        av_dict_free(&options);
+        free_writer(writer);
+        return nullptr;
+    }
+
+    // without a seek callback the muxer knows it can not go back, and only containers which stream will open
+    uint8_t* buffer = (uint8_t*)av_malloc(bufferBytes);
+    writer->format->pb = avio_alloc_context(buffer, (int)bufferBytes, 1, writer, nullptr, file_write, writer->stream ? nullptr : file_seek);
+    if (!writer->format->pb) {
+        av_free(buffer);
+        error = "Unable to allocate the muxer buffer";
+        av_dict_free(&options);
+        free_writer(writer);
+        return nullptr;
+    }
+
+    writer->format->opaque = writer;
+    writer->ioOpen = writer->format->io_open;
+    writer->format->io_open = open_flushed;
+
+    // packets stay in the buffer until it fills, unless the settings ask for flush_packets
+    writer->format->flush_packets = 0;
+    ret = avformat_write_header(writer->format, &options);
+
+    // anything left was not an option of the container or of libavformat
+    const AVDictionaryEntry* unused = nullptr;
+    while ((unused = av_dict_get(options, "", unused, AV_DICT_IGNORE_SUFFIX))) {
+        events_write("WARNING: Unknown muxer setting '" + string(unused->key) + "'");
+    }
+    av_dict_free(&options);
+
+    if (ret < 0) {
+        error = "Unable to write header to '" + path + "': " + av_error_string(ret);
+        bool stream = writer->stream;
+        free_writer(writer);
+        if (!stream) {
+            os_unlink(path.c_str());
+        }
+        return nullptr;
+    }
+
+    return writer;
+}
+
+mux_writer* mux_writer_open(const string& path, const string& formatName, obs_encoder_t* video, obs_encoder_t* audio, const string& muxerSettings, string& error, const disk_writer_options& fileOptions)
+{
+    mux_stream_info videoInfo = mux_stream_from_encoder(video);
+    mux_stream_info audioInfo{};
+    if (audio) {
+        audioInfo = mux_stream_from_encoder(audio);
+    }
+    return mux_writer_open(path, formatName, &videoInfo, audio ? &audioInfo : nullptr, muxerSettings, error, fileOptions);
+}
+
+static bool write_packet(mux_writer* writer, const encoder_packet* packet, int64_t pts, int64_t dts, AVRational timeBase)
+{
+    if (writer->failed) {
+        return false;
+    }
+
+    AVStream* stream = packet->type == OBS_ENCODER_VIDEO ? writer->video : writer->audio;
+    if (!stream) {
+        return true;
+    }
+
+    auto rounding = (AVRounding)(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
+    AVPacket* pkt = writer->packet;
+    pkt->data = packet->data;
+    pkt->size = (int)packet->size;
+    pkt->stream_index = stream->index;
+    pkt->dts = av_rescale_q_rnd(dts, timeBase, stream->time_base, rounding);
+    pkt->pts = av_rescale_q_rnd(pts, timeBase, stream->time_base, rounding);
+    pkt->flags = packet->keyframe ? AV_PKT_FLAG_KEY : 0;
+
+    // the packet data is not reference counted, so libavformat copies it before buffering for interleaving
+    int ret = av_interleaved_write_frame(writer->format, pkt);
+    av_packet_unref(pkt);
+    if (ret < 0) {
+        events_write("ERROR: Writing to '" + writer->path + "' failed: " + av_error_string(ret));
+        writer->failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool mux_writer_write(mux_writer* writer, const encoder_packet* packet, int64_t originUsec)
+{
+    // sys_dts_usec is the only timestamp on the packet which is in the same clock for every encoder
+    int64_t dtsUsec = packet->sys_dts_usec - originUsec;
+    int64_t ptsUsec = dtsUsec + (packet->pts - packet->dts) * 1000000 * packet->timebase_num / packet->timebase_den;
+    return write_packet(writer, packet, ptsUsec, dtsUsec, USEC_TIME_BASE);
+}
+
+bool mux_writer_write_encoder_time(mux_writer* writer, const encoder_packet* packet)
+{
+    return write_packet(writer, packet, packet->pts, packet->dts, { packet->timebase_num, packet->timebase_den });
+}
+
+bool mux_writer_reserve(mux_writer* writer, uint32_t bytes)
+{
+    // the muxer finds its place in the file with avio_tell, so bytes written between its own writes shift nothing
+    static const uint8_t zeros[4096]{};
+    AVIOContext* pb = writer->format->pb;
+    avio_wb32(pb, bytes);
+    avio_wl32(pb, MKTAG('f', 'r', 'e', 'e'));
+    for (uint32_t left = bytes > 8 ? bytes - 8 : 0; left > 0;) {
+        uint32_t size = min<uint32_t>(left, sizeof(zeros));
+        avio_write(pb, zeros, (int)size);
+        left -= size;
+    }
+    return pb->error >= 0;
+}
+
+uint64_t mux_writer_blocked_ns(mux_writer* writer)
+{
+    uint64_t startNs = writer->writeStartNs.load(memory_order_relaxed);
+    uint64_t blockedNs = writer->blockedNs.load(memory_order_relaxed);
+    return startNs ? blockedNs + (os_gettime_ns() - startNs) : blockedNs;
+}
+
+bool mux_writer_disk_stats(mux_writer* writer, disk_writer_stats& stats)
+{
+    if (!writer->disk) {
+        return false;
+    }
+    stats = disk_writer_get_stats(writer->disk);
+    return true;
+}
+
+bool mux_writer_out_of_space(mux_writer* writer)
+{
+    return writer->disk && disk_writer_out_of_space(writer->disk);
+}
+
+void mux_add_setting(string& muxerSettings, const string& key, const string& value)
+{
+    // whole keys are compared, frag_duration is not min_frag_duration
+    size_t start = 0;
+    while (start < muxerSettings.size()) {
+        size_t end = muxerSettings.find(' ', start);
+        if (end == string::npos) {
+            end = muxerSettings.size();
+        }
+        size_t equals = muxerSettings.find('=', start);
+        if (equals < end && muxerSettings.compare(start, equals - start, key) == 0) {
+            if (value[0] == '+') {
+                muxerSettings.insert(end, value);
+            }
+            return;
+        }
+        start = end + 1;
+    }
+
+    if (!muxerSettings.empty()) {
+        muxerSettings += " ";
+    }
+    muxerSettings += key + "=" + value;
+}
+
+disk_writer_options mux_disk_options(obs_data_t* settings)
+{
+    disk_writer_options options{};
+    if (obs_data_has_user_value(settings, "write_buffers")) {
+        options.blocks = (uint32_t)obs_data_get_int(settings, "write_buffers");
+    }
+    if (obs_data_has_user_value(settings, "preallocate_bytes")) {
+        options.preallocateBytes = (uint64_t)obs_data_get_int(settings, "preallocate_bytes");
+    }
+    options.directIo = obs_data_get_bool(settings, "direct_io");
+    return options;
+}
+
+uint64_t mux_writer_bytes(mux_writer* writer)
+{
+    int64_t bytes = avio_tell(writer->format->pb);
+    return bytes > 0 ? (uint64_t)bytes : 0;
+}
+
+bool mux_writer_close(mux_writer* writer, bool keep)
+{
+    bool success = !writer->failed;
+    if (keep && success) {
+        int ret = av_write_trailer(writer->format);
+        if (ret >= 0) {
+            ret = writer->format->pb->error;
+        }
+        if (ret < 0) {
+            events_write("ERROR: Finalizing '" + writer->path + "' failed: " + av_error_string(ret));
+            success = false;
+        }
+    }
+
+    string path = writer->path;
+    bool stream = writer->stream;
+    if (!free_writer(writer) && keep && success) {
+        events_write("ERROR: Writing to '" + path + "' failed");
+        success = false;
+    }
+    if (!keep && !stream) {
+        os_unlink(path.c_str());
+    }
+    return success;
+}
+
+int64_t mux_file_duration_ms(const string& path)
+{
+    AVFormatContext* format = nullptr;
+    if (avformat_open_input(&format, path.c_str(), nullptr, nullptr) < 0) {
+        return -1;
+    }
+
+    int64_t durationMs = -1;
+    if (avformat_find_stream_info(format, nullptr) >= 0) {
+        int index = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (index >= 0 && format->streams[index]->duration != AV_NOPTS_VALUE) {
+            durationMs = av_rescale_q(format->streams[index]->duration, format->streams[index]->time_base, AVRational{ 1, 1000 });
+        }
+        else if (format->duration != AV_NOPTS_VALUE) {
+            durationMs = av_rescale_q(format->duration, AV_TIME_BASE_Q, AVRational{ 1, 1000 });
+        }
+    }
+    avformat_close_input(&format);
+    return durationMs;
+}
+
+// the header obs-ffmpeg-mux reads ahead of each packet's data
+struct pipe_packet_header
+{
+    int type;
+    int keyframe;
+    int64_t pts;
+    int64_t dts;
+    uint32_t size;
+};
+
+static bool pipe_read(HANDLE pipe, void* data, size_t size)
+{
+    auto bytes = (uint8_t*)data;
+    while (size > 0) {
+        DWORD read = 0;
+        if (!ReadFile(pipe, bytes, (DWORD)size, &read, nullptr) || read == 0) {
+            return false;
+        }
+        bytes += read;
+        size -= read;
+    }
+    return true;
+}
+
+static bool pipe_write(HANDLE pipe, const void* data, size_t size)
+{
+    DWORD written = 0;
+    return WriteFile(pipe, data, (DWORD)size, &written, nullptr) && written == size;
+}
+
+// the same synthetic 60fps video and aac stream for every benchmark, packets point into payload
+struct synthetic_recording
+{
+    mux_stream_info video, audio;
+    vector<uint8_t> payload;
+    vector<encoder_packet> packets;
+};
+
+static const uint32_t SYNTHETIC_FPS = 60, SYNTHETIC_SAMPLE_RATE = 48000;
+
+static void synthetic_recording_create(synthetic_recording& recording, uint32_t videoKbps, uint32_t seconds, bool annexB)
+{
+    const uint32_t fps = SYNTHETIC_FPS, gop = 120, sampleRate = SYNTHETIC_SAMPLE_RATE, audioFrame = 1024, audioBytes = 512;
+
+    // a keyframe is four times the size of the average frame, the other frames share what is left of the gop
+    size_t averageFrame = (size_t)videoKbps * 1000 / 8 / fps;
+    size_t keyframeBytes = averageFrame * 4;
+    size_t frameBytes = (averageFrame * gop - keyframeBytes) / (gop - 1);
+
+    // the contents are never parsed, only the codec header has to look like one. no byte is zero, so the payload
+    // never contains a start code of its own.
+    vector<uint8_t>& payload = recording.payload;
+    payload.resize(keyframeBytes + (annexB ? frameBytes * 2 : 0));
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = (uint8_t)((i * 2654435761u) >> 24) | 0x01;
+    }
+
+    mux_stream_info& video = recording.video;
+    video.codec = "h264";
+    video.width = 1920;
+    video.height = 1080;
+    video.fpsNum = fps;
+    video.fpsDen = 1;
+    if (annexB) {
+        // mpegts takes h264 the way obs encoders hand it out, each frame starting with a start code
+        // the frames between keyframes take turns at being a reference and being disposable, a slice which no
+        // other frame refers to, like the b-frames of an encoder which has them.
+        video.extraData = { 0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x00, 0x2A, 0x00, 0x00, 0x00, 0x01, 0x68, 0xEE, 0x3C, 0x80 };
+        const uint8_t keyframe[] = { 0x00, 0x00, 0x00, 0x01, 0x65 };
+        const uint8_t reference[] = { 0x00, 0x00, 0x00, 0x01, 0x41 };
+        const uint8_t disposable[] = { 0x00, 0x00, 0x00, 0x01, 0x01 };
+        std::copy(std::begin(keyframe), std::end(keyframe), payload.begin());
+        std::copy(std::begin(reference), std::end(reference), payload.begin() + keyframeBytes);
+        std::copy(std::begin(disposable), std::end(disposable), payload.begin() + keyframeBytes + frameBytes);
+    }
+    else {
+        video.extraData = { 0x01, 0x64, 0x00, 0x2A, 0xFF, 0xE1, 0x00, 0x04, 0x67, 0x64, 0x00, 0x2A, 0x01, 0x00, 0x04, 0x68, 0xEE, 0x3C, 0x80 };
+    }
+
+    mux_stream_info& audio = recording.audio;
+    audio.codec = "aac";
+    audio.sampleRate = sampleRate;
+    audio.channels = 2;
+    audio.frameSize = audioFrame;
+    audio.extraData = { 0x11, 0x90 };
+
+    // interleaved by time, as obs hands them to an output
+    vector<encoder_packet>& packets = recording.packets;
+    uint64_t audioIndex = 0;
+    for (uint64_t frame = 0; frame < (uint64_t)fps * seconds; frame++) {
+        while (audioIndex * audioFrame * fps <= frame * sampleRate) {
+            encoder_packet packet{};
+            packet.type = OBS_ENCODER_AUDIO;
+            packet.data = payload.data();
+            packet.size = audioBytes;
+            packet.pts = packet.dts = (int64_t)(audioIndex * audioFrame);
+            packet.timebase_num = 1;
+            packet.timebase_den = sampleRate;
+            packet.keyframe = true;
+            packets.push_back(packet);
+            audioIndex++;
+        }
+
+        encoder_packet packet{};
+        packet.type = OBS_ENCODER_VIDEO;
+        packet.keyframe = frame % gop == 0;
+        packet.data = payload.data() + (annexB && !packet.keyframe ? keyframeBytes + frameBytes * (frame % 2) : 0);
+        packet.size = packet.keyframe ? keyframeBytes : frameBytes;
+        packet.pts = packet.dts = (int64_t)frame;
+        packet.timebase_num = 1;
+        packet.timebase_den = fps;
+        packets.push_back(packet);
+    }
+}
+
+vector<mux_benchmark_result> mux_benchmark(const string& file, uint32_t videoKbps, uint32_t seconds)
+{
+    const uint32_t fps = SYNTHETIC_FPS, sampleRate = SYNTHETIC_SAMPLE_RATE;
+    synthetic_recording recording{};
+    synthetic_recording_create(recording, videoKbps, seconds, false);
+    const mux_stream_info& video = recording.video;
+    const mux_stream_info& audio = recording.audio;
+    const vector<encoder_packet>& packets = recording.packets;
+
+    vector<mux_benchmark_result> results{};
+    auto finish = [&](const char* path, uint64_t startNs, uint64_t bytes) {
+        double elapsed = (os_gettime_ns() - startNs) / 1e9;
+        results.push_back({ path, bytes / 1e6 / elapsed, seconds / elapsed, (uint64_t)packets.size(), bytes });
+        os_unlink(file.c_str());
+    };
+    string error;
+
+    {
+        uint64_t startNs = os_gettime_ns();
+        mux_writer* writer = mux_writer_open(file, "", &video, &audio, "", error);
+        if (!writer) {
+            events_write("ERROR: " + error);
+            return results;
+        }
+        for (auto& packet : packets) {
+            mux_writer_write_encoder_time(writer, &packet);
+        }
+        uint64_t bytes = mux_writer_bytes(writer);
+        mux_writer_close(writer, true);
+        finish("in_process", startNs, bytes);
+    }
+
+    {
+        // the pipe gets the default buffer size, as os_process_pipe gives obs-ffmpeg-mux
+        HANDLE readPipe, writePipe;
+        if (!CreatePipe(&readPipe, &writePipe, nullptr, 0)) {
+            return results;
+        }
+
+        uint64_t startNs = os_gettime_ns();
+        uint64_t bytes = 0;
+        thread subprocess([&]() {
+            mux_writer* writer = mux_writer_open(file, "", &video, &audio, "", error, disk_writer_options{ 32768, 0, false, 0 });
+            vector<uint8_t> data{};
+            pipe_packet_header header{};
+            while (pipe_read(readPipe, &header, sizeof(header))) {
+                data.resize(header.size);
+                if (!pipe_read(readPipe, data.data(), header.size)) {
+                    break;
+                }
+                if (writer) {
+                    encoder_packet packet{};
+                    packet.type = (obs_encoder_type)header.type;
+                    packet.keyframe = header.keyframe != 0;
+                    packet.data = data.data();
+                    packet.size = header.size;
+                    packet.pts = header.pts;
+                    packet.dts = header.dts;
+                    packet.timebase_num = 1;
+                    packet.timebase_den = header.type == OBS_ENCODER_VIDEO ? fps : sampleRate;
+                    mux_writer_write_encoder_time(writer, &packet);
+                }
+            }
+            if (writer) {
+                bytes = mux_writer_bytes(writer);
+                mux_writer_close(writer, true);
+            }
+        });
+
+        for (auto& packet : packets) {
+            pipe_packet_header header{ (int)packet.type, packet.keyframe ? 1 : 0, packet.pts, packet.dts, (uint32_t)packet.size };
+            if (!pipe_write(writePipe, &header, sizeof(header)) || !pipe_write(writePipe, packet.data, packet.size)) {
+                break;
+            }
+        }
+        CloseHandle(writePipe);
+        subprocess.join();
+        CloseHandle(readPipe);
+        finish("subprocess", startNs, bytes);
+    }
+
+    return results;
+}
+
+mux_benchmark_result mux_benchmark_stream(const string& path, const string& formatName, const string& muxerSettings, uint32_t videoKbps, uint32_t seconds)
+{
+    synthetic_recording recording{};
+    synthetic_recording_create(recording, videoKbps, seconds, true);
+    mux_benchmark_result result{ "stream", 0, 0, (uint64_t)recording.packets.size(), 0, 0 };
+
+    string error;
+    uint64_t startNs = os_gettime_ns();
+    mux_writer* writer = mux_writer_open(path, formatName, &recording.video, &recording.audio, muxerSettings, error);
+    if (!writer) {
+        events_write("ERROR: " + error);
+        return result;
+    }
+    for (auto& packet : recording.packets) {
+        if (!mux_writer_write_encoder_time(writer, &packet)) {
+            break;
+        }
+    }
+    result.bytes = mux_writer_bytes(writer);
+    result.blockedMs = mux_writer_blocked_ns(writer) / 1e6;
+    mux_writer_close(writer, true);
+
+    // the reader sets the pace, the rate is how fast it took the stream
+    double elapsed = (os_gettime_ns() - startNs) / 1e9;
+    result.MBps = result.bytes / 1e6 / elapsed;
+    result.realtime = seconds / elapsed;
+    return result;
+}
+
+mux_stall_result mux_benchmark_stall(const string& file, uint32_t videoKbps, uint32_t seconds, uint32_t stallMs, const packet_ring_options& options)
+{
+    synthetic_recording recording{};
+    synthetic_recording_create(recording, videoKbps, seconds, true);
+    mux_stall_result result{};
+    result.packets = recording.packets.size();
+
+    string error;
+    mux_writer* writer = mux_writer_open(file, "mpegts", &recording.video, &recording.audio, "", error);
+    if (!writer) {
+        events_write("ERROR: " + error);
+        return result;
+    }
+
+    packet_ring* ring = packet_ring_create();
+    packet_ring_open(ring, options);
+
+    // the writer stalls once, a second into the recording, the way a virus scanner holds a file it has just seen
+    thread writerThread([&]() {
+        bool stalled = false;
+        deque<encoder_packet> batch{};
+        while (packet_ring_take(ring, batch)) {
+            for (auto& packet : batch) {
+                if (!stalled && packet.type == OBS_ENCODER_VIDEO && packet.dts >= SYNTHETIC_FPS) {
+                    stalled = true;
+                    os_sleep_ms(stallMs);
+                }
+                if (mux_writer_write_encoder_time(writer, &packet)) {
+                    result.written++;
+                }
+                packet_ring_release(ring, packet);
+            }
+            batch.clear();
+        }
+    });
+
+    // packets arrive at the pace they were captured, each in memory of its own the way an encoder hands them out
+    uint64_t startNs = os_gettime_ns();
+    for (auto& packet : recording.packets) {
+        os_sleepto_ns(startNs + (uint64_t)packet.dts * 1000000000 * packet.timebase_num / packet.timebase_den);
+        encoder_packet instance{};
+        obs_encoder_packet_create_instance(&instance, &packet);
+        packet_ring_push(ring, &instance);
+        obs_encoder_packet_release(&instance);
+    }
+    packet_ring_close(ring);
+    writerThread.join();
+
+    packet_ring_stats stats = packet_ring_get_stats(ring);
+    packet_ring_destroy(ring);
+    mux_writer_close(writer, false);
+
+    result.dropped = stats.droppedPackets;
+    result.peakBytes = stats.peakBytes;
+    result.longestStallMs = stats.longestStallNs / 1e6;
+    result.blockedMs = stats.blockedNs / 1e6;
+    return result;
+}
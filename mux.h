@@ -0,0 +1,119 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "obs-studio/libobs/obs.h"
+#include "diskwriter.h"
+#include "packetring.h"
+
+// writes encoded packets from libobs into a container with libavformat, in this process and on the caller's
+// thread. the container is chosen from the file extension, mp4 if there is none. the container is assembled in
+// a buffer of its own and handed to a disk_writer a whole block at a time, rather than the 32kb avio writes of
+// obs-ffmpeg-mux.
+//
+// instead of a file the path may be a stream: "-" for this process's stdout, or "pipe:{name}" for a named pipe
+// \\.\pipe\{name} which the reader has already created. a stream can not seek, so it is mpegts unless another
+// format is asked for, and an mp4 must then be fragmented with the movflags in muxerSettings.
+struct mux_writer;
+
+// a stream is written in smaller blocks, so the reader gets a steady flow rather than a burst every few seconds
+#define MUX_STREAM_BUFFER_BYTES (256 * 1024)
+
+bool mux_is_stream(const std::string& path);
+
+// takes this process's stdout for "-", before anything else is written to it. see events_redirect for where
+// everything else printed then goes.
+void mux_claim_stdout();
+
+// what a stream's container headers are made from
+struct mux_stream_info
+{
+    std::string codec;              // obs codec name: h264, hevc, av1, aac or opus
+    uint32_t width, height;
+    uint32_t fpsNum, fpsDen;
+    uint32_t sampleRate, channels, frameSize;
+    std::vector<uint8_t> extraData; // sps/pps or the audio specific config, required by mp4 and mkv
+};
+
+// the encoder must already be initialized, its codec headers are part of the info
+mux_stream_info mux_stream_from_encoder(obs_encoder_t* encoder);
+
+// formatName is a libavformat muxer name, empty to go by the path. muxerSettings are space separated key=value
+// pairs, the same as ffmpeg_muxer's "muxer_settings", so --omux options mean the same thing in both. audio may be
+// null. returns nullptr and sets error if the file could not be created.
+mux_writer* mux_writer_open(const std::string& path, const std::string& formatName, const mux_stream_info* video, const mux_stream_info* audio, const std::string& muxerSettings, std::string& error, const disk_writer_options& fileOptions = {});
+mux_writer* mux_writer_open(const std::string& path, const std::string& formatName, obs_encoder_t* video, obs_encoder_t* audio, const std::string& muxerSettings, std::string& error, const disk_writer_options& fileOptions = {});
+
+// adds key=value to space separated muxer settings. a value starting with '+' is a flag, appended to any flags
+// already given for the key, any other value is only added if the key has none yet.
+void mux_add_setting(std::string& muxerSettings, const std::string& key, const std::string& value);
+
+// the disk_writer_options in an output's settings: "write_buffers", "direct_io" and "preallocate_bytes", with the
+// defaults for any which are not set
+disk_writer_options mux_disk_options(obs_data_t* settings);
+
+// timestamps are written relative to originUsec, a system time in the same clock as sys_dts_usec. video before
+// the origin is kept so decoding can start at its keyframe, and containers with edit lists (mp4, mov) hide it
+// on playback. returns false once a write has failed, the file should then be closed.
+bool mux_writer_write(mux_writer* writer, const encoder_packet* packet, int64_t originUsec);
+
+// timestamps are the packet's own pts and dts, which libobs starts at zero for each stream of an output. this is
+// how obs-ffmpeg-mux writes them, so a pause leaves no gap in the file.
+bool mux_writer_write_encoder_time(mux_writer* writer, const encoder_packet* packet);
+
+// writes a free box of this size, which fmp4_finalize may later put the index into. only before the first packet.
+bool mux_writer_reserve(mux_writer* writer, uint32_t bytes);
+
+uint64_t mux_writer_bytes(mux_writer* writer);
+
+// how long writes to a stream have waited for its reader, including one which is waiting now. always zero for a
+// file. unlike everything else here it may be called from another thread while the writer is in use.
+uint64_t mux_writer_blocked_ns(mux_writer* writer);
+
+// block write latency and how long the muxer waited on the disk, false for a stream. may be called from another
+// thread, like mux_writer_blocked_ns.
+bool mux_writer_disk_stats(mux_writer* writer, disk_writer_stats& stats);
+
+// a write failed because the disk is full, so the output should stop with OBS_OUTPUT_NO_SPACE
+bool mux_writer_out_of_space(mux_writer* writer);
+
+// finalizes the file if keep is set, otherwise closes and deletes it. the writer is freed either way.
+bool mux_writer_close(mux_writer* writer, bool keep);
+
+// the duration of a finished file by the timestamps of the packets in it, those of its video if it has any. the
+// index of an mp4 or mkv has them, other formats are read at both ends. -1 if the file can not be read.
+int64_t mux_file_duration_ms(const std::string& path);
+
+struct mux_benchmark_result
+{
+    const char* path;
+    double MBps;
+    double realtime;        // seconds of the synthetic recording muxed per second
+    uint64_t packets;
+    uint64_t bytes;
+    double blockedMs;       // for a stream, how long the reader held up the writer
+};
+
+// muxes the same synthetic 60fps video and aac stream into file through each write path. "in_process" is this
+// writer, "subprocess" copies every packet through a pipe to a thread which muxes with 32kb writes, the way
+// ffmpeg_muxer hands packets to obs-ffmpeg-mux. the file is deleted afterwards.
+std::vector<mux_benchmark_result> mux_benchmark(const std::string& file, uint32_t videoKbps, uint32_t seconds);
+
+// writes the same synthetic recording to a stream as fast as its reader takes it, to try a reader end to end
+// without capturing anything. the stream ends when it has all been written.
+mux_benchmark_result mux_benchmark_stream(const std::string& path, const std::string& formatName, const std::string& muxerSettings, uint32_t videoKbps, uint32_t seconds);
+
+struct mux_stall_result
+{
+    uint64_t packets;
+    uint64_t written;           // reached the file, the rest were lost
+    uint64_t dropped;           // left out by the packet_ring policy
+    uint64_t peakBytes;
+    double longestStallMs;
+    double blockedMs;           // how long the encoder would have waited for room
+};
+
+// hands the synthetic recording over at its own pace through a packet_ring to a writer which stalls for stallMs
+// after the first second. file is written as mpegts and deleted afterwards.
+mux_stall_result mux_benchmark_stall(const std::string& file, uint32_t videoKbps, uint32_t seconds, uint32_t stallMs, const packet_ring_options& options);
@@ -0,0 +1,151 @@
+#include "muxoutput.h"
+#include "mux.h"
+#include "packetring.h"
+#include "outputwriter.h"
+
+#include <string>
+
+using namespace std;
+
+struct mux_output
+{
+    output_writer writer;           // takes packets from the ring
+    packet_ring* ring;
+};
+
+static const char* mux_output_get_name(void* unused)
+{
+    return "In-process Muxer Output";
+}
+
+static void mux_output_get_stats_proc(void* data, calldata_t* cd)
+{
+    auto ctx = (mux_output*)data;
+    output_writer_get_stats(&ctx->writer, cd);
+    packet_ring_stats ring = packet_ring_get_stats(ctx->ring);
+    calldata_set_int(cd, "queued_bytes", (long long)ring.bufferedBytes);
+    calldata_set_int(cd, "queued_packets", (long long)ring.bufferedPackets);
+    calldata_set_int(cd, "peak_bytes", (long long)ring.peakBytes);
+    calldata_set_int(cd, "drained_bytes", (long long)ring.drainedBytes);
+    calldata_set_int(cd, "longest_stall_ns", (long long)ring.longestStallNs);
+    calldata_set_int(cd, "dropped_packets", (long long)ring.droppedPackets);
+    calldata_set_int(cd, "dropped_bytes", (long long)ring.droppedBytes);
+    calldata_set_int(cd, "full_blocked_ns", (long long)ring.blockedNs);
+    calldata_set_int(cd, "full_count", ring.exhausted);
+}
+
+static void* mux_output_create(obs_data_t* settings, obs_output_t* output)
+{
+    auto ctx = new mux_output{};
+    ctx->ring = packet_ring_create();
+    ctx->writer.output = output;
+    ctx->writer.ring = ctx->ring;
+    proc_handler_add(obs_output_get_proc_handler(output), "void get_stats(" OUTPUT_WRITER_STATS ", out int queued_bytes, out int queued_packets, "
+        "out int peak_bytes, out int drained_bytes, out int longest_stall_ns, out int dropped_packets, out int dropped_bytes, out int full_blocked_ns, "
+        "out int full_count)", mux_output_get_stats_proc, ctx);
+    return ctx;
+}
+
+static void mux_output_destroy(void* data)
+{
+    auto ctx = (mux_output*)data;
+    output_writer_join(&ctx->writer);
+    packet_ring_destroy(ctx->ring);
+    delete ctx;
+}
+
+static bool mux_output_start(void* data)
+{
+    auto ctx = (mux_output*)data;
+    obs_output_t* output = ctx->writer.output;
+    if (!obs_output_can_begin_data_capture(output, 0)) {
+        return false;
+    }
+    if (!obs_output_initialize_encoders(output, 0)) {
+        return false;
+    }
+    output_writer_join(&ctx->writer);
+
+    obs_data_t* settings = obs_output_get_settings(output);
+    string path = obs_data_get_string(settings, "path");
+    string formatName = obs_data_get_string(settings, "format_name");
+    string muxerSettings = obs_data_get_string(settings, "muxer_settings");
+    disk_writer_options fileOptions = mux_disk_options(settings);
+    uint32_t indexReserve = (uint32_t)obs_data_get_int(settings, "index_reserve_bytes");
+    packet_ring_options ringOptions{};
+    ringOptions.budgetBytes = (uint64_t)obs_data_get_int(settings, "buffer_bytes");
+    ringOptions.policy = string(obs_data_get_string(settings, "buffer_policy")) == "block" ? packet_ring_policy::block : packet_ring_policy::drop;
+    ringOptions.codec = obs_encoder_get_codec(obs_output_get_video_encoder(output));
+    obs_data_release(settings);
+
+    string error;
+    mux_writer* mux = mux_writer_open(path, formatName, obs_output_get_video_encoder(output), obs_output_get_audio_encoder(output, 0), muxerSettings, error, fileOptions);
+    if (!mux) {
+        obs_output_set_last_error(output, error.c_str());
+        return false;
+    }
+    if (indexReserve > 0) {
+        mux_writer_reserve(mux, indexReserve);
+    }
+
+    packet_ring_open(ctx->ring, ringOptions);
+    output_writer_start(&ctx->writer, mux, 0, true);
+
+    if (!obs_output_begin_data_capture(output, 0)) {
+        lock_guard<mutex> guard(ctx->writer.lock);
+        output_writer_finish(&ctx->writer, false);
+        return false;
+    }
+    return true;
+}
+
+static void mux_output_stop(void* data, uint64_t ts)
+{
+    auto ctx = (mux_output*)data;
+    lock_guard<mutex> guard(ctx->writer.lock);
+    output_writer_stop(&ctx->writer, ts);
+}
+
+static void mux_output_packet(void* data, encoder_packet* packet)
+{
+    auto ctx = (mux_output*)data;
+    if (!packet) {
+        // the encoder failed
+        lock_guard<mutex> guard(ctx->writer.lock);
+        if (ctx->writer.mux) {
+            output_writer_fail(&ctx->writer, OBS_OUTPUT_ENCODE_ERROR);
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> guard(ctx->writer.lock);
+        if (!ctx->writer.mux || ctx->writer.finishing || output_writer_reached_stop(&ctx->writer, packet)) {
+            return;
+        }
+    }
+
+    // not under the lock, a push may wait for room until a stop closes the ring. obs hands packets to an output
+    // one at a time, so they still reach the ring in order.
+    packet_ring_push(ctx->ring, packet);
+}
+
+static uint64_t mux_output_get_total_bytes(void* data)
+{
+    return ((mux_output*)data)->writer.bytes.load(memory_order_relaxed);
+}
+
+void mux_output_register()
+{
+    obs_output_info output{};
+    output.id = MUX_OUTPUT_ID;
+    output.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_CAN_PAUSE;
+    output.get_name = mux_output_get_name;
+    output.create = mux_output_create;
+    output.destroy = mux_output_destroy;
+    output.start = mux_output_start;
+    output.stop = mux_output_stop;
+    output.encoded_packet = mux_output_packet;
+    output.get_total_bytes = mux_output_get_total_bytes;
+    obs_register_output(&output);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "obs-studio/libobs/obs.h"
+
+#define MUX_OUTPUT_ID "express_mux_output"
+
+// a drop-in for ffmpeg_muxer which muxes in this process instead of copying every packet through a pipe to
+// obs-ffmpeg-mux. packets are handed to a writer thread through a packet_ring, so the encoder threads do not wait
+// on the disk, and the file is written in large blocks. it can be paused, and a stop keeps everything captured
+// before it was requested.
+//
+// settings: "path", a file or a stream as described in mux.h, "format_name", the libavformat muxer to use instead
+//           of going by the path, "muxer_settings", "index_reserve_bytes", space left after the container header
+//           for fmp4_finalize to move the index of a fragmented mp4 into, the disk_writer_options read by
+//           mux_disk_options, and "buffer_bytes" and "buffer_policy", drop or block, the packet_ring_options of
+//           the packets waiting for the writer thread. 0 buffer_bytes, the default, does not limit them.
+//
+// procs:    get_stats(out int blocked_ns, out int queued_bytes, out int queued_packets), how long writes have
+//           waited on the reader of a stream, and what is waiting for the writer thread. together they are the
+//           backpressure of a stream. for a file it also gives disk_wait_ns, disk_queued and the block write
+//           latency_p50_ms, latency_p95_ms, latency_p99_ms and latency_max_ms of its disk_writer. the rest are
+//           the packet_ring_stats: peak_bytes, drained_bytes, longest_stall_ns, dropped_packets, dropped_bytes,
+//           full_blocked_ns and full_count.
+void mux_output_register();
@@ -0,0 +1,187 @@
+#include "outputwriter.h"
+
+using namespace std;
+
+static void release_packets(deque<encoder_packet>& packets)
+{
+    for (auto& packet : packets) {
+        obs_encoder_packet_release(&packet);
+    }
+    packets.clear();
+}
+
+// waits for the next packets, false once the writer is finishing and every packet has been taken
+static bool output_writer_take(output_writer* writer, deque<encoder_packet>& batch, int64_t& originUsec)
+{
+    if (writer->ring) {
+        return packet_ring_take(writer->ring, batch);
+    }
+
+    unique_lock<mutex> guard(writer->lock);
+    writer->wake.wait(guard, [writer] { return !writer->pending.empty() || writer->finishing; });
+    batch.swap(writer->pending);
+    originUsec = writer->originUsec;
+    return !batch.empty();
+}
+
+// packets from the ring are still in encoder time, the queued ones are already in real time
+static bool output_writer_write(output_writer* writer, encoder_packet& packet, int64_t originUsec)
+{
+    if (writer->ring) {
+        return mux_writer_write_encoder_time(writer->mux, &packet);
+    }
+    return mux_writer_write(writer->mux, &packet, originUsec);
+}
+
+static void output_writer_loop(output_writer* writer)
+{
+    bool failed = false;
+    deque<encoder_packet> batch{};
+    int64_t originUsec = 0;
+    while (output_writer_take(writer, batch, originUsec)) {
+        // only this thread frees the mux_writer, so it is used without the lock
+        int stopCode = OBS_OUTPUT_SUCCESS;
+        for (auto& packet : batch) {
+            if (!failed && !output_writer_write(writer, packet, originUsec)) {
+                failed = true;
+                stopCode = mux_writer_out_of_space(writer->mux) ? OBS_OUTPUT_NO_SPACE : OBS_OUTPUT_ERROR;
+            }
+            if (writer->ring) {
+                packet_ring_release(writer->ring, packet);
+            }
+            else {
+                obs_encoder_packet_release(&packet);
+            }
+        }
+        batch.clear();
+        writer->bytes.store(mux_writer_bytes(writer->mux), memory_order_relaxed);
+
+        if (stopCode != OBS_OUTPUT_SUCCESS) {
+            lock_guard<mutex> guard(writer->lock);
+            output_writer_fail(writer, stopCode);
+        }
+    }
+
+    unique_lock<mutex> guard(writer->lock);
+    bool keep = writer->keep;
+    bool endCapture = writer->endCapture;
+    int stopCode = writer->stopCode;
+    mux_writer* mux = writer->mux;
+    writer->mux = nullptr;
+    guard.unlock();
+
+    // like ffmpeg_muxer, whatever was written is kept even if the recording failed part way
+    if (!mux_writer_close(mux, keep) && keep && stopCode == OBS_OUTPUT_SUCCESS && endCapture) {
+        stopCode = OBS_OUTPUT_ERROR;
+    }
+    if (writer->closed) {
+        writer->closed();
+    }
+    if (stopCode != OBS_OUTPUT_SUCCESS) {
+        obs_output_signal_stop(writer->output, stopCode);
+    }
+    else if (endCapture) {
+        obs_output_end_data_capture(writer->output);
+    }
+}
+
+void output_writer_start(output_writer* writer, mux_writer* mux, int64_t originUsec, bool keep)
+{
+    {
+        lock_guard<mutex> guard(writer->lock);
+        writer->mux = mux;
+        writer->originUsec = originUsec;
+        writer->keep = keep;
+        writer->stopping = writer->finishing = writer->endCapture = false;
+        writer->stopCode = OBS_OUTPUT_SUCCESS;
+        writer->stopUsec = 0;
+        writer->bytes = 0;
+    }
+    writer->thread = thread(output_writer_loop, writer);
+}
+
+void output_writer_join(output_writer* writer)
+{
+    {
+        lock_guard<mutex> guard(writer->lock);
+        if (writer->mux) {
+            output_writer_finish(writer, false);
+        }
+    }
+    if (writer->thread.joinable()) {
+        writer->thread.join();
+    }
+    release_packets(writer->pending);
+}
+
+void output_writer_push(output_writer* writer, encoder_packet& packet)
+{
+    writer->pending.push_back(packet);
+    writer->wake.notify_one();
+}
+
+void output_writer_finish(output_writer* writer, bool endCapture)
+{
+    if (writer->finishing) {
+        return;
+    }
+    writer->finishing = true;
+    writer->endCapture = endCapture;
+    if (writer->ring) {
+        packet_ring_close(writer->ring);
+    }
+    writer->wake.notify_one();
+}
+
+void output_writer_fail(output_writer* writer, int stopCode)
+{
+    if (writer->stopCode == OBS_OUTPUT_SUCCESS) {
+        writer->stopCode = stopCode;
+    }
+    output_writer_finish(writer, false);
+}
+
+bool output_writer_stop(output_writer* writer, uint64_t ts)
+{
+    if (!writer->mux || writer->finishing) {
+        return false;
+    }
+
+    if (ts == 0) {
+        output_writer_finish(writer, true);
+        return false;
+    }
+    writer->stopping = true;
+    writer->stopUsec = (int64_t)(ts / 1000);
+    return true;
+}
+
+bool output_writer_reached_stop(output_writer* writer, const encoder_packet* packet)
+{
+    if (!writer->stopping || packet->sys_dts_usec < writer->stopUsec) {
+        return false;
+    }
+    output_writer_finish(writer, true);
+    return true;
+}
+
+void output_writer_get_stats(output_writer* writer, calldata_t* cd)
+{
+    uint64_t blockedNs = 0;
+    disk_writer_stats disk{};
+    {
+        // the writer thread only frees the mux_writer after taking it from here under the lock
+        lock_guard<mutex> guard(writer->lock);
+        if (writer->mux) {
+            blockedNs = mux_writer_blocked_ns(writer->mux);
+            mux_writer_disk_stats(writer->mux, disk);
+        }
+    }
+    calldata_set_int(cd, "blocked_ns", (long long)blockedNs);
+    calldata_set_int(cd, "disk_wait_ns", (long long)disk.waitNs);
+    calldata_set_int(cd, "disk_queued", (long long)disk.queued);
+    calldata_set_float(cd, "latency_p50_ms", disk.latencyP50Ms);
+    calldata_set_float(cd, "latency_p95_ms", disk.latencyP95Ms);
+    calldata_set_float(cd, "latency_p99_ms", disk.latencyP99Ms);
+    calldata_set_float(cd, "latency_max_ms", disk.latencyMaxMs);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+#include "mux.h"
+#include "packetring.h"
+#include "obs-studio/libobs/obs.h"
+
+// the writer thread and stop handling of the in process outputs. packets are queued for a thread which writes them
+// to a mux_writer, so the encoder threads never wait on the disk. the writer ends data capture, or signals the stop
+// code, only once the file is closed: anything waiting for the stop signal would otherwise find a file which is
+// still being finalized.
+//
+// the fields after the lock are only touched under it, and the outputs guard their own state with it too.
+struct output_writer
+{
+    obs_output_t* output;
+    packet_ring* ring;              // packets waiting for the writer in encoder time, or nullptr to queue them in pending
+    std::function<void()> closed;   // called on the writer thread once the file is closed, before the stop is signalled
+    std::thread thread;
+    std::atomic<uint64_t> bytes{ 0 };
+
+    std::mutex lock;
+    std::condition_variable wake;
+    mux_writer* mux;                // only the writer thread frees it after taking it from here
+    std::deque<encoder_packet> pending;     // packets waiting for the writer in real time from originUsec
+    int64_t originUsec;
+    bool keep;                      // whether the file is worth keeping when it is closed
+    bool stopping;                  // a stop is waiting for the packets captured before stopUsec
+    bool finishing;                 // the writer closes the file once everything queued is written
+    bool endCapture;                // the writer ends data capture once the file is closed
+    int stopCode;                   // or signals this stop code instead, OBS_OUTPUT_SUCCESS for none
+    int64_t stopUsec;
+};
+
+// finishes the file without ending data capture and waits for the thread. the output's start calls it before
+// opening the next file, so the previous one is closed, and its destroy before freeing what the thread uses.
+void output_writer_join(output_writer* writer);
+
+// starts a thread which writes to mux and closes it when finished, before the output begins data capture
+void output_writer_start(output_writer* writer, mux_writer* mux, int64_t originUsec, bool keep);
+
+// caller holds writer->lock. queues a packet for the writer, taking ownership of the reference
+void output_writer_push(output_writer* writer, encoder_packet& packet);
+
+// caller holds writer->lock. the writer closes the file once everything queued is written
+void output_writer_finish(output_writer* writer, bool endCapture);
+
+// caller holds writer->lock. finishes the file and signals the first stop code given instead of ending capture
+void output_writer_fail(output_writer* writer, int stopCode);
+
+// caller holds writer->lock. a ts of 0 finishes at once, any other waits for the packets captured before it. true
+// while a stop is waiting.
+bool output_writer_stop(output_writer* writer, uint64_t ts);
+
+// caller holds writer->lock. finishes the file once a packet from the stop time on arrives, true if it did
+bool output_writer_reached_stop(output_writer* writer, const encoder_packet* packet);
+
+// the writer's blocked_ns, and disk_wait_ns, disk_queued and latency_p50_ms, latency_p95_ms, latency_p99_ms and
+// latency_max_ms of its disk_writer, for a get_stats proc
+void output_writer_get_stats(output_writer* writer, calldata_t* cd);
+
+#define OUTPUT_WRITER_STATS "out int blocked_ns, out int disk_wait_ns, out int disk_queued, out float latency_p50_ms, " \
+    "out float latency_p95_ms, out float latency_p99_ms, out float latency_max_ms"
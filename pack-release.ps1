@@ -19,6 +19,12 @@ msbuild ObsExpressCpp.sln -t:Rebuild -p:Configuration=Release -p:Platform=x64
 $ReleaseDir = Resolve-Path -Path "build64/rundir/MinSizeRel"
 $BinDir = Resolve-Path -Path "$ReleaseDir/bin/64bit"
 
+& "$BinDir/obs-express-tests.exe"
+if ($LASTEXITCODE -ne 0) {
+    Write-Host "Tests failed, not creating a release"
+    exit $LASTEXITCODE
+}
+
 # remove non en-US locale's
 $localeFiles = Get-ChildItem -Path $ReleaseDir -Filter *.ini -Recurse -ErrorAction SilentlyContinue -Force
 foreach($file in $localeFiles)
@@ -38,5 +44,6 @@ rce "$BinDir/obs-express.exe" `
 
 # create final zip
 Remove-Item -Path "$BinDir/*.pdb" -ErrorAction Ignore
+Remove-Item -Path "$BinDir/obs-express-tests.exe" -ErrorAction Ignore
 Remove-Item -Path "obs-express.zip" -ErrorAction Ignore
 seven a obs-express.zip -y -mx9 `"${ReleaseDir}/*`"
@@ -0,0 +1,211 @@
+#include "packetring.h"
+
+#include <mutex>
+#include <algorithm>
+#include <condition_variable>
+
+#include "obs-studio/libobs/util/platform.h"
+
+using namespace std;
+
+struct packet_ring
+{
+    packet_ring_options options;
+
+    mutex lock;
+    condition_variable wake;        // for the writer, a packet was pushed or the ring was closed
+    condition_variable room;        // for a push waiting on the budget, a packet was released or the ring was closed
+    deque<encoder_packet> pending;  // pushed and not yet taken
+    bool closed;
+    bool skipToKeyframe;            // a reference frame was dropped, nothing decodes again before the next keyframe
+    bool full;                      // the budget ran out and the ring has not yet drained to half of it
+    uint64_t progressNs;            // when the writer last released a packet, or the ring last stopped being empty
+
+    packet_ring_stats stats;
+};
+
+// a frame no other frame is predicted from, so leaving it out costs only that frame. the encoders hand frames out
+// as annex b, every nal unit after a start code. the emulation prevention bytes of the format mean a start code
+// is never part of a nal unit itself.
+static bool packet_disposable(const encoder_packet* packet, const string& codec)
+{
+    bool h264 = codec == "h264";
+    bool hevc = codec == "hevc";
+    if (!h264 && !hevc) {
+        return false;
+    }
+
+    bool slices = false;
+    const uint8_t* data = packet->data;
+    for (size_t i = 0; i + 3 < packet->size; i++) {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+            continue;
+        }
+        uint8_t header = data[i + 3];
+        if (h264) {
+            // a slice with a nal_ref_idc of zero is not a reference
+            uint8_t type = header & 0x1F;
+            if (type == 1 || type == 5) {
+                if (header & 0x60) {
+                    return false;
+                }
+                slices = true;
+            }
+        }
+        else {
+            // the sub-layer non-reference pictures are the even vcl types up to 14
+            uint8_t type = (header >> 1) & 0x3F;
+            if (type < 32) {
+                if (type > 14 || type % 2 == 1) {
+                    return false;
+                }
+                slices = true;
+            }
+        }
+        i += 3;
+    }
+    return slices;
+}
+
+// caller holds ring->lock. a packet larger than the whole budget still fits into an empty ring.
+static bool over_budget(packet_ring* ring, size_t size)
+{
+    uint64_t budget = ring->options.budgetBytes;
+    return budget > 0 && ring->stats.bufferedBytes > 0 && ring->stats.bufferedBytes + size > budget;
+}
+
+// caller holds ring->lock
+static void release_pending(packet_ring* ring)
+{
+    for (auto& packet : ring->pending) {
+        obs_encoder_packet_release(&packet);
+    }
+    ring->pending.clear();
+}
+
+packet_ring* packet_ring_create()
+{
+    auto ring = new packet_ring{};
+    ring->closed = true;
+    return ring;
+}
+
+void packet_ring_open(packet_ring* ring, const packet_ring_options& options)
+{
+    lock_guard<mutex> guard(ring->lock);
+    release_pending(ring);
+    ring->options = options;
+    ring->closed = ring->skipToKeyframe = ring->full = false;
+    ring->progressNs = 0;
+    ring->stats = {};
+}
+
+bool packet_ring_push(packet_ring* ring, encoder_packet* packet)
+{
+    unique_lock<mutex> guard(ring->lock);
+    if (ring->closed) {
+        return false;
+    }
+
+    bool video = packet->type == OBS_ENCODER_VIDEO;
+    if (video && packet->keyframe) {
+        ring->skipToKeyframe = false;
+    }
+
+    bool drop = video && ring->skipToKeyframe;
+    if (!drop && over_budget(ring, packet->size)) {
+        if (!ring->full) {
+            ring->full = true;
+            ring->stats.exhausted++;
+        }
+
+        if (ring->options.policy == packet_ring_policy::block) {
+            uint64_t startNs = os_gettime_ns();
+            ring->room.wait(guard, [ring, packet] { return ring->closed || !over_budget(ring, packet->size); });
+            ring->stats.blockedNs += os_gettime_ns() - startNs;
+            if (ring->closed) {
+                return false;
+            }
+        }
+        else if (video) {
+            ring->skipToKeyframe = !packet_disposable(packet, ring->options.codec);
+            drop = true;
+        }
+    }
+
+    if (drop) {
+        ring->stats.droppedPackets++;
+        ring->stats.droppedBytes += packet->size;
+        return false;
+    }
+
+    encoder_packet copy{};
+    obs_encoder_packet_ref(&copy, packet);
+    if (ring->stats.bufferedPackets == 0) {
+        // the writer had nothing to do until now, so it can not have been stalled
+        ring->progressNs = os_gettime_ns();
+    }
+    ring->pending.push_back(copy);
+    ring->stats.bufferedBytes += copy.size;
+    ring->stats.bufferedPackets++;
+    ring->stats.peakBytes = max(ring->stats.peakBytes, ring->stats.bufferedBytes);
+    ring->wake.notify_one();
+    return true;
+}
+
+bool packet_ring_take(packet_ring* ring, deque<encoder_packet>& batch)
+{
+    unique_lock<mutex> guard(ring->lock);
+    ring->wake.wait(guard, [ring] { return !ring->pending.empty() || ring->closed; });
+    if (ring->pending.empty()) {
+        return false;
+    }
+    batch.swap(ring->pending);
+    return true;
+}
+
+void packet_ring_release(packet_ring* ring, encoder_packet& packet)
+{
+    uint64_t nowNs = os_gettime_ns();
+    {
+        lock_guard<mutex> guard(ring->lock);
+        ring->stats.longestStallNs = max(ring->stats.longestStallNs, nowNs - ring->progressNs);
+        ring->progressNs = nowNs;
+        ring->stats.bufferedBytes -= packet.size;
+        ring->stats.bufferedPackets--;
+        ring->stats.drainedBytes += packet.size;
+        if (ring->full && ring->stats.bufferedBytes <= ring->options.budgetBytes / 2) {
+            ring->full = false;
+        }
+        ring->room.notify_all();
+    }
+    obs_encoder_packet_release(&packet);
+}
+
+void packet_ring_close(packet_ring* ring)
+{
+    lock_guard<mutex> guard(ring->lock);
+    ring->closed = true;
+    ring->wake.notify_all();
+    ring->room.notify_all();
+}
+
+packet_ring_stats packet_ring_get_stats(packet_ring* ring)
+{
+    lock_guard<mutex> guard(ring->lock);
+    packet_ring_stats stats = ring->stats;
+    if (stats.bufferedPackets > 0) {
+        // a stall which is still going on
+        stats.longestStallNs = max(stats.longestStallNs, os_gettime_ns() - ring->progressNs);
+    }
+    return stats;
+}
+
+void packet_ring_destroy(packet_ring* ring)
+{
+    {
+        lock_guard<mutex> guard(ring->lock);
+        release_pending(ring);
+    }
+    delete ring;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <deque>
+#include <string>
+#include <cstdint>
+#include "obs-studio/libobs/obs.h"
+
+// a bounded buffer of encoded packets between the encoders and a writer thread. a write which stalls for a few
+// seconds, a virus scanner opening the file or a network drive catching up, is absorbed in memory and the
+// encoders never notice. a packet is counted against the budget until the writer releases it, written or not.
+//
+// once the budget is used up the policy decides. drop leaves out video frames which no other frame refers to,
+// and when the frame at hand is a reference, everything up to the next keyframe with it, so the file always
+// decodes. block makes the encoder wait for room, so obs skips frames before they are encoded instead. audio is
+// always buffered, it is a small part of the bytes and a gap in it is heard.
+struct packet_ring;
+
+enum class packet_ring_policy
+{
+    drop,
+    block,
+};
+
+struct packet_ring_options
+{
+    uint64_t budgetBytes = 0;                       // 0 for no limit
+    packet_ring_policy policy = packet_ring_policy::drop;
+    std::string codec;                              // the video encoder's, frames are only told apart in h264 and hevc
+};
+
+struct packet_ring_stats
+{
+    uint64_t bufferedBytes;     // pushed and not yet released by the writer
+    uint64_t bufferedPackets;
+    uint64_t peakBytes;
+    uint64_t drainedBytes;      // released by the writer
+    uint64_t longestStallNs;    // the longest the writer went without releasing a packet while some were waiting
+    uint64_t droppedPackets;
+    uint64_t droppedBytes;
+    uint64_t blockedNs;         // how long pushes waited for room
+    uint32_t exhausted;         // times the budget ran out, again only after the ring has drained to half of it
+};
+
+packet_ring* packet_ring_create();
+
+// empties the ring and takes packets again under these options, the stats start over
+void packet_ring_open(packet_ring* ring, const packet_ring_options& options);
+
+// keeps a reference to the packet, or drops it by the policy and returns false. also false once the ring is
+// closed. with the block policy this waits until there is room, so it must not hold a lock which the writer or
+// packet_ring_close needs.
+bool packet_ring_push(packet_ring* ring, encoder_packet* packet);
+
+// waits for packets and moves all of them into batch, which must be empty. false once the ring is closed and
+// every packet has been taken.
+bool packet_ring_take(packet_ring* ring, std::deque<encoder_packet>& batch);
+
+// the writer is done with a packet it took, its reference is released
+void packet_ring_release(packet_ring* ring, encoder_packet& packet);
+
+// no more packets are pushed, a push which is waiting gives up. what is in the ring can still be taken.
+void packet_ring_close(packet_ring* ring);
+
+// may be called from any thread
+packet_ring_stats packet_ring_get_stats(packet_ring* ring);
+
+void packet_ring_destroy(packet_ring* ring);
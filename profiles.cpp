@@ -0,0 +1,341 @@
+#include "profiles.h"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "obs-studio/libobs/util/platform.h"
+#include "obs-studio/libobs/util/bmem.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+// --crf and the quality offsets are on the h264 scale
+#define PROFILE_BASE_QUALITY_MAX 51
+
+static const char* INTENT_NAMES[] = { "latency", "balanced", "quality", "size" };
+
+// hardware profiles leave the crf alone for latency, only x264 loses enough quality at its fastest preset
+// to need compensating. obs 29 renamed nvenc's presets to p1-p7 and quick sync's to TU1-TU7.
+// only x264 has speed ladders, it is the only encoder which applies analysis options while it is running. a
+// preset can not be changed that way, so each intent spells out the options its ladder touches, which are the
+// ones its preset would have set anyway, to give stepping back something to return to.
+static const char* BUILTIN_PROFILES = R"json(
+{
+    "obs_x264": {
+        "qualityMax": 51,
+        "rateControls": [ { "name": "CRF", "quality": [ "crf" ] } ],
+        "settings": { "profile": "high", "use_bufsize": true },
+        "intents": {
+            "latency": {
+                "qualityOffset": -2, "settings": { "preset": "ultrafast" },
+                "speedLadder": [ { "qualityOffset": 2 }, { "qualityOffset": 4 } ]
+            },
+            "balanced": {
+                "settings": { "preset": "veryfast", "x264opts": "subme=2 me=hex trellis=0 ref=1 partitions=i8x8,i4x4" },
+                "speedLadder": [
+                    { "qualityOffset": 1, "settings": { "x264opts": "subme=1 me=dia trellis=0 ref=1 partitions=i8x8,i4x4" } },
+                    { "qualityOffset": 2, "settings": { "x264opts": "subme=0 me=dia trellis=0 ref=1 partitions=none" } }
+                ]
+            },
+            "quality": {
+                "qualityOffset": -2, "settings": { "preset": "faster", "x264opts": "subme=4 me=hex trellis=1 ref=2 partitions=p8x8,b8x8,i8x8,i4x4" },
+                "speedLadder": [
+                    { "qualityOffset": 1, "settings": { "x264opts": "subme=2 me=hex trellis=0 ref=1 partitions=i8x8,i4x4" } },
+                    { "qualityOffset": 2, "settings": { "x264opts": "subme=1 me=dia trellis=0 ref=1 partitions=i8x8,i4x4" } },
+                    { "qualityOffset": 3, "settings": { "x264opts": "subme=0 me=dia trellis=0 ref=1 partitions=none" } }
+                ]
+            },
+            "size": {
+                "qualityOffset": 2, "settings": { "preset": "medium", "x264opts": "subme=7 me=hex trellis=1 ref=3 partitions=p8x8,b8x8,i8x8,i4x4" },
+                "speedLadder": [
+                    { "settings": { "x264opts": "subme=4 me=hex trellis=1 ref=2 partitions=p8x8,b8x8,i8x8,i4x4" } },
+                    { "qualityOffset": 1, "settings": { "x264opts": "subme=2 me=hex trellis=0 ref=1 partitions=i8x8,i4x4" } },
+                    { "qualityOffset": 2, "settings": { "x264opts": "subme=0 me=dia trellis=0 ref=1 partitions=none" } }
+                ]
+            }
+        }
+    },
+    "jim_nvenc": {
+        "qualityMax": 51,
+        "rateControls": [ { "name": "CQP", "quality": [ "cqp" ] } ],
+        "settings": { "profile": "high", "bitrate": 0 },
+        "intents": {
+            "latency": { "settings": { "preset2": "p1", "tune": "ull", "multipass": "disabled" } },
+            "balanced": { "settings": { "preset2": "p4", "tune": "hq", "multipass": "qres" } },
+            "quality": { "qualityOffset": -2, "settings": { "preset2": "p6", "tune": "hq", "multipass": "qres" } },
+            "size": { "qualityOffset": 2, "settings": { "preset2": "p7", "tune": "hq", "multipass": "fullres" } }
+        }
+    },
+    "jim_hevc_nvenc": {
+        "qualityMax": 51,
+        "rateControls": [ { "name": "CQP", "quality": [ "cqp" ] } ],
+        "settings": { "profile": "main", "bitrate": 0 },
+        "intents": {
+            "latency": { "settings": { "preset2": "p1", "tune": "ull", "multipass": "disabled" } },
+            "balanced": { "settings": { "preset2": "p4", "tune": "hq", "multipass": "qres" } },
+            "quality": { "qualityOffset": -2, "settings": { "preset2": "p6", "tune": "hq", "multipass": "qres" } },
+            "size": { "qualityOffset": 2, "settings": { "preset2": "p7", "tune": "hq", "multipass": "fullres" } }
+        }
+    },
+    "jim_av1_nvenc": {
+        "qualityMax": 63,
+        "rateControls": [ { "name": "CQP", "quality": [ "cqp" ] } ],
+        "settings": { "profile": "main", "bitrate": 0 },
+        "intents": {
+            "latency": { "settings": { "preset2": "p1", "tune": "ull", "multipass": "disabled" } },
+            "balanced": { "settings": { "preset2": "p4", "tune": "hq", "multipass": "qres" } },
+            "quality": { "qualityOffset": -2, "settings": { "preset2": "p6", "tune": "hq", "multipass": "qres" } },
+            "size": { "qualityOffset": 2, "settings": { "preset2": "p7", "tune": "hq", "multipass": "fullres" } }
+        }
+    },
+    "amd_amf_h264": {
+        "qualityMax": 51,
+        "rateControls": [ { "name": "CQP", "quality": [ "QP.IFrame", "QP.PFrame", "QP.BFrame" ], "settings": { "RateControlMethod": 0 } } ],
+        "settings": { "Usage": 0, "Profile": 100, "VBVBuffer": 1, "VBVBuffer.Size": 100000, "KeyframeInterval": 2.0, "BFrame.Pattern": 0 },
+        "intents": {
+            "latency": { "settings": { "QualityPreset": 0 } },
+            "balanced": { "settings": { "QualityPreset": 1 } },
+            "quality": { "qualityOffset": -2, "settings": { "QualityPreset": 2 } },
+            "size": { "qualityOffset": 2, "settings": { "QualityPreset": 2 } }
+        }
+    },
+    "h265_texture_amf": {
+        "qualityMax": 51,
+        "rateControls": [ { "name": "CQP", "quality": [ "cqp" ] } ],
+        "settings": { "profile": "main", "bitrate": 0 },
+        "intents": {
+            "latency": { "settings": { "preset": "speed" } },
+            "balanced": { "settings": { "preset": "balanced" } },
+            "quality": { "qualityOffset": -2, "settings": { "preset": "quality" } },
+            "size": { "qualityOffset": 2, "settings": { "preset": "quality" } }
+        }
+    },
+    "av1_texture_amf": {
+        "qualityMax": 63,
+        "rateControls": [ { "name": "CQP", "quality": [ "cqp" ] } ],
+        "settings": { "profile": "main", "bitrate": 0 },
+        "intents": {
+            "latency": { "settings": { "preset": "speed" } },
+            "balanced": { "settings": { "preset": "balanced" } },
+            "quality": { "qualityOffset": -2, "settings": { "preset": "quality" } },
+            "size": { "qualityOffset": 2, "settings": { "preset": "highQuality" } }
+        }
+    },
+    "obs_qsv11": {
+        "qualityMax": 51,
+        "rateControls": [
+            { "name": "ICQ", "quality": [ "icq_quality" ] },
+            { "name": "CQP", "quality": [ "qpi", "qpp", "qpb", "cqp" ] }
+        ],
+        "settings": { "profile": "high" },
+        "intents": {
+            "latency": { "settings": { "target_usage": "TU7", "latency": "ultra-low" } },
+            "balanced": { "settings": { "target_usage": "TU4" } },
+            "quality": { "qualityOffset": -2, "settings": { "target_usage": "TU2" } },
+            "size": { "qualityOffset": 2, "settings": { "target_usage": "TU1" } }
+        }
+    },
+    "obs_qsv11_hevc": {
+        "qualityMax": 51,
+        "rateControls": [
+            { "name": "ICQ", "quality": [ "icq_quality" ] },
+            { "name": "CQP", "quality": [ "qpi", "qpp", "qpb", "cqp" ] }
+        ],
+        "settings": { "profile": "main" },
+        "intents": {
+            "latency": { "settings": { "target_usage": "TU7", "latency": "ultra-low" } },
+            "balanced": { "settings": { "target_usage": "TU4" } },
+            "quality": { "qualityOffset": -2, "settings": { "target_usage": "TU2" } },
+            "size": { "qualityOffset": 2, "settings": { "target_usage": "TU1" } }
+        }
+    },
+    "obs_qsv11_av1": {
+        "qualityMax": 63,
+        "rateControls": [
+            { "name": "ICQ", "quality": [ "icq_quality" ] },
+            { "name": "CQP", "quality": [ "qpi", "qpp", "qpb", "cqp" ] }
+        ],
+        "settings": { "profile": "main" },
+        "intents": {
+            "latency": { "settings": { "target_usage": "TU7", "latency": "ultra-low" } },
+            "balanced": { "settings": { "target_usage": "TU4" } },
+            "quality": { "qualityOffset": -2, "settings": { "target_usage": "TU2" } },
+            "size": { "qualityOffset": 2, "settings": { "target_usage": "TU1" } }
+        }
+    },
+    "ffmpeg_svt_av1": {
+        "qualityMax": 63,
+        "rateControls": [ { "name": "CQP", "quality": [ "cqp" ] } ],
+        "intents": {
+            "latency": { "settings": { "preset": 12 } },
+            "balanced": { "settings": { "preset": 10 } },
+            "quality": { "qualityOffset": -2, "settings": { "preset": 8 } },
+            "size": { "qualityOffset": 2, "settings": { "preset": 6 } }
+        }
+    },
+    "ffmpeg_aom_av1": {
+        "qualityMax": 63,
+        "rateControls": [ { "name": "CQP", "quality": [ "cqp" ] } ],
+        "intents": {
+            "latency": { "settings": { "preset": 9 } },
+            "balanced": { "settings": { "preset": 8 } },
+            "quality": { "qualityOffset": -2, "settings": { "preset": 6 } },
+            "size": { "qualityOffset": 2, "settings": { "preset": 5 } }
+        }
+    }
+}
+)json";
+
+encoder_intent parse_encoder_intent(const string& name)
+{
+    for (int i = 0; i < (int)size(INTENT_NAMES); i++) {
+        if (name == INTENT_NAMES[i]) {
+            return (encoder_intent)i;
+        }
+    }
+    throw std::invalid_argument("Invalid profile '" + name + "', must be one of: latency, balanced, quality, size.");
+}
+
+const char* encoder_intent_name(encoder_intent intent)
+{
+    return INTENT_NAMES[intent];
+}
+
+json profiles_load(const string& overridePath)
+{
+    json table = json::parse(BUILTIN_PROFILES);
+    if (overridePath.empty()) {
+        return table;
+    }
+
+    char* contents = os_quick_read_utf8_file(overridePath.c_str());
+    if (!contents) {
+        throw std::invalid_argument("Unable to read profile file '" + overridePath + "'");
+    }
+    auto patch = json::parse(contents, nullptr, false);
+    bfree(contents);
+    if (patch.is_discarded() || !patch.is_object()) {
+        throw std::invalid_argument("Profile file '" + overridePath + "' is not a json object");
+    }
+
+    table.merge_patch(patch);
+    return table;
+}
+
+static void merge_settings(json& settings, const json& source)
+{
+    if (source.is_object()) {
+        for (auto& [key, value] : source.items()) {
+            settings[key] = value;
+        }
+    }
+}
+
+// drops list values the encoder does not offer and clamps numbers to its range. settings the encoder does
+// not report are kept, some encoders read settings they never show.
+static void validate_settings(const encoder_capabilities& caps, resolved_profile& profile)
+{
+    for (auto it = profile.settings.begin(); it != profile.settings.end();) {
+        auto property = caps.find_property(profile.encoderId, it.key());
+        if (property && !property->values.empty() && it->is_string()
+            && std::find(property->values.begin(), property->values.end(), it->get<string>()) == property->values.end()) {
+            profile.warnings.push_back("'" + it.key() + "' does not accept '" + it->get<string>() + "', using the encoder default");
+            it = profile.settings.erase(it);
+            continue;
+        }
+        if (property && property->ranged && it->is_number_integer()) {
+            long long value = it->get<long long>();
+            long long clamped = std::clamp(value, property->min, property->max);
+            if (clamped != value) {
+                profile.warnings.push_back("'" + it.key() + "' clamped from " + to_string(value) + " to " + to_string(clamped));
+                *it = clamped;
+            }
+        }
+        ++it;
+    }
+}
+
+static json find_intent_profile(const json& entry, encoder_intent intent)
+{
+    auto intents = entry.value("intents", json::object());
+    return intents.value(encoder_intent_name(intent), intents.value("balanced", json::object()));
+}
+
+uint32_t profiles_speed_levels(const json& table, const string& encoderId, encoder_intent intent)
+{
+    auto entry = table.find(encoderId);
+    if (entry == table.end() || !entry->is_object()) {
+        return 1;
+    }
+    auto ladder = find_intent_profile(*entry, intent).value("speedLadder", json::array());
+    return ladder.is_array() ? 1 + (uint32_t)ladder.size() : 1;
+}
+
+resolved_profile profiles_resolve(const json& table, const encoder_capabilities& caps, const string& encoderId, encoder_intent intent, uint16_t crf, uint32_t outputWidth, uint32_t outputHeight, uint32_t speedStep)
+{
+    auto entry = table.find(encoderId);
+    if (entry == table.end() || !entry->is_object()) {
+        throw std::invalid_argument("No encoder profile for '" + encoderId + "', add one with --profileFile");
+    }
+
+    resolved_profile profile{};
+    profile.encoderId = encoderId;
+    profile.intent = intent;
+    profile.settings = json::object();
+
+    try {
+        merge_settings(profile.settings, entry->value("settings", json::object()));
+
+        // an encoder which does not report rate_control at all is given the first entry without it
+        auto& rateControls = entry->at("rateControls");
+        if (!rateControls.is_array() || rateControls.empty()) {
+            throw std::invalid_argument("has no rateControls");
+        }
+        bool reportsRateControl = caps.find_property(encoderId, "rate_control") != nullptr;
+        const json* rateControl = &rateControls.front();
+        for (auto& candidate : rateControls) {
+            if (caps.has_rate_control(encoderId, candidate.at("name").get<string>())) {
+                rateControl = &candidate;
+                break;
+            }
+        }
+        profile.rateControl = rateControl->at("name").get<string>();
+        if (reportsRateControl) {
+            profile.settings["rate_control"] = profile.rateControl;
+        }
+        merge_settings(profile.settings, rateControl->value("settings", json::object()));
+
+        json intentProfile = find_intent_profile(*entry, intent);
+        merge_settings(profile.settings, intentProfile.value("settings", json::object()));
+        int qualityOffset = intentProfile.value("qualityOffset", 0);
+
+        if (speedStep > 0) {
+            auto& step = intentProfile.at("speedLadder").at(speedStep - 1);
+            merge_settings(profile.settings, step.value("settings", json::object()));
+            qualityOffset += step.value("qualityOffset", 0);
+        }
+
+        int qualityMax = entry->value("qualityMax", PROFILE_BASE_QUALITY_MAX);
+        int quality = CalcCRF((int)outputWidth, (int)outputHeight, crf) + qualityOffset;
+        profile.quality = std::clamp((int)lround(quality * (double)qualityMax / PROFILE_BASE_QUALITY_MAX), 0, qualityMax);
+
+        // an encoder may only read some of the listed keys, write just those if it says which
+        auto qualityKeys = rateControl->at("quality").get<vector<string>>();
+        bool anyReported = std::any_of(qualityKeys.begin(), qualityKeys.end(), [&](const string& key) { return caps.find_property(encoderId, key) != nullptr; });
+        for (auto& key : qualityKeys) {
+            if (!anyReported || caps.find_property(encoderId, key)) {
+                profile.settings[key] = profile.quality;
+            }
+        }
+    }
+    catch (const json::exception& exc) {
+        throw std::invalid_argument("Encoder profile for '" + encoderId + "' is invalid: " + exc.what());
+    }
+    catch (const std::invalid_argument& exc) {
+        throw std::invalid_argument("Encoder profile for '" + encoderId + "' " + exc.what());
+    }
+
+    validate_settings(caps, profile);
+    return profile;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "json.hpp"
+#include "encoder.h"
+
+// what the recording is for, each encoder profile maps it onto its own presets and quality offset
+enum encoder_intent
+{
+    INTENT_LATENCY,   // cheapest to encode, for slow machines or when the cpu is needed elsewhere
+    INTENT_BALANCED,
+    INTENT_QUALITY,
+    INTENT_SIZE,      // slowest presets and a higher crf, for recordings which are archived or uploaded
+};
+
+// accepts the names used by --profile, throws std::invalid_argument for anything else
+encoder_intent parse_encoder_intent(const std::string& name);
+const char* encoder_intent_name(encoder_intent intent);
+
+// the table maps encoder ids to profiles:
+//
+//   "obs_x264": {
+//     "qualityMax": 51,                  top of the encoder's quality scale, --crf is stretched from 0-51 onto it
+//     "rateControls": [                  in order of preference, the first the encoder reports is used
+//       { "name": "CRF", "quality": ["crf"], "settings": {} }
+//     ],
+//     "settings": { "profile": "high" }, written for every intent
+//     "intents": {                       settings and a crf offset for each intent, balanced if one is missing
+//       "latency": {
+//         "qualityOffset": -2,
+//         "settings": { "preset": "ultrafast" },
+//         "speedLadder": [                 optional, steps --cpuBudget may take while recording, cheapest last.
+//           { "qualityOffset": 2 }         each is applied on top of the intent, its offset is added to the intent's
+//         ]
+//       }
+//     }
+//   }
+//
+// the built-in table is returned if overridePath is empty. otherwise the file is applied on top of it as a json
+// merge patch, so it only has to contain what it changes, and an encoder which is not built in can be added
+// whole. throws std::invalid_argument if the file can not be read or parsed.
+nlohmann::json profiles_load(const std::string& overridePath);
+
+struct resolved_profile
+{
+    std::string encoderId;
+    encoder_intent intent;
+    std::string rateControl;
+    int quality;                        // the value written to the rate control's quality settings
+    nlohmann::json settings;            // every setting given to the encoder
+    std::vector<std::string> warnings;  // settings dropped or clamped because the encoder reported other limits
+};
+
+// looks the encoder up in the table and validates the result against the properties the encoder reported.
+// crf is on the h264 scale, it is adjusted for the output size before the profile's offset and scale.
+// speedStep 0 is the intent itself, 1 the first entry of its speed ladder and so on.
+// throws std::invalid_argument if the table has no usable profile for the encoder.
+resolved_profile profiles_resolve(const nlohmann::json& table, const encoder_capabilities& caps, const std::string& encoderId, encoder_intent intent, uint16_t crf, uint32_t outputWidth, uint32_t outputHeight, uint32_t speedStep = 0);
+
+// how many speed steps profiles_resolve accepts for the intent, counting the intent itself
+uint32_t profiles_speed_levels(const nlohmann::json& table, const std::string& encoderId, encoder_intent intent);
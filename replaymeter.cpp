@@ -0,0 +1,154 @@
+#include "replaymeter.h"
+
+#include <mutex>
+
+using namespace std;
+
+struct replay_meter_output
+{
+    obs_output_t* output;
+
+    mutex lock;
+    replay_meter meter;
+    bool active;
+};
+
+// returns whether a keyframe was removed
+static bool replay_meter_pop(replay_meter& meter)
+{
+    auto& front = meter.entries.front();
+    bool keyframe = front.keyframe;
+    meter.bytes -= front.size;
+    if (keyframe) {
+        meter.keyframes--;
+    }
+    meter.entries.pop_front();
+    return keyframe;
+}
+
+// like purge in obs-ffmpeg-mux, a keyframe is only removed together with everything up to the next one, so what
+// is held always starts at a keyframe
+static void replay_meter_purge(replay_meter& meter)
+{
+    if (!replay_meter_pop(meter)) {
+        return;
+    }
+    while (!meter.entries.empty() && !meter.entries.front().keyframe) {
+        replay_meter_pop(meter);
+    }
+}
+
+void replay_meter_push(replay_meter& meter, const replay_meter_entry& entry)
+{
+    // the replay buffer keeps at least two keyframe intervals whatever the limits say
+    if (meter.maxBytes > 0) {
+        while (meter.keyframes > 2 && meter.bytes + entry.size > meter.maxBytes) {
+            replay_meter_purge(meter);
+        }
+    }
+    while (meter.keyframes > 2 && entry.dtsUsec - meter.entries.front().dtsUsec > meter.maxUsec) {
+        replay_meter_purge(meter);
+    }
+
+    meter.entries.push_back(entry);
+    meter.bytes += entry.size;
+    if (entry.keyframe) {
+        meter.keyframes++;
+    }
+}
+
+int64_t replay_meter_buffered_usec(const replay_meter& meter)
+{
+    if (meter.entries.empty()) {
+        return 0;
+    }
+    return meter.entries.back().dtsUsec - meter.entries.front().dtsUsec;
+}
+
+static const char* replay_meter_get_name(void* unused)
+{
+    return "Replay Buffer Meter";
+}
+
+static void replay_meter_get_stats_proc(void* data, calldata_t* cd)
+{
+    auto ctx = (replay_meter_output*)data;
+    lock_guard<mutex> guard(ctx->lock);
+    calldata_set_int(cd, "buffered_usec", (long long)replay_meter_buffered_usec(ctx->meter));
+    calldata_set_int(cd, "buffered_bytes", (long long)ctx->meter.bytes);
+    calldata_set_int(cd, "buffered_packets", (long long)ctx->meter.entries.size());
+}
+
+static void* replay_meter_create(obs_data_t* settings, obs_output_t* output)
+{
+    auto ctx = new replay_meter_output{};
+    ctx->output = output;
+    proc_handler_add(obs_output_get_proc_handler(output), "void get_stats(out int buffered_usec, out int buffered_bytes, out int buffered_packets)",
+        replay_meter_get_stats_proc, ctx);
+    return ctx;
+}
+
+static void replay_meter_destroy(void* data)
+{
+    delete (replay_meter_output*)data;
+}
+
+static bool replay_meter_start(void* data)
+{
+    auto ctx = (replay_meter_output*)data;
+    if (!obs_output_can_begin_data_capture(ctx->output, 0)) {
+        return false;
+    }
+    if (!obs_output_initialize_encoders(ctx->output, 0)) {
+        return false;
+    }
+
+    obs_data_t* settings = obs_output_get_settings(ctx->output);
+    {
+        lock_guard<mutex> guard(ctx->lock);
+        ctx->meter = {};
+        ctx->meter.maxUsec = obs_data_get_int(settings, "max_time_sec") * 1000000;
+        ctx->meter.maxBytes = (uint64_t)obs_data_get_int(settings, "max_size_mb") * 1024 * 1024;
+        ctx->active = true;
+    }
+    obs_data_release(settings);
+    return obs_output_begin_data_capture(ctx->output, 0);
+}
+
+static void replay_meter_stop(void* data, uint64_t ts)
+{
+    auto ctx = (replay_meter_output*)data;
+    {
+        lock_guard<mutex> guard(ctx->lock);
+        ctx->active = false;
+    }
+    obs_output_end_data_capture(ctx->output);
+}
+
+static void replay_meter_packet(void* data, encoder_packet* packet)
+{
+    auto ctx = (replay_meter_output*)data;
+    if (!packet) {
+        // the replay buffer stops on the same encoder error and reports it
+        return;
+    }
+
+    lock_guard<mutex> guard(ctx->lock);
+    if (ctx->active) {
+        replay_meter_push(ctx->meter, { packet->dts_usec, packet->size, packet->type == OBS_ENCODER_VIDEO && packet->keyframe });
+    }
+}
+
+void replay_meter_register()
+{
+    obs_output_info output{};
+    output.id = REPLAY_METER_OUTPUT_ID;
+    output.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED;
+    output.get_name = replay_meter_get_name;
+    output.create = replay_meter_create;
+    output.destroy = replay_meter_destroy;
+    output.start = replay_meter_start;
+    output.stop = replay_meter_stop;
+    output.encoded_packet = replay_meter_packet;
+    obs_register_output(&output);
+}
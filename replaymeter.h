@@ -0,0 +1,37 @@
+#pragma once
+#include <deque>
+#include <cstdint>
+#include "obs-studio/libobs/obs.h"
+
+#define REPLAY_METER_OUTPUT_ID "express_replay_meter"
+
+// obs' replay_buffer keeps its packets to itself, it tells neither how much it holds nor how far back it goes.
+// this output is given the same encoders, so it sees the same packets, and trims a list of their sizes and
+// times by the same rules the replay buffer trims its packets by. no packet is kept, only what it weighs.
+//
+// settings: "max_time_sec", "max_size_mb", those of the replay buffer it follows
+// procs:    get_stats(out int buffered_usec, out int buffered_bytes, out int buffered_packets)
+void replay_meter_register();
+
+struct replay_meter_entry
+{
+    int64_t dtsUsec;
+    uint64_t size;
+    bool keyframe;              // a video keyframe
+};
+
+struct replay_meter
+{
+    int64_t maxUsec = 0;
+    uint64_t maxBytes = 0;      // 0 for no limit
+
+    std::deque<replay_meter_entry> entries;
+    uint64_t bytes = 0;
+    uint32_t keyframes = 0;
+};
+
+// trims the oldest packets like the replay buffer would before it takes this one, then adds it
+void replay_meter_push(replay_meter& meter, const replay_meter_entry& entry);
+
+// from the oldest packet still held to the newest
+int64_t replay_meter_buffered_usec(const replay_meter& meter);
@@ -0,0 +1,42 @@
+#include "ripple.h"
+
+bool ripple_evaluate(const ripple_click& click, uint64_t nowMs, ripple_frame& frame)
+{
+    // clicks can be timestamped slightly ahead of the frame that is rendering them
+    uint64_t ago = nowMs > click.startMs ? nowMs - click.startMs : 0;
+    if (ago >= RIPPLE_DURATION_MS) {
+        return false;
+    }
+
+    float progress = (float)ago / RIPPLE_DURATION_MS;
+    float zoom = (float)click.dpi / RIPPLE_BASE_DPI;
+
+    frame.x = (float)click.x;
+    frame.y = (float)click.y;
+    frame.radius = (RIPPLE_MIN_RADIUS + (progress * RIPPLE_GROW_RADIUS)) * zoom;
+    frame.opacity = (1 - progress) * RIPPLE_MAX_OPACITY;
+    return true;
+}
+
+void ripple_set::push(const ripple_click& click)
+{
+    if (count == RIPPLE_MAX_ACTIVE) {
+        // clicks are stored oldest first, drop the oldest
+        for (uint32_t i = 1; i < count; i++) {
+            clicks[i - 1] = clicks[i];
+        }
+        count--;
+    }
+    clicks[count++] = click;
+}
+
+void ripple_set::expire(uint64_t nowMs)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (nowMs < clicks[i].startMs + RIPPLE_DURATION_MS) {
+            clicks[kept++] = clicks[i];
+        }
+    }
+    count = kept;
+}
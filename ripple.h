@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// the maximum number of click ripples that can be animating at the same time
+#define RIPPLE_MAX_ACTIVE 8
+
+// matches the original tracker.png animation: 400ms, 85% max opacity, radius 10 -> 40 (*dpi)
+#define RIPPLE_DURATION_MS 400
+#define RIPPLE_MAX_OPACITY 0.85f
+#define RIPPLE_MIN_RADIUS 10.0f
+#define RIPPLE_GROW_RADIUS 30.0f
+#define RIPPLE_BASE_DPI 96.0f
+
+struct ripple_click
+{
+    int32_t x;
+    int32_t y;
+    uint32_t dpi;
+    uint64_t startMs;
+};
+
+struct ripple_frame
+{
+    float x;       // center, in the same coordinate space as the click
+    float y;
+    float radius;  // in pixels, already scaled by dpi
+    float opacity; // 0 to RIPPLE_MAX_OPACITY
+};
+
+// computes the ripple for a click at a point in time. returns false if the animation has finished.
+bool ripple_evaluate(const ripple_click& click, uint64_t nowMs, ripple_frame& frame);
+
+// fixed-size set of animating ripples, no allocations after construction
+struct ripple_set
+{
+    ripple_click clicks[RIPPLE_MAX_ACTIVE];
+    uint32_t count = 0;
+
+    // starts a new ripple, replacing the oldest one if the set is full
+    void push(const ripple_click& click);
+
+    // removes ripples which have finished animating at this time
+    void expire(uint64_t nowMs);
+};
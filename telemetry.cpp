@@ -0,0 +1,121 @@
+#include "telemetry.h"
+
+#include <atomic>
+#include <algorithm>
+
+#include "obs-studio/libobs/util/platform.h"
+
+using namespace std;
+
+// written by the graphics thread
+static atomic<uint32_t> intervalHistogram[TELEMETRY_BUCKETS];
+static atomic<uint64_t> intervalMaxNs{ 0 };
+static uint64_t lastTickNs = 0;
+
+// written by the audio thread
+static atomic<uint64_t> audioBufferingNs{ 0 };
+
+// owned by the sampling thread
+static uint32_t sampledHistogram[TELEMETRY_BUCKETS];
+static uint64_t lastSampleNs = 0;
+static uint64_t lastSampleBytes = 0;
+static uint32_t baseLaggedFrames = 0;
+static uint32_t baseSkippedFrames = 0;
+static uint32_t baseVideoFrames = 0;
+
+static void telemetry_tick(void* param, float seconds)
+{
+    uint64_t now = os_gettime_ns();
+    if (lastTickNs != 0) {
+        uint64_t interval = now - lastTickNs;
+        size_t bucket = (size_t)min<uint64_t>(interval / TELEMETRY_BUCKET_NS, TELEMETRY_BUCKETS - 1);
+        intervalHistogram[bucket].fetch_add(1, memory_order_relaxed);
+
+        uint64_t prevMax = intervalMaxNs.load(memory_order_relaxed);
+        while (interval > prevMax && !intervalMaxNs.compare_exchange_weak(prevMax, interval, memory_order_relaxed)) { }
+    }
+    lastTickNs = now;
+}
+
+static void telemetry_audio(void* param, size_t mix_idx, struct audio_data* data)
+{
+    // mixed audio is timestamped with the time it was captured, so the gap to now is the buffering delay
+    uint64_t now = os_gettime_ns();
+    audioBufferingNs.store(now > data->timestamp ? now - data->timestamp : 0, memory_order_relaxed);
+}
+
+static double histogram_percentile(const uint32_t* counts, uint64_t total, double percentile)
+{
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(total * percentile);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < TELEMETRY_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > target) {
+            // upper edge of the bucket, so we never under-report
+            return (double)((i + 1) * TELEMETRY_BUCKET_NS) / 1000000.0;
+        }
+    }
+    return (double)(TELEMETRY_BUCKETS * TELEMETRY_BUCKET_NS) / 1000000.0;
+}
+
+void telemetry_init()
+{
+    obs_add_tick_callback(telemetry_tick, nullptr);
+    obs_add_raw_audio_callback(0, nullptr, telemetry_audio, nullptr);
+}
+
+void telemetry_output_started(obs_output_t* output)
+{
+    video_t* video = obs_get_video();
+    baseLaggedFrames = obs_get_lagged_frames();
+    baseSkippedFrames = video_output_get_skipped_frames(video);
+    baseVideoFrames = video_output_get_total_frames(video);
+    lastSampleBytes = obs_output_get_total_bytes(output);
+    lastSampleNs = os_gettime_ns();
+
+    for (size_t i = 0; i < TELEMETRY_BUCKETS; i++) {
+        sampledHistogram[i] = intervalHistogram[i].load(memory_order_relaxed);
+    }
+    intervalMaxNs.store(0, memory_order_relaxed);
+}
+
+void telemetry_collect(obs_output_t* output, telemetry_sample& sample)
+{
+    uint64_t now = os_gettime_ns();
+    uint64_t intervalNs = now - lastSampleNs;
+    lastSampleNs = now;
+    sample.intervalMs = intervalNs / 1000000;
+
+    video_t* video = obs_get_video();
+    sample.laggedFrames = obs_get_lagged_frames() - baseLaggedFrames;
+    sample.skippedFrames = video_output_get_skipped_frames(video) - baseSkippedFrames;
+
+    int64_t sentToEncoder = (int64_t)(video_output_get_total_frames(video) - baseVideoFrames) - sample.skippedFrames;
+    int64_t inFlight = sentToEncoder - obs_output_get_total_frames(output);
+    sample.encoderInFlight = inFlight > 0 ? (uint32_t)inFlight : 0;
+
+    uint64_t bytes = obs_output_get_total_bytes(output);
+    sample.bytesWritten = bytes;
+    sample.bitrateKbps = intervalNs > 0 && bytes >= lastSampleBytes ? (double)(bytes - lastSampleBytes) * 8.0 / ((double)intervalNs / 1000000.0) : 0;
+    lastSampleBytes = bytes;
+
+    // the histogram is only ever incremented, so the delta from the previous snapshot covers just this sample
+    uint32_t counts[TELEMETRY_BUCKETS];
+    uint64_t total = 0;
+    for (size_t i = 0; i < TELEMETRY_BUCKETS; i++) {
+        uint32_t current = intervalHistogram[i].load(memory_order_relaxed);
+        counts[i] = current - sampledHistogram[i];
+        sampledHistogram[i] = current;
+        total += counts[i];
+    }
+
+    sample.frameIntervalP50Ms = histogram_percentile(counts, total, 0.50);
+    sample.frameIntervalP95Ms = histogram_percentile(counts, total, 0.95);
+    sample.frameIntervalP99Ms = histogram_percentile(counts, total, 0.99);
+    sample.frameIntervalMaxMs = (double)intervalMaxNs.exchange(0, memory_order_relaxed) / 1000000.0;
+    sample.audioBufferingMs = (double)audioBufferingNs.load(memory_order_relaxed) / 1000000.0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+#include "obs-studio/libobs/obs.h"
+
+// frame intervals are bucketed in 0.25ms steps up to 64ms, anything longer lands in the last bucket
+#define TELEMETRY_BUCKET_NS 250000ULL
+#define TELEMETRY_BUCKETS 257
+
+struct telemetry_sample
+{
+    uint64_t intervalMs;         // time covered by this sample
+
+    uint32_t laggedFrames;       // frames the graphics thread failed to render in time, since output start
+    uint32_t skippedFrames;      // raw frames the encoder could not accept in time, since output start
+    uint32_t encoderInFlight;    // frames handed to the encoder which have not come out as packets yet
+
+    uint64_t bytesWritten;       // total output bytes
+    double bitrateKbps;          // output bitrate over this sample
+
+    double frameIntervalP50Ms;   // graphics thread frame-to-frame time over this sample
+    double frameIntervalP95Ms;
+    double frameIntervalP99Ms;
+    double frameIntervalMaxMs;
+
+    double audioBufferingMs;     // how far the audio mix trails real time
+};
+
+// registers the tick and audio callbacks used to collect timings. call once the video and audio pipelines are up.
+void telemetry_init();
+
+// records the counters at the moment the output starts, later samples are relative to this
+void telemetry_output_started(obs_output_t* output);
+
+// collects a sample covering the time since the previous call. never allocates, call from a single thread.
+void telemetry_collect(obs_output_t* output, telemetry_sample& sample);
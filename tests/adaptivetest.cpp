@@ -0,0 +1,138 @@
+#include "test.h"
+#include "adaptive.h"
+
+#include <vector>
+
+using namespace std;
+
+// simulated load traces for the --cpuBudget controller, with a 50% budget, 1% drop target and the defaults of
+// three intervals to step up, ten to recover and three of cooldown
+
+static const adaptive_sample OVER{ 80, 0 };
+static const adaptive_sample DROPPING{ 10, 5 };
+static const adaptive_sample BAND{ 45, 0 };     // under the budget but not by the recover margin
+static const adaptive_sample UNDER{ 20, 0 };
+
+// the name of every action taken over the trace, "" for the intervals which held
+static vector<string> run_trace(const adaptive_config& config, adaptive_state& state, const vector<adaptive_sample>& trace)
+{
+    vector<string> actions;
+    for (auto& sample : trace) {
+        auto action = adaptive_step(config, state, sample);
+        actions.push_back(action == ADAPTIVE_HOLD ? "" : adaptive_action_name(action));
+    }
+    return actions;
+}
+
+static vector<adaptive_sample> repeat(const adaptive_sample& sample, size_t count)
+{
+    return vector<adaptive_sample>(count, sample);
+}
+
+static string joined(const vector<string>& actions)
+{
+    string text;
+    for (auto& action : actions) {
+        text += (text.empty() ? "" : ",") + (action.empty() ? string("-") : action);
+    }
+    return text;
+}
+
+TEST(adaptive_steps_up_after_three_intervals_over)
+{
+    auto config = adaptive_default_config(50, 1, 3, 2);
+    adaptive_state state{};
+    CHECK_EQ(joined(run_trace(config, state, repeat(OVER, 3))), "-,-,faster");
+    CHECK_EQ(state.level, 1u);
+}
+
+TEST(adaptive_drops_count_as_over)
+{
+    auto config = adaptive_default_config(50, 1, 3, 2);
+    adaptive_state state{};
+    CHECK_EQ(joined(run_trace(config, state, repeat(DROPPING, 3))), "-,-,faster");
+}
+
+TEST(adaptive_cooldown_holds_after_a_change)
+{
+    // the over intervals during the cooldown still count, so a load which stays high steps every fourth interval
+    auto config = adaptive_default_config(50, 1, 3, 2);
+    adaptive_state state{};
+    CHECK_EQ(joined(run_trace(config, state, repeat(OVER, 7))), "-,-,faster,-,-,-,faster");
+    CHECK_EQ(state.level, 2u);
+}
+
+TEST(adaptive_dead_band_resets_both_counters)
+{
+    auto config = adaptive_default_config(50, 1, 3, 2);
+    adaptive_state state{};
+    CHECK_EQ(joined(run_trace(config, state, { OVER, OVER, BAND, OVER, OVER, BAND })), "-,-,-,-,-,-");
+    CHECK_EQ(state.level, 0u);
+
+    auto recovering = repeat(UNDER, 9);
+    recovering.push_back(BAND);
+    state.level = 1;
+    CHECK_EQ(joined(run_trace(config, state, recovering)), "-,-,-,-,-,-,-,-,-,-");
+    CHECK_EQ(state.level, 1u);
+}
+
+TEST(adaptive_alternating_load_changes_nothing)
+{
+    auto config = adaptive_default_config(50, 1, 3, 2);
+    adaptive_state state{};
+    vector<adaptive_sample> trace;
+    for (int i = 0; i < 50; i++) {
+        trace.push_back(i % 2 == 0 ? OVER : UNDER);
+    }
+    run_trace(config, state, trace);
+    CHECK_EQ(state.level, 0u);
+    CHECK_EQ(state.fpsStep, 0u);
+}
+
+TEST(adaptive_reduces_fps_only_at_the_cheapest_level)
+{
+    auto config = adaptive_default_config(50, 1, 2, 2);
+    adaptive_state state{};
+    CHECK_EQ(joined(run_trace(config, state, repeat(OVER, 15))), "-,-,faster,-,-,-,reduce_fps,-,-,-,reduce_fps,-,-,-,-");
+    CHECK_EQ(state.level, 1u);
+    CHECK_EQ(state.fpsStep, 2u);
+}
+
+TEST(adaptive_without_fps_steps_stops_at_the_cheapest_level)
+{
+    auto config = adaptive_default_config(50, 1, 2, 0);
+    adaptive_state state{};
+    CHECK_EQ(joined(run_trace(config, state, repeat(OVER, 12))), "-,-,faster,-,-,-,-,-,-,-,-,-");
+    CHECK_EQ(state.fpsStep, 0u);
+}
+
+TEST(adaptive_recovers_fps_before_levels_and_never_below_zero)
+{
+    auto config = adaptive_default_config(50, 1, 2, 2);
+    adaptive_state state{ 1, 1, 0, 0, 0 };
+    auto actions = run_trace(config, state, repeat(UNDER, 60));
+
+    vector<string> changes;
+    for (auto& action : actions) {
+        if (!action.empty()) {
+            changes.push_back(action);
+        }
+    }
+    CHECK_EQ(joined(changes), "restore_fps,slower");
+    CHECK_EQ(actions[9], "restore_fps");
+    CHECK_EQ(state.level, 0u);
+    CHECK_EQ(state.fpsStep, 0u);
+}
+
+TEST(adaptive_recovery_takes_ten_intervals_after_the_cooldown)
+{
+    auto config = adaptive_default_config(50, 1, 3, 2);
+    adaptive_state state{};
+    run_trace(config, state, repeat(OVER, 3));
+    CHECK_EQ(state.level, 1u);
+
+    // the under intervals during the cooldown count towards the ten
+    auto actions = run_trace(config, state, repeat(UNDER, 10));
+    CHECK_EQ(actions[9], "slower");
+    CHECK_EQ(state.level, 0u);
+}
@@ -0,0 +1,116 @@
+#include "test.h"
+#include "canvas.h"
+
+using namespace std;
+
+TEST(canvas_region_which_fits_is_not_scaled)
+{
+    auto plan = canvas_plan_create(1920, 1080, 0, 0, 2);
+    CHECK_EQ(plan.baseWidth, 1920u);
+    CHECK_EQ(plan.baseHeight, 1080u);
+    CHECK_EQ(plan.outputWidth, 1920u);
+    CHECK_EQ(plan.outputHeight, 1080u);
+    CHECK_EQ(plan.scaler, CANVAS_SCALE_POINT);
+    CHECK(!plan.alignScaled);
+    CHECK_EQ(plan.pixelCost, 1920.0 * 1080);
+}
+
+TEST(canvas_odd_region_is_padded_to_even)
+{
+    auto plan = canvas_plan_create(1921, 1081, 2000, 2000, 2);
+    CHECK_EQ(plan.baseWidth, 1922u);
+    CHECK_EQ(plan.baseHeight, 1082u);
+    CHECK_EQ(plan.outputWidth, 1922u);
+    CHECK_EQ(plan.outputHeight, 1082u);
+    CHECK_EQ(plan.scaler, CANVAS_SCALE_POINT);
+}
+
+TEST(canvas_exact_half_uses_bilinear)
+{
+    auto plan = canvas_plan_create(3840, 2160, 1920, 1080, 2);
+    CHECK_EQ(plan.baseWidth, 3840u);
+    CHECK_EQ(plan.outputWidth, 1920u);
+    CHECK_EQ(plan.outputHeight, 1080u);
+    CHECK_EQ(plan.scaler, CANVAS_SCALE_BILINEAR);
+    CHECK_EQ(plan.pixelCost, 3840.0 * 2160 + 1920.0 * 1080);
+}
+
+TEST(canvas_large_downscale_uses_area)
+{
+    auto plan = canvas_plan_create(3840, 2160, 1280, 0, 2);
+    CHECK_EQ(plan.outputWidth, 1280u);
+    CHECK_EQ(plan.outputHeight, 720u);
+    CHECK_EQ(plan.scaler, CANVAS_SCALE_AREA);
+}
+
+TEST(canvas_small_downscale_uses_bicubic)
+{
+    auto plan = canvas_plan_create(2560, 1440, 1920, 0, 2);
+    CHECK_EQ(plan.outputWidth, 1920u);
+    CHECK_EQ(plan.outputHeight, 1080u);
+    CHECK_EQ(plan.scaler, CANVAS_SCALE_BICUBIC);
+    CHECK(!plan.alignScaled);
+}
+
+TEST(canvas_downscale_keeps_the_aspect_ratio)
+{
+    auto plan = canvas_plan_create(2560, 1600, 0, 1080, 2);
+    CHECK_EQ(plan.outputWidth, 1728u);
+    CHECK_EQ(plan.outputHeight, 1080u);
+
+    plan = canvas_plan_create(1000, 3000, 1920, 1080, 2);
+    CHECK_EQ(plan.outputWidth, 360u);
+    CHECK_EQ(plan.outputHeight, 1080u);
+}
+
+TEST(canvas_coarse_alignment_scales_instead_of_padding)
+{
+    // 1080 is not a multiple of 16, padding would record eight black rows
+    auto plan = canvas_plan_create(1920, 1080, 0, 0, 16);
+    CHECK_EQ(plan.alignment, 16u);
+    CHECK(plan.alignScaled);
+    CHECK_EQ(plan.baseWidth, 1920u);
+    CHECK_EQ(plan.baseHeight, 1080u);
+    CHECK_EQ(plan.outputWidth, 1920u);
+    CHECK_EQ(plan.outputHeight, 1072u);
+    CHECK_EQ(plan.scaler, CANVAS_SCALE_BICUBIC);
+
+    plan = canvas_plan_create(1920, 1088, 0, 0, 16);
+    CHECK(!plan.alignScaled);
+    CHECK_EQ(plan.outputHeight, 1088u);
+    CHECK_EQ(plan.scaler, CANVAS_SCALE_POINT);
+}
+
+TEST(canvas_output_is_aligned_and_within_the_maximums)
+{
+    const uint32_t alignments[] = { 2, 4, 16 };
+    for (uint32_t alignment : alignments) {
+        for (uint32_t width = 641; width < 4000; width += 297) {
+            for (uint32_t height = 359; height < 2400; height += 211) {
+                auto plan = canvas_plan_create(width, height, 1280, 720, alignment);
+                CHECK(plan.outputWidth % alignment == 0);
+                CHECK(plan.outputHeight % alignment == 0);
+                CHECK(plan.outputWidth <= 1280 && plan.outputHeight <= 720);
+                CHECK(plan.outputWidth <= plan.baseWidth && plan.outputHeight <= plan.baseHeight);
+            }
+        }
+    }
+}
+
+TEST(canvas_zero_alignment_means_even)
+{
+    auto plan = canvas_plan_create(1281, 721, 0, 0, 0);
+    CHECK_EQ(plan.alignment, 2u);
+    CHECK_EQ(plan.outputWidth, 1282u);
+    CHECK_EQ(plan.outputHeight, 722u);
+}
+
+TEST(canvas_encoders_get_even_frames)
+{
+    auto plan = canvas_plan_create(1365, 767, 0, 0, CANVAS_ENCODER_ALIGNMENT);
+    CHECK_EQ(plan.alignment, 2u);
+    CHECK(!plan.alignScaled);
+    CHECK_EQ(plan.outputWidth, 1366u);
+    CHECK_EQ(plan.outputHeight, 768u);
+    CHECK_EQ(string(canvas_scaler_name(CANVAS_SCALE_AREA)), "area");
+}
@@ -0,0 +1,180 @@
+#include "test.h"
+#include "control.h"
+#include "json.hpp"
+
+#include <vector>
+
+using namespace std;
+using json = nlohmann::json;
+
+// records what it was asked to do, and keeps the tickets of the signalled commands like the recorder does
+struct fake_target : control_target
+{
+    vector<string> calls;
+    vector<control_ticket> tickets;
+
+    control_result start(const control_ticket& ticket) override { return take("start", ticket); }
+    control_result pause(const control_ticket& ticket) override { return take("pause", ticket); }
+    control_result stop(const control_ticket& ticket) override { return take("stop", ticket); }
+
+    control_result set_muted(char deviceType, int deviceIndex, bool muted) override
+    {
+        calls.push_back(string(muted ? "mute " : "unmute ") + deviceType + " " + to_string(deviceIndex));
+        return { true, "muted" };
+    }
+
+    control_result save() override
+    {
+        calls.push_back("save");
+        return { false, "no replay buffer" };
+    }
+
+    control_result record(const vector<string>& args) override
+    {
+        string call = "record";
+        for (auto& arg : args) {
+            call += " " + arg;
+        }
+        calls.push_back(call);
+        return { true, "queued" };
+    }
+
+    control_result quit() override
+    {
+        calls.push_back("quit");
+        return { true, "bye" };
+    }
+
+    control_result take(const string& name, const control_ticket& ticket)
+    {
+        calls.push_back(name);
+        tickets.push_back(ticket);
+        return { true, name };
+    }
+};
+
+static json handle(fake_target& target, const string& line, uint64_t receivedNs, vector<string>* replies = nullptr)
+{
+    auto response = control_handle_line(target, line, receivedNs, [replies](const string& reply) {
+        if (replies) {
+            replies->push_back(reply);
+        }
+    });
+    return json::parse(response, nullptr, false);
+}
+
+TEST(control_parses_text_commands)
+{
+    control_request request;
+    string error;
+    CHECK(control_parse_request("mute s 0", request, error));
+    CHECK_EQ(request.command, CONTROL_MUTE);
+    CHECK_EQ(request.deviceType, 's');
+    CHECK_EQ(request.deviceIndex, 0);
+    CHECK(!request.json);
+
+    CHECK(control_parse_request("UNMUTE microphone 2", request, error));
+    CHECK_EQ(request.command, CONTROL_UNMUTE);
+    CHECK_EQ(request.deviceType, 'm');
+    CHECK_EQ(request.deviceIndex, 2);
+
+    CHECK(control_parse_request("q", request, error));
+    CHECK_EQ(request.command, CONTROL_QUIT);
+}
+
+TEST(control_rejects_invalid_text_commands)
+{
+    control_request request;
+    string error;
+    CHECK(!control_parse_request("mute s", request, error));
+    CHECK(!control_parse_request("mute x 0", request, error));
+    CHECK(!control_parse_request("mute s one", request, error));
+    CHECK(!control_parse_request("start now", request, error));
+    CHECK(!control_parse_request("rewind", request, error));
+}
+
+TEST(control_record_keeps_the_case_of_its_options)
+{
+    control_request request;
+    string error;
+    CHECK(control_parse_request("record --output C:\\Videos\\Clip.mp4", request, error));
+    CHECK_EQ(request.args.size(), 2u);
+    CHECK_EQ(request.args[1], "C:\\Videos\\Clip.mp4");
+}
+
+TEST(control_parses_json_requests)
+{
+    control_request request;
+    string error;
+    CHECK(control_parse_request("  {\"id\":7,\"command\":\"Mute\",\"device\":\"speaker\",\"index\":1}", request, error));
+    CHECK(request.json);
+    CHECK_EQ(request.id, "7");
+    CHECK_EQ(request.command, CONTROL_MUTE);
+    CHECK_EQ(request.deviceIndex, 1);
+
+    CHECK(!control_parse_request("{\"id\":\"1\",\"command\":\"mute\",\"device\":\"speaker\"}", request, error));
+    CHECK(!control_parse_request("{\"id\":\"1\",\"command\":\"record\",\"args\":[\"--fps\",30]}", request, error));
+    CHECK(!control_parse_request("{\"id\":\"1\"", request, error));
+}
+
+TEST(control_text_requests_get_the_message)
+{
+    fake_target target;
+    CHECK_EQ(control_handle_line(target, "save", 0, {}), "no replay buffer");
+    CHECK_EQ(control_handle_line(target, "   ", 0, {}), "");
+    CHECK_EQ(target.calls.size(), 1u);
+}
+
+TEST(control_immediate_commands_report_latency_in_the_response)
+{
+    fake_target target;
+    auto response = handle(target, "{\"id\":\"2\",\"command\":\"mute\",\"device\":\"m\",\"index\":0}", control_now_ns());
+    CHECK_EQ(response["type"].get<string>(), "response");
+    CHECK_EQ(response["id"].get<string>(), "2");
+    CHECK(response["ok"].get<bool>());
+    CHECK(response.contains("latencyUs"));
+    CHECK_EQ(target.calls[0], "mute m 0");
+
+    auto invalid = handle(target, "{\"id\":\"3\",\"command\":\"rewind\"}", control_now_ns());
+    CHECK(!invalid["ok"].get<bool>());
+    CHECK(invalid.contains("latencyUs"));
+}
+
+TEST(control_signalled_commands_report_latency_when_applied)
+{
+    fake_target target;
+    vector<string> replies;
+    uint64_t receivedNs = control_now_ns();
+    auto response = handle(target, "{\"id\":\"1\",\"command\":\"start\"}", receivedNs, &replies);
+    CHECK(response["ok"].get<bool>());
+    CHECK(!response.contains("latencyUs"));
+    CHECK_EQ(target.tickets.size(), 1u);
+
+    // the ticket carries everything needed to answer once the output signals, and the way back to the controller
+    auto& ticket = target.tickets[0];
+    CHECK_EQ(ticket.id, "1");
+    CHECK_EQ(ticket.command, CONTROL_START);
+    CHECK_EQ(ticket.receivedNs, receivedNs);
+    CHECK(ticket.json);
+    ticket.reply(control_applied_line(ticket, receivedNs + 25000000));
+    CHECK_EQ(replies.size(), 1u);
+
+    auto applied = json::parse(replies[0]);
+    CHECK_EQ(applied["type"].get<string>(), "applied");
+    CHECK_EQ(applied["id"].get<string>(), "1");
+    CHECK_EQ(applied["command"].get<string>(), "start");
+    CHECK(applied["ok"].get<bool>());
+    CHECK_EQ(applied["latencyUs"].get<uint64_t>(), 25000u);
+
+    auto abandoned = json::parse(control_applied_line(ticket, receivedNs, "ended"));
+    CHECK(!abandoned["ok"].get<bool>());
+    CHECK_EQ(abandoned["message"].get<string>(), "ended");
+}
+
+TEST(control_legacy_tickets_are_not_json)
+{
+    fake_target target;
+    control_handle_line(target, "pause", control_now_ns(), {});
+    CHECK_EQ(target.tickets.size(), 1u);
+    CHECK(!target.tickets[0].json);
+}
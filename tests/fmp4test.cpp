@@ -0,0 +1,349 @@
+#include "test.h"
+#include "fmp4.h"
+#include "mux.h"
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <algorithm>
+#include <filesystem>
+
+#pragma comment(lib, "obs.lib")
+
+using namespace std;
+
+// two seconds of h264 and aac muxed by the in-process muxer the way --fragmentMs 500 does it, finalized, and
+// the result read back box by box
+
+static const uint32_t FPS = 30, GOP = 30, SECONDS = 2, SAMPLE_RATE = 48000, AUDIO_FRAME = 1024;
+
+struct muxed_file
+{
+    string path;
+    uint32_t videoFrames;
+    uint32_t audioFrames;
+};
+
+struct mp4_box
+{
+    string type;
+    size_t offset;      // the header
+    size_t size;
+    size_t data;        // the payload
+};
+
+static string temp_file(const char* name)
+{
+    return (filesystem::temp_directory_path() / name).string();
+}
+
+static bool mux_fragmented(const string& path, uint32_t indexReserve, muxed_file& muxed)
+{
+    mux_stream_info video{};
+    video.codec = "h264";
+    video.width = 1280;
+    video.height = 720;
+    video.fpsNum = FPS;
+    video.fpsDen = 1;
+    video.extraData = { 0x01, 0x64, 0x00, 0x1F, 0xFF, 0xE1, 0x00, 0x04, 0x67, 0x64, 0x00, 0x1F, 0x01, 0x00, 0x04, 0x68, 0xEE, 0x3C, 0x80 };
+
+    mux_stream_info audio{};
+    audio.codec = "aac";
+    audio.sampleRate = SAMPLE_RATE;
+    audio.channels = 2;
+    audio.frameSize = AUDIO_FRAME;
+    audio.extraData = { 0x11, 0x90 };
+
+    string settings;
+    mux_add_setting(settings, "movflags", "+empty_moov+default_base_moof");
+    mux_add_setting(settings, "frag_duration", "500000");
+    string error;
+    mux_writer* writer = mux_writer_open(path, "", &video, &audio, settings, error);
+    if (!writer) {
+        return false;
+    }
+    if (indexReserve > 0) {
+        mux_writer_reserve(writer, indexReserve);
+    }
+
+    // the contents are never parsed
+    vector<uint8_t> payload(2000, 0x5A);
+    muxed = { path, 0, 0 };
+    for (uint32_t frame = 0; frame < FPS * SECONDS; frame++) {
+        while ((uint64_t)muxed.audioFrames * AUDIO_FRAME * FPS <= (uint64_t)frame * SAMPLE_RATE) {
+            encoder_packet packet{};
+            packet.type = OBS_ENCODER_AUDIO;
+            packet.keyframe = true;
+            packet.data = payload.data();
+            packet.size = 300;
+            packet.pts = packet.dts = (int64_t)muxed.audioFrames * AUDIO_FRAME;
+            packet.timebase_num = 1;
+            packet.timebase_den = SAMPLE_RATE;
+            mux_writer_write_encoder_time(writer, &packet);
+            muxed.audioFrames++;
+        }
+
+        encoder_packet packet{};
+        packet.type = OBS_ENCODER_VIDEO;
+        packet.keyframe = frame % GOP == 0;
+        packet.data = payload.data();
+        packet.size = packet.keyframe ? 2000 : 500;
+        packet.pts = packet.dts = frame;
+        packet.timebase_num = 1;
+        packet.timebase_den = FPS;
+        mux_writer_write_encoder_time(writer, &packet);
+        muxed.videoFrames++;
+    }
+    return mux_writer_close(writer, true);
+}
+
+static vector<uint8_t> read_file(const string& path)
+{
+    vector<uint8_t> data{};
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return data;
+    }
+    fseek(file, 0, SEEK_END);
+    data.resize((size_t)ftell(file));
+    fseek(file, 0, SEEK_SET);
+    if (fread(data.data(), 1, data.size(), file) != data.size()) {
+        data.clear();
+    }
+    fclose(file);
+    return data;
+}
+
+static uint32_t be32(const vector<uint8_t>& data, size_t offset)
+{
+    return ((uint32_t)data[offset] << 24) | ((uint32_t)data[offset + 1] << 16) | ((uint32_t)data[offset + 2] << 8) | data[offset + 3];
+}
+
+static uint64_t be64(const vector<uint8_t>& data, size_t offset)
+{
+    return ((uint64_t)be32(data, offset) << 32) | be32(data, offset + 4);
+}
+
+// the boxes from offset to end, stops at one which does not fit
+static vector<mp4_box> read_boxes(const vector<uint8_t>& data, size_t offset, size_t end)
+{
+    vector<mp4_box> boxes{};
+    while (offset + 8 <= end) {
+        uint64_t size = be32(data, offset);
+        size_t header = 8;
+        if (size == 1) {
+            size = be64(data, offset + 8);
+            header = 16;
+        }
+        if (size < header || size > end - offset) {
+            break;
+        }
+        boxes.push_back({ string((const char*)&data[offset + 4], 4), offset, (size_t)size, offset + header });
+        offset += (size_t)size;
+    }
+    return boxes;
+}
+
+static vector<mp4_box> children(const vector<uint8_t>& data, const mp4_box& box)
+{
+    return read_boxes(data, box.data, box.offset + box.size);
+}
+
+static const mp4_box* find_box(const vector<mp4_box>& boxes, const char* type)
+{
+    for (auto& box : boxes) {
+        if (box.type == type) {
+            return &box;
+        }
+    }
+    return nullptr;
+}
+
+static size_t count_boxes(const vector<mp4_box>& boxes, const char* type)
+{
+    size_t count = 0;
+    for (auto& box : boxes) {
+        count += box.type == type ? 1 : 0;
+    }
+    return count;
+}
+
+// the timescale and duration of a mvhd or mdhd, which are wider in version 1
+static void read_header(const vector<uint8_t>& data, const mp4_box& box, uint32_t& timescale, uint64_t& duration)
+{
+    bool wide = data[box.data] == 1;
+    timescale = be32(data, box.data + (wide ? 20 : 12));
+    duration = wide ? be64(data, box.data + 24) : be32(data, box.data + 16);
+}
+
+// checks one trak against what was muxed into it, returns its duration in seconds
+static double check_track(const vector<uint8_t>& data, const vector<mp4_box>& mdats, const mp4_box& trak, const muxed_file& muxed)
+{
+    auto mdia = children(data, *find_box(children(data, trak), "mdia"));
+    string handler((const char*)&data[find_box(mdia, "hdlr")->data + 8], 4);
+    bool video = handler == "vide";
+    CHECK(video || handler == "soun");
+    uint32_t samples = video ? muxed.videoFrames : muxed.audioFrames;
+
+    uint32_t timescale;
+    uint64_t duration;
+    read_header(data, *find_box(mdia, "mdhd"), timescale, duration);
+    auto minf = children(data, *find_box(mdia, "minf"));
+    auto stbl = children(data, *find_box(minf, "stbl"));
+    CHECK(find_box(stbl, "stsd") != nullptr);
+
+    auto stsz = find_box(stbl, "stsz");
+    CHECK_EQ(be32(data, stsz->data + 8), samples);
+
+    // every sample has a duration and together they are the track's
+    auto stts = find_box(stbl, "stts");
+    uint64_t counted = 0, summed = 0;
+    for (uint32_t i = 0; i < be32(data, stts->data + 4); i++) {
+        uint32_t count = be32(data, stts->data + 8 + i * 8);
+        counted += count;
+        summed += (uint64_t)count * be32(data, stts->data + 12 + i * 8);
+    }
+    CHECK_EQ(counted, (uint64_t)samples);
+    CHECK_EQ(summed, duration);
+
+    // the muxer may not know how long the last sample is, everything before it is exact
+    uint64_t sampleTicks = video ? (uint64_t)timescale / FPS : (uint64_t)timescale * AUDIO_FRAME / SAMPLE_RATE;
+    CHECK(duration >= (samples - 1) * sampleTicks);
+    CHECK(duration <= samples * sampleTicks);
+
+    auto stss = find_box(stbl, "stss");
+    if (video) {
+        CHECK(stss != nullptr);
+        if (stss) {
+            CHECK_EQ(be32(data, stss->data + 4), SECONDS * FPS / GOP);
+            CHECK_EQ(be32(data, stss->data + 8), 1u);
+            CHECK_EQ(be32(data, stss->data + 12), GOP + 1);
+        }
+    }
+    else {
+        CHECK(stss == nullptr);
+    }
+
+    // every chunk starts in the payload of an mdat
+    auto stco = find_box(stbl, "stco");
+    CHECK(stco != nullptr);
+    for (uint32_t i = 0; stco && i < be32(data, stco->data + 4); i++) {
+        uint32_t offset = be32(data, stco->data + 8 + i * 4);
+        bool inMdat = false;
+        for (auto& mdat : mdats) {
+            inMdat |= offset >= mdat.data && offset < mdat.offset + mdat.size;
+        }
+        CHECK(inMdat);
+    }
+    return (double)duration / timescale;
+}
+
+// checks the layout of a finalized file, one index and the media with every fragment header freed
+static void check_finalized(const muxed_file& muxed, bool faststart)
+{
+    auto data = read_file(muxed.path);
+    auto boxes = read_boxes(data, 0, data.size());
+    CHECK(!boxes.empty());
+    if (boxes.empty()) {
+        return;
+    }
+    CHECK_EQ(boxes.back().offset + boxes.back().size, data.size());
+    CHECK_EQ(boxes[0].type, "ftyp");
+    CHECK_EQ(count_boxes(boxes, "moov"), 1u);
+    CHECK_EQ(count_boxes(boxes, "moof"), 0u);
+    CHECK_EQ(count_boxes(boxes, "mfra"), 0u);
+    CHECK(count_boxes(boxes, "mdat") >= 2);
+    if (faststart) {
+        CHECK_EQ(boxes[1].type, "moov");
+        CHECK_EQ(boxes[2].type, "free");
+    }
+    else {
+        CHECK_EQ(boxes[1].type, "free");
+        CHECK_EQ(boxes.back().type, "moov");
+    }
+
+    vector<mp4_box> mdats{};
+    for (auto& box : boxes) {
+        if (box.type == "mdat") {
+            mdats.push_back(box);
+        }
+    }
+
+    auto moov = children(data, *find_box(boxes, "moov"));
+    CHECK(find_box(moov, "mvex") == nullptr);
+    CHECK_EQ(count_boxes(moov, "trak"), 2u);
+    double longest = 0;
+    for (auto& trak : moov) {
+        if (trak.type == "trak") {
+            longest = max(longest, check_track(data, mdats, trak, muxed));
+        }
+    }
+
+    uint32_t timescale;
+    uint64_t duration;
+    read_header(data, *find_box(moov, "mvhd"), timescale, duration);
+    CHECK(longest > SECONDS - 0.1 && longest <= SECONDS + 0.1);
+    CHECK((double)duration / timescale > longest - 0.01);
+    CHECK((double)duration / timescale < longest + 0.01);
+}
+
+TEST(fmp4_finalize_writes_the_index_into_the_reserved_space)
+{
+    muxed_file muxed{};
+    CHECK(mux_fragmented(temp_file("obs-express-test-reserved.mp4"), FMP4_INDEX_RESERVE_BYTES, muxed));
+    uint64_t muxedBytes = read_file(muxed.path).size();
+
+    auto result = fmp4_finalize(muxed.path);
+    CHECK(result.success);
+    CHECK(result.faststart);
+    CHECK_EQ(result.samples, (uint64_t)muxed.videoFrames + muxed.audioFrames);
+    CHECK(result.fragments >= 4);
+    CHECK_EQ(read_file(muxed.path).size(), muxedBytes);
+    check_finalized(muxed, true);
+    remove(muxed.path.c_str());
+}
+
+TEST(fmp4_finalize_appends_the_index_without_room_in_front)
+{
+    muxed_file muxed{};
+    CHECK(mux_fragmented(temp_file("obs-express-test-appended.mp4"), 0, muxed));
+    uint64_t muxedBytes = read_file(muxed.path).size();
+
+    auto result = fmp4_finalize(muxed.path);
+    CHECK(result.success);
+    CHECK(!result.faststart);
+    CHECK_EQ(result.samples, (uint64_t)muxed.videoFrames + muxed.audioFrames);
+    CHECK_EQ(read_file(muxed.path).size(), muxedBytes + result.indexBytes);
+    check_finalized(muxed, false);
+    remove(muxed.path.c_str());
+}
+
+TEST(fmp4_finalize_keeps_the_fragments_a_crash_left_whole)
+{
+    muxed_file muxed{};
+    CHECK(mux_fragmented(temp_file("obs-express-test-cut.mp4"), FMP4_INDEX_RESERVE_BYTES, muxed));
+
+    // cut into the media of the last fragment, as a crash while it was written would
+    auto data = read_file(muxed.path);
+    auto boxes = read_boxes(data, 0, data.size());
+    size_t lastMdat = 0;
+    for (auto& box : boxes) {
+        lastMdat = box.type == "mdat" ? box.offset : lastMdat;
+    }
+    CHECK(lastMdat > 0);
+    filesystem::resize_file(muxed.path, lastMdat + 16);
+
+    auto result = fmp4_finalize(muxed.path);
+    CHECK(result.success);
+    CHECK(result.faststart);
+    CHECK(result.samples > 0);
+    CHECK(result.samples < (uint64_t)muxed.videoFrames + muxed.audioFrames);
+
+    // what is left ends with the last whole fragment
+    auto finalized = read_file(muxed.path);
+    auto left = read_boxes(finalized, 0, finalized.size());
+    CHECK_EQ(left.back().offset + left.back().size, finalized.size());
+    CHECK(finalized.size() <= lastMdat);
+    CHECK_EQ(count_boxes(left, "moof"), 0u);
+    remove(muxed.path.c_str());
+}
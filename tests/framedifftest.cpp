@@ -0,0 +1,119 @@
+#include "test.h"
+#include "framediff.h"
+
+#include <vector>
+#include <cstring>
+
+#pragma comment(lib, "obs.lib")
+
+using namespace std;
+
+// every kernel is compared with a plain byte by byte reference, over row lengths which leave every possible tail
+// after the 32 and 64 byte blocks of the vector kernels, and with a difference at every byte of the row
+
+// the kernels this cpu can run, the scalar one is always among them
+static vector<framediff_kernel> supported_kernels()
+{
+    vector<framediff_kernel> kernels{};
+    for (int k = FRAMEDIFF_SCALAR; k <= framediff_best_kernel(); k++) {
+        kernels.push_back((framediff_kernel)k);
+    }
+    return kernels;
+}
+
+static bool expected_update(vector<uint8_t>& reference, size_t referenceStride, const vector<uint8_t>& current, size_t currentStride, size_t rowBytes, size_t rows)
+{
+    for (size_t row = 0; row < rows; row++) {
+        if (memcmp(&reference[row * referenceStride], &current[row * currentStride], rowBytes) != 0) {
+            for (; row < rows; row++) {
+                memcpy(&reference[row * referenceStride], &current[row * currentStride], rowBytes);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static vector<uint8_t> pattern(size_t bytes, uint32_t seed)
+{
+    vector<uint8_t> data(bytes);
+    for (size_t i = 0; i < bytes; i++) {
+        data[i] = (uint8_t)(((i + seed) * 2654435761u) >> 24);
+    }
+    return data;
+}
+
+TEST(framediff_kernels_find_a_difference_at_every_byte)
+{
+    for (auto kernel : supported_kernels()) {
+        for (size_t rowBytes = 1; rowBytes <= 160; rowBytes++) {
+            auto current = pattern(rowBytes, (uint32_t)rowBytes);
+            for (size_t at = 0; at < rowBytes; at++) {
+                auto reference = current;
+                reference[at] ^= 0x80;
+                bool changed = framediff_update(kernel, reference.data(), rowBytes, current.data(), rowBytes, rowBytes, 1);
+                if (!changed || reference != current) {
+                    CHECK(changed);
+                    CHECK(reference == current);
+                    test_fail(__FILE__, __LINE__, string(framediff_kernel_name(kernel)) + " missed a difference at byte " + to_string(at) + " of " + to_string(rowBytes));
+                    return;
+                }
+            }
+            auto reference = current;
+            CHECK(!framediff_update(kernel, reference.data(), rowBytes, current.data(), rowBytes, rowBytes, 1));
+        }
+    }
+}
+
+TEST(framediff_kernels_match_the_reference_on_padded_planes)
+{
+    const size_t rows = 24;
+    for (auto kernel : supported_kernels()) {
+        for (size_t rowBytes : { 1u, 31u, 63u, 64u, 65u, 130u, 1920u, 1921u }) {
+            // the current plane has the 256 byte readback stride, the reference is packed tighter
+            size_t currentStride = (rowBytes + 255) & ~(size_t)255;
+            size_t referenceStride = rowBytes + 7;
+            auto current = pattern(currentStride * rows, 7);
+
+            for (size_t changedRow = 0; changedRow <= rows; changedRow++) {
+                vector<uint8_t> reference(referenceStride * rows, 0xEE);
+                for (size_t row = 0; row < rows; row++) {
+                    memcpy(&reference[row * referenceStride], &current[row * currentStride], rowBytes);
+                }
+                if (changedRow < rows) {
+                    reference[changedRow * referenceStride + rowBytes / 2] ^= 0x01;
+                }
+                auto expected = reference;
+
+                bool expectedChanged = expected_update(expected, referenceStride, current, currentStride, rowBytes, rows);
+                bool changed = framediff_update(kernel, reference.data(), referenceStride, current.data(), currentStride, rowBytes, rows);
+                CHECK_EQ(changed, expectedChanged);
+                CHECK_EQ(changed, changedRow < rows);
+
+                // the bytes between rowBytes and the stride are never written
+                CHECK(reference == expected);
+            }
+        }
+    }
+}
+
+TEST(framediff_kernels_compare_the_whole_plane)
+{
+    // a difference only in the last byte of the last row, past the vector blocks of every row
+    const size_t width = 1366, height = 12, stride = 1536;
+    for (auto kernel : supported_kernels()) {
+        auto current = pattern(stride * height, 3);
+        auto reference = current;
+        reference[stride * (height - 1) + width - 1] ^= 0x40;
+        CHECK(framediff_update(kernel, reference.data(), stride, current.data(), stride, width, height));
+        CHECK(reference == current);
+        CHECK(!framediff_update(kernel, reference.data(), stride, current.data(), stride, width, height));
+    }
+}
+
+TEST(framediff_names_every_kernel)
+{
+    CHECK_EQ(string(framediff_kernel_name(FRAMEDIFF_SCALAR)), "scalar");
+    CHECK_EQ(string(framediff_kernel_name(FRAMEDIFF_SSE2)), "sse2");
+    CHECK_EQ(string(framediff_kernel_name(FRAMEDIFF_AVX2)), "avx2");
+}
@@ -0,0 +1,103 @@
+#include "test.h"
+#include "layout.h"
+
+using namespace std;
+
+// a 1080p monitor with a taller 1440p one to its right, and a 1080p one above the left monitor
+static vector<screen_info> three_monitors()
+{
+    return {
+        { 0, 0, 1920, 1080, 96, "1", "\\\\.\\DISPLAY1", "Main" },
+        { 1920, -360, 2560, 1440, 144, "2", "\\\\.\\DISPLAY2", "Right" },
+        { 0, -1080, 1920, 1080, 96, "3", "\\\\.\\DISPLAY3", "Top" },
+    };
+}
+
+// the width and height the cropped source is drawn at
+static int32_t drawn_width(const screen_info& screen, const capture_placement& p)
+{
+    return screen.width - p.cropLeft - p.cropRight;
+}
+
+static int32_t drawn_height(const screen_info& screen, const capture_placement& p)
+{
+    return screen.height - p.cropTop - p.cropBottom;
+}
+
+TEST(layout_whole_monitor_is_not_cropped)
+{
+    auto placements = layout_capture_region(three_monitors(), { 0, 0, 1920, 1080 });
+    CHECK_EQ(placements.size(), 1u);
+    auto& p = placements[0];
+    CHECK_EQ(p.screen, 0u);
+    CHECK_EQ(p.x, 0);
+    CHECK_EQ(p.y, 0);
+    CHECK_EQ(p.cropLeft + p.cropTop + p.cropRight + p.cropBottom, 0);
+}
+
+TEST(layout_region_inside_a_monitor_is_cropped_on_every_side)
+{
+    auto screens = three_monitors();
+    auto placements = layout_capture_region(screens, { 2000, 0, 800, 600 });
+    CHECK_EQ(placements.size(), 1u);
+    auto& p = placements[0];
+    CHECK_EQ(p.screen, 1u);
+    CHECK_EQ(p.x, 0);
+    CHECK_EQ(p.y, 0);
+    CHECK_EQ(p.cropLeft, 80);
+    CHECK_EQ(p.cropTop, 360);
+    CHECK_EQ(p.cropRight, 2560 - 80 - 800);
+    CHECK_EQ(p.cropBottom, 1440 - 360 - 600);
+    CHECK_EQ(drawn_width(screens[1], p), 800);
+    CHECK_EQ(drawn_height(screens[1], p), 600);
+}
+
+TEST(layout_region_across_monitors_places_each_part)
+{
+    // spans the bottom of the top monitor, the top of the main one, and the left of the right one
+    auto screens = three_monitors();
+    capture_region region{ 1000, -200, 1420, 600 };
+    auto placements = layout_capture_region(screens, region);
+    CHECK_EQ(placements.size(), 3u);
+
+    int64_t area = 0;
+    for (auto& p : placements) {
+        auto& screen = screens[p.screen];
+        int32_t width = drawn_width(screen, p);
+        int32_t height = drawn_height(screen, p);
+        area += (int64_t)width * height;
+
+        // every part stays inside the canvas, and sits where its pixels are on the desktop
+        CHECK(p.x >= 0 && p.x + width <= region.width);
+        CHECK(p.y >= 0 && p.y + height <= region.height);
+        CHECK_EQ(screen.x + p.cropLeft - region.x, p.x);
+        CHECK_EQ(screen.y + p.cropTop - region.y, p.y);
+    }
+
+    // the right monitor reaches the whole height of the region, the other two split it at y = 0
+    CHECK_EQ(area, (int64_t)920 * 600 + (int64_t)500 * 600);
+    CHECK_EQ(placements[0].screen, 0u);
+    CHECK_EQ(placements[0].y, 200);
+    CHECK_EQ(placements[1].screen, 1u);
+    CHECK_EQ(placements[1].x, 920);
+    CHECK_EQ(placements[2].screen, 2u);
+    CHECK_EQ(placements[2].y, 0);
+    CHECK_EQ(placements[2].cropTop, 880);
+}
+
+TEST(layout_region_off_every_monitor_places_nothing)
+{
+    CHECK(layout_capture_region(three_monitors(), { -5000, -5000, 100, 100 }).empty());
+}
+
+TEST(layout_region_touching_an_edge_does_not_include_the_neighbour)
+{
+    auto placements = layout_capture_region(three_monitors(), { 0, 0, 1920, 1080 });
+    CHECK_EQ(placements.size(), 1u);
+
+    placements = layout_capture_region(three_monitors(), { 1919, 0, 2, 10 });
+    CHECK_EQ(placements.size(), 2u);
+    CHECK_EQ(placements[0].cropLeft, 1919);
+    CHECK_EQ(placements[1].cropLeft, 0);
+    CHECK_EQ(placements[1].x, 1);
+}
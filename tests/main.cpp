@@ -0,0 +1,55 @@
+#include "test.h"
+
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+struct test_case
+{
+    const char* name;
+    void (*run)();
+};
+
+// a function local, the tests register themselves during static initialization in any order
+static vector<test_case>& test_cases()
+{
+    static vector<test_case> cases;
+    return cases;
+}
+
+static uint32_t currentFailures = 0;
+
+void test_register(const char* name, void (*run)())
+{
+    test_cases().push_back({ name, run });
+}
+
+void test_fail(const char* file, int line, const string& message)
+{
+    currentFailures++;
+    cout << "  " << file << "(" << line << "): " << message << std::endl;
+}
+
+// obs-express-tests [filter], runs every test whose name contains the filter
+int main(int argc, char* argv[])
+{
+    const char* filter = argc > 1 ? argv[1] : "";
+    uint32_t run = 0;
+    uint32_t failed = 0;
+    for (auto& test : test_cases()) {
+        if (strstr(test.name, filter) == nullptr) {
+            continue;
+        }
+        cout << test.name << std::endl;
+        currentFailures = 0;
+        test.run();
+        run++;
+        if (currentFailures > 0) {
+            failed++;
+        }
+    }
+    cout << run - failed << " of " << run << " tests passed" << std::endl;
+    return failed > 0 ? 1 : 0;
+}
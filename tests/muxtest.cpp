@@ -0,0 +1,62 @@
+#include "test.h"
+#include "mux.h"
+
+using namespace std;
+
+TEST(mux_add_setting_adds_to_empty_settings)
+{
+    string settings;
+    mux_add_setting(settings, "movflags", "+faststart");
+    CHECK_EQ(settings, "movflags=+faststart");
+}
+
+TEST(mux_add_setting_builds_the_fragment_settings)
+{
+    // what --fragmentMs 500 adds to no --omux options
+    string settings;
+    mux_add_setting(settings, "movflags", "+empty_moov+default_base_moof");
+    mux_add_setting(settings, "frag_duration", "500000");
+    mux_add_setting(settings, "flush_packets", "1");
+    CHECK_EQ(settings, "movflags=+empty_moov+default_base_moof frag_duration=500000 flush_packets=1");
+}
+
+TEST(mux_add_setting_appends_flags_to_the_users)
+{
+    string settings = "movflags=+frag_keyframe";
+    mux_add_setting(settings, "movflags", "+empty_moov");
+    CHECK_EQ(settings, "movflags=+frag_keyframe+empty_moov");
+
+    settings = "brand=isom movflags=faststart title=x";
+    mux_add_setting(settings, "movflags", "+empty_moov");
+    CHECK_EQ(settings, "brand=isom movflags=faststart+empty_moov title=x");
+}
+
+TEST(mux_add_setting_keeps_the_users_value)
+{
+    string settings = "frag_duration=1000000";
+    mux_add_setting(settings, "frag_duration", "500000");
+    CHECK_EQ(settings, "frag_duration=1000000");
+}
+
+TEST(mux_add_setting_compares_whole_keys)
+{
+    string settings = "min_frag_duration=100000";
+    mux_add_setting(settings, "frag_duration", "500000");
+    CHECK_EQ(settings, "min_frag_duration=100000 frag_duration=500000");
+
+    settings = "frag_duration_extra=1";
+    mux_add_setting(settings, "frag_duration", "500000");
+    CHECK_EQ(settings, "frag_duration_extra=1 frag_duration=500000");
+
+    // a key which only appears in another setting's value
+    settings = "title=movflags=1";
+    mux_add_setting(settings, "movflags", "+faststart");
+    CHECK_EQ(settings, "title=movflags=1 movflags=+faststart");
+}
+
+TEST(mux_add_setting_skips_empty_entries)
+{
+    string settings = "brand=isom  movflags=+faststart";
+    mux_add_setting(settings, "movflags", "+empty_moov");
+    CHECK_EQ(settings, "brand=isom  movflags=+faststart+empty_moov");
+}
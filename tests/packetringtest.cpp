@@ -0,0 +1,265 @@
+#include "test.h"
+#include "packetring.h"
+
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "obs-studio/libobs/util/platform.h"
+
+#pragma comment(lib, "obs.lib")
+
+using namespace std;
+
+// a synthetic h264 stream with a keyframe every 30 frames, between them the odd frames are references and the
+// even ones are disposable. every video frame is followed by an audio packet.
+
+static const uint32_t GOP = 30;
+static const size_t KEYFRAME_BYTES = 4000;
+static const size_t FRAME_BYTES = 1000;
+static const size_t AUDIO_BYTES = 200;
+
+struct synthetic_stream
+{
+    vector<vector<uint8_t>> payloads;
+    vector<encoder_packet> packets;
+};
+
+static bool is_keyframe(uint64_t frame)
+{
+    return frame % GOP == 0;
+}
+
+static bool is_disposable(uint64_t frame)
+{
+    return !is_keyframe(frame) && frame % 2 == 0;
+}
+
+static synthetic_stream synthetic_stream_create(uint64_t frames)
+{
+    synthetic_stream stream{};
+    stream.payloads.reserve(frames * 2);
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        // an annex b start code and the nal header, nal_ref_idc is zero only for the disposable frames
+        uint8_t header = is_keyframe(frame) ? 0x65 : is_disposable(frame) ? 0x01 : 0x41;
+        auto& video = stream.payloads.emplace_back(is_keyframe(frame) ? KEYFRAME_BYTES : FRAME_BYTES, (uint8_t)0x11);
+        video[0] = video[1] = video[2] = 0;
+        video[3] = 1;
+        video[4] = header;
+        auto& audio = stream.payloads.emplace_back(AUDIO_BYTES, (uint8_t)0x22);
+
+        encoder_packet packet{};
+        packet.type = OBS_ENCODER_VIDEO;
+        packet.keyframe = is_keyframe(frame);
+        packet.data = video.data();
+        packet.size = video.size();
+        packet.pts = packet.dts = (int64_t)frame;
+        packet.timebase_num = 1;
+        packet.timebase_den = 60;
+        stream.packets.push_back(packet);
+
+        packet.type = OBS_ENCODER_AUDIO;
+        packet.keyframe = true;
+        packet.data = audio.data();
+        packet.size = audio.size();
+        stream.packets.push_back(packet);
+    }
+    return stream;
+}
+
+// what a push of the first count packets adds up to
+static uint64_t stream_bytes(const synthetic_stream& stream, size_t count)
+{
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        bytes += stream.packets[i].size;
+    }
+    return bytes;
+}
+
+// pushes the way an encoder hands packets out, each in memory of its own
+static bool push(packet_ring* ring, const encoder_packet& packet)
+{
+    encoder_packet instance{};
+    obs_encoder_packet_create_instance(&instance, &packet);
+    bool pushed = packet_ring_push(ring, &instance);
+    obs_encoder_packet_release(&instance);
+    return pushed;
+}
+
+// takes and releases everything waiting, returns the video frames which were written. a take waits for a push
+// when nothing is pending, and everything taken is released at once, so whatever is buffered is pending.
+static vector<int64_t> drain(packet_ring* ring)
+{
+    vector<int64_t> frames{};
+    deque<encoder_packet> batch{};
+    if (packet_ring_get_stats(ring).bufferedPackets == 0 || !packet_ring_take(ring, batch)) {
+        return frames;
+    }
+    for (auto& packet : batch) {
+        if (packet.type == OBS_ENCODER_VIDEO) {
+            frames.push_back(packet.dts);
+        }
+        packet_ring_release(ring, packet);
+    }
+    return frames;
+}
+
+// the writer takes nothing for the first stallPackets, then drains after every push. returns the video frames
+// written, in order.
+static vector<int64_t> run_stall(const synthetic_stream& stream, const packet_ring_options& options, size_t stallPackets, packet_ring_stats& stats)
+{
+    packet_ring* ring = packet_ring_create();
+    packet_ring_open(ring, options);
+
+    vector<int64_t> written{};
+    for (size_t i = 0; i < stream.packets.size(); i++) {
+        push(ring, stream.packets[i]);
+        if (i + 1 >= stallPackets) {
+            auto frames = drain(ring);
+            written.insert(written.end(), frames.begin(), frames.end());
+        }
+    }
+    packet_ring_close(ring);
+    stats = packet_ring_get_stats(ring);
+    packet_ring_destroy(ring);
+    return written;
+}
+
+static vector<int64_t> frames_missing(const vector<int64_t>& written, uint64_t frames)
+{
+    vector<int64_t> missing{};
+    size_t next = 0;
+    for (int64_t frame = 0; frame < (int64_t)frames; frame++) {
+        if (next < written.size() && written[next] == frame) {
+            next++;
+        }
+        else {
+            missing.push_back(frame);
+        }
+    }
+    return missing;
+}
+
+TEST(packet_ring_absorbs_a_stall_within_its_budget)
+{
+    auto stream = synthetic_stream_create(GOP * 3);
+    size_t stallPackets = GOP * 2 * 2;
+    packet_ring_options options{ stream_bytes(stream, stallPackets), packet_ring_policy::drop, "h264" };
+
+    packet_ring_stats stats{};
+    auto written = run_stall(stream, options, stallPackets, stats);
+    CHECK_EQ(stats.droppedPackets, 0u);
+    CHECK_EQ(stats.exhausted, 0u);
+    CHECK_EQ(stats.peakBytes, stream_bytes(stream, stallPackets));
+    CHECK_EQ(stats.drainedBytes, stream_bytes(stream, stream.packets.size()));
+    CHECK_EQ(stats.bufferedBytes, 0u);
+    CHECK_EQ(written.size(), (size_t)GOP * 3);
+    CHECK(frames_missing(written, GOP * 3).empty());
+}
+
+TEST(packet_ring_drops_from_a_disposable_frame_to_the_next_keyframe)
+{
+    // frame 10 is the first which does not fit and is disposable, the reference frame after it does not fit either
+    auto stream = synthetic_stream_create(GOP * 3);
+    packet_ring_options options{ stream_bytes(stream, 10 * 2) + 500, packet_ring_policy::drop, "h264" };
+
+    packet_ring_stats stats{};
+    auto written = run_stall(stream, options, 20 * 2, stats);
+    auto missing = frames_missing(written, GOP * 3);
+    CHECK(!missing.empty());
+    CHECK(is_disposable(missing.front()));
+    CHECK_EQ(missing.front(), 10);
+
+    // one run with no gaps, up to the keyframe which ends it, which is written like everything after it
+    CHECK_EQ(missing.back(), (int64_t)GOP - 1);
+    CHECK_EQ(missing.size(), (size_t)GOP - 10);
+    CHECK_EQ(stats.droppedPackets, (uint64_t)missing.size());
+    CHECK_EQ(stats.exhausted, 1u);
+}
+
+TEST(packet_ring_drops_from_a_reference_frame_to_the_next_keyframe)
+{
+    auto stream = synthetic_stream_create(GOP * 3);
+    packet_ring_options options{ stream_bytes(stream, 11 * 2) + 500, packet_ring_policy::drop, "h264" };
+
+    packet_ring_stats stats{};
+    auto written = run_stall(stream, options, 12 * 2, stats);
+    auto missing = frames_missing(written, GOP * 3);
+    CHECK_EQ(missing.size(), (size_t)GOP - 11);
+    CHECK_EQ(missing.front(), 11);
+    CHECK_EQ(missing.back(), (int64_t)GOP - 1);
+}
+
+TEST(packet_ring_drops_no_audio)
+{
+    auto stream = synthetic_stream_create(GOP * 2);
+    packet_ring_options options{ stream_bytes(stream, 10 * 2) + 500, packet_ring_policy::drop, "h264" };
+
+    packet_ring* ring = packet_ring_create();
+    packet_ring_open(ring, options);
+    size_t audioPushed = 0;
+    for (auto& packet : stream.packets) {
+        if (push(ring, packet) && packet.type == OBS_ENCODER_AUDIO) {
+            audioPushed++;
+        }
+    }
+    CHECK_EQ(audioPushed, (size_t)GOP * 2);
+    packet_ring_close(ring);
+    packet_ring_destroy(ring);
+}
+
+TEST(packet_ring_treats_frames_of_other_codecs_as_references)
+{
+    // without h264 or hevc every frame counts as a reference, so the drops still end at a keyframe
+    auto stream = synthetic_stream_create(GOP * 2);
+    packet_ring_options options{ stream_bytes(stream, 10 * 2) + 500, packet_ring_policy::drop, "av1" };
+
+    packet_ring_stats stats{};
+    auto written = run_stall(stream, options, 20 * 2, stats);
+    auto missing = frames_missing(written, GOP * 2);
+    CHECK_EQ(missing.front(), 10);
+    CHECK_EQ(missing.back(), (int64_t)GOP - 1);
+    CHECK_EQ(missing.size(), (size_t)GOP - 10);
+}
+
+TEST(packet_ring_block_waits_for_the_writer_instead_of_dropping)
+{
+    auto stream = synthetic_stream_create(GOP * 2);
+    packet_ring_options options{ stream_bytes(stream, 10 * 2), packet_ring_policy::block, "h264" };
+
+    packet_ring* ring = packet_ring_create();
+    packet_ring_open(ring, options);
+
+    vector<int64_t> written{};
+    thread writer([&]() {
+        os_sleep_ms(50);
+        deque<encoder_packet> batch{};
+        while (packet_ring_take(ring, batch)) {
+            for (auto& packet : batch) {
+                if (packet.type == OBS_ENCODER_VIDEO) {
+                    written.push_back(packet.dts);
+                }
+                packet_ring_release(ring, packet);
+            }
+            batch.clear();
+        }
+    });
+
+    size_t pushed = 0;
+    for (auto& packet : stream.packets) {
+        if (push(ring, packet)) {
+            pushed++;
+        }
+    }
+    packet_ring_close(ring);
+    writer.join();
+
+    auto stats = packet_ring_get_stats(ring);
+    packet_ring_destroy(ring);
+    CHECK_EQ(pushed, stream.packets.size());
+    CHECK_EQ(stats.droppedPackets, 0u);
+    CHECK(stats.blockedNs > 0);
+    CHECK(stats.peakBytes <= options.budgetBytes);
+    CHECK(frames_missing(written, GOP * 2).empty());
+}
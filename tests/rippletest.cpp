@@ -0,0 +1,76 @@
+#include "test.h"
+#include "ripple.h"
+
+#include <cmath>
+
+using namespace std;
+
+static bool near(float actual, float expected)
+{
+    return fabsf(actual - expected) < 0.001f;
+}
+
+TEST(ripple_starts_small_and_opaque)
+{
+    ripple_frame frame{};
+    CHECK(ripple_evaluate({ 100, 200, 96, 1000 }, 1000, frame));
+    CHECK_EQ(frame.x, 100.0f);
+    CHECK_EQ(frame.y, 200.0f);
+    CHECK(near(frame.radius, RIPPLE_MIN_RADIUS));
+    CHECK(near(frame.opacity, RIPPLE_MAX_OPACITY));
+}
+
+TEST(ripple_grows_and_fades_over_its_duration)
+{
+    ripple_frame frame{};
+    CHECK(ripple_evaluate({ 0, 0, 96, 1000 }, 1000 + RIPPLE_DURATION_MS / 2, frame));
+    CHECK(near(frame.radius, RIPPLE_MIN_RADIUS + RIPPLE_GROW_RADIUS / 2));
+    CHECK(near(frame.opacity, RIPPLE_MAX_OPACITY / 2));
+
+    CHECK(ripple_evaluate({ 0, 0, 96, 1000 }, 1000 + RIPPLE_DURATION_MS - 1, frame));
+    CHECK(frame.radius < RIPPLE_MIN_RADIUS + RIPPLE_GROW_RADIUS);
+    CHECK(frame.opacity > 0);
+    CHECK(!ripple_evaluate({ 0, 0, 96, 1000 }, 1000 + RIPPLE_DURATION_MS, frame));
+}
+
+TEST(ripple_scales_with_dpi)
+{
+    ripple_frame frame{};
+    CHECK(ripple_evaluate({ 0, 0, 192, 1000 }, 1000, frame));
+    CHECK(near(frame.radius, RIPPLE_MIN_RADIUS * 2));
+}
+
+TEST(ripple_clicks_ahead_of_the_frame_start_at_the_beginning)
+{
+    ripple_frame frame{};
+    CHECK(ripple_evaluate({ 0, 0, 96, 1010 }, 1000, frame));
+    CHECK(near(frame.radius, RIPPLE_MIN_RADIUS));
+    CHECK(near(frame.opacity, RIPPLE_MAX_OPACITY));
+}
+
+TEST(ripple_set_replaces_the_oldest_when_full)
+{
+    ripple_set set{};
+    for (uint64_t i = 0; i < RIPPLE_MAX_ACTIVE + 2; i++) {
+        set.push({ (int32_t)i, 0, 96, 1000 + i });
+    }
+    CHECK_EQ(set.count, (uint32_t)RIPPLE_MAX_ACTIVE);
+    CHECK_EQ(set.clicks[0].x, 2);
+    CHECK_EQ(set.clicks[RIPPLE_MAX_ACTIVE - 1].x, RIPPLE_MAX_ACTIVE + 1);
+}
+
+TEST(ripple_set_expires_only_finished_ripples)
+{
+    ripple_set set{};
+    set.push({ 1, 0, 96, 1000 });
+    set.push({ 2, 0, 96, 1200 });
+    set.push({ 3, 0, 96, 1300 });
+
+    set.expire(1000 + RIPPLE_DURATION_MS);
+    CHECK_EQ(set.count, 2u);
+    CHECK_EQ(set.clicks[0].x, 2);
+    CHECK_EQ(set.clicks[1].x, 3);
+
+    set.expire(1300 + RIPPLE_DURATION_MS);
+    CHECK_EQ(set.count, 0u);
+}
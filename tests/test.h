@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <sstream>
+
+// a minimal test harness for the modules which do not need obs running. every TEST registers itself, a failed
+// CHECK is reported and the test carries on, so one run shows everything which is wrong.
+
+void test_register(const char* name, void (*run)());
+void test_fail(const char* file, int line, const std::string& message);
+
+#define TEST(name) \
+    static void name(); \
+    static const bool name##_registered = (test_register(#name, name), true); \
+    static void name()
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) \
+            test_fail(__FILE__, __LINE__, #expr); \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        auto actualValue = (actual); \
+        auto expectedValue = (expected); \
+        if (!(actualValue == expectedValue)) { \
+            std::ostringstream message; \
+            message << #actual << " is " << actualValue << ", expected " << expectedValue; \
+            test_fail(__FILE__, __LINE__, message.str()); \
+        } \
+    } while (0)
@@ -0,0 +1,113 @@
+#include "test.h"
+#include "topology.h"
+
+#include <memory>
+
+using namespace std;
+
+// counts how often the layout is enumerated, and returns whatever it was last given
+struct counting_provider : display_topology_provider
+{
+    vector<screen_info> layout;
+    uint32_t* enumerated;
+
+    counting_provider(vector<screen_info> layout, uint32_t* enumerated) : layout(std::move(layout)), enumerated(enumerated) { }
+
+    vector<screen_info> enumerate() override
+    {
+        (*enumerated)++;
+        return layout;
+    }
+};
+
+// a 1080p monitor at 96 dpi, with a 4k one at 192 dpi to its right
+static vector<screen_info> two_monitors()
+{
+    return {
+        { 0, 0, 1920, 1080, 96, "\\\\?\\DISPLAY#1", "\\\\.\\DISPLAY1", "Left" },
+        { 1920, 0, 3840, 2160, 192, "\\\\?\\DISPLAY#2", "\\\\.\\DISPLAY2", "Right" },
+    };
+}
+
+TEST(topology_finds_the_monitor_containing_a_point)
+{
+    display_topology topology(make_unique<display_topology_fixed_provider>(two_monitors()));
+    CHECK_EQ(topology.index_for_point(0, 0), 0);
+    CHECK_EQ(topology.index_for_point(1919, 1079), 0);
+    CHECK_EQ(topology.index_for_point(1920, 0), 1);
+    CHECK_EQ(topology.dpi_for_point(100, 100), 96u);
+    CHECK_EQ(topology.dpi_for_point(3000, 2000), 192u);
+}
+
+TEST(topology_uses_the_nearest_monitor_for_a_point_off_screen)
+{
+    display_topology topology(make_unique<display_topology_fixed_provider>(two_monitors()));
+    CHECK_EQ(topology.index_for_point(-50, 500), 0);
+    CHECK_EQ(topology.index_for_point(100, 1500), 0);
+    CHECK_EQ(topology.index_for_point(2500, 1500), 1);
+    CHECK_EQ(topology.index_for_point(9000, -10), 1);
+}
+
+TEST(topology_without_monitors_answers_96_dpi)
+{
+    display_topology topology(make_unique<display_topology_fixed_provider>(vector<screen_info>{}));
+    CHECK_EQ(topology.index_for_point(0, 0), -1);
+    CHECK_EQ(topology.dpi_for_point(0, 0), 96u);
+    CHECK(topology.screens().empty());
+}
+
+TEST(topology_enumerates_only_after_an_invalidate)
+{
+    uint32_t enumerated = 0;
+    auto provider = make_unique<counting_provider>(two_monitors(), &enumerated);
+    auto& layout = provider->layout;
+    display_topology topology(std::move(provider));
+
+    // the layout is there before the first lookup, so concurrent first callers never see an empty table
+    CHECK_EQ(enumerated, 1u);
+    CHECK_EQ(topology.generation(), 1u);
+
+    topology.index_for_point(0, 0);
+    topology.dpi_for_point(2000, 0);
+    CHECK_EQ(topology.screens().size(), 2u);
+    CHECK_EQ(enumerated, 1u);
+    CHECK_EQ(topology.generation(), 1u);
+
+    // the right monitor is unplugged
+    layout.pop_back();
+    CHECK_EQ(topology.index_for_point(2000, 0), 1);
+    topology.invalidate();
+    CHECK_EQ(topology.index_for_point(2000, 0), 0);
+    CHECK_EQ(topology.dpi_for_point(2000, 0), 96u);
+    CHECK_EQ(enumerated, 2u);
+    CHECK_EQ(topology.generation(), 2u);
+}
+
+TEST(topology_forgets_the_last_hit_when_the_layout_changes)
+{
+    uint32_t enumerated = 0;
+    auto provider = make_unique<counting_provider>(two_monitors(), &enumerated);
+    auto& layout = provider->layout;
+    display_topology topology(std::move(provider));
+    CHECK_EQ(topology.index_for_point(2000, 10), 1);
+
+    // the monitors swap places, the cached hit would still point at the old right one
+    layout = {
+        { 1920, 0, 1920, 1080, 96, "\\\\?\\DISPLAY#1", "\\\\.\\DISPLAY1", "Right" },
+        { -3840, 0, 3840, 2160, 192, "\\\\?\\DISPLAY#2", "\\\\.\\DISPLAY2", "Left" },
+    };
+    topology.invalidate();
+    CHECK_EQ(topology.index_for_point(2000, 10), 0);
+    CHECK_EQ(topology.index_for_point(-100, 10), 1);
+    CHECK_EQ(string(topology.screens()[1].monitor_friendly_name), "Left");
+}
+
+TEST(topology_benchmark_looks_up_the_cached_layout)
+{
+    uint32_t enumerated = 0;
+    display_topology topology(make_unique<counting_provider>(two_monitors(), &enumerated));
+    auto result = topology_benchmark(topology, 1000);
+    CHECK_EQ(result.monitors, 2u);
+    CHECK(result.sameMonitorNs > 0 && result.alternatingNs > 0 && result.offScreenNs > 0);
+    CHECK_EQ(enumerated, 1u);
+}
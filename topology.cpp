@@ -0,0 +1,139 @@
+#include "topology.h"
+
+#include <mutex>
+#include <limits>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+display_topology::display_topology(unique_ptr<display_topology_provider> provider)
+    : provider(std::move(provider))
+{
+    // enumerated before any lookup can run, a first caller racing the refresh would otherwise find an empty table
+    refresh_if_stale();
+}
+
+void display_topology::invalidate()
+{
+    stale.store(true, memory_order_release);
+}
+
+void display_topology::refresh_if_stale()
+{
+    // only one thread re-enumerates, and it does so outside of the lock so lookups on
+    // other threads keep using the old layout meanwhile
+    if (!stale.load(memory_order_acquire) || !stale.exchange(false, memory_order_acq_rel)) {
+        return;
+    }
+
+    auto screens = provider->enumerate();
+
+    vector<bounds> newRects{};
+    newRects.reserve(screens.size());
+    for (auto& s : screens) {
+        newRects.push_back(bounds{ s.x, s.y, s.x + s.width, s.y + s.height });
+    }
+
+    unique_lock<shared_mutex> writer(lock);
+    table = std::move(screens);
+    rects = std::move(newRects);
+    lastHit.store(-1, memory_order_relaxed);
+    gen.fetch_add(1, memory_order_acq_rel);
+}
+
+int32_t display_topology::find_locked(int32_t x, int32_t y)
+{
+    int32_t count = (int32_t)rects.size();
+    if (count == 0) {
+        return -1;
+    }
+
+    // consecutive queries are almost always on the same monitor
+    int32_t hint = lastHit.load(memory_order_relaxed);
+    if (hint >= 0 && hint < count) {
+        auto& r = rects[hint];
+        if (x >= r.left && x < r.right && y >= r.top && y < r.bottom) {
+            return hint;
+        }
+    }
+
+    int64_t bestDistance = numeric_limits<int64_t>::max();
+    int32_t best = 0;
+    for (int32_t i = 0; i < count; i++) {
+        auto& r = rects[i];
+        if (x >= r.left && x < r.right && y >= r.top && y < r.bottom) {
+            lastHit.store(i, memory_order_relaxed);
+            return i;
+        }
+
+        // same as MONITOR_DEFAULTTONEAREST, squared distance to the closest edge
+        int64_t dx = x < r.left ? r.left - x : (x >= r.right ? x - r.right + 1 : 0);
+        int64_t dy = y < r.top ? r.top - y : (y >= r.bottom ? y - r.bottom + 1 : 0);
+        int64_t distance = dx * dx + dy * dy;
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+int32_t display_topology::index_for_point(int32_t x, int32_t y)
+{
+    refresh_if_stale();
+    shared_lock<shared_mutex> reader(lock);
+    return find_locked(x, y);
+}
+
+uint32_t display_topology::dpi_for_point(int32_t x, int32_t y)
+{
+    refresh_if_stale();
+    shared_lock<shared_mutex> reader(lock);
+    int32_t idx = find_locked(x, y);
+    return idx < 0 ? 96 : table[idx].dpi;
+}
+
+vector<screen_info> display_topology::screens()
+{
+    refresh_if_stale();
+    shared_lock<shared_mutex> reader(lock);
+    return table;
+}
+
+// ns per dpi_for_point over the points, taken in turn
+static double time_lookups(display_topology& topology, const vector<pair<int32_t, int32_t>>& points, uint32_t iterations)
+{
+    volatile uint32_t sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        auto& point = points[i % points.size()];
+        sink = sink + topology.dpi_for_point(point.first, point.second);
+    }
+    return (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / iterations;
+}
+
+topology_benchmark_result topology_benchmark(display_topology& topology, uint32_t iterations)
+{
+    auto screens = topology.screens();
+    topology_benchmark_result result{};
+    result.monitors = (uint32_t)screens.size();
+
+    // the centre of each monitor, and a point beyond the bottom right of all of them
+    vector<pair<int32_t, int32_t>> centres{};
+    int32_t right = 0, bottom = 0;
+    for (auto& s : screens) {
+        centres.push_back({ s.x + s.width / 2, s.y + s.height / 2 });
+        right = max(right, s.x + s.width);
+        bottom = max(bottom, s.y + s.height);
+    }
+    if (centres.empty()) {
+        centres.push_back({ 0, 0 });
+    }
+
+    result.sameMonitorNs = time_lookups(topology, { centres[0] }, iterations);
+    result.alternatingNs = time_lookups(topology, centres, iterations);
+    result.offScreenNs = time_lookups(topology, { { right + 1000, bottom + 1000 } }, iterations);
+    return result;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+
+#include "getscreens.h"
+
+// source of the monitor layout. the win32 implementation lives in getscreens.cpp, other implementations
+// can return a fixed layout so the topology service can be exercised without real displays.
+struct display_topology_provider
+{
+    virtual ~display_topology_provider() = default;
+    virtual std::vector<screen_info> enumerate() = 0;
+};
+
+// a provider which always returns the same layout
+struct display_topology_fixed_provider : display_topology_provider
+{
+    explicit display_topology_fixed_provider(std::vector<screen_info> screens) : screens(std::move(screens)) { }
+    std::vector<screen_info> enumerate() override { return screens; }
+    std::vector<screen_info> screens;
+};
+
+// caches the monitor layout and answers point -> monitor queries without calling into the OS. the layout is
+// enumerated once on construction, and again only after invalidate() is called, e.g. from a display change notification.
+class display_topology
+{
+public:
+    explicit display_topology(std::unique_ptr<display_topology_provider> provider);
+
+    // a copy of the current monitor table, in enumeration order
+    std::vector<screen_info> screens();
+
+    // the dpi of the monitor containing the point, or the nearest monitor if the point is off-screen.
+    // returns 96 if there are no monitors.
+    uint32_t dpi_for_point(int32_t x, int32_t y);
+
+    // index into screens() of the monitor containing (or nearest to) the point, or -1 if there are no monitors
+    int32_t index_for_point(int32_t x, int32_t y);
+
+    // marks the cached layout as stale, it will be re-enumerated on next use. safe to call from any thread.
+    void invalidate();
+
+    // incremented every time the layout is enumerated, 1 once constructed
+    uint64_t generation() const { return gen.load(std::memory_order_acquire); }
+
+private:
+    struct bounds
+    {
+        int32_t left;
+        int32_t top;
+        int32_t right;
+        int32_t bottom;
+    };
+
+    void refresh_if_stale();
+    int32_t find_locked(int32_t x, int32_t y);
+
+    std::unique_ptr<display_topology_provider> provider;
+    std::shared_mutex lock;
+    std::vector<screen_info> table;
+    std::vector<bounds> rects; // flat copy of table bounds, kept separate so lookups touch as little memory as possible
+    std::atomic<int32_t> lastHit{ -1 };
+    std::atomic<bool> stale{ true };
+    std::atomic<uint64_t> gen{ 0 };
+};
+
+struct topology_benchmark_result
+{
+    uint32_t monitors;
+    double sameMonitorNs;   // per lookup, consecutive points on one monitor, the common case for a cursor
+    double alternatingNs;   // per lookup, points alternating between the monitors, each one misses the last hit
+    double offScreenNs;     // per lookup, a point outside every monitor, which measures the distance to each
+};
+
+// times dpi_for_point on points of the topology's current layout
+topology_benchmark_result topology_benchmark(display_topology& topology, uint32_t iterations);
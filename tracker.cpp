@@ -0,0 +1,247 @@
+#include "tracker.h"
+#include "ripple.h"
+#include "input.h"
+#include "getscreens.h"
+#include "util.h"
+#include "events.h"
+
+#include <atomic>
+#include <cmath>
+
+#include "obs-studio/libobs/graphics/vec4.h"
+
+using namespace std;
+
+// draws an anti-aliased disc filling the sprite it is rendered on. all per-ripple state is passed
+// as uniforms so nothing needs to be allocated or re-parsed per frame.
+static const char* ripple_effect_source = R"(
+uniform float4x4 ViewProj;
+uniform float4 color;
+uniform float radius;
+uniform float opacity;
+
+struct VertData {
+    float4 pos : POSITION;
+    float2 uv  : TEXCOORD0;
+};
+
+VertData VSDefault(VertData v_in)
+{
+    VertData vert_out;
+    vert_out.pos = mul(float4(v_in.pos.xyz, 1.0), ViewProj);
+    vert_out.uv = v_in.uv;
+    return vert_out;
+}
+
+float4 PSRipple(VertData v_in) : TARGET
+{
+    float dist = length((v_in.uv * 2.0 - 1.0) * radius);
+    float edge = saturate(radius - dist + 0.5);
+    return float4(color.rgb, color.a * opacity * edge);
+}
+
+technique Draw
+{
+    pass
+    {
+        vertex_shader = VSDefault(v_in);
+        pixel_shader = PSRipple(v_in);
+    }
+}
+)";
+
+struct ripple_source
+{
+    obs_source_t* source;
+    gs_effect_t* effect;
+    gs_eparam_t* paramColor;
+    gs_eparam_t* paramRadius;
+    gs_eparam_t* paramOpacity;
+
+    vec4 color;
+    int32_t originX;
+    int32_t originY;
+    uint32_t width;
+    uint32_t height;
+
+    atomic<input_collector*> input;
+    ripple_set ripples;
+    bool held;
+    bool pinned;
+    uint64_t frameTimeMs;
+};
+
+static const char* ripple_source_get_name(void* unused)
+{
+    return "Click Ripple";
+}
+
+static void* ripple_source_create(obs_data_t* settings, obs_source_t* source)
+{
+    auto ctx = new ripple_source{};
+    ctx->source = source;
+    ctx->originX = (int32_t)obs_data_get_int(settings, "x");
+    ctx->originY = (int32_t)obs_data_get_int(settings, "y");
+    ctx->width = (uint32_t)obs_data_get_int(settings, "width");
+    ctx->height = (uint32_t)obs_data_get_int(settings, "height");
+
+    uint32_t rgb = (uint32_t)obs_data_get_int(settings, "color");
+    vec4_set(&ctx->color, ((rgb >> 16) & 0xFF) / 255.0f, ((rgb >> 8) & 0xFF) / 255.0f, (rgb & 0xFF) / 255.0f, 1.0f);
+
+    char* errors = nullptr;
+    obs_enter_graphics();
+    ctx->effect = gs_effect_create(ripple_effect_source, "click_ripple.effect", &errors);
+    obs_leave_graphics();
+
+    if (!ctx->effect) {
+        events_write(string("ERROR: Unable to compile click ripple effect: ") + (errors ? errors : "unknown error"));
+        bfree(errors);
+        delete ctx;
+        return nullptr;
+    }
+
+    ctx->paramColor = gs_effect_get_param_by_name(ctx->effect, "color");
+    ctx->paramRadius = gs_effect_get_param_by_name(ctx->effect, "radius");
+    ctx->paramOpacity = gs_effect_get_param_by_name(ctx->effect, "opacity");
+    return ctx;
+}
+
+static void ripple_source_destroy(void* data)
+{
+    auto ctx = (ripple_source*)data;
+    input_collector_destroy(ctx->input.load());
+    obs_enter_graphics();
+    gs_effect_destroy(ctx->effect);
+    obs_leave_graphics();
+    delete ctx;
+}
+
+static uint32_t ripple_source_get_width(void* data)
+{
+    return ((ripple_source*)data)->width;
+}
+
+static uint32_t ripple_source_get_height(void* data)
+{
+    return ((ripple_source*)data)->height;
+}
+
+static void ripple_source_tick(void* data, float seconds)
+{
+    auto ctx = (ripple_source*)data;
+    auto time = util_obs_get_time_ms();
+    auto input = ctx->input.load(memory_order_acquire);
+    if (input == nullptr) {
+        return;
+    }
+
+    // every event is applied at the time it happened, not the time of this tick
+    input_event ev;
+    while (input_collector_pop(input, ev)) {
+        ripple_click* last = ctx->ripples.count > 0 ? &ctx->ripples.clicks[ctx->ripples.count - 1] : nullptr;
+        int32_t x = ev.x - ctx->originX;
+        int32_t y = ev.y - ctx->originY;
+        uint64_t evTimeMs = ev.timeNs / 1000000;
+
+        if (ev.type == INPUT_EVENT_DOWN) {
+            ctx->ripples.push(ripple_click{ x, y, get_dpi_for_point(ev.x, ev.y), evTimeMs });
+            ctx->held = true;
+            ctx->pinned = false;
+        }
+        else if (ev.type == INPUT_EVENT_MOVE && ctx->held && last) {
+            last->x = x;
+            last->y = y;
+        }
+        else if (ev.type == INPUT_EVENT_UP && ctx->held) {
+            if (ctx->pinned && last) {
+                last->startMs = evTimeMs;
+            }
+            ctx->held = false;
+            ctx->pinned = false;
+        }
+    }
+
+    if (ctx->held && ctx->ripples.count > 0) {
+        // while the button is held the ripple stays at the start of its animation
+        ctx->ripples.clicks[ctx->ripples.count - 1].startMs = time;
+        ctx->pinned = true;
+    }
+
+    ctx->ripples.expire(time);
+    ctx->frameTimeMs = time;
+}
+
+static void ripple_source_render(void* data, gs_effect_t* unused)
+{
+    auto ctx = (ripple_source*)data;
+    if (ctx->ripples.count == 0) {
+        return;
+    }
+
+    gs_blend_state_push();
+    gs_blend_function(GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA);
+    gs_effect_set_vec4(ctx->paramColor, &ctx->color);
+
+    gs_technique_t* tech = gs_effect_get_technique(ctx->effect, "Draw");
+    gs_technique_begin(tech);
+    gs_technique_begin_pass(tech, 0);
+
+    for (uint32_t i = 0; i < ctx->ripples.count; i++) {
+        ripple_frame frame;
+        if (!ripple_evaluate(ctx->ripples.clicks[i], ctx->frameTimeMs, frame)) {
+            continue;
+        }
+
+        gs_effect_set_float(ctx->paramRadius, frame.radius);
+        gs_effect_set_float(ctx->paramOpacity, frame.opacity);
+
+        uint32_t size = (uint32_t)ceilf(frame.radius * 2);
+        gs_matrix_push();
+        gs_matrix_translate3f(frame.x - frame.radius, frame.y - frame.radius, 0.0f);
+        gs_draw_sprite(nullptr, 0, size, size);
+        gs_matrix_pop();
+    }
+
+    gs_technique_end_pass(tech);
+    gs_technique_end(tech);
+    gs_blend_state_pop();
+}
+
+void tracker_register_source()
+{
+    obs_source_info info{};
+    info.id = TRACKER_SOURCE_ID;
+    info.type = OBS_SOURCE_TYPE_INPUT;
+    info.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW;
+    info.get_name = ripple_source_get_name;
+    info.create = ripple_source_create;
+    info.destroy = ripple_source_destroy;
+    info.get_width = ripple_source_get_width;
+    info.get_height = ripple_source_get_height;
+    info.video_tick = ripple_source_tick;
+    info.video_render = ripple_source_render;
+    obs_register_source(&info);
+}
+
+obs_source_t* tracker_create_source(int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t color, input_collector* input)
+{
+    auto opt = obs_data_create();
+    obs_data_set_int(opt, "x", x);
+    obs_data_set_int(opt, "y", y);
+    obs_data_set_int(opt, "width", width);
+    obs_data_set_int(opt, "height", height);
+    obs_data_set_int(opt, "color", color);
+    obs_source_t* source = obs_source_create(TRACKER_SOURCE_ID, "mouse_highlight", opt, nullptr);
+    obs_data_release(opt);
+
+    // the source ticks on the graphics thread as soon as it exists, so hand over the collector atomically
+    auto ctx = (ripple_source*)obs_obj_get_data(source);
+    if (ctx == nullptr) {
+        obs_source_release(source);
+        input_collector_destroy(input);
+        return nullptr;
+    }
+
+    ctx->input.store(input, memory_order_release);
+    return source;
+}
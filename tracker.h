@@ -0,0 +1,13 @@
+#pragma once
+#include "obs-studio/libobs/obs.h"
+
+struct input_collector;
+
+#define TRACKER_SOURCE_ID "express_click_ripple"
+
+// registers the procedural click ripple source with obs, must be called after obs_startup
+void tracker_register_source();
+
+// creates a ripple source covering the capture region. color is 0xRRGGBB.
+// the source takes ownership of the input collector, and destroys it when the source is destroyed.
+obs_source_t* tracker_create_source(int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t color, input_collector* input);
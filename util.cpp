@@ -114,4 +114,60 @@ std::string util_string_utf8_encode(const std::wstring& wstr)
     std::string strTo(size_needed, 0);
     WideCharToMultiByte(CP_UTF8, 0, &wstr[0], (int)wstr.size(), &strTo[0], size_needed, NULL, NULL);
     return strTo;
-}
\ No newline at end of file
+}
+
+void util_split_path(const string& path, string& directory, string& stem, string& extension)
+{
+    auto slash = path.find_last_of("\\/");
+    directory = slash == string::npos ? "." : path.substr(0, slash);
+    string filename = slash == string::npos ? path : path.substr(slash + 1);
+
+    auto dot = filename.find_last_of('.');
+    if (dot == string::npos || dot == 0) {
+        stem = filename;
+        extension = "";
+    }
+    else {
+        stem = filename.substr(0, dot);
+        extension = filename.substr(dot + 1);
+    }
+}
+
+HANDLE util_connect_pipe(const string& name, uint32_t timeoutMs)
+{
+    // the reader creates the pipe and this process is the client, waiting while another client holds it
+    string path = "\\\\.\\pipe\\" + name;
+    while (true) {
+        HANDLE pipe = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (pipe != INVALID_HANDLE_VALUE || GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeA(path.c_str(), timeoutMs))
+            return pipe;
+    }
+}
+
+uint64_t util_disk_free_bytes(const string& directory)
+{
+    int length = MultiByteToWideChar(CP_UTF8, 0, directory.c_str(), -1, NULL, 0);
+    wstring wide(length > 0 ? length - 1 : 0, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, directory.c_str(), -1, wide.data(), length);
+
+    // the space available to this user, which quotas may make less than what is free on the volume
+    ULARGE_INTEGER available{};
+    if (!GetDiskFreeSpaceExW(wide.c_str(), &available, NULL, NULL))
+        return UINT64_MAX;
+    return available.QuadPart;
+}
+
+bool util_file_closed(const string& path)
+{
+    int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+    wstring wide(length > 0 ? length - 1 : 0, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wide.data(), length);
+
+    // sharing only reads fails while any other handle can still write the file
+    HANDLE file = CreateFileW(wide.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return GetLastError() != ERROR_SHARING_VIOLATION;
+    }
+    CloseHandle(file);
+    return true;
+}
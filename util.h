@@ -15,3 +15,7 @@ Gdiplus::Rect util_parse_rect(const string& input);
 Gdiplus::Color util_parse_color(const string& input);
 string get_obs_output_errorcode_string(uint32_t code);
 std::string util_string_utf8_encode(const std::wstring& wstr);
+void util_split_path(const string& path, string& directory, string& stem, string& extension);
+HANDLE util_connect_pipe(const string& name, uint32_t timeoutMs);
+uint64_t util_disk_free_bytes(const string& directory);
+bool util_file_closed(const string& path);
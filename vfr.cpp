@@ -0,0 +1,502 @@
+#include "vfr.h"
+#include "mux.h"
+#include "framediff.h"
+#include "outputwriter.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+
+#include "obs-studio/libobs/media-io/video-frame.h"
+
+using namespace std;
+
+// the video encoder's view of the screen. frames from the main video output are compared against the last one
+// sent and only the ones which changed are passed on through a video_t the encoder is connected to instead.
+struct vfr_capture
+{
+    video_t* proxy;
+    framediff_kernel kernel;
+    uint32_t width;
+    uint32_t height;
+    uint64_t frameTimeNs;
+    uint64_t maxGapNs;
+
+    // only touched on the video thread
+    vector<uint8_t> reference;      // nv12 planes of the last frame sent, rows packed at the frame width
+    bool referenceValid;
+    uint64_t lastSentNs;
+
+    atomic<bool> sendNext{ false };
+    atomic<uint32_t> shareNum{ 1 };     // at most num of every den frames are offered to the encoder
+    atomic<uint32_t> shareDen{ 1 };
+    uint32_t sharePhase;                // only touched on the video thread
+    atomic<uint64_t> frames{ 0 };
+    atomic<uint64_t> unchanged{ 0 };
+    atomic<uint64_t> skipped{ 0 };
+    atomic<uint64_t> reduced{ 0 };
+
+    mutex lock;
+    deque<uint64_t> frameTimes;     // capture time of each frame the encoder received, from firstIndex
+    int64_t firstIndex;
+};
+
+static void vfr_capture_record(vfr_capture* cap, uint64_t timestamp)
+{
+    lock_guard<mutex> guard(cap->lock);
+    cap->frameTimes.push_back(timestamp);
+}
+
+static void vfr_capture_frame(void* param, video_data* frame)
+{
+    auto cap = (vfr_capture*)param;
+
+    // frames sent before the encoder connects would never reach it, and the numbering would be off by as many
+    if (!video_output_active(cap->proxy)) {
+        return;
+    }
+    cap->frames.fetch_add(1, memory_order_relaxed);
+
+    // both planes are always compared so the reference stays whole, a change can be in either
+    uint8_t* referenceChroma = cap->reference.data() + (size_t)cap->width * cap->height;
+    bool lumaChanged = framediff_update(cap->kernel, cap->reference.data(), cap->width, frame->data[0], frame->linesize[0], cap->width, cap->height);
+    bool chromaChanged = framediff_update(cap->kernel, referenceChroma, cap->width, frame->data[1], frame->linesize[1], cap->width, cap->height / 2);
+
+    // frames outside the share are held back whatever they show, only a stop overrides it
+    cap->sharePhase += cap->shareNum.load(memory_order_relaxed);
+    uint32_t den = cap->shareDen.load(memory_order_relaxed);
+    if (cap->sharePhase < den && !cap->sendNext.load(memory_order_relaxed)) {
+        if (lumaChanged || chromaChanged) {
+            // the reference has taken this frame in, so the change would otherwise never be sent
+            cap->referenceValid = false;
+        }
+        cap->reduced.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    cap->sharePhase = cap->sharePhase >= den ? cap->sharePhase - den : 0;
+
+    bool send = lumaChanged || chromaChanged || !cap->referenceValid || cap->sendNext.exchange(false)
+        || frame->timestamp - cap->lastSentNs >= cap->maxGapNs;
+    if (!send) {
+        cap->unchanged.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    video_frame out{};
+    if (video_output_lock_frame(cap->proxy, &out, 1, frame->timestamp)) {
+        video_frame in{};
+        for (int plane = 0; plane < MAX_AV_PLANES; plane++) {
+            in.data[plane] = frame->data[plane];
+            in.linesize[plane] = frame->linesize[plane];
+        }
+        video_frame_copy(&out, &in, VIDEO_FORMAT_NV12, cap->height);
+        video_output_unlock_frame(cap->proxy);
+        cap->referenceValid = true;
+    }
+    else {
+        // the encoder is behind, the proxy repeats its newest frame in place of this one. the repeat still counts
+        // as a frame to the encoder, and this content has to be sent again.
+        cap->skipped.fetch_add(1, memory_order_relaxed);
+        cap->referenceValid = false;
+    }
+    cap->lastSentNs = frame->timestamp;
+    vfr_capture_record(cap, frame->timestamp);
+}
+
+static vfr_capture* vfr_capture_create(uint64_t maxGapNs, string& error)
+{
+    const video_output_info* main = video_output_get_info(obs_get_video());
+    if (main->format != VIDEO_FORMAT_NV12) {
+        error = "Variable frame rate needs nv12 video";
+        return nullptr;
+    }
+
+    auto cap = new vfr_capture{};
+    video_output_info info = *main;
+    info.name = "vfr";
+    if (video_output_open(&cap->proxy, &info) != VIDEO_OUTPUT_SUCCESS) {
+        error = "Unable to open the variable frame rate video output";
+        delete cap;
+        return nullptr;
+    }
+
+    cap->kernel = framediff_best_kernel();
+    cap->width = info.width;
+    cap->height = info.height;
+    cap->frameTimeNs = 1000000000ULL * info.fps_den / info.fps_num;
+    cap->maxGapNs = maxGapNs;
+    cap->reference.resize((size_t)info.width * info.height * 3 / 2);
+    obs_add_raw_video_callback(nullptr, vfr_capture_frame, cap);
+    return cap;
+}
+
+static void vfr_capture_destroy(vfr_capture* cap)
+{
+    obs_remove_raw_video_callback(vfr_capture_frame, cap);
+    video_output_close(cap->proxy);
+    delete cap;
+}
+
+// capture time of the encoder's frame with this index, extrapolated at the nominal rate for decode times
+// before the first frame
+static int64_t vfr_capture_frame_time(vfr_capture* cap, int64_t index)
+{
+    lock_guard<mutex> guard(cap->lock);
+    if (cap->frameTimes.empty()) {
+        return 0;
+    }
+    int64_t first = cap->firstIndex;
+    int64_t last = first + (int64_t)cap->frameTimes.size() - 1;
+    if (index < first) {
+        return (int64_t)cap->frameTimes.front() - (first - index) * (int64_t)cap->frameTimeNs;
+    }
+    if (index > last) {
+        return (int64_t)cap->frameTimes.back() + (index - last) * (int64_t)cap->frameTimeNs;
+    }
+    return (int64_t)cap->frameTimes[(size_t)(index - first)];
+}
+
+// packets arrive in decode order and a frame is never displayed before it is decoded, so nothing before the
+// newest decode time is needed again
+static void vfr_capture_forget_before(vfr_capture* cap, int64_t index)
+{
+    lock_guard<mutex> guard(cap->lock);
+    while (cap->frameTimes.size() > 1 && cap->firstIndex < index) {
+        cap->frameTimes.pop_front();
+        cap->firstIndex++;
+    }
+}
+
+struct vfr_output
+{
+    output_writer writer;               // timed from the capture time of the first frame, -1 until it is known
+    obs_output_t* audioOutput;
+    obs_encoder_t* videoEncoder;        // fed by the capture until the output is destroyed
+    vfr_capture* capture;
+
+    // guarded by the writer's lock
+    deque<encoder_packet> earlyAudio;   // audio received before the first frame was sent
+    bool hasAudio;
+    bool videoDone;                     // a packet from after the stop time has arrived, for each stream
+    bool audioDone;
+};
+
+struct vfr_audio_output
+{
+    obs_output_t* output;
+    vfr_output* parent;
+};
+
+static int64_t packet_pts_usec(const encoder_packet* packet)
+{
+    return packet->sys_dts_usec + (packet->pts - packet->dts) * 1000000 * packet->timebase_num / packet->timebase_den;
+}
+
+static void release_packets(deque<encoder_packet>& packets)
+{
+    for (auto& packet : packets) {
+        obs_encoder_packet_release(&packet);
+    }
+    packets.clear();
+}
+
+// caller holds ctx->writer.lock, takes ownership of the packet reference
+static void vfr_output_send(vfr_output* ctx, encoder_packet& packet)
+{
+    bool late = ctx->writer.stopping && packet.sys_dts_usec >= ctx->writer.stopUsec;
+    bool& done = packet.type == OBS_ENCODER_VIDEO ? ctx->videoDone : ctx->audioDone;
+    // the first video frame after the stop is kept, it carries the screen up to the stop time
+    if (done || (late && packet.type == OBS_ENCODER_AUDIO)) {
+        obs_encoder_packet_release(&packet);
+    }
+    else if (packet.type == OBS_ENCODER_AUDIO && packet_pts_usec(&packet) < ctx->writer.originUsec) {
+        obs_encoder_packet_release(&packet);
+    }
+    else {
+        output_writer_push(&ctx->writer, packet);
+    }
+
+    if (late) {
+        done = true;
+        if (ctx->videoDone && (ctx->audioDone || !ctx->hasAudio)) {
+            output_writer_finish(&ctx->writer, true);
+        }
+    }
+}
+
+static void vfr_output_video_packet(vfr_output* ctx, encoder_packet* packet)
+{
+    // pts and dts count the frames the encoder received, in units of timebase_num
+    int64_t dtsIndex = packet->dts / packet->timebase_num;
+    int64_t ptsIndex = packet->pts / packet->timebase_num;
+    int64_t dtsNs = vfr_capture_frame_time(ctx->capture, dtsIndex);
+    int64_t ptsNs = vfr_capture_frame_time(ctx->capture, ptsIndex);
+
+    encoder_packet copy{};
+    obs_encoder_packet_ref(&copy, packet);
+    copy.timebase_num = 1;
+    copy.timebase_den = 1000000;
+    copy.dts = dtsNs / 1000;
+    copy.pts = ptsNs / 1000;
+    copy.dts_usec = copy.sys_dts_usec = copy.dts;
+
+    lock_guard<mutex> guard(ctx->writer.lock);
+    if (!ctx->writer.mux || ctx->writer.finishing) {
+        obs_encoder_packet_release(&copy);
+        return;
+    }
+    if (ctx->writer.originUsec < 0) {
+        // the first frame sent is the first one the encoder received, the file is only kept once there is one
+        ctx->writer.originUsec = vfr_capture_frame_time(ctx->capture, 0) / 1000;
+        ctx->writer.keep = true;
+        for (auto& audio : ctx->earlyAudio) {
+            vfr_output_send(ctx, audio);
+        }
+        ctx->earlyAudio.clear();
+    }
+    vfr_capture_forget_before(ctx->capture, dtsIndex);
+    vfr_output_send(ctx, copy);
+}
+
+static void vfr_output_audio_packet(vfr_output* ctx, encoder_packet* packet)
+{
+    encoder_packet copy{};
+    obs_encoder_packet_ref(&copy, packet);
+
+    lock_guard<mutex> guard(ctx->writer.lock);
+    if (!ctx->writer.mux || ctx->writer.finishing) {
+        obs_encoder_packet_release(&copy);
+    }
+    else if (ctx->writer.originUsec < 0) {
+        ctx->earlyAudio.push_back(copy);
+    }
+    else {
+        vfr_output_send(ctx, copy);
+    }
+}
+
+static void vfr_output_get_stats_proc(void* data, calldata_t* cd)
+{
+    auto ctx = (vfr_output*)data;
+    output_writer_get_stats(&ctx->writer, cd);
+    vfr_capture* cap = ctx->capture;
+    calldata_set_int(cd, "frames", cap ? (long long)cap->frames.load(memory_order_relaxed) : 0);
+    calldata_set_int(cd, "unchanged", cap ? (long long)cap->unchanged.load(memory_order_relaxed) : 0);
+    calldata_set_int(cd, "skipped", cap ? (long long)cap->skipped.load(memory_order_relaxed) : 0);
+    calldata_set_int(cd, "reduced", cap ? (long long)cap->reduced.load(memory_order_relaxed) : 0);
+}
+
+static void vfr_output_set_frame_share_proc(void* data, calldata_t* cd)
+{
+    auto ctx = (vfr_output*)data;
+    auto num = (uint32_t)calldata_int(cd, "num");
+    auto den = (uint32_t)calldata_int(cd, "den");
+    if (!ctx->capture || num == 0 || den < num) {
+        return;
+    }
+    // the video thread reads the pair without a lock, so for a frame or two it may see half of a change
+    ctx->capture->shareNum.store(num, memory_order_relaxed);
+    ctx->capture->shareDen.store(den, memory_order_relaxed);
+}
+
+static const char* vfr_output_get_name(void* unused)
+{
+    return "Variable Frame Rate Output";
+}
+
+static void* vfr_output_create(obs_data_t* settings, obs_output_t* output)
+{
+    auto ctx = new vfr_output{};
+    ctx->writer.output = output;
+    ctx->writer.originUsec = -1;
+    ctx->writer.closed = [ctx] {
+        {
+            lock_guard<mutex> guard(ctx->writer.lock);
+            release_packets(ctx->earlyAudio);
+        }
+        if (ctx->hasAudio) {
+            obs_output_end_data_capture(ctx->audioOutput);
+        }
+    };
+    proc_handler_add(obs_output_get_proc_handler(output), "void get_stats(out int frames, out int unchanged, out int skipped, out int reduced, " OUTPUT_WRITER_STATS ")", vfr_output_get_stats_proc, ctx);
+    proc_handler_add(obs_output_get_proc_handler(output), "void set_frame_share(int num, int den)", vfr_output_set_frame_share_proc, ctx);
+
+    ctx->audioOutput = obs_output_create(VFR_AUDIO_OUTPUT_ID, "vfr_audio", nullptr, nullptr);
+    ((vfr_audio_output*)obs_obj_get_data(ctx->audioOutput))->parent = ctx;
+    return ctx;
+}
+
+static void vfr_output_destroy(void* data)
+{
+    auto ctx = (vfr_output*)data;
+    output_writer_join(&ctx->writer);
+    obs_output_release(ctx->audioOutput);
+
+    // the encoders have stopped by the time an output is released, so the encoder can go back to the main video
+    if (ctx->capture) {
+        obs_encoder_set_video(ctx->videoEncoder, obs_get_video());
+        vfr_capture_destroy(ctx->capture);
+    }
+    release_packets(ctx->earlyAudio);
+    delete ctx;
+}
+
+static bool vfr_output_start(void* data)
+{
+    auto ctx = (vfr_output*)data;
+    obs_output_t* output = ctx->writer.output;
+    if (!obs_output_can_begin_data_capture(output, 0)) {
+        return false;
+    }
+    output_writer_join(&ctx->writer);
+
+    obs_encoder_t* video = obs_output_get_video_encoder(output);
+    obs_encoder_t* audio = obs_output_get_audio_encoder(output, 0);
+    if (obs_get_encoder_caps(obs_encoder_get_id(video)) & OBS_ENCODER_CAP_PASS_TEXTURE) {
+        obs_output_set_last_error(output, "Variable frame rate needs an encoder which reads frames from memory");
+        return false;
+    }
+
+    obs_data_t* settings = obs_output_get_settings(output);
+    string path = obs_data_get_string(settings, "path");
+    string muxerSettings = obs_data_get_string(settings, "muxer_settings");
+    disk_writer_options fileOptions = mux_disk_options(settings);
+    uint64_t maxGapNs = (uint64_t)obs_data_get_int(settings, "max_gap_ms") * 1000000;
+    obs_data_release(settings);
+
+    string error;
+    if (!ctx->capture) {
+        ctx->capture = vfr_capture_create(maxGapNs, error);
+        if (!ctx->capture) {
+            obs_output_set_last_error(output, error.c_str());
+            return false;
+        }
+        ctx->videoEncoder = video;
+        obs_encoder_set_video(video, ctx->capture->proxy);
+    }
+
+    obs_output_set_audio_encoder(ctx->audioOutput, audio, 0);
+    if (!obs_output_initialize_encoders(output, 0) || (audio && !obs_output_initialize_encoders(ctx->audioOutput, 0))) {
+        return false;
+    }
+
+    mux_writer* mux = mux_writer_open(path, "", video, audio, muxerSettings, error, fileOptions);
+    if (!mux) {
+        obs_output_set_last_error(output, error.c_str());
+        return false;
+    }
+
+    {
+        lock_guard<mutex> guard(ctx->writer.lock);
+        ctx->hasAudio = audio != nullptr;
+        ctx->videoDone = ctx->audioDone = false;
+    }
+    output_writer_start(&ctx->writer, mux, -1, false);
+
+    // audio first, so the packets from before the first frame can be dropped rather than missed
+    if ((ctx->hasAudio && !obs_output_start(ctx->audioOutput)) || !obs_output_begin_data_capture(output, 0)) {
+        lock_guard<mutex> guard(ctx->writer.lock);
+        output_writer_finish(&ctx->writer, false);
+        return false;
+    }
+    return true;
+}
+
+static void vfr_output_stop(void* data, uint64_t ts)
+{
+    auto ctx = (vfr_output*)data;
+    lock_guard<mutex> guard(ctx->writer.lock);
+
+    // keep everything captured before the stop was requested. a static screen may not send another frame for
+    // max_gap_ms, so the next one is sent regardless to close the video at the stop time.
+    if (output_writer_stop(&ctx->writer, ctx->writer.originUsec < 0 ? 0 : ts)) {
+        ctx->capture->sendNext = true;
+    }
+}
+
+static void vfr_output_packet(void* data, encoder_packet* packet)
+{
+    auto ctx = (vfr_output*)data;
+    if (!packet) {
+        // the encoder failed
+        lock_guard<mutex> guard(ctx->writer.lock);
+        if (ctx->writer.mux) {
+            output_writer_fail(&ctx->writer, OBS_OUTPUT_ENCODE_ERROR);
+        }
+        return;
+    }
+    vfr_output_video_packet(ctx, packet);
+}
+
+static uint64_t vfr_output_get_total_bytes(void* data)
+{
+    return ((vfr_output*)data)->writer.bytes.load(memory_order_relaxed);
+}
+
+static const char* vfr_audio_output_get_name(void* unused)
+{
+    return "Variable Frame Rate Audio";
+}
+
+static void* vfr_audio_output_create(obs_data_t* settings, obs_output_t* output)
+{
+    auto ctx = new vfr_audio_output{};
+    ctx->output = output;
+    return ctx;
+}
+
+static void vfr_audio_output_destroy(void* data)
+{
+    delete (vfr_audio_output*)data;
+}
+
+static bool vfr_audio_output_start(void* data)
+{
+    auto ctx = (vfr_audio_output*)data;
+    return ctx->parent && obs_output_can_begin_data_capture(ctx->output, 0) && obs_output_initialize_encoders(ctx->output, 0)
+        && obs_output_begin_data_capture(ctx->output, 0);
+}
+
+static void vfr_audio_output_stop(void* data, uint64_t ts)
+{
+    // the video output ends audio capture once it has the audio up to its own stop time
+}
+
+static void vfr_audio_output_packet(void* data, encoder_packet* packet)
+{
+    auto ctx = (vfr_audio_output*)data;
+    if (!packet) {
+        vfr_output_packet(ctx->parent, nullptr);
+        return;
+    }
+    vfr_output_audio_packet(ctx->parent, packet);
+}
+
+void vfr_register()
+{
+    obs_output_info output{};
+    output.id = VFR_OUTPUT_ID;
+    output.flags = OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED;
+    output.get_name = vfr_output_get_name;
+    output.create = vfr_output_create;
+    output.destroy = vfr_output_destroy;
+    output.start = vfr_output_start;
+    output.stop = vfr_output_stop;
+    output.encoded_packet = vfr_output_packet;
+    output.get_total_bytes = vfr_output_get_total_bytes;
+    obs_register_output(&output);
+
+    obs_output_info audio{};
+    audio.id = VFR_AUDIO_OUTPUT_ID;
+    audio.flags = OBS_OUTPUT_AUDIO | OBS_OUTPUT_ENCODED;
+    audio.get_name = vfr_audio_output_get_name;
+    audio.create = vfr_audio_output_create;
+    audio.destroy = vfr_audio_output_destroy;
+    audio.start = vfr_audio_output_start;
+    audio.stop = vfr_audio_output_stop;
+    audio.encoded_packet = vfr_audio_output_packet;
+    obs_register_output(&audio);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "obs-studio/libobs/obs.h"
+
+#define VFR_OUTPUT_ID "express_vfr_output"
+#define VFR_AUDIO_OUTPUT_ID "express_vfr_audio_output"
+
+// an output which only gives the video encoder frames that differ from the previous one, or which are max_gap_ms
+// after the last frame it was given. the encoder is fed through a video_t of its own while the output runs, so
+// it only works with encoders which read frames from memory, not ones passed gpu textures.
+//
+// libobs numbers encoded frames by how many the encoder received, so the capture time of every frame sent is
+// kept and packets are written with those times instead. video and audio are captured by two outputs, the
+// interleaving obs does for a single output would compare the renumbered video against real time audio. the
+// audio output is created by this one and driven by it, it is not meant to be used on its own.
+//
+// settings: "path", "muxer_settings", "max_gap_ms", and the disk_writer_options read by mux_disk_options
+// procs:    "void get_stats(out int frames, out int unchanged, out int skipped, out int reduced, ...)", frames seen
+//           since start, how many were not sent because nothing changed, how many the encoder was too busy to
+//           accept, and how many were held back by set_frame_share. the rest is the write latency of the file from
+//           output_writer_get_stats.
+//           "void set_frame_share(int num, int den)", offers the encoder at most num of every den frames, a lower
+//           frame rate for as long as it is set. a change in a frame held back is sent with the next one offered.
+// the audio encoder is set on this output as usual, even though obs does not start it for a video output.
+void vfr_register();